@@ -75,6 +75,7 @@ DK_DECL_HANDLE(Device);
 DK_DECL_HANDLE(MemBlock);
 DK_DECL_OPAQUE(Fence, 8, 64);
 DK_DECL_HANDLE(CmdBuf);
+DK_DECL_HANDLE(CmdArena);
 DK_DECL_HANDLE(Queue);
 DK_DECL_OPAQUE(Shader, 8, 128);
 DK_DECL_OPAQUE(ImageLayout, 8, 128);
@@ -82,6 +83,9 @@ DK_DECL_OPAQUE(Image, 8, 128);
 DK_DECL_OPAQUE(ImageDescriptor, 4, 32);
 DK_DECL_OPAQUE(SamplerDescriptor, 4, 32);
 DK_DECL_HANDLE(Swapchain);
+DK_DECL_HANDLE(Profiler);
+DK_DECL_HANDLE(Pipeline);
+DK_DECL_HANDLE(Framebuffer);
 
 #undef DK_DECL_HANDLE
 #undef DK_DECL_OPAQUE
@@ -125,6 +129,7 @@ typedef struct DkDeviceMaker
 	DkAllocFunc cbAlloc;
 	DkFreeFunc cbFree;
 	uint32_t flags;
+	uint32_t errorCheckIntervalUs;
 } DkDeviceMaker;
 
 DK_CONSTEXPR void dkDeviceMakerDefaults(DkDeviceMaker* maker)
@@ -134,11 +139,13 @@ DK_CONSTEXPR void dkDeviceMakerDefaults(DkDeviceMaker* maker)
 	maker->cbAlloc = NULL;
 	maker->cbFree = NULL;
 	maker->flags = DkDeviceFlags_DepthZeroToOne | DkDeviceFlags_OriginUpperLeft;
+	maker->errorCheckIntervalUs = 10000;
 }
 
 #define DK_MEMBLOCK_ALIGNMENT 0x1000
 #define DK_CMDMEM_ALIGNMENT 4
 #define DK_QUEUE_MIN_CMDMEM_SIZE 0x10000
+#define DK_CMDARENA_DEFAULT_CHUNK_SIZE 0x10000
 #define DK_PER_WARP_SCRATCH_MEM_ALIGNMENT 0x200
 #define DK_NUM_UNIFORM_BUFS 16
 #define DK_NUM_STORAGE_BUFS 16
@@ -157,6 +164,9 @@ DK_CONSTEXPR void dkDeviceMakerDefaults(DkDeviceMaker* maker)
 #define DK_MAX_VERTEX_ATTRIBS 32
 #define DK_MAX_VERTEX_BUFFERS 16
 #define DK_IMAGE_LINEAR_STRIDE_ALIGNMENT 32
+#define DK_TIMESTAMP_ALIGNMENT 16
+#define DK_PROFILER_REGION_SIZE 32
+#define DK_PROFILER_INVALID_REGION UINT32_MAX
 
 enum
 {
@@ -197,11 +207,21 @@ DK_CONSTEXPR void dkMemBlockMakerDefaults(DkMemBlockMaker* maker, DkDevice devic
 	maker->storage = NULL;
 }
 
+enum
+{
+	DkCmdBufFlags_FilterRedundantState = 1U << 0,
+	DkCmdBufFlags_SharedCtrlMemPool    = 1U << 1,
+	DkCmdBufFlags_OptimizeCaptures     = 1U << 2,
+	DkCmdBufFlags_FullVtxStateRebind   = 1U << 3,
+};
+
 typedef struct DkCmdBufMaker
 {
 	DkDevice device;
 	void* userData;
 	DkCmdBufAddMemFunc cbAddMem;
+	DkCmdArena arena;
+	uint32_t flags;
 } DkCmdBufMaker;
 
 DK_CONSTEXPR void dkCmdBufMakerDefaults(DkCmdBufMaker* maker, DkDevice device)
@@ -209,6 +229,26 @@ DK_CONSTEXPR void dkCmdBufMakerDefaults(DkCmdBufMaker* maker, DkDevice device)
 	maker->device = device;
 	maker->userData = NULL;
 	maker->cbAddMem = NULL;
+	maker->arena = NULL;
+	maker->flags = 0;
+}
+
+typedef struct DkCmdArenaMaker
+{
+	DkDevice device;
+	DkMemBlock memBlock;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t chunkSize;
+} DkCmdArenaMaker;
+
+DK_CONSTEXPR void dkCmdArenaMakerDefaults(DkCmdArenaMaker* maker, DkDevice device, DkMemBlock memBlock, uint32_t offset, uint32_t size)
+{
+	maker->device = device;
+	maker->memBlock = memBlock;
+	maker->offset = offset;
+	maker->size = size;
+	maker->chunkSize = DK_CMDARENA_DEFAULT_CHUNK_SIZE;
 }
 
 enum
@@ -221,6 +261,8 @@ enum
 	DkQueueFlags_PrioMask     = 3U << 2,
 	DkQueueFlags_EnableZcull  = 0U << 4,
 	DkQueueFlags_DisableZcull = 1U << 4,
+	DkQueueFlags_SyncSubmit   = 0U << 5,
+	DkQueueFlags_AsyncSubmit  = 1U << 5,
 };
 
 typedef struct DkQueueMaker
@@ -245,6 +287,14 @@ DK_CONSTEXPR void dkQueueMakerDefaults(DkQueueMaker* maker, DkDevice device)
 	maker->maxConcurrentComputeJobs = DK_DEFAULT_MAX_COMPUTE_CONCURRENT_JOBS;
 }
 
+typedef struct DkCmdListSubmission
+{
+	DkCmdList cmdList;
+	DkFence* waitFence;
+	DkFence* signalFence;
+	bool signalFlush;
+} DkCmdListSubmission;
+
 typedef struct DkShaderMaker
 {
 	DkMemBlock codeMem;
@@ -1166,6 +1216,80 @@ DK_CONSTEXPR void dkSwapchainMakerDefaults(DkSwapchainMaker* maker, DkDevice dev
 	maker->numImages = numImages;
 }
 
+typedef struct DkProfilerMaker
+{
+	DkDevice device;
+	DkMemBlock memBlock;
+	uint32_t offset;
+	uint32_t numRegions;
+} DkProfilerMaker;
+
+DK_CONSTEXPR void dkProfilerMakerDefaults(DkProfilerMaker* maker, DkDevice device, DkMemBlock memBlock, uint32_t offset, uint32_t numRegions)
+{
+	maker->device = device;
+	maker->memBlock = memBlock;
+	maker->offset = offset;
+	maker->numRegions = numRegions;
+}
+
+typedef struct DkProfilerRegion
+{
+	uint32_t tag;
+	uint64_t durationNs;
+} DkProfilerRegion;
+
+typedef struct DkPipelineMaker
+{
+	DkDevice device;
+	uint32_t stageMask;
+	DkShader const* const* shaders;
+	uint32_t numShaders;
+	DkRasterizerState const* rasterizerState;
+	DkColorState const* colorState;
+	DkColorWriteState const* colorWriteState;
+	DkBlendState const* blendStates;
+	uint32_t numBlendStates;
+	DkDepthStencilState const* depthStencilState;
+	DkVtxAttribState const* vtxAttribs;
+	uint32_t numVtxAttribs;
+	DkVtxBufferState const* vtxBuffers;
+	uint32_t numVtxBuffers;
+} DkPipelineMaker;
+
+DK_CONSTEXPR void dkPipelineMakerDefaults(DkPipelineMaker* maker, DkDevice device)
+{
+	maker->device = device;
+	maker->stageMask = 0;
+	maker->shaders = NULL;
+	maker->numShaders = 0;
+	maker->rasterizerState = NULL;
+	maker->colorState = NULL;
+	maker->colorWriteState = NULL;
+	maker->blendStates = NULL;
+	maker->numBlendStates = 0;
+	maker->depthStencilState = NULL;
+	maker->vtxAttribs = NULL;
+	maker->numVtxAttribs = 0;
+	maker->vtxBuffers = NULL;
+	maker->numVtxBuffers = 0;
+}
+
+typedef struct DkFramebufferMaker
+{
+	DkDevice device;
+	DkImageView const* const* colorTargets;
+	uint32_t numColorTargets;
+	DkImageView const* depthTarget;
+} DkFramebufferMaker;
+
+DK_CONSTEXPR void dkFramebufferMakerDefaults(DkFramebufferMaker* maker, DkDevice device, DkImageView const* const colorTargets[], uint32_t numColorTargets, DkImageView const* depthTarget)
+{
+	maker->device = device;
+	maker->colorTargets = colorTargets;
+	maker->numColorTargets = numColorTargets;
+	maker->depthTarget = depthTarget;
+}
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -1181,19 +1305,32 @@ uint32_t dkMemBlockGetSize(DkMemBlock obj);
 DkResult dkMemBlockFlushCpuCache(DkMemBlock obj, uint32_t offset, uint32_t size);
 
 DkResult dkFenceWait(DkFence* obj, int64_t timeout_ns);
+DkResult dkFenceWaitMany(DkFence* const fences[], uint32_t numFences, bool waitAll, int64_t timeout_ns);
+
+DkCmdArena dkCmdArenaCreate(DkCmdArenaMaker const* maker);
+void dkCmdArenaDestroy(DkCmdArena obj);
 
 DkCmdBuf dkCmdBufCreate(DkCmdBufMaker const* maker);
 void dkCmdBufDestroy(DkCmdBuf obj);
 void dkCmdBufAddMemory(DkCmdBuf obj, DkMemBlock mem, uint32_t offset, uint32_t size);
 DkCmdList dkCmdBufFinishList(DkCmdBuf obj);
+// Clearing returns arena chunks unfenced: arena-backed command buffers still in use by the GPU must be recycled instead
 void dkCmdBufClear(DkCmdBuf obj);
+void dkCmdBufRecycleMemory(DkCmdBuf obj, DkFence const* fence);
 void dkCmdBufBeginCaptureCmds(DkCmdBuf obj, uint32_t* storage, uint32_t max_words);
 uint32_t dkCmdBufEndCaptureCmds(DkCmdBuf obj);
+uint32_t dkCmdBufOptimizeCapturedCmds(DkCmdBuf obj, uint32_t* words, uint32_t num_words);
 void dkCmdBufReplayCmds(DkCmdBuf obj, const uint32_t* words, uint32_t num_words);
+void dkCmdBufBeginCaptureCmdsToMemBlock(DkCmdBuf obj, DkMemBlock mem, uint32_t offset, uint32_t max_words);
+void dkCmdBufReplayCmdsFromMemBlock(DkCmdBuf obj, DkMemBlock mem, uint32_t offset, uint32_t num_words);
+void dkCmdBufReplayCmdsAtGpuAddr(DkCmdBuf obj, DkGpuAddr addr, uint32_t num_words);
+size_t dkCmdBufGetCompiledListSize(DkCmdBuf obj, DkCmdList list);
+DkCmdList dkCmdBufCompileList(DkCmdBuf obj, DkCmdList list, void* storage, size_t storageSize);
 void dkCmdBufCallList(DkCmdBuf obj, DkCmdList list);
 void dkCmdBufWaitFence(DkCmdBuf obj, DkFence* fence);
 void dkCmdBufSignalFence(DkCmdBuf obj, DkFence* fence, bool flush);
 void dkCmdBufBarrier(DkCmdBuf obj, DkBarrier mode, uint32_t invalidateFlags);
+void dkCmdBufWriteTimestamp(DkCmdBuf obj, DkGpuAddr addr);
 void dkCmdBufBindShaders(DkCmdBuf obj, uint32_t stageMask, DkShader const* const shaders[], uint32_t numShaders);
 void dkCmdBufBindUniformBuffers(DkCmdBuf obj, DkStage stage, uint32_t firstId, DkBufExtents const buffers[], uint32_t numBuffers);
 void dkCmdBufBindStorageBuffers(DkCmdBuf obj, DkStage stage, uint32_t firstId, DkBufExtents const buffers[], uint32_t numBuffers);
@@ -1244,6 +1381,10 @@ void dkCmdBufDraw(DkCmdBuf obj, DkPrimitive prim, uint32_t vertexCount, uint32_t
 void dkCmdBufDrawIndirect(DkCmdBuf obj, DkPrimitive prim, DkGpuAddr indirect);
 void dkCmdBufDrawIndexed(DkCmdBuf obj, DkPrimitive prim, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
 void dkCmdBufDrawIndexedIndirect(DkCmdBuf obj, DkPrimitive prim, DkGpuAddr indirect);
+void dkCmdBufMultiDraw(DkCmdBuf obj, DkPrimitive prim, DkDrawIndirectData const draws[], uint32_t numDraws);
+void dkCmdBufMultiDrawIndexed(DkCmdBuf obj, DkPrimitive prim, DkDrawIndexedIndirectData const draws[], uint32_t numDraws);
+void dkCmdBufMultiDrawIndirect(DkCmdBuf obj, DkPrimitive prim, DkGpuAddr indirect, uint32_t stride, uint32_t maxDrawCount, DkGpuAddr countAddr);
+void dkCmdBufMultiDrawIndexedIndirect(DkCmdBuf obj, DkPrimitive prim, DkGpuAddr indirect, uint32_t stride, uint32_t maxDrawCount, DkGpuAddr countAddr);
 void dkCmdBufDispatchCompute(DkCmdBuf obj, uint32_t numGroupsX, uint32_t numGroupsY, uint32_t numGroupsZ);
 void dkCmdBufDispatchComputeIndirect(DkCmdBuf obj, DkGpuAddr indirect);
 void dkCmdBufPushConstants(DkCmdBuf obj, DkGpuAddr uboAddr, uint32_t uboSize, uint32_t offset, uint32_t size, const void* data);
@@ -1258,9 +1399,17 @@ void dkCmdBufCopyImageToBuffer(DkCmdBuf obj, DkImageView const* srcView, DkImage
 DkQueue dkQueueCreate(DkQueueMaker const* maker);
 void dkQueueDestroy(DkQueue obj);
 bool dkQueueIsInErrorState(DkQueue obj);
+uint32_t dkQueueGetNumStalls(DkQueue obj);
 void dkQueueWaitFence(DkQueue obj, DkFence* fence);
 void dkQueueSignalFence(DkQueue obj, DkFence* fence, bool flush);
+void dkQueueWaitTimeline(DkQueue obj, DkQueue srcQueue, uint64_t value);
+uint64_t dkQueueSignalTimeline(DkQueue obj);
+uint64_t dkQueueGetTimelineValue(DkQueue obj);
+bool dkQueuePollTimeline(DkQueue obj, uint64_t value);
+DkResult dkQueueHostWaitTimeline(DkQueue obj, uint64_t value, int64_t timeout_ns);
+uint64_t dkQueueWaitQueue(DkQueue obj, DkQueue srcQueue);
 void dkQueueSubmitCommands(DkQueue obj, DkCmdList cmds);
+void dkQueueSubmitCommandsBatch(DkQueue obj, DkCmdListSubmission const submissions[], uint32_t numSubmissions);
 void dkQueueFlush(DkQueue obj);
 void dkQueueWaitIdle(DkQueue obj);
 int dkQueueAcquireImage(DkQueue obj, DkSwapchain swapchain);
@@ -1289,6 +1438,21 @@ void dkSwapchainAcquireImage(DkSwapchain obj, int* imageSlot, DkFence* fence);
 void dkSwapchainSetCrop(DkSwapchain obj, int32_t left, int32_t top, int32_t right, int32_t bottom);
 void dkSwapchainSetSwapInterval(DkSwapchain obj, uint32_t interval);
 
+DkProfiler dkProfilerCreate(DkProfilerMaker const* maker);
+void dkProfilerDestroy(DkProfiler obj);
+uint32_t dkProfilerBeginRegion(DkProfiler obj, DkCmdBuf cmdbuf, uint32_t tag);
+void dkProfilerEndRegion(DkProfiler obj, DkCmdBuf cmdbuf, uint32_t region);
+void dkProfilerSubmitRegions(DkProfiler obj, DkFence const* fence);
+uint32_t dkProfilerResolve(DkProfiler obj, DkProfilerRegion regions[], uint32_t maxRegions);
+
+DkPipeline dkPipelineCreate(DkPipelineMaker const* maker);
+void dkPipelineDestroy(DkPipeline obj);
+void dkCmdBufBindPipeline(DkCmdBuf obj, DkPipeline pipeline, DkPipeline prevPipeline);
+
+DkFramebuffer dkFramebufferCreate(DkFramebufferMaker const* maker);
+void dkFramebufferDestroy(DkFramebuffer obj);
+void dkCmdBufBindFramebuffer(DkCmdBuf obj, DkFramebuffer framebuffer);
+
 static inline void dkCmdBufBindUniformBuffer(DkCmdBuf obj, DkStage stage, uint32_t id, DkGpuAddr bufAddr, uint32_t bufSize)
 {
 	DkBufExtents ext = { bufAddr, bufSize };
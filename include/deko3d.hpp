@@ -164,6 +164,12 @@ namespace dk
 	{
 		DK_OPAQUE_COMMON_MEMBERS(Fence);
 		DkResult wait(int64_t timeout_ns = -1);
+		static DkResult waitMany(detail::ArrayProxy<DkFence* const> fences, bool waitAll = true, int64_t timeout_ns = -1);
+	};
+
+	struct CmdArena : public detail::Handle<::DkCmdArena>
+	{
+		DK_HANDLE_COMMON_MEMBERS(CmdArena);
 	};
 
 	struct CmdBuf : public detail::Handle<::DkCmdBuf>
@@ -172,13 +178,21 @@ namespace dk
 		void addMemory(DkMemBlock mem, uint32_t offset, uint32_t size);
 		DkCmdList finishList();
 		void clear();
+		void recycleMemory(DkFence const* fence = nullptr);
 		void beginCaptureCmds(uint32_t* storage, uint32_t max_words);
 		uint32_t endCaptureCmds();
+		uint32_t optimizeCapturedCmds(uint32_t* words, uint32_t num_words);
 		void replayCmds(detail::ArrayProxy<uint32_t const> words);
+		void beginCaptureCmdsToMemBlock(DkMemBlock mem, uint32_t offset, uint32_t max_words);
+		void replayCmdsFromMemBlock(DkMemBlock mem, uint32_t offset, uint32_t num_words);
+		void replayCmdsAtGpuAddr(DkGpuAddr addr, uint32_t num_words);
+		size_t getCompiledListSize(DkCmdList list);
+		DkCmdList compileList(DkCmdList list, void* storage, size_t storageSize);
 		void callList(DkCmdList list);
 		void waitFence(DkFence& fence);
 		void signalFence(DkFence& fence, bool flush = false);
 		void barrier(DkBarrier mode, uint32_t invalidateFlags);
+		void writeTimestamp(DkGpuAddr addr);
 		void bindShaders(uint32_t stageMask, detail::ArrayProxy<DkShader const* const> shaders);
 		void bindUniformBuffer(DkStage stage, uint32_t id, DkGpuAddr bufAddr, uint32_t bufSize);
 		void bindUniformBuffers(DkStage stage, uint32_t firstId, detail::ArrayProxy<DkBufExtents const> buffers);
@@ -189,6 +203,7 @@ namespace dk
 		void bindImageDescriptorSet(DkGpuAddr setAddr, uint32_t numDescriptors);
 		void bindSamplerDescriptorSet(DkGpuAddr setAddr, uint32_t numDescriptors);
 		void bindRenderTargets(detail::ArrayProxy<DkImageView const* const> colorTargets, DkImageView const* depthTarget = nullptr);
+		void bindFramebuffer(DkFramebuffer framebuffer);
 		void bindRasterizerState(DkRasterizerState const& state);
 		void bindMultisampleState(DkMultisampleState const& state);
 		void bindColorState(DkColorState const& state);
@@ -197,6 +212,7 @@ namespace dk
 		void bindDepthStencilState(DkDepthStencilState const& state);
 		void bindVtxAttribState(detail::ArrayProxy<DkVtxAttribState const> attribs);
 		void bindVtxBufferState(detail::ArrayProxy<DkVtxBufferState const> buffers);
+		void bindPipeline(DkPipeline pipeline, DkPipeline prevPipeline = nullptr);
 		void bindVtxBuffer(uint32_t id, DkGpuAddr bufAddr, uint32_t bufSize);
 		void bindVtxBuffers(uint32_t firstId, detail::ArrayProxy<DkBufExtents const> buffers);
 		void bindIdxBuffer(DkIdxFormat format, DkGpuAddr address);
@@ -233,6 +249,10 @@ namespace dk
 		void drawIndirect(DkPrimitive prim, DkGpuAddr indirect);
 		void drawIndexed(DkPrimitive prim, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
 		void drawIndexedIndirect(DkPrimitive prim, DkGpuAddr indirect);
+		void multiDraw(DkPrimitive prim, detail::ArrayProxy<DkDrawIndirectData const> draws);
+		void multiDrawIndexed(DkPrimitive prim, detail::ArrayProxy<DkDrawIndexedIndirectData const> draws);
+		void multiDrawIndirect(DkPrimitive prim, DkGpuAddr indirect, uint32_t stride, uint32_t maxDrawCount, DkGpuAddr countAddr = DK_GPU_ADDR_INVALID);
+		void multiDrawIndexedIndirect(DkPrimitive prim, DkGpuAddr indirect, uint32_t stride, uint32_t maxDrawCount, DkGpuAddr countAddr = DK_GPU_ADDR_INVALID);
 		void dispatchCompute(uint32_t numGroupsX, uint32_t numGroupsY, uint32_t numGroupsZ);
 		void dispatchComputeIndirect(DkGpuAddr indirect);
 		void pushConstants(DkGpuAddr uboAddr, uint32_t uboSize, uint32_t offset, uint32_t size, const void* data);
@@ -251,7 +271,14 @@ namespace dk
 		bool isInErrorState();
 		void waitFence(DkFence& fence);
 		void signalFence(DkFence& fence, bool flush = false);
+		void waitTimeline(DkQueue srcQueue, uint64_t value);
+		uint64_t signalTimeline();
+		uint64_t getTimelineValue();
+		bool pollTimeline(uint64_t value);
+		DkResult hostWaitTimeline(uint64_t value, int64_t timeout_ns = -1);
+		uint64_t waitQueue(DkQueue srcQueue);
 		void submitCommands(DkCmdList cmds);
+		void submitCommandsBatch(detail::ArrayProxy<DkCmdListSubmission const> submissions);
 		void flush();
 		void waitIdle();
 		int acquireImage(DkSwapchain swapchain);
@@ -288,6 +315,25 @@ namespace dk
 		void setSwapInterval(uint32_t interval);
 	};
 
+	struct Profiler : public detail::Handle<::DkProfiler>
+	{
+		DK_HANDLE_COMMON_MEMBERS(Profiler);
+		uint32_t beginRegion(DkCmdBuf cmdbuf, uint32_t tag);
+		void endRegion(DkCmdBuf cmdbuf, uint32_t region);
+		void submitRegions(DkFence const& fence);
+		uint32_t resolve(detail::ArrayProxy<DkProfilerRegion> regions);
+	};
+
+	struct Pipeline : public detail::Handle<::DkPipeline>
+	{
+		DK_HANDLE_COMMON_MEMBERS(Pipeline);
+	};
+
+	struct Framebuffer : public detail::Handle<::DkFramebuffer>
+	{
+		DK_HANDLE_COMMON_MEMBERS(Framebuffer);
+	};
+
 	struct DeviceMaker : public ::DkDeviceMaker
 	{
 		DeviceMaker() noexcept : DkDeviceMaker{} { ::dkDeviceMakerDefaults(this); }
@@ -298,6 +344,7 @@ namespace dk
 		DeviceMaker& setCbAlloc(DkAllocFunc cbAlloc) noexcept { this->cbAlloc = cbAlloc; return *this; }
 		DeviceMaker& setCbFree(DkFreeFunc cbFree) noexcept { this->cbFree = cbFree; return *this; }
 		DeviceMaker& setFlags(uint32_t flags) noexcept { this->flags = flags; return *this; }
+		DeviceMaker& setErrorCheckIntervalUs(uint32_t errorCheckIntervalUs) noexcept { this->errorCheckIntervalUs = errorCheckIntervalUs; return *this; }
 		Device create() const;
 	};
 
@@ -316,9 +363,18 @@ namespace dk
 		CmdBufMaker(DkDevice device) noexcept : DkCmdBufMaker{} { ::dkCmdBufMakerDefaults(this, device); }
 		CmdBufMaker& setUserData(void* userData) noexcept { this->userData = userData; return *this; }
 		CmdBufMaker& setCbAddMem(DkCmdBufAddMemFunc cbAddMem) noexcept { this->cbAddMem = cbAddMem; return *this; }
+		CmdBufMaker& setArena(DkCmdArena arena) noexcept { this->arena = arena; return *this; }
+		CmdBufMaker& setFlags(uint32_t flags) noexcept { this->flags = flags; return *this; }
 		CmdBuf create() const;
 	};
 
+	struct CmdArenaMaker : public ::DkCmdArenaMaker
+	{
+		CmdArenaMaker(DkDevice device, DkMemBlock memBlock, uint32_t offset, uint32_t size) noexcept : DkCmdArenaMaker{} { ::dkCmdArenaMakerDefaults(this, device, memBlock, offset, size); }
+		CmdArenaMaker& setChunkSize(uint32_t chunkSize) noexcept { this->chunkSize = chunkSize; return *this; }
+		CmdArena create() const;
+	};
+
 	struct QueueMaker : public ::DkQueueMaker
 	{
 		QueueMaker(DkDevice device) noexcept : DkQueueMaker{} { ::dkQueueMakerDefaults(this, device); }
@@ -543,6 +599,32 @@ namespace dk
 		Swapchain create() const;
 	};
 
+	struct ProfilerMaker : public ::DkProfilerMaker
+	{
+		ProfilerMaker(DkDevice device, DkMemBlock memBlock, uint32_t offset, uint32_t numRegions) noexcept : DkProfilerMaker{} { ::dkProfilerMakerDefaults(this, device, memBlock, offset, numRegions); }
+		Profiler create() const;
+	};
+
+	struct PipelineMaker : public ::DkPipelineMaker
+	{
+		PipelineMaker(DkDevice device) noexcept : DkPipelineMaker{} { ::dkPipelineMakerDefaults(this, device); }
+		PipelineMaker& setShaders(uint32_t stageMask, detail::ArrayProxy<DkShader const* const> shaders) noexcept { this->stageMask = stageMask; this->shaders = shaders.data(); this->numShaders = shaders.size(); return *this; }
+		PipelineMaker& setRasterizerState(DkRasterizerState const* state) noexcept { this->rasterizerState = state; return *this; }
+		PipelineMaker& setColorState(DkColorState const* state) noexcept { this->colorState = state; return *this; }
+		PipelineMaker& setColorWriteState(DkColorWriteState const* state) noexcept { this->colorWriteState = state; return *this; }
+		PipelineMaker& setBlendStates(detail::ArrayProxy<DkBlendState const> states) noexcept { this->blendStates = states.data(); this->numBlendStates = states.size(); return *this; }
+		PipelineMaker& setDepthStencilState(DkDepthStencilState const* state) noexcept { this->depthStencilState = state; return *this; }
+		PipelineMaker& setVtxAttribState(detail::ArrayProxy<DkVtxAttribState const> attribs) noexcept { this->vtxAttribs = attribs.data(); this->numVtxAttribs = attribs.size(); return *this; }
+		PipelineMaker& setVtxBufferState(detail::ArrayProxy<DkVtxBufferState const> buffers) noexcept { this->vtxBuffers = buffers.data(); this->numVtxBuffers = buffers.size(); return *this; }
+		Pipeline create() const;
+	};
+
+	struct FramebufferMaker : public ::DkFramebufferMaker
+	{
+		FramebufferMaker(DkDevice device, detail::ArrayProxy<DkImageView const* const> colorTargets, DkImageView const* depthTarget = nullptr) noexcept : DkFramebufferMaker{} { ::dkFramebufferMakerDefaults(this, device, colorTargets.data(), colorTargets.size(), depthTarget); }
+		Framebuffer create() const;
+	};
+
 	inline Device DeviceMaker::create() const
 	{
 		return Device{::dkDeviceCreate(this)};
@@ -590,11 +672,27 @@ namespace dk
 		return ::dkFenceWait(this, timeout_ns);
 	}
 
+	inline DkResult Fence::waitMany(detail::ArrayProxy<DkFence* const> fences, bool waitAll, int64_t timeout_ns)
+	{
+		return ::dkFenceWaitMany(fences.data(), fences.size(), waitAll, timeout_ns);
+	}
+
 	inline CmdBuf CmdBufMaker::create() const
 	{
 		return CmdBuf{::dkCmdBufCreate(this)};
 	}
 
+	inline CmdArena CmdArenaMaker::create() const
+	{
+		return CmdArena{::dkCmdArenaCreate(this)};
+	}
+
+	inline void CmdArena::destroy()
+	{
+		::dkCmdArenaDestroy(*this);
+		_clear();
+	}
+
 	inline void CmdBuf::destroy()
 	{
 		::dkCmdBufDestroy(*this);
@@ -616,6 +714,11 @@ namespace dk
 		::dkCmdBufClear(*this);
 	}
 
+	inline void CmdBuf::recycleMemory(DkFence const* fence)
+	{
+		::dkCmdBufRecycleMemory(*this, fence);
+	}
+
 	inline void CmdBuf::beginCaptureCmds(uint32_t* storage, uint32_t max_words)
 	{
 		::dkCmdBufBeginCaptureCmds(*this, storage, max_words);
@@ -626,11 +729,41 @@ namespace dk
 		return ::dkCmdBufEndCaptureCmds(*this);
 	}
 
+	inline uint32_t CmdBuf::optimizeCapturedCmds(uint32_t* words, uint32_t num_words)
+	{
+		return ::dkCmdBufOptimizeCapturedCmds(*this, words, num_words);
+	}
+
 	inline void CmdBuf::replayCmds(detail::ArrayProxy<uint32_t const> words)
 	{
 		::dkCmdBufReplayCmds(*this, words.data(), words.size());
 	}
 
+	inline void CmdBuf::beginCaptureCmdsToMemBlock(DkMemBlock mem, uint32_t offset, uint32_t max_words)
+	{
+		::dkCmdBufBeginCaptureCmdsToMemBlock(*this, mem, offset, max_words);
+	}
+
+	inline void CmdBuf::replayCmdsFromMemBlock(DkMemBlock mem, uint32_t offset, uint32_t num_words)
+	{
+		::dkCmdBufReplayCmdsFromMemBlock(*this, mem, offset, num_words);
+	}
+
+	inline void CmdBuf::replayCmdsAtGpuAddr(DkGpuAddr addr, uint32_t num_words)
+	{
+		::dkCmdBufReplayCmdsAtGpuAddr(*this, addr, num_words);
+	}
+
+	inline size_t CmdBuf::getCompiledListSize(DkCmdList list)
+	{
+		return ::dkCmdBufGetCompiledListSize(*this, list);
+	}
+
+	inline DkCmdList CmdBuf::compileList(DkCmdList list, void* storage, size_t storageSize)
+	{
+		return ::dkCmdBufCompileList(*this, list, storage, storageSize);
+	}
+
 	inline void CmdBuf::callList(DkCmdList list)
 	{
 		::dkCmdBufCallList(*this, list);
@@ -651,6 +784,11 @@ namespace dk
 		::dkCmdBufBarrier(*this, mode, invalidateFlags);
 	}
 
+	inline void CmdBuf::writeTimestamp(DkGpuAddr addr)
+	{
+		::dkCmdBufWriteTimestamp(*this, addr);
+	}
+
 	inline void CmdBuf::bindShaders(uint32_t stageMask, detail::ArrayProxy<DkShader const* const> shaders)
 	{
 		::dkCmdBufBindShaders(*this, stageMask, shaders.data(), shaders.size());
@@ -701,6 +839,11 @@ namespace dk
 		::dkCmdBufBindRenderTargets(*this, colorTargets.data(), colorTargets.size(), depthTarget);
 	}
 
+	inline void CmdBuf::bindFramebuffer(DkFramebuffer framebuffer)
+	{
+		::dkCmdBufBindFramebuffer(*this, framebuffer);
+	}
+
 	inline void CmdBuf::bindColorState(DkColorState const& state)
 	{
 		::dkCmdBufBindColorState(*this, &state);
@@ -741,6 +884,11 @@ namespace dk
 		::dkCmdBufBindVtxBufferState(*this, buffers.data(), buffers.size());
 	}
 
+	inline void CmdBuf::bindPipeline(DkPipeline pipeline, DkPipeline prevPipeline)
+	{
+		::dkCmdBufBindPipeline(*this, pipeline, prevPipeline);
+	}
+
 	inline void CmdBuf::bindVtxBuffer(uint32_t id, DkGpuAddr bufAddr, uint32_t bufSize)
 	{
 		::dkCmdBufBindVtxBuffer(*this, id, bufAddr, bufSize);
@@ -924,6 +1072,26 @@ namespace dk
 		::dkCmdBufDrawIndexedIndirect(*this, prim, indirect);
 	}
 
+	inline void CmdBuf::multiDraw(DkPrimitive prim, detail::ArrayProxy<DkDrawIndirectData const> draws)
+	{
+		::dkCmdBufMultiDraw(*this, prim, draws.data(), draws.size());
+	}
+
+	inline void CmdBuf::multiDrawIndexed(DkPrimitive prim, detail::ArrayProxy<DkDrawIndexedIndirectData const> draws)
+	{
+		::dkCmdBufMultiDrawIndexed(*this, prim, draws.data(), draws.size());
+	}
+
+	inline void CmdBuf::multiDrawIndirect(DkPrimitive prim, DkGpuAddr indirect, uint32_t stride, uint32_t maxDrawCount, DkGpuAddr countAddr)
+	{
+		::dkCmdBufMultiDrawIndirect(*this, prim, indirect, stride, maxDrawCount, countAddr);
+	}
+
+	inline void CmdBuf::multiDrawIndexedIndirect(DkPrimitive prim, DkGpuAddr indirect, uint32_t stride, uint32_t maxDrawCount, DkGpuAddr countAddr)
+	{
+		::dkCmdBufMultiDrawIndexedIndirect(*this, prim, indirect, stride, maxDrawCount, countAddr);
+	}
+
 	inline void CmdBuf::dispatchCompute(uint32_t numGroupsX, uint32_t numGroupsY, uint32_t numGroupsZ)
 	{
 		::dkCmdBufDispatchCompute(*this, numGroupsX, numGroupsY, numGroupsZ);
@@ -1000,11 +1168,46 @@ namespace dk
 		::dkQueueSignalFence(*this, &fence, flush);
 	}
 
+	inline void Queue::waitTimeline(DkQueue srcQueue, uint64_t value)
+	{
+		::dkQueueWaitTimeline(*this, srcQueue, value);
+	}
+
+	inline uint64_t Queue::signalTimeline()
+	{
+		return ::dkQueueSignalTimeline(*this);
+	}
+
+	inline uint64_t Queue::getTimelineValue()
+	{
+		return ::dkQueueGetTimelineValue(*this);
+	}
+
+	inline bool Queue::pollTimeline(uint64_t value)
+	{
+		return ::dkQueuePollTimeline(*this, value);
+	}
+
+	inline DkResult Queue::hostWaitTimeline(uint64_t value, int64_t timeout_ns)
+	{
+		return ::dkQueueHostWaitTimeline(*this, value, timeout_ns);
+	}
+
+	inline uint64_t Queue::waitQueue(DkQueue srcQueue)
+	{
+		return ::dkQueueWaitQueue(*this, srcQueue);
+	}
+
 	inline void Queue::submitCommands(DkCmdList cmds)
 	{
 		::dkQueueSubmitCommands(*this, cmds);
 	}
 
+	inline void Queue::submitCommandsBatch(detail::ArrayProxy<DkCmdListSubmission const> submissions)
+	{
+		::dkQueueSubmitCommandsBatch(*this, submissions.data(), submissions.size());
+	}
+
 	inline void Queue::flush()
 	{
 		::dkQueueFlush(*this);
@@ -1112,9 +1315,66 @@ namespace dk
 		::dkSwapchainSetSwapInterval(*this, interval);
 	}
 
+	inline Profiler ProfilerMaker::create() const
+	{
+		return Profiler{::dkProfilerCreate(this)};
+	}
+
+	inline void Profiler::destroy()
+	{
+		::dkProfilerDestroy(*this);
+		_clear();
+	}
+
+	inline uint32_t Profiler::beginRegion(DkCmdBuf cmdbuf, uint32_t tag)
+	{
+		return ::dkProfilerBeginRegion(*this, cmdbuf, tag);
+	}
+
+	inline void Profiler::endRegion(DkCmdBuf cmdbuf, uint32_t region)
+	{
+		::dkProfilerEndRegion(*this, cmdbuf, region);
+	}
+
+	inline void Profiler::submitRegions(DkFence const& fence)
+	{
+		::dkProfilerSubmitRegions(*this, &fence);
+	}
+
+	inline uint32_t Profiler::resolve(detail::ArrayProxy<DkProfilerRegion> regions)
+	{
+		return ::dkProfilerResolve(*this, regions.data(), regions.size());
+	}
+
+	inline Pipeline PipelineMaker::create() const
+	{
+		return Pipeline{::dkPipelineCreate(this)};
+	}
+
+	inline void Pipeline::destroy()
+	{
+		::dkPipelineDestroy(*this);
+		_clear();
+	}
+
+	inline Framebuffer FramebufferMaker::create() const
+	{
+		return Framebuffer{::dkFramebufferCreate(this)};
+	}
+
+	inline void Framebuffer::destroy()
+	{
+		::dkFramebufferDestroy(*this);
+		_clear();
+	}
+
 	using UniqueDevice = detail::UniqueHandle<Device>;
 	using UniqueMemBlock = detail::UniqueHandle<MemBlock>;
 	using UniqueCmdBuf = detail::UniqueHandle<CmdBuf>;
+	using UniqueCmdArena = detail::UniqueHandle<CmdArena>;
 	using UniqueQueue = detail::UniqueHandle<Queue>;
 	using UniqueSwapchain = detail::UniqueHandle<Swapchain>;
+	using UniqueProfiler = detail::UniqueHandle<Profiler>;
+	using UniquePipeline = detail::UniqueHandle<Pipeline>;
+	using UniqueFramebuffer = detail::UniqueHandle<Framebuffer>;
 }
@@ -12,6 +12,13 @@ using namespace maxwell;
 
 namespace
 {
+	// Offset of a per-stage binding within the graphics driver cbuf
+	// (offsetof does not accept runtime array indices in C++)
+	constexpr uint32_t PerStageCbufOffset(unsigned stage, size_t fieldOffset, size_t fieldSize, uint32_t id)
+	{
+		return offsetof(GraphicsDriverCbuf, data) + stage*sizeof(PerStageData) + fieldOffset + id*fieldSize;
+	}
+
 #ifdef DEBUG
 
 	constexpr bool checkInRange(uint32_t base, uint32_t size, uint32_t max)
@@ -227,7 +234,7 @@ void dkCmdBufBindStorageBuffers(DkCmdBuf obj, DkStage stage, uint32_t firstId, D
 	static_assert(offsetof(DkBufExtents,size) == offsetof(BufDescriptor,size),    "Bad definition for DkBufExtents");
 
 	w.reserve(2 + numBuffers*4);
-	w << MacroInline(SelectDriverConstbuf, offsetof(GraphicsDriverCbuf, data[stage].storageBufs[firstId])/4);
+	w << MacroInline(SelectDriverConstbuf, PerStageCbufOffset(stage, offsetof(PerStageData, storageBufs), sizeof(BufDescriptor), firstId)/4);
 	w << CmdList<1>{ MakeCmdHeader(NonIncreasing, numBuffers*4, Subchannel3D, Engine3D::LoadConstbufData{}) };
 	w.addRawData(buffers, numBuffers*sizeof(DkBufExtents));
 }
@@ -254,7 +261,7 @@ void dkCmdBufBindTextures(DkCmdBuf obj, DkStage stage, uint32_t firstId, DkResHa
 	}
 
 	w.reserve(3 + numHandles);
-	w << MacroInline(SelectDriverConstbuf, offsetof(GraphicsDriverCbuf, data[stage].textures[firstId])/4);
+	w << MacroInline(SelectDriverConstbuf, PerStageCbufOffset(stage, offsetof(PerStageData, textures), sizeof(DkResHandle), firstId)/4);
 	w << CmdInline(3D, PipeNop{}, 0);
 	w << CmdList<1>{ MakeCmdHeader(NonIncreasing, numHandles, Subchannel3D, Engine3D::LoadConstbufData{}) };
 	w.addRawData(handles, numHandles*sizeof(DkResHandle));
@@ -282,7 +289,7 @@ void dkCmdBufBindImages(DkCmdBuf obj, DkStage stage, uint32_t firstId, DkResHand
 	}
 
 	w.reserve(3 + numHandles);
-	w << MacroInline(SelectDriverConstbuf, offsetof(GraphicsDriverCbuf, data[stage].images[firstId])/4);
+	w << MacroInline(SelectDriverConstbuf, PerStageCbufOffset(stage, offsetof(PerStageData, images), sizeof(DkResHandle), firstId)/4);
 	w << CmdInline(3D, PipeNop{}, 0);
 	w << CmdList<1>{ MakeCmdHeader(NonIncreasing, numHandles, Subchannel3D, Engine3D::LoadConstbufData{}) };
 	w.addRawData(handles, numHandles*sizeof(DkResHandle));
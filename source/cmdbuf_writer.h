@@ -46,7 +46,7 @@ namespace dk::detail
 		{
 			flush();
 			maxwell::CmdWord *pos = getPos();
-			if ((pos + size) >= m_cmdBuf->m_cmdEnd)
+			if ((pos + size) > m_cmdBuf->m_cmdEnd)
 				m_pos = pos = m_cmdBuf->requestCmdMem(size);
 			return pos;
 		}
@@ -118,6 +118,16 @@ namespace dk::detail
 			reserveAdd(std::move(list));
 		}
 
+		// Like operator<<, but drops the commands if they only rewrite 3D state
+		// to its last known values (requires DkCmdBufFlags_FilterRedundantState)
+		template <uint32_t size>
+		void addState(maxwell::CmdList<size> const& cmds)
+		{
+			if (m_cmdBuf->m_stateShadow && m_cmdBuf->filterState(cmds.raw, size))
+				return;
+			*this << cmds;
+		}
+
 		template <uint32_t size>
 		CmdBufWriter& operator<<(maxwell::CmdList<size> const& cmds)
 		{
@@ -0,0 +1,48 @@
+#include "ctrlmempool.h"
+#include "dk_device.h"
+
+using namespace dk::detail;
+
+void CtrlMemPool::cleanup()
+{
+	for (unsigned i = 0; i < s_numSizeClasses; i ++)
+	{
+		CtrlMemChunk *next;
+		for (CtrlMemChunk *cur = m_freeChunks[i]; cur; cur = next)
+		{
+			next = cur->m_next;
+			freeMem(cur);
+		}
+		m_freeChunks[i] = nullptr;
+	}
+}
+
+CtrlMemChunk* CtrlMemPool::allocChunkOfSize(size_t size)
+{
+	auto* chunk = static_cast<CtrlMemChunk*>(allocMem(sizeof(CtrlMemChunk)+size));
+	if (chunk) // above already errored out if this failed
+		chunk->m_size = size;
+	return chunk;
+}
+
+CtrlMemChunk* CtrlMemPool::acquireChunk(unsigned sizeClass)
+{
+	{
+		MutexHolder m{m_mutex};
+		CtrlMemChunk* chunk = m_freeChunks[sizeClass];
+		if (chunk)
+		{
+			m_freeChunks[sizeClass] = chunk->m_next;
+			return chunk;
+		}
+	}
+
+	return allocChunk(sizeClass);
+}
+
+void CtrlMemPool::releaseChunks(unsigned sizeClass, CtrlMemChunk* first, CtrlMemChunk* last)
+{
+	MutexHolder m{m_mutex};
+	last->m_next = m_freeChunks[sizeClass];
+	m_freeChunks[sizeClass] = first;
+}
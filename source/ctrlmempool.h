@@ -0,0 +1,48 @@
+#pragma once
+#include "dk_private.h"
+
+namespace dk::detail
+{
+	struct CtrlMemChunk
+	{
+		CtrlMemChunk *m_next;
+		size_t m_size;
+	};
+
+	class CtrlMemPool : public ObjBase
+	{
+	public:
+		// Chunks come in power-of-two sizes (header included), from 1 KiB to 128 KiB.
+		// Bigger chunks are allocated to size, and freed as soon as they're no longer used.
+		static constexpr unsigned s_minChunkSizeLog2 = 10;
+		static constexpr unsigned s_numSizeClasses = 8;
+
+		static constexpr size_t getClassSize(unsigned sizeClass) noexcept
+		{
+			return (size_t{1} << (s_minChunkSizeLog2 + sizeClass)) - sizeof(CtrlMemChunk);
+		}
+
+		static constexpr unsigned getSizeClass(size_t size) noexcept
+		{
+			size_t totalSize = size + sizeof(CtrlMemChunk);
+			if (totalSize <= (size_t{1} << s_minChunkSizeLog2))
+				return 0;
+			return 8*sizeof(long) - __builtin_clzl(totalSize - 1) - s_minChunkSizeLog2;
+		}
+
+	private:
+		Mutex m_mutex;
+		CtrlMemChunk* m_freeChunks[s_numSizeClasses];
+
+	public:
+		constexpr CtrlMemPool(DkDevice device) noexcept : ObjBase{device},
+			m_mutex{}, m_freeChunks{} { }
+
+		void cleanup() noexcept;
+
+		CtrlMemChunk* allocChunk(unsigned sizeClass) noexcept { return allocChunkOfSize(getClassSize(sizeClass)); }
+		CtrlMemChunk* allocChunkOfSize(size_t size) noexcept;
+		CtrlMemChunk* acquireChunk(unsigned sizeClass) noexcept;
+		void releaseChunks(unsigned sizeClass, CtrlMemChunk* first, CtrlMemChunk* last) noexcept;
+	};
+}
@@ -0,0 +1,163 @@
+#include "dk_cmdarena.h"
+#include "dk_memblock.h"
+
+using namespace dk::detail;
+
+void CmdArena::pushList(uint64_t& top, uint32_t first, uint32_t last) noexcept
+{
+	uint64_t oldTop = __atomic_load_n(&top, __ATOMIC_RELAXED);
+	do
+		__atomic_store_n(&m_chunks[last].m_next, getListHead(oldTop), __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&top, &oldTop, makeListTop(oldTop, first), true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+uint32_t CmdArena::popList(uint64_t& top) noexcept
+{
+	uint64_t oldTop = __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+	uint32_t id, next;
+	do
+	{
+		id = getListHead(oldTop);
+		if (id == s_invalidChunk)
+			break;
+		next = __atomic_load_n(&m_chunks[id].m_next, __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&top, &oldTop, makeListTop(oldTop, next), true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+	return id;
+}
+
+uint32_t CmdArena::reclaimRetired() noexcept
+{
+	// Take ownership of the entire list of retired chunks. Other threads can't see the
+	// chunks while they are being sorted, so let them know that some are on their way back
+	__atomic_add_fetch(&m_numReclaimers, 1, __ATOMIC_ACQUIRE);
+	uint64_t oldTop = __atomic_load_n(&m_retiredTop, __ATOMIC_ACQUIRE);
+	while (getListHead(oldTop) != s_invalidChunk &&
+		!__atomic_compare_exchange_n(&m_retiredTop, &oldTop, makeListTop(oldTop, s_invalidChunk), true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+	// Sort the chunks depending on whether the GPU is done with them
+	uint32_t ret = s_invalidChunk;
+	uint32_t freeFirst = s_invalidChunk, freeLast = s_invalidChunk;
+	uint32_t pendingFirst = s_invalidChunk, pendingLast = s_invalidChunk;
+	for (uint32_t cur = getListHead(oldTop), next; cur != s_invalidChunk; cur = next)
+	{
+		ChunkInfo& chunk = m_chunks[cur];
+		next = chunk.m_next;
+
+		if (chunk.m_hasFence && chunk.m_fence.wait(0) != DkResult_Success)
+		{
+			chunk.m_next = pendingFirst;
+			pendingFirst = cur;
+			if (pendingLast == s_invalidChunk)
+				pendingLast = cur;
+		}
+		else if (ret == s_invalidChunk)
+			ret = cur;
+		else
+		{
+			chunk.m_next = freeFirst;
+			freeFirst = cur;
+			if (freeLast == s_invalidChunk)
+				freeLast = cur;
+		}
+	}
+
+	// If nothing is available yet, keep the oldest pending chunk for ourselves
+	bool mustWait = false;
+	if (ret == s_invalidChunk && pendingFirst != s_invalidChunk)
+	{
+		ret = pendingFirst;
+		pendingFirst = m_chunks[ret].m_next;
+		if (pendingFirst == s_invalidChunk)
+			pendingLast = s_invalidChunk;
+		mustWait = true;
+	}
+
+	// Hand back everything else before blocking, so that other threads can use it meanwhile
+	if (freeFirst != s_invalidChunk)
+		pushList(m_freeTop, freeFirst, freeLast);
+	if (pendingFirst != s_invalidChunk)
+		pushList(m_retiredTop, pendingFirst, pendingLast);
+	__atomic_sub_fetch(&m_numReclaimers, 1, __ATOMIC_RELEASE);
+
+	if (mustWait)
+		m_chunks[ret].m_fence.wait();
+
+	// Some other thread may have released chunks in the meantime
+	if (ret == s_invalidChunk)
+		ret = popList(m_freeTop);
+
+	return ret;
+}
+
+uint32_t CmdArena::acquireChunk() noexcept
+{
+	for (;;)
+	{
+		uint64_t freeTop = __atomic_load_n(&m_freeTop, __ATOMIC_ACQUIRE);
+		uint64_t retiredTop = __atomic_load_n(&m_retiredTop, __ATOMIC_ACQUIRE);
+
+		// Reuse a chunk that has already been released
+		uint32_t id = popList(m_freeTop);
+		if (id != s_invalidChunk)
+			return id;
+
+		// Carve a new chunk out of the memory block
+		id = __atomic_load_n(&m_nextFreshChunk, __ATOMIC_RELAXED);
+		while (id < m_numChunks)
+			if (__atomic_compare_exchange_n(&m_nextFreshChunk, &id, id+1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				return id;
+
+		// Last resort: recycle chunks the GPU is (or will soon be) done with
+		id = reclaimRetired();
+		if (id != s_invalidChunk)
+			return id;
+
+		// The arena is only exhausted if every chunk is held by a command buffer. Otherwise,
+		// chunks are either being sorted by another thread, or were released since we looked
+		if (!__atomic_load_n(&m_numReclaimers, __ATOMIC_ACQUIRE) &&
+			__atomic_load_n(&m_freeTop, __ATOMIC_ACQUIRE) == freeTop &&
+			__atomic_load_n(&m_retiredTop, __ATOMIC_ACQUIRE) == retiredTop)
+			return s_invalidChunk;
+
+		svcSleepThread(0);
+	}
+}
+
+void CmdArena::releaseChunks(uint32_t first, DkFence const* fence) noexcept
+{
+	uint32_t last = first;
+	for (;;)
+	{
+		ChunkInfo& chunk = m_chunks[last];
+		chunk.m_hasFence = fence != nullptr;
+		if (fence)
+			chunk.m_fence = *fence;
+		if (chunk.m_next == s_invalidChunk)
+			break;
+		last = chunk.m_next;
+	}
+
+	pushList(fence ? m_retiredTop : m_freeTop, first, last);
+}
+
+DkCmdArena dkCmdArenaCreate(DkCmdArenaMaker const* maker)
+{
+	DK_ENTRYPOINT(maker->device);
+	DK_DEBUG_NON_NULL(maker->memBlock);
+	DK_DEBUG_NON_ZERO(maker->chunkSize);
+	DK_DEBUG_DATA_ALIGN(maker->offset, DK_CMDMEM_ALIGNMENT);
+	DK_DEBUG_SIZE_ALIGN(maker->chunkSize, DK_CMDMEM_ALIGNMENT);
+	DK_DEBUG_BAD_INPUT(maker->size < maker->chunkSize, "arena must be able to hold at least one chunk");
+	DK_DEBUG_BAD_INPUT(maker->offset + maker->size > maker->memBlock->getSize(), "arena out of bounds");
+	DK_DEBUG_BAD_FLAGS(maker->memBlock->isGpuNoAccess() || !maker->memBlock->isCpuUncached(), "DkMemBlock must be created with DkMemBlockFlags_CpuUncached and DkMemBlockFlags_GpuCached");
+
+	DkCmdArena obj = nullptr;
+	obj = new(maker->device, CmdArena::calcExtraSize(*maker)) CmdArena(*maker);
+	return obj;
+}
+
+void dkCmdArenaDestroy(DkCmdArena obj)
+{
+	DK_ENTRYPOINT(obj);
+	delete obj;
+}
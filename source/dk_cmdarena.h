@@ -0,0 +1,67 @@
+#pragma once
+#include "dk_private.h"
+#include "dk_fence.h"
+
+namespace dk::detail
+{
+
+// Pool of fixed-size command memory chunks carved out of a single memory block.
+// All operations are lock-free, so that it can be shared by command buffers
+// recording on different threads.
+class CmdArena : public ObjBase
+{
+public:
+	static constexpr uint32_t s_invalidChunk = UINT32_MAX;
+
+private:
+	struct ChunkInfo
+	{
+		uint32_t m_next;
+		bool m_hasFence;
+		DkFence m_fence;
+	};
+
+	DkMemBlock m_memBlock;
+	uint32_t m_offset;
+	uint32_t m_chunkSize;
+	uint32_t m_numChunks;
+	uint32_t m_nextFreshChunk;
+	uint32_t m_numReclaimers;
+	uint64_t m_freeTop;
+	uint64_t m_retiredTop;
+	ChunkInfo* m_chunks;
+
+	// Lists are tagged with a counter in the upper half to avoid ABA problems
+	static constexpr uint32_t getListHead(uint64_t top) noexcept { return uint32_t(top); }
+	static constexpr uint64_t makeListTop(uint64_t oldTop, uint32_t head) noexcept
+	{
+		return ((oldTop + (UINT64_C(1) << 32)) &~ UINT64_C(0xFFFFFFFF)) | head;
+	}
+
+	void pushList(uint64_t& top, uint32_t first, uint32_t last) noexcept;
+	uint32_t popList(uint64_t& top) noexcept;
+	uint32_t reclaimRetired() noexcept;
+
+public:
+	constexpr CmdArena(DkCmdArenaMaker const& m) noexcept : ObjBase{m.device},
+		m_memBlock{m.memBlock}, m_offset{m.offset}, m_chunkSize{m.chunkSize}, m_numChunks{m.size / m.chunkSize},
+		m_nextFreshChunk{}, m_numReclaimers{}, m_freeTop{s_invalidChunk}, m_retiredTop{s_invalidChunk},
+		m_chunks{(ChunkInfo*)(void*)(this+1)} { }
+
+	constexpr DkMemBlock getMemBlock() const noexcept { return m_memBlock; }
+	constexpr uint32_t getChunkSize() const noexcept { return m_chunkSize; }
+	constexpr uint32_t getChunkOffset(uint32_t id) const noexcept { return m_offset + id*m_chunkSize; }
+
+	uint32_t getNextChunk(uint32_t id) const noexcept { return m_chunks[id].m_next; }
+	void setNextChunk(uint32_t id, uint32_t next) noexcept { m_chunks[id].m_next = next; }
+
+	uint32_t acquireChunk() noexcept;
+	void releaseChunks(uint32_t first, DkFence const* fence) noexcept;
+
+	static size_t calcExtraSize(DkCmdArenaMaker const& m) noexcept
+	{
+		return sizeof(ChunkInfo) * (m.size / m.chunkSize);
+	}
+};
+
+}
@@ -1,23 +1,247 @@
 #include "dk_cmdbuf.h"
 #include "dk_memblock.h"
+#include "dk_device.h"
 #include "cmdbuf_writer.h"
 
 using namespace maxwell;
 using namespace dk::detail;
 
+namespace
+{
+	template <typename T>
+	bool ForEachStateWrite(CmdWord const* words, uint32_t numWords, T&& func)
+	{
+		for (uint32_t i = 0; i < numWords;)
+		{
+			uint32_t header = words[i++].i;
+			uint32_t method = header & 0x1FFF;
+			uint32_t subchannel = (header >> 13) & 7;
+			uint32_t arg = (header >> 16) & 0x1FFF;
+			uint32_t mode = header >> 29;
+
+			if (subchannel != Subchannel3D)
+				return false;
+
+			switch (mode)
+			{
+				case Inline:
+					func(method, arg);
+					break;
+				case Increasing:
+					for (uint32_t j = 0; j < arg; j ++)
+						func(method + j, words[i++].i);
+					break;
+				case IncreaseOnce:
+					// Used for macro calls: track each parameter separately
+					for (uint32_t j = 0; j < arg; j ++)
+						func(method | (j << 13), words[i++].i);
+					break;
+				default:
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Rewrites a command stream in place, merging method writes into as few
+	// headers as possible. The sequence of (method, value) writes received by
+	// each engine is left exactly as it was.
+	class CmdOptimizer
+	{
+		enum RunKind
+		{
+			Single,
+			Ascending,
+			SameMethod,
+		};
+
+		static constexpr uint32_t s_maxRunSize = 256;
+
+		CmdWord* m_words;
+		uint32_t m_outPos;
+
+		uint32_t m_runSubchannel;
+		uint32_t m_runMethod;
+		uint32_t m_runLastMethod;
+		RunKind m_runKind;
+		uint32_t m_runSize;
+		uint32_t m_runValues[s_maxRunSize];
+
+		static constexpr bool isMergeable(uint32_t mode, uint32_t subchannel, uint32_t method)
+		{
+			// Leave alone FIFO methods (which are handled by PFIFO itself) and macro methods
+			if (mode != Increasing && mode != NonIncreasing && mode != Inline)
+				return false;
+			if (method < 0x40)
+				return false;
+			if (subchannel == Subchannel3D && method >= 0xE00)
+				return false;
+			return true;
+		}
+
+		bool canAppend(uint32_t subchannel, uint32_t method, RunKind kind, uint32_t count) const
+		{
+			if (!m_runSize || m_runSubchannel != subchannel || m_runSize + count > s_maxRunSize)
+				return false;
+			bool ascending  = method == m_runLastMethod+1 && kind != SameMethod;
+			bool sameMethod = method == m_runLastMethod && kind != Ascending;
+			switch (m_runKind)
+			{
+				default:
+				case Single:     return ascending || sameMethod;
+				case Ascending:  return ascending;
+				case SameMethod: return sameMethod;
+			}
+		}
+
+		void flushRun()
+		{
+			if (!m_runSize)
+				return;
+
+			uint32_t singleCost = 0;
+			for (uint32_t i = 0; i < m_runSize; i ++)
+				singleCost += m_runValues[i] < 0x2000 ? 1 : 2;
+
+			if (singleCost <= 1 + m_runSize)
+			{
+				// Emit each write on its own
+				for (uint32_t i = 0; i < m_runSize; i ++)
+				{
+					uint32_t method = m_runKind == Ascending ? m_runMethod + i : m_runMethod;
+					uint32_t value = m_runValues[i];
+					if (value < 0x2000)
+						m_words[m_outPos++].i = MakeCmdHeader(Inline, value, m_runSubchannel, method);
+					else
+					{
+						m_words[m_outPos++].i = MakeCmdHeader(Increasing, 1, m_runSubchannel, method);
+						m_words[m_outPos++].i = value;
+					}
+				}
+			}
+			else
+			{
+				// Emit the whole run under a single header
+				SubmissionMode mode = m_runKind == SameMethod ? NonIncreasing : Increasing;
+				m_words[m_outPos++].i = MakeCmdHeader(mode, m_runSize, m_runSubchannel, m_runMethod);
+				for (uint32_t i = 0; i < m_runSize; i ++)
+					m_words[m_outPos++].i = m_runValues[i];
+			}
+
+			m_runSize = 0;
+		}
+
+	public:
+		CmdOptimizer(CmdWord* words) : m_words{words}, m_outPos{}, m_runSize{} { }
+
+		uint32_t process(uint32_t numWords)
+		{
+			// Runs are only ever made of whole commands, which guarantees that
+			// the output never grows past the input that has been consumed so far.
+			uint32_t inPos = 0;
+			while (inPos < numWords)
+			{
+				uint32_t header = m_words[inPos].i;
+				uint32_t method = header & 0x1FFF;
+				uint32_t subchannel = (header >> 13) & 7;
+				uint32_t arg = (header >> 16) & 0x1FFF;
+				uint32_t mode = header >> 29;
+				uint32_t numData = mode == Inline ? 0 : arg;
+
+				if (inPos + 1 + numData > numWords)
+				{
+					// Malformed/truncated command, copy the rest as is
+					flushRun();
+					memmove(&m_words[m_outPos], &m_words[inPos], (numWords-inPos)*sizeof(CmdWord));
+					m_outPos += numWords-inPos;
+					break;
+				}
+
+				uint32_t count = mode == Inline ? 1 : arg;
+				if (!isMergeable(mode, subchannel, method) || count > s_maxRunSize)
+				{
+					flushRun();
+					memmove(&m_words[m_outPos], &m_words[inPos], (1+numData)*sizeof(CmdWord));
+					m_outPos += 1+numData;
+					inPos += 1+numData;
+					continue;
+				}
+
+				// Commands that write nothing can be dropped altogether
+				if (!count)
+				{
+					inPos ++;
+					continue;
+				}
+
+				RunKind kind = Single;
+				if (count > 1)
+					kind = mode == NonIncreasing ? SameMethod : Ascending;
+
+				if (canAppend(subchannel, method, kind, count))
+				{
+					if (m_runKind == Single)
+						m_runKind = method == m_runLastMethod ? SameMethod : Ascending;
+				}
+				else
+				{
+					flushRun();
+					m_runSubchannel = subchannel;
+					m_runMethod = method;
+					m_runKind = kind;
+				}
+
+				if (mode == Inline)
+					m_runValues[m_runSize++] = arg;
+				else for (uint32_t i = 0; i < count; i ++)
+					m_runValues[m_runSize++] = m_words[inPos+1+i].i;
+
+				m_runLastMethod = m_runKind == Ascending ? method + count - 1 : method;
+				inPos += 1+numData;
+			}
+
+			flushRun();
+			return m_outPos;
+		}
+	};
+}
+
 CmdBuf::~CmdBuf()
 {
 	if (m_hasFlushFunc)
 		return;
 
-	// Make sure all used chunks get transferred to the free list
+	// Make sure all used chunks get transferred to the free lists
 	clear();
 
-	CtrlMemChunk *cur, *next;
-	for (cur = m_ctrlChunkFree; cur; cur = next)
+	// Return all command memory to the arena
+	if (m_arenaChunks != CmdArena::s_invalidChunk)
+		m_arena->releaseChunks(m_arenaChunks, nullptr);
+
+	for (unsigned i = 0; i < CtrlMemPool::s_numSizeClasses; i ++)
 	{
-		next = cur->m_next;
-		freeMem(cur);
+		CtrlMemChunk *first = m_ctrlChunkFree[i];
+		if (!first)
+			continue;
+
+		if (m_useSharedCtrlMemPool)
+		{
+			// Give the chunks back to the device so that other command buffers can use them
+			CtrlMemChunk *last = first;
+			while (last->m_next)
+				last = last->m_next;
+			getDevice()->getCtrlMemPool().releaseChunks(i, first, last);
+		}
+		else
+		{
+			CtrlMemChunk *cur, *next;
+			for (cur = first; cur; cur = next)
+			{
+				next = cur->m_next;
+				freeMem(cur);
+			}
+		}
 	}
 }
 
@@ -51,6 +275,7 @@ DkCmdList CmdBuf::finishList()
 	// Reset internal variables
 	m_ctrlGpfifo = nullptr;
 	m_ctrlStart = nullptr;
+	invalidateStateShadow();
 
 	// If we've used up all available control memory in this chunk, just clear it out and move on
 	if (m_ctrlPos >= m_ctrlEnd)
@@ -64,19 +289,40 @@ DkCmdList CmdBuf::finishList()
 
 void CmdBuf::clear()
 {
-	// Transfer all used chunks into the free list
-	if (m_ctrlChunkCur)
+	// Transfer all used chunks into the free lists
+	CtrlMemChunk *cur, *next;
+	for (cur = m_ctrlChunkCur; cur; cur = next)
 	{
-		m_ctrlChunkCur->m_next = m_ctrlChunkFree;
-		m_ctrlChunkFree = m_ctrlChunkCur;
-		m_ctrlChunkCur = nullptr;
+		unsigned sizeClass = CtrlMemPool::getSizeClass(cur->m_size);
+		next = cur->m_next;
+		if (sizeClass >= CtrlMemPool::s_numSizeClasses)
+		{
+			// Chunks allocated for oversized commands are not worth keeping around
+			freeMem(cur);
+			continue;
+		}
+		cur->m_next = m_ctrlChunkFree[sizeClass];
+		m_ctrlChunkFree[sizeClass] = cur;
 	}
+	m_ctrlChunkCur = nullptr;
 
 	// Clear control memory management variables
 	m_ctrlGpfifo = nullptr;
 	m_ctrlStart = nullptr;
 	m_ctrlPos = nullptr;
 	m_ctrlEnd = nullptr;
+	invalidateStateShadow();
+
+	// Return all arena chunks except for the one currently in use
+	if (m_arenaChunks != CmdArena::s_invalidChunk)
+	{
+		uint32_t next = m_arena->getNextChunk(m_arenaChunks);
+		if (next != CmdArena::s_invalidChunk)
+		{
+			m_arena->releaseChunks(next, nullptr);
+			m_arena->setNextChunk(m_arenaChunks, CmdArena::s_invalidChunk);
+		}
+	}
 
 	// Reset command memory back to the beginning of the chunk added by the last addMemory call
 	if (m_cmdChunkStart)
@@ -87,11 +333,33 @@ void CmdBuf::clear()
 	}
 }
 
-void CmdBuf::beginCapture(uint32_t* storage, uint32_t max_words)
+void CmdBuf::recycleMemory(DkFence const* fence)
+{
+	// Hand over all arena chunks, which will be reused once the fence is signaled
+	if (m_arenaChunks != CmdArena::s_invalidChunk)
+	{
+		m_arena->releaseChunks(m_arenaChunks, fence);
+		m_arenaChunks = CmdArena::s_invalidChunk;
+	}
+
+	clear();
+
+	// Forget about the current command memory
+	m_cmdChunkStartIova = 0;
+	m_cmdStartIova = 0;
+	m_cmdChunkStart = nullptr;
+	m_cmdStart = nullptr;
+	m_cmdPos = nullptr;
+	m_cmdEnd = nullptr;
+}
+
+void CmdBuf::beginCapture(uint32_t* storage, uint32_t max_words, bool allowOverflow)
 {
 	clear();
 
 	m_isCapturing = true;
+	m_allowCaptureOverflow = allowOverflow;
+	m_captureOverflowed = false;
 	m_cmdChunkStart = nullptr;
 	m_cmdStart = (CmdWord*)storage;
 	m_cmdPos = m_cmdStart;
@@ -100,8 +368,21 @@ void CmdBuf::beginCapture(uint32_t* storage, uint32_t max_words)
 
 uint32_t CmdBuf::endCapture()
 {
-	uint32_t ret = m_cmdPos - m_cmdStart;
+	uint32_t ret = 0;
+	if (m_captureOverflowed)
+	{
+		freeMem(m_captureScratch);
+		m_captureScratch = nullptr;
+	}
+	else
+	{
+		ret = m_cmdPos - m_cmdStart;
+		if (m_optimizeCaptures)
+			ret = optimizeCmds(m_cmdStart, ret);
+	}
 
+	// Captured commands may be replayed anywhere, so they must not depend on prior state
+	invalidateStateShadow();
 	m_isCapturing = false;
 	m_cmdStart = nullptr;
 	m_cmdPos = nullptr;
@@ -110,20 +391,142 @@ uint32_t CmdBuf::endCapture()
 	return ret;
 }
 
+void CmdBuf::replayRawCmds(DkGpuAddr iova, uint32_t numWords)
+{
+	// Make sure previously recorded commands are executed first
+	signOffGpfifoEntry();
+
+	// Point the GPU directly at the commands, without copying them
+	appendRawGpfifoEntry(iova, numWords, CtrlCmdGpfifoEntry::AutoKick);
+
+	// The replayed commands may have changed any state
+	invalidateStateShadow();
+}
+
+uint32_t CmdBuf::optimizeCmds(CmdWord* words, uint32_t numWords)
+{
+	return CmdOptimizer{words}.process(numWords);
+}
+
+size_t CmdBuf::compileList(DkCmdList list, void* storage)
+{
+	// When storage is null, only the size of the compiled list is calculated
+	char* out = static_cast<char*>(storage);
+	size_t size = 0;
+	auto emit = [&](void const* data, size_t dataSize)
+	{
+		if (out)
+			memcpy(out+size, data, dataSize);
+		size += dataSize;
+	};
+
+	// Consecutive gpfifo lists are merged into a single one, coalescing contiguous entries
+	size_t runOffset = 0;
+	uint32_t runLength = 0;
+	CtrlCmdGpfifoEntry lastEntry = {};
+
+	WalkCtrlCmds(reinterpret_cast<CtrlCmdHeader const*>(list), [&](CtrlCmdHeader const* cur) -> CtrlCmdHeader const*
+	{
+		if (cur->type != CtrlCmdHeader::GpfifoList)
+		{
+			size_t cmdSize = GetCtrlCmdSize(cur);
+			if (!cmdSize)
+				return nullptr;
+			runLength = 0;
+			emit(cur, cmdSize);
+			return reinterpret_cast<CtrlCmdHeader const*>(reinterpret_cast<char const*>(cur) + cmdSize);
+		}
+
+		auto* entries = reinterpret_cast<CtrlCmdGpfifoEntry const*>(cur+1);
+		if (!runLength)
+		{
+			CtrlCmdHeader header = {};
+			header.type = CtrlCmdHeader::GpfifoList;
+			runOffset = size;
+			emit(&header, sizeof(header));
+		}
+
+		for (uint32_t i = 0; i < cur->arg; i ++)
+		{
+			auto& ent = entries[i];
+			if (runLength && ent.flags == CtrlCmdGpfifoEntry::AutoKick &&
+				lastEntry.iova + lastEntry.numCmds*sizeof(CmdWord) == ent.iova &&
+				lastEntry.numCmds + ent.numCmds <= s_maxGpfifoEntryWords)
+			{
+				lastEntry.numCmds += ent.numCmds;
+				lastEntry.flags |= CtrlCmdGpfifoEntry::AutoKick;
+				size -= sizeof(CtrlCmdGpfifoEntry);
+			}
+			else
+			{
+				lastEntry = ent;
+				runLength ++;
+			}
+			emit(&lastEntry, sizeof(lastEntry));
+		}
+
+		if (out)
+			reinterpret_cast<CtrlCmdHeader*>(out+runOffset)->arg = runLength;
+		return reinterpret_cast<CtrlCmdHeader const*>(entries+cur->arg);
+	});
+
+	CtrlCmdHeader retCmd = {};
+	retCmd.type = CtrlCmdHeader::Return;
+	emit(&retCmd, sizeof(retCmd));
+	return size;
+}
+
 CmdWord* CmdBuf::requestCmdMem(uint32_t size)
 {
 	if (m_isCapturing)
 	{
-		DK_ERROR(DkResult_BadState, "out of capture memory");
-		return nullptr;
+		if (!m_allowCaptureOverflow)
+		{
+			DK_ERROR(DkResult_BadState, "out of capture memory");
+			return nullptr;
+		}
+
+		// Keep recording into scratch memory, which is thrown away when the capture ends
+		if (m_captureScratch)
+			freeMem(m_captureScratch);
+		m_captureScratch = static_cast<CmdWord*>(allocMem(size*sizeof(CmdWord)));
+		if (!m_captureScratch)
+		{
+			DK_ERROR(DkResult_OutOfMemory, "failed to allocate capture scratch memory");
+			return nullptr;
+		}
+		m_captureOverflowed = true;
+		m_cmdStart = m_captureScratch;
+		m_cmdPos = m_cmdStart;
+		m_cmdEnd = m_cmdPos + size;
+		return m_cmdPos;
+	}
+	uint32_t reqSize = (size+m_numReservedWords)*sizeof(CmdWord);
+	if (m_arena)
+	{
+		if (reqSize > m_arena->getChunkSize())
+		{
+			DK_ERROR(DkResult_OutOfMemory, "command does not fit in a command arena chunk");
+			return nullptr;
+		}
+		uint32_t id = m_arena->acquireChunk();
+		if (id == CmdArena::s_invalidChunk)
+		{
+			DK_ERROR(DkResult_OutOfMemory, "out of command arena memory");
+			return nullptr;
+		}
+		m_arena->setNextChunk(id, m_arenaChunks);
+		m_arenaChunks = id;
+		addMemory(m_arena->getMemBlock(), m_arena->getChunkOffset(id), m_arena->getChunkSize());
 	}
-	if (!m_cbAddMem)
+	else if (!m_cbAddMem)
 	{
 		DK_ERROR(DkResult_OutOfMemory, "out of command memory and no add-mem callback set");
 		return nullptr;
 	}
-	m_cbAddMem(m_userData, this, (size+m_numReservedWords)*sizeof(CmdWord));
-	if ((m_cmdPos + size) >= m_cmdEnd)
+	else
+		m_cbAddMem(m_userData, this, reqSize);
+	if ((m_cmdPos + size) > m_cmdEnd)
 	{
 		DK_ERROR(DkResult_OutOfMemory, "add-mem callback did not add enough command memory");
 		return nullptr;
@@ -131,6 +534,42 @@ CmdWord* CmdBuf::requestCmdMem(uint32_t size)
 	return m_cmdPos;
 }
 
+bool CmdBuf::filterState(CmdWord const* words, uint32_t numWords)
+{
+	// Related 3D state tends to live in arrays aligned to large strides, so the
+	// methods are hashed (multiplicatively) instead of using their low bits
+	auto getSlot = [](uint32_t key) { return (key * 0x9E3779B1U) >> (32 - StateShadow::s_numEntriesLog2); };
+
+	// Check whether every method write matches its last known value
+	bool redundant = true;
+	bool supported = ForEachStateWrite(words, numWords, [&](uint32_t key, uint32_t value)
+	{
+		uint32_t slot = getSlot(key);
+		if (m_stateShadow->m_keys[slot] != (key | StateShadow::s_validBit) || m_stateShadow->m_values[slot] != value)
+			redundant = false;
+	});
+
+	if (!supported)
+	{
+		// We don't know what these commands do - forget everything
+		invalidateStateShadow();
+		return false;
+	}
+
+	if (redundant)
+		return true;
+
+	// Record the new values
+	ForEachStateWrite(words, numWords, [&](uint32_t key, uint32_t value)
+	{
+		uint32_t slot = getSlot(key);
+		m_stateShadow->m_keys[slot] = key | StateShadow::s_validBit;
+		m_stateShadow->m_values[slot] = value;
+	});
+
+	return false;
+}
+
 bool CmdBuf::appendRawGpfifoEntry(DkGpuAddr iova, uint32_t numCmds, uint32_t flags)
 {
 	if (m_ctrlGpfifo)
@@ -202,30 +641,28 @@ CtrlCmdHeader* CmdBuf::appendCtrlCmd(size_t size)
 		ret = static_cast<CtrlCmdHeader*>(m_ctrlPos);
 	else
 	{
-		// Calculate minimum required size for the chunk
-		size_t reqSize = size + s_reservedCtrlMem;
-		if (reqSize < s_ctrlChunkSize)
-			reqSize = s_ctrlChunkSize;
-
-		// Try to find a big enough chunk in the list of free chunks
+		// Calculate the size class of the chunk
+		unsigned sizeClass = CtrlMemPool::getSizeClass(size + s_reservedCtrlMem);
 		CtrlMemChunk* chunk = nullptr;
-		CtrlMemChunk** prevNext = &m_ctrlChunkFree;
-		for (chunk = *prevNext; chunk; prevNext = &chunk->m_next, chunk = *prevNext)
+		if (sizeClass >= CtrlMemPool::s_numSizeClasses)
 		{
-			if (chunk->m_size >= reqSize)
-			{
-				// Found a suitable chunk - pop it off the list
-				*prevNext = chunk->m_next;
-				break;
-			}
+			// Too big for any size class: allocate a chunk just for this command
+			chunk = getDevice()->getCtrlMemPool().allocChunkOfSize(size + s_reservedCtrlMem);
 		}
-
-		// If above didn't give us a chunk, we need to create a new one
-		if (!chunk)
+		else if (m_ctrlChunkFree[sizeClass])
+		{
+			// Pop a chunk off the list of free chunks of this size class
+			chunk = m_ctrlChunkFree[sizeClass];
+			m_ctrlChunkFree[sizeClass] = chunk->m_next;
+		}
+		else
 		{
-			chunk = static_cast<CtrlMemChunk*>(allocMem(sizeof(CtrlMemChunk)+reqSize));
-			if (chunk) // above already errored out if this failed
-				chunk->m_size = reqSize;
+			// Otherwise get one from the device, or create a new one
+			auto& pool = getDevice()->getCtrlMemPool();
+			if (m_useSharedCtrlMemPool)
+				chunk = pool.acquireChunk(sizeClass);
+			else
+				chunk = pool.allocChunk(sizeClass);
 		}
 
 		// Make the chunk's memory available and add it to the list of used chunks
@@ -259,8 +696,16 @@ CtrlCmdHeader* CmdBuf::appendCtrlCmd(size_t size)
 DkCmdBuf dkCmdBufCreate(DkCmdBufMaker const* maker)
 {
 	DK_ENTRYPOINT(maker->device);
+	DK_DEBUG_BAD_FLAGS(maker->flags &~ (DkCmdBufFlags_FilterRedundantState | DkCmdBufFlags_SharedCtrlMemPool | DkCmdBufFlags_OptimizeCaptures | DkCmdBufFlags_FullVtxStateRebind), "unsupported flags");
+
+	size_t extraSize = 0;
+	if (maker->flags & DkCmdBufFlags_FilterRedundantState)
+		extraSize += sizeof(CmdBuf::StateShadow);
+
 	DkCmdBuf obj = nullptr;
-	obj = new(maker->device) CmdBuf(*maker);
+	obj = new(maker->device, extraSize) CmdBuf(*maker);
+	if (obj && extraSize)
+		obj->enableStateShadow(new(obj+1) CmdBuf::StateShadow);
 	return obj;
 }
 
@@ -296,6 +741,13 @@ void dkCmdBufClear(DkCmdBuf obj)
 	obj->clear();
 }
 
+void dkCmdBufRecycleMemory(DkCmdBuf obj, DkFence const* fence)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_BAD_STATE(obj->isCapturing(), "illegal operation during command capture");
+	obj->recycleMemory(fence);
+}
+
 void dkCmdBufBeginCaptureCmds(DkCmdBuf obj, uint32_t* storage, uint32_t max_words)
 {
 	DK_ENTRYPOINT(obj);
@@ -312,6 +764,13 @@ uint32_t dkCmdBufEndCaptureCmds(DkCmdBuf obj)
 	return obj->endCapture();
 }
 
+uint32_t dkCmdBufOptimizeCapturedCmds(DkCmdBuf obj, uint32_t* words, uint32_t num_words)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL_ARRAY(words, num_words);
+	return CmdBuf::optimizeCmds((CmdWord*)words, num_words);
+}
+
 void dkCmdBufReplayCmds(DkCmdBuf obj, const uint32_t* words, uint32_t num_words)
 {
 	DK_ENTRYPOINT(obj);
@@ -322,6 +781,70 @@ void dkCmdBufReplayCmds(DkCmdBuf obj, const uint32_t* words, uint32_t num_words)
 	CmdBufWriter w{obj};
 	w.reserve(num_words);
 	w.addRawData(words, num_words*4);
+	obj->invalidateStateShadow();
+}
+
+void dkCmdBufBeginCaptureCmdsToMemBlock(DkCmdBuf obj, DkMemBlock mem, uint32_t offset, uint32_t max_words)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL(mem);
+	DK_DEBUG_NON_ZERO(max_words);
+	DK_DEBUG_DATA_ALIGN(offset, DK_CMDMEM_ALIGNMENT);
+	DK_DEBUG_BAD_INPUT(offset + uint64_t(max_words)*sizeof(CmdWord) > mem->getSize(), "capture storage out of bounds");
+	DK_DEBUG_BAD_FLAGS(mem->isGpuNoAccess() || !mem->isCpuUncached(), "DkMemBlock must be created with DkMemBlockFlags_CpuUncached and DkMemBlockFlags_GpuCached");
+	DK_DEBUG_BAD_STATE(obj->isCapturing(), "command capture already active");
+	obj->beginCapture((uint32_t*)((char*)mem->getCpuAddr() + offset), max_words);
+}
+
+void dkCmdBufReplayCmdsFromMemBlock(DkCmdBuf obj, DkMemBlock mem, uint32_t offset, uint32_t num_words)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL(mem);
+	DK_DEBUG_DATA_ALIGN(offset, DK_CMDMEM_ALIGNMENT);
+	DK_DEBUG_BAD_INPUT(offset + uint64_t(num_words)*sizeof(CmdWord) > mem->getSize(), "replayed commands out of bounds");
+	DK_DEBUG_BAD_FLAGS(mem->isGpuNoAccess(), "DkMemBlock must be GPU accessible");
+	DK_DEBUG_BAD_INPUT(num_words > CmdBuf::s_maxGpfifoEntryWords, "too many commands to replay at once");
+	DK_DEBUG_BAD_STATE(obj->isCapturing(), "illegal operation during command capture");
+	if (!num_words)
+		return;
+
+	obj->replayRawCmds(mem->getGpuAddrPitch() + offset, num_words);
+}
+
+void dkCmdBufReplayCmdsAtGpuAddr(DkCmdBuf obj, DkGpuAddr addr, uint32_t num_words)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_DATA_ALIGN(addr, DK_CMDMEM_ALIGNMENT);
+	DK_DEBUG_BAD_INPUT(num_words > CmdBuf::s_maxGpfifoEntryWords, "too many commands to replay at once");
+	DK_DEBUG_BAD_STATE(obj->isCapturing(), "illegal operation during command capture");
+	if (!num_words)
+		return;
+
+	obj->replayRawCmds(addr, num_words);
+}
+
+size_t dkCmdBufGetCompiledListSize(DkCmdBuf obj, DkCmdList list)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL(list);
+	return CmdBuf::compileList(list, nullptr);
+}
+
+DkCmdList dkCmdBufCompileList(DkCmdBuf obj, DkCmdList list, void* storage, size_t storageSize)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL(list);
+	DK_DEBUG_NON_NULL(storage);
+	DK_DEBUG_DATA_ALIGN(storage, alignof(CtrlCmdHeader));
+
+	if (CmdBuf::compileList(list, nullptr) > storageSize)
+	{
+		DK_ERROR(DkResult_OutOfMemory, "not enough storage for the compiled command list");
+		return 0;
+	}
+
+	CmdBuf::compileList(list, storage);
+	return DkCmdList(storage);
 }
 
 void dkCmdBufCallList(DkCmdBuf obj, DkCmdList list)
@@ -335,6 +858,9 @@ void dkCmdBufCallList(DkCmdBuf obj, DkCmdList list)
 		cmd->type = CtrlCmdHeader::Call;
 		cmd->ptr = reinterpret_cast<CtrlCmdHeader const*>(list);
 	}
+
+	// The called list may have changed any state
+	obj->invalidateStateShadow();
 }
 
 void dkCmdBufWaitFence(DkCmdBuf obj, DkFence* fence)
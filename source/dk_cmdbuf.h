@@ -2,6 +2,8 @@
 #include "dk_private.h"
 #include "dk_memblock.h"
 #include "dk_ctrlcmd.h"
+#include "dk_cmdarena.h"
+#include "ctrlmempool.h"
 #include "maxwell/command.h"
 
 namespace dk::detail
@@ -14,27 +16,51 @@ class CmdBuf : public ObjBase
 {
 	template <bool> friend class CmdBufWriter;
 
-	struct CtrlMemChunk
+	static constexpr auto s_reservedCtrlMem = sizeof(CtrlCmdJumpCall);
+
+public:
+	// Maximum length of a single gpfifo entry (21-bit word count)
+	static constexpr uint32_t s_maxGpfifoEntryWords = 0x1FFFFF;
+
+	// Direct-mapped cache of the last known values of 3D engine methods,
+	// used by DkCmdBufFlags_FilterRedundantState to drop redundant writes.
+	struct StateShadow
 	{
-		CtrlMemChunk *m_next;
-		size_t m_size;
+		static constexpr unsigned s_numEntriesLog2 = 7;
+		static constexpr unsigned s_numEntries = 1U << s_numEntriesLog2;
+		static constexpr uint32_t s_validBit = 1U << 31;
+		uint32_t m_keys[s_numEntries];
+		uint32_t m_values[s_numEntries];
+
+		void* operator new(size_t size, void* p) noexcept { return p; }
+		void operator delete(void* ptr, void* p) noexcept { }
 	};
 
-	static constexpr size_t s_ctrlChunkSize = 1024 - sizeof(CtrlMemChunk);
-	static constexpr auto s_reservedCtrlMem = sizeof(CtrlCmdJumpCall);
-
+private:
 	void* m_userData;
 	DkCmdBufAddMemFunc m_cbAddMem;
+	DkCmdArena m_arena;
+	uint32_t m_arenaChunks;
 
 	uint32_t m_numReservedWords;
 	bool m_hasFlushFunc;
 	bool m_isCapturing;
+	bool m_allowCaptureOverflow;
+	bool m_captureOverflowed;
+	bool m_useSharedCtrlMemPool;
+	bool m_optimizeCaptures;
+	bool m_fullVtxStateRebind;
+	uint8_t m_numVtxAttribs; // Vertex attribute/buffer slots possibly enabled by previous binds
+	uint8_t m_numVtxBuffers;
+	StateShadow* m_stateShadow;
+	maxwell::CmdWord* m_captureScratch;
 
 	union
 	{
 		struct
 		{
-			CtrlMemChunk *m_ctrlChunkCur, *m_ctrlChunkFree;
+			CtrlMemChunk *m_ctrlChunkCur;
+			CtrlMemChunk *m_ctrlChunkFree[CtrlMemPool::s_numSizeClasses];
 		};
 		struct
 		{
@@ -48,7 +74,13 @@ class CmdBuf : public ObjBase
 	maxwell::CmdWord *m_cmdChunkStart, *m_cmdStart, *m_cmdPos, *m_cmdEnd;
 public:
 	constexpr CmdBuf(DkCmdBufMaker const& maker, uint32_t rw = 0) noexcept : ObjBase{maker.device},
-		m_userData{maker.userData}, m_cbAddMem{maker.cbAddMem}, m_numReservedWords{rw}, m_hasFlushFunc{false}, m_isCapturing{false},
+		m_userData{maker.userData}, m_cbAddMem{maker.cbAddMem}, m_arena{maker.arena}, m_arenaChunks{CmdArena::s_invalidChunk},
+		m_numReservedWords{rw}, m_hasFlushFunc{false}, m_isCapturing{false},
+		m_allowCaptureOverflow{false}, m_captureOverflowed{false},
+		m_useSharedCtrlMemPool{(maker.flags & DkCmdBufFlags_SharedCtrlMemPool) != 0},
+		m_optimizeCaptures{(maker.flags & DkCmdBufFlags_OptimizeCaptures) != 0},
+		m_fullVtxStateRebind{(maker.flags & DkCmdBufFlags_FullVtxStateRebind) != 0},
+		m_numVtxAttribs{DK_MAX_VERTEX_ATTRIBS}, m_numVtxBuffers{DK_MAX_VERTEX_BUFFERS}, m_stateShadow{}, m_captureScratch{},
 		m_ctrlChunkCur{}, m_ctrlChunkFree{}, m_ctrlGpfifo{}, m_ctrlStart{}, m_ctrlPos{}, m_ctrlEnd{},
 		m_cmdChunkStartIova{}, m_cmdStartIova{}, m_cmdChunkStart{}, m_cmdStart{}, m_cmdPos{}, m_cmdEnd{} { }
 	~CmdBuf();
@@ -64,6 +96,20 @@ public:
 		m_ctrlEnd = (char*)m_ctrlPos + maxEntries*sizeof(CtrlCmdGpfifoEntry);
 	}
 
+	void enableStateShadow(StateShadow* shadow)
+	{
+		m_stateShadow = shadow;
+		invalidateStateShadow();
+	}
+
+	void invalidateStateShadow()
+	{
+		m_numVtxAttribs = DK_MAX_VERTEX_ATTRIBS;
+		m_numVtxBuffers = DK_MAX_VERTEX_BUFFERS;
+		if (m_stateShadow)
+			memset(m_stateShadow->m_keys, 0, sizeof(m_stateShadow->m_keys));
+	}
+
 	void unlockReservedWords()
 	{
 		m_cmdEnd += m_numReservedWords;
@@ -72,16 +118,40 @@ public:
 	void addMemory(DkMemBlock mem, uint32_t offset, uint32_t size);
 	DkCmdList finishList();
 	void clear();
+	void recycleMemory(DkFence const* fence);
 
-	void beginCapture(uint32_t* storage, uint32_t max_words);
+	// With allowOverflow, commands that don't fit are discarded instead of raising an error
+	void beginCapture(uint32_t* storage, uint32_t max_words, bool allowOverflow = false);
 	uint32_t endCapture();
+	void replayRawCmds(DkGpuAddr iova, uint32_t numWords);
+	static uint32_t optimizeCmds(maxwell::CmdWord* words, uint32_t numWords);
+	static size_t compileList(DkCmdList list, void* storage);
 
 	constexpr bool isDirty() const noexcept { return m_cmdStart != m_cmdPos; }
 	constexpr bool isCapturing() const noexcept { return m_isCapturing; }
+	constexpr bool hasCaptureOverflowed() const noexcept { return m_captureOverflowed; }
+
+	// Returns the number of slots that may still be enabled by a previous bind, and records the new count
+	uint32_t swapNumVtxAttribs(uint32_t num) noexcept
+	{
+		uint32_t prev = m_numVtxAttribs;
+		if (!m_fullVtxStateRebind)
+			m_numVtxAttribs = num;
+		return prev;
+	}
+
+	uint32_t swapNumVtxBuffers(uint32_t num) noexcept
+	{
+		uint32_t prev = m_numVtxBuffers;
+		if (!m_fullVtxStateRebind)
+			m_numVtxBuffers = num;
+		return prev;
+	}
 	constexpr uint32_t getCmdOffset() const noexcept { return uint32_t((char*)(void*)m_cmdPos - (char*)(void*)m_cmdChunkStart); }
 	constexpr size_t getCtrlSpaceFree() const noexcept { return size_t((char*)(void*)m_ctrlEnd-(char*)(void*)m_ctrlPos); }
 	maxwell::CmdWord* requestCmdMem(uint32_t size);
 	CtrlCmdHeader* appendCtrlCmd(size_t size);
+	bool filterState(maxwell::CmdWord const* words, uint32_t numWords);
 
 	bool appendRawGpfifoEntry(DkGpuAddr iova, uint32_t numCmds, uint32_t flags);
 	void signOffGpfifoEntry(uint32_t flags = CtrlCmdGpfifoEntry::AutoKick)
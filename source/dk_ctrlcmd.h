@@ -74,4 +74,72 @@ struct CtrlCmdComputeDispatch : public CtrlCmdHeader
 	uint32_t numGroupsZ;
 };
 
+// Maximum nesting level of called command lists
+constexpr unsigned s_maxCtrlCallDepth = 32;
+
+// Returns the size of a command that is neither a control flow command nor a gpfifo list,
+// or zero if the command is not recognized.
+constexpr size_t GetCtrlCmdSize(CtrlCmdHeader const* cmd)
+{
+	switch (cmd->type)
+	{
+		default:
+			return 0;
+		case CtrlCmdHeader::WaitFence:
+		case CtrlCmdHeader::SignalFence:
+			return sizeof(CtrlCmdFence);
+		case CtrlCmdHeader::ComputeBindShader:
+			return sizeof(CtrlCmdComputeShader);
+		case CtrlCmdHeader::ComputeBindBuffer:
+		case CtrlCmdHeader::ComputeDispatchIndirect:
+			return sizeof(CtrlCmdComputeAddress);
+		case CtrlCmdHeader::ComputeBindHandle:
+			return sizeof(CtrlCmdHeader);
+		case CtrlCmdHeader::ComputeDispatch:
+			return sizeof(CtrlCmdComputeDispatch);
+	}
+}
+
+// Walks a control command list, following jumps and calls (using a bounded explicit stack),
+// and hands every other command to the given function. The function returns the command that
+// follows the processed one, or nullptr in order to return from the current list.
+template <typename Func>
+void WalkCtrlCmds(CtrlCmdHeader const* cur, Func&& func)
+{
+	CtrlCmdHeader const* stack[s_maxCtrlCallDepth];
+	unsigned depth = 0;
+	while (cur)
+	{
+		CtrlCmdHeader const* next;
+		switch (cur->type)
+		{
+			case CtrlCmdHeader::Return:
+				next = nullptr;
+				break;
+			case CtrlCmdHeader::Jump:
+				next = static_cast<CtrlCmdJumpCall const*>(cur)->ptr;
+				break;
+			case CtrlCmdHeader::Call:
+			{
+				auto* cmd = static_cast<CtrlCmdJumpCall const*>(cur);
+				if (depth == s_maxCtrlCallDepth)
+				{
+					DK_ERROR(DkResult_BadState, "command lists nested too deeply");
+					return;
+				}
+				stack[depth++] = cmd+1;
+				next = cmd->ptr;
+				break;
+			}
+			default:
+				next = func(cur);
+				break;
+		}
+
+		if (!next && depth)
+			next = stack[--depth];
+		cur = next;
+	}
+}
+
 }
@@ -120,13 +120,14 @@ Device::~Device()
 	if (!m_didLibInit) return;
 
 #ifdef DEBUG
-	for (uint32_t i = 0; i < s_numQueues; i ++)
-		if (m_queueTable[i])
+	for (uint32_t i = 0; i < s_usedQueueBitmapSize; i ++)
+		if (m_usedQueues[i])
 			DK_ERROR(DkResult_BadState, "unfreed queues");
 #endif
 
 	m_semaphoreMem.destroy(); // must do this before NvLib is wound down
 	m_codeSeg.cleanup();
+	m_ctrlMemPool.cleanup();
 	nvAddressSpaceClose(&m_addrSpace); // does nothing if uninitialized
 	nvLibExit();
 }
@@ -150,8 +151,25 @@ int32_t Device::reserveQueueId()
 void Device::returnQueueId(uint32_t id)
 {
 	MutexHolder m{m_queueTableMutex};
-	m_queueTable[id] = nullptr;
-	m_usedQueues[id/32] &= ~(1U << (id & 0x3F));
+	m_usedQueues[id/32] &= ~(1U << (id & 0x1F));
+}
+
+void Device::registerQueue(uint32_t id, DkQueue queue)
+{
+	__atomic_store_n(&m_queueTable[id], queue, __ATOMIC_SEQ_CST);
+	__atomic_or_fetch(&m_liveQueues[id/32], 1U << (id & 0x1F), __ATOMIC_SEQ_CST);
+}
+
+void Device::unregisterQueue(uint32_t id)
+{
+	__atomic_and_fetch(&m_liveQueues[id/32], ~(1U << (id & 0x1F)), __ATOMIC_SEQ_CST);
+	__atomic_store_n(&m_queueTable[id], nullptr, __ATOMIC_SEQ_CST);
+
+	// Error checks that found the queue before it was removed may still be using it.
+	// Only checks of this very queue are waited on, and those finish quickly: checks
+	// that start from now on see an empty slot
+	while (__atomic_load_n(&m_queueRefs[id], __ATOMIC_SEQ_CST))
+		svcSleepThread(0);
 }
 
 void* Device::allocMem(size_t size, size_t alignment) const noexcept
@@ -208,13 +226,14 @@ void ObjBase::operator delete(void* ptr)
 
 void dk::detail::SetContextForDebug(Device const* dev, const char* funcname)
 {
-	g_debugContext.maker = &dev->getMaker();
+	g_debugContext.maker = dev ? &dev->getMaker() : nullptr;
 	g_debugContext.funcname = funcname;
 }
 
 void dk::detail::RaiseError(DkResult result, const char* message)
 {
-	InvokeDebugCallback(*g_debugContext.maker, g_debugContext.funcname, result, message);
+	if (g_debugContext.maker)
+		InvokeDebugCallback(*g_debugContext.maker, g_debugContext.funcname, result, message);
 	// If above returns, just fall back on the default debug callback
 	defaultDebugFunc(nullptr, g_debugContext.funcname, result, message);
 	__builtin_trap();
@@ -229,7 +248,10 @@ void dk::detail::WarningMsg(const char* fmt, ...)
 	vsnprintf(message, sizeof(message), fmt, va);
 	va_end(va);
 
-	InvokeDebugCallback(*g_debugContext.maker, g_debugContext.funcname, DkResult_Success, message);
+	if (g_debugContext.maker)
+		InvokeDebugCallback(*g_debugContext.maker, g_debugContext.funcname, DkResult_Success, message);
+	else
+		defaultDebugFunc(nullptr, g_debugContext.funcname, DkResult_Success, message);
 }
 
 #else
@@ -2,6 +2,7 @@
 #include "dk_private.h"
 #include "dk_memblock.h"
 #include "codesegmgr.h"
+#include "ctrlmempool.h"
 
 #ifdef DEBUG
 #define DK_DEVICE_ERROR(_m, _ctx, _res, _msg) \
@@ -61,25 +62,32 @@ class Device
 	GpuInfo m_gpuInfo;
 	bool m_didLibInit;
 
+	// Queue ids are reserved under the mutex, while the queue table itself is read
+	// without locking: live queues are published through a bitmap, and error checks
+	// hold a per-queue reference while looking at a queue, which unregistering waits on
 	Mutex m_queueTableMutex;
 	DkQueue m_queueTable[s_numQueues];
 	uint32_t m_usedQueues[s_usedQueueBitmapSize];
+	uint32_t m_liveQueues[s_usedQueueBitmapSize];
+	uint32_t m_queueRefs[s_numQueues];
 
 	MemBlock m_semaphoreMem;
-	uint32_t m_semaphores[s_numQueues];
+	uint64_t m_semaphores[s_numQueues];
 
 	CodeSegMgr m_codeSeg;
+	CtrlMemPool m_ctrlMemPool;
 
 public:
 
 	constexpr Device(DkDeviceMaker const& m) noexcept :
 		m_maker{m}, m_addrSpace{}, m_gpuInfo{}, m_didLibInit{},
-		m_queueTableMutex{}, m_queueTable{}, m_usedQueues{},
+		m_queueTableMutex{}, m_queueTable{}, m_usedQueues{}, m_liveQueues{}, m_queueRefs{},
 		m_semaphoreMem{this}, m_semaphores{},
-		m_codeSeg{this} { }
+		m_codeSeg{this}, m_ctrlMemPool{this} { }
 	constexpr DkDeviceMaker const& getMaker() const noexcept { return m_maker; }
 	constexpr NvAddressSpace *getAddrSpace() const noexcept { return &m_addrSpace; }
 	constexpr CodeSegMgr &getCodeSeg() noexcept { return m_codeSeg; }
+	constexpr CtrlMemPool &getCtrlMemPool() noexcept { return m_ctrlMemPool; }
 	constexpr GpuInfo const& getGpuInfo() const noexcept { return m_gpuInfo; }
 
 	bool isDepthModeOpenGL() const noexcept { return (m_maker.flags & DkDeviceFlags_DepthMinusOneToOne) != 0; }
@@ -90,10 +98,8 @@ public:
 
 	int32_t reserveQueueId() noexcept;
 	void returnQueueId(uint32_t id) noexcept;
-	void registerQueue(uint32_t id, DkQueue queue) noexcept
-	{
-		m_queueTable[id] = queue;
-	}
+	void registerQueue(uint32_t id, DkQueue queue) noexcept;
+	void unregisterQueue(uint32_t id) noexcept;
 
 	NvLongSemaphore volatile* getSemaphoreCpuAddr(uint32_t id) noexcept
 	{
@@ -105,14 +111,17 @@ public:
 		return m_semaphoreMem.getGpuAddrPitch() + id*sizeof(NvLongSemaphore);
 	}
 
-	uint32_t getSemaphoreValue(uint32_t id) const noexcept
+	// The GPU only stores the lower 32 bits of the (64-bit) semaphore values
+	uint64_t getSemaphoreValue(uint32_t id) const noexcept
 	{
-		return m_semaphores[id];
+		return __atomic_load_n(&m_semaphores[id], __ATOMIC_ACQUIRE);
 	}
 
-	uint32_t incrSemaphoreValue(uint32_t id) noexcept
+	uint64_t incrSemaphoreValue(uint32_t id) noexcept
 	{
-		return ++m_semaphores[id];
+		uint64_t value = m_semaphores[id] + 1;
+		__atomic_store_n(&m_semaphores[id], value, __ATOMIC_RELEASE);
+		return value;
 	}
 
 	void checkQueueErrors() noexcept;
@@ -1,6 +1,84 @@
 #include "dk_fence.h"
 #include "dk_device.h"
 
+using namespace dk::detail;
+
+namespace
+{
+	// Time spent spinning on internal fences before blocking, adapted per thread
+	// depending on whether the previous spins paid off
+	constexpr u64 s_minSpinNs = 1000;   // 1 μs
+	constexpr u64 s_maxSpinNs = 64000;  // 64 μs
+	thread_local u64 g_spinNs = 8000;   // 8 μs
+
+	// Maximum time spent blocking on syncpoints between checks for queue errors
+	constexpr s32 s_maxBlockUs = 1000000; // 1 s
+
+	template <typename Func>
+	bool SpinWait(Func&& poll)
+	{
+		u64 start = armGetSystemTick();
+		do
+		{
+			if (poll())
+			{
+				if (g_spinNs < s_maxSpinNs)
+					g_spinNs *= 2;
+				return true;
+			}
+		} while (armTicksToNs(armGetSystemTick() - start) < g_spinNs);
+
+		if (g_spinNs > s_minSpinNs)
+			g_spinNs /= 2;
+		return false;
+	}
+
+	bool AddToMultiFence(NvMultiFence& mf, NvFence const& fence)
+	{
+		if ((s32)fence.id < 0)
+			return true;
+
+		// Fences on the same syncpoint are merged by keeping the latest value
+		for (u32 i = 0; i < mf.num_fences; i ++)
+		{
+			NvFence& f = mf.fences[i];
+			if (f.id == fence.id)
+			{
+				if ((s32)(fence.value - f.value) > 0)
+					f.value = fence.value;
+				return true;
+			}
+		}
+
+		if (mf.num_fences >= sizeof(mf.fences)/sizeof(mf.fences[0]))
+			return false;
+		mf.fences[mf.num_fences++] = fence;
+		return true;
+	}
+
+	s32 GetRemainingUs(s32 timeout_us, u64 start)
+	{
+		if (timeout_us < 0)
+			return -1;
+		s32 elapsed_us = armTicksToNs(armGetSystemTick() - start) / 1000U;
+		return elapsed_us < timeout_us ? timeout_us - elapsed_us : 0;
+	}
+}
+
+bool DkFence::poll()
+{
+	switch (m_type)
+	{
+		default:
+		case DkFence::Invalid:
+			return false;
+		case DkFence::Internal:
+			return internalPoll();
+		case DkFence::External:
+			return R_SUCCEEDED(nvMultiFenceWait(&m_external.m_fence, 0));
+	}
+}
+
 DkResult DkFence::wait(s32 timeout_us)
 {
 	Result res = 0;
@@ -19,8 +97,12 @@ DkResult DkFence::wait(s32 timeout_us)
 			if (timeout_us == 0)
 				return DkResult_Timeout;
 
+			// Short waits are cheaper to spin on than to block on
+			if ((timeout_us < 0 || u64(timeout_us)*1000 > g_spinNs) && SpinWait([this] { return internalPoll(); }))
+				return DkResult_Success;
+
 			u64 start = armGetSystemTick();
-			do
+			for (;;)
 			{
 				s32 wait_timeout = 100000; // 10^5 μs = 100 ms
 				if (timeout_us >= 0)
@@ -39,7 +121,12 @@ DkResult DkFence::wait(s32 timeout_us)
 				if (R_FAILED(res) && res != MAKERESULT(Module_LibnxNvidia, LibnxNvidiaError_Timeout))
 					break;
 				m_internal.m_device->checkQueueErrors();
-			} while (R_FAILED(res) || !internalPoll());
+
+				// Only the semaphore tells whether the fence is signaled: when a queue fails, the
+				// semaphore is released even though the syncpoint may never reach the fence value
+				if (internalPoll())
+					return DkResult_Success;
+			}
 			break;
 		}
 		case DkFence::External:
@@ -58,6 +145,174 @@ DkResult DkFence::wait(s32 timeout_us)
 	}
 }
 
+DkResult DkFence::waitMany(DkFence* const fences[], uint32_t numFences, bool waitAll, s32 timeout_us)
+{
+	bool anyInternal = false, allInternal = true;
+	auto pollAll = [&]() -> bool
+	{
+		bool anySignaled = false, allSignaled = true;
+		for (uint32_t i = 0; i < numFences; i ++)
+		{
+			if (fences[i]->poll())
+				anySignaled = true;
+			else
+				allSignaled = false;
+		}
+		return waitAll ? allSignaled : anySignaled;
+	};
+
+	// Queues in error state release their semaphores, which may be enough to end the wait.
+	// The fences may come from several devices: check each of them once (checks are cheap
+	// to repeat, since every device rate limits them on its own)
+	auto checkErrors = [&]()
+	{
+		for (uint32_t i = 0; i < numFences; i ++)
+		{
+			DkFence& f = *fences[i];
+			if (f.m_type != DkFence::Internal)
+				continue;
+
+			bool seen = false;
+			for (uint32_t j = 0; !seen && j < i; j ++)
+				seen = fences[j]->m_type == DkFence::Internal && fences[j]->m_internal.m_device == f.m_internal.m_device;
+			if (!seen)
+				f.m_internal.m_device->checkQueueErrors();
+		}
+	};
+
+	for (uint32_t i = 0; i < numFences; i ++)
+	{
+		DkFence& f = *fences[i];
+		if (f.m_type == DkFence::Invalid)
+			return DkResult_Fail;
+		if (f.m_type == DkFence::Internal)
+			anyInternal = true;
+		else
+			allInternal = false;
+	}
+
+	if (pollAll())
+		return DkResult_Success;
+	if (timeout_us == 0)
+		return DkResult_Timeout;
+
+	// Polling external fences involves a syscall, so only spin on internal ones
+	if (allInternal && SpinWait(pollAll))
+		return DkResult_Success;
+
+	u64 start = armGetSystemTick();
+	if (waitAll)
+	{
+		// Merge the syncpoint fences of all pending fences, and wait on them in as few
+		// syscalls as possible (there are at most 4 syncpoints per multi-fence)
+		uint32_t pos = 0;
+		while (pos < numFences)
+		{
+			uint32_t groupStart = pos;
+			NvMultiFence mf = {};
+			for (; pos < numFences; pos ++)
+			{
+				DkFence& f = *fences[pos];
+				if (f.poll())
+					continue;
+
+				NvMultiFence saved = mf;
+				bool fits = true;
+				if (f.m_type == DkFence::Internal)
+					fits = AddToMultiFence(mf, f.m_internal.m_fence);
+				else
+				{
+					for (u32 j = 0; fits && j < f.m_external.m_fence.num_fences; j ++)
+						fits = AddToMultiFence(mf, f.m_external.m_fence.fences[j]);
+				}
+				if (!fits)
+				{
+					mf = saved;
+					break;
+				}
+			}
+
+			if (!mf.num_fences)
+				continue;
+
+			Result res;
+			for (;;)
+			{
+				// Block in long slices, only so that queues entering error state are noticed
+				s32 remaining_us = GetRemainingUs(timeout_us, start);
+				s32 slice_us = (remaining_us < 0 || remaining_us > s_maxBlockUs) ? s_maxBlockUs : remaining_us;
+				res = nvMultiFenceWait(&mf, slice_us);
+				if (res != MAKERESULT(Module_LibnxNvidia, LibnxNvidiaError_Timeout) || slice_us == remaining_us)
+					break;
+
+				if (anyInternal)
+					checkErrors();
+
+				bool groupSignaled = true;
+				for (uint32_t i = groupStart; groupSignaled && i < pos; i ++)
+					groupSignaled = fences[i]->poll();
+				if (groupSignaled)
+				{
+					res = 0;
+					break;
+				}
+			}
+
+			if (R_FAILED(res))
+				break;
+		}
+	}
+	else
+	{
+		// There is no way to block on any of several syncpoints, so back off between polls
+		s64 sleep_ns = 10000; // 10 μs
+		for (;;)
+		{
+			s32 remaining_us = GetRemainingUs(timeout_us, start);
+			if (remaining_us == 0)
+				break;
+			svcSleepThread(sleep_ns);
+			if (sleep_ns < 1000000) // 1 ms
+				sleep_ns *= 2;
+			if (pollAll())
+				return DkResult_Success;
+			if (anyInternal)
+			{
+				checkErrors();
+				if (pollAll())
+					return DkResult_Success;
+			}
+		}
+	}
+
+	// The semaphore release of an internal fence happens shortly after its syncpoint
+	// increment, so wait for the stragglers (normally this does not block)
+	if (waitAll)
+	{
+		for (uint32_t i = 0; i < numFences; i ++)
+		{
+			DkFence& f = *fences[i];
+			if (f.m_type != DkFence::Internal || f.internalPoll())
+				continue;
+			s32 remaining_us = GetRemainingUs(timeout_us, start);
+			if (remaining_us == 0 || f.wait(remaining_us) != DkResult_Success)
+				break;
+		}
+	}
+
+	if (pollAll())
+		return DkResult_Success;
+
+	if (anyInternal)
+	{
+		checkErrors();
+		if (pollAll())
+			return DkResult_Success;
+	}
+
+	return GetRemainingUs(timeout_us, start) == 0 ? DkResult_Timeout : DkResult_Fail;
+}
+
 DkResult dkFenceWait(DkFence* obj, int64_t timeout_ns)
 {
 	if (obj->m_type == DkFence::Internal)
@@ -68,3 +323,29 @@ DkResult dkFenceWait(DkFence* obj, int64_t timeout_ns)
 		timeout_us = timeout_ns / 1000;
 	return obj->wait(timeout_us);
 }
+
+DkResult dkFenceWaitMany(DkFence* const fences[], uint32_t numFences, bool waitAll, int64_t timeout_ns)
+{
+	// Validate the array before looking into the fences: until a device is known,
+	// errors are reported through the default debug callback
+	DK_ENTRYPOINT(static_cast<DkDevice>(nullptr));
+	DK_DEBUG_NON_NULL_ARRAY(fences, numFences);
+	for (uint32_t i = 0; i < numFences; i ++)
+		DK_DEBUG_NON_NULL(fences[i]);
+	if (!numFences)
+		return DkResult_Success;
+
+	for (uint32_t i = 0; i < numFences; i ++)
+	{
+		if (fences[i]->m_type == DkFence::Internal)
+		{
+			DK_ENTRYPOINT(fences[i]->m_internal.m_device);
+			break;
+		}
+	}
+
+	s32 timeout_us = -1;
+	if (timeout_ns >= 0)
+		timeout_us = timeout_ns / 1000;
+	return DkFence::waitMany(fences, numFences, waitAll, timeout_us);
+}
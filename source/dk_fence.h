@@ -41,7 +41,9 @@ struct Fence
 		return (int32_t)(*m_internal.m_semaphoreCpuAddr - m_internal.m_semaphoreValue) >= 0;
 	}
 
+	bool poll();
 	DkResult wait(s32 timeout_us = -1);
+	static DkResult waitMany(Fence* const fences[], uint32_t numFences, bool waitAll, s32 timeout_us);
 };
 
 }
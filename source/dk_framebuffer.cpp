@@ -0,0 +1,55 @@
+#include "dk_framebuffer.h"
+#include "dk_cmdbuf.h"
+#include "cmdbuf_writer.h"
+
+using namespace maxwell;
+using namespace dk::detail;
+
+void Framebuffer::compile(DkFramebufferMaker const& maker)
+{
+	// Record the commands emitted by the regular bind function
+	DkCmdBufMaker cmdBufMaker;
+	dkCmdBufMakerDefaults(&cmdBufMaker, getDevice());
+	cmdBufMaker.flags = DkCmdBufFlags_OptimizeCaptures;
+	CmdBuf cmdbuf{cmdBufMaker};
+
+	cmdbuf.beginCapture(reinterpret_cast<uint32_t*>(m_words), s_maxWords);
+	dkCmdBufBindRenderTargets(&cmdbuf, maker.colorTargets, maker.numColorTargets, maker.depthTarget);
+	m_numWords = cmdbuf.endCapture();
+}
+
+void Framebuffer::bind(DkCmdBuf cmdbuf) const
+{
+	CmdBufWriter w{cmdbuf};
+	w.reserve(m_numWords);
+	w.addRawData(m_words, m_numWords*sizeof(CmdWord));
+}
+
+DkFramebuffer dkFramebufferCreate(DkFramebufferMaker const* maker)
+{
+	DK_ENTRYPOINT(maker->device);
+	DK_DEBUG_BAD_INPUT(maker->numColorTargets > DK_MAX_RENDER_TARGETS);
+	DK_DEBUG_NON_NULL_ARRAY(maker->colorTargets, maker->numColorTargets);
+
+	DkFramebuffer obj = nullptr;
+	obj = new(maker->device) Framebuffer(maker->device);
+	if (obj)
+	{
+		obj->compile(*maker);
+		DK_ENTRYPOINT(maker->device);
+	}
+	return obj;
+}
+
+void dkFramebufferDestroy(DkFramebuffer obj)
+{
+	DK_ENTRYPOINT(obj);
+	delete obj;
+}
+
+void dkCmdBufBindFramebuffer(DkCmdBuf obj, DkFramebuffer framebuffer)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL(framebuffer);
+	framebuffer->bind(obj);
+}
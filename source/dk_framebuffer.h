@@ -0,0 +1,25 @@
+#pragma once
+#include "dk_private.h"
+#include "maxwell/command.h"
+
+namespace dk::detail
+{
+
+// Render target configuration compiled into ready-to-replay commands, so that
+// binding it doesn't need to recalculate image and zcull parameters every time.
+class Framebuffer : public ObjBase
+{
+	// Same as the worst case reserved by dkCmdBufBindRenderTargets
+	static constexpr uint32_t s_maxWords = 2 + DK_MAX_RENDER_TARGETS*9 + 12+14 + 4;
+
+	uint32_t m_numWords;
+	maxwell::CmdWord m_words[s_maxWords];
+
+public:
+	Framebuffer(DkDevice dev) noexcept : ObjBase{dev}, m_numWords{}, m_words{} { }
+
+	void compile(DkFramebufferMaker const& maker) noexcept;
+	void bind(DkCmdBuf cmdbuf) const noexcept;
+};
+
+}
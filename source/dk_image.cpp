@@ -55,44 +55,52 @@ namespace
 	}
 }
 
-uint64_t DkImageLayout::calcLevelOffset(unsigned level) const
+uint64_t DkImageLayout::calcLevelSize(unsigned level) const
 {
 	uint32_t tileWidth  = 64 / m_bytesPerBlock; // non-sparse tile width is always zero
 	uint32_t tileHeight = 8 << m_tileH;
 	uint32_t tileDepth  = 1 << m_tileD;
 
-	u64 offset = 0;
-	for (unsigned i = 0; i < level; i ++)
-	{
-		uint32_t levelWidth  = adjustSize(m_dimensions[0]*m_samplesX, i, m_blockW);
-		uint32_t levelHeight = m_dimsPerLayer>=2 ? adjustSize(m_dimensions[1]*m_samplesY, i, m_blockH) : 1;
-		uint32_t levelDepth  = m_dimsPerLayer>=3 ? adjustMipSize(m_dimensions[2], i) : 1;
-		uint32_t levelWidthBytes = levelWidth << m_bytesPerBlockLog2;
-
-		uint32_t levelTileWShift = adjustTileSize(0,       64, levelWidthBytes); // non-sparse tile width is always zero
-		uint32_t levelTileHShift = adjustTileSize(m_tileH, 8,  levelHeight);
-		uint32_t levelTileDShift = adjustTileSize(m_tileD, 1,  levelDepth);
-		uint32_t levelTileWGobs  = 1U << levelTileWShift;
-		uint32_t levelTileHGobs  = 1U << levelTileHShift;
-		uint32_t levelTileD      = 1U << levelTileDShift;
-
-		uint32_t levelWidthGobs = (levelWidthBytes + 63) / 64;
-		uint32_t levelHeightGobs = (levelHeight + 7) / 8;
-
-		uint32_t levelWidthTiles = (levelWidthGobs + levelTileWGobs - 1) >> levelTileWShift;
-		uint32_t levelHeightTiles = (levelHeightGobs + levelTileHGobs - 1) >> levelTileHShift;
-		uint32_t levelDepthTiles = (levelDepth + levelTileD - 1) >> levelTileDShift;
-
-		if (m_tileW && tileWidth <= levelWidth && tileHeight <= levelHeight && tileDepth <= levelDepth)
-		{
-			// For sparse images, we need to align the width using the sparse tile width.
-			uint32_t align = 1U << m_tileW;
-			levelWidthTiles = (levelWidthTiles + align - 1) &~ (align - 1);
-		}
+	uint32_t levelWidth  = adjustSize(m_dimensions[0]*m_samplesX, level, m_blockW);
+	uint32_t levelHeight = m_dimsPerLayer>=2 ? adjustSize(m_dimensions[1]*m_samplesY, level, m_blockH) : 1;
+	uint32_t levelDepth  = m_dimsPerLayer>=3 ? adjustMipSize(m_dimensions[2], level) : 1;
+	uint32_t levelWidthBytes = levelWidth << m_bytesPerBlockLog2;
 
-		offset += uint64_t(levelWidthTiles*levelHeightTiles*levelDepthTiles) << (9 + levelTileWShift + levelTileHShift + levelTileDShift);
+	uint32_t levelTileWShift = adjustTileSize(0,       64, levelWidthBytes); // non-sparse tile width is always zero
+	uint32_t levelTileHShift = adjustTileSize(m_tileH, 8,  levelHeight);
+	uint32_t levelTileDShift = adjustTileSize(m_tileD, 1,  levelDepth);
+	uint32_t levelTileWGobs  = 1U << levelTileWShift;
+	uint32_t levelTileHGobs  = 1U << levelTileHShift;
+	uint32_t levelTileD      = 1U << levelTileDShift;
+
+	uint32_t levelWidthGobs = (levelWidthBytes + 63) / 64;
+	uint32_t levelHeightGobs = (levelHeight + 7) / 8;
+
+	uint32_t levelWidthTiles = (levelWidthGobs + levelTileWGobs - 1) >> levelTileWShift;
+	uint32_t levelHeightTiles = (levelHeightGobs + levelTileHGobs - 1) >> levelTileHShift;
+	uint32_t levelDepthTiles = (levelDepth + levelTileD - 1) >> levelTileDShift;
+
+	if (m_tileW && tileWidth <= levelWidth && tileHeight <= levelHeight && tileDepth <= levelDepth)
+	{
+		// For sparse images, we need to align the width using the sparse tile width.
+		uint32_t align = 1U << m_tileW;
+		levelWidthTiles = (levelWidthTiles + align - 1) &~ (align - 1);
 	}
 
+	return uint64_t(levelWidthTiles*levelHeightTiles*levelDepthTiles) << (9 + levelTileWShift + levelTileHShift + levelTileDShift);
+}
+
+uint64_t DkImageLayout::calcLevelOffset(unsigned level) const
+{
+	if (!level)
+		return 0;
+
+	// Start from the closest precalculated level, only the smallest levels need to be walked
+	unsigned i = level <= s_numCachedLevels ? level : s_numCachedLevels;
+	u64 offset = u64(m_levelOffsets[i-1]) << 9;
+	for (; i < level; i ++)
+		offset += calcLevelSize(i);
+
 	return offset;
 }
 
@@ -440,7 +448,16 @@ void dkImageLayoutInitialize(DkImageLayout* obj, DkImageLayoutMaker const* maker
 		(obj->m_flags & DkImageFlags_HwCompression) != 0,
 		(obj->m_flags & DkImageFlags_Z16EnableZbc) != 0);
 
-	obj->m_layerSize = obj->calcLevelOffset(obj->m_mipLevels);
+	// Calculate the offsets of all levels, caching the ones that fit in the layout
+	u64 offset = 0;
+	for (unsigned i = 0; i < obj->m_mipLevels; i ++)
+	{
+		offset += obj->calcLevelSize(i);
+		if (i < ImageLayout::s_numCachedLevels)
+			obj->m_levelOffsets[i] = offset >> 9;
+	}
+
+	obj->m_layerSize = offset;
 	if (obj->m_hasLayers)
 		obj->m_storageSize = obj->m_dimensions[2] * obj->m_layerSize;
 	else
@@ -8,6 +8,10 @@ namespace dk::detail
 
 struct ImageLayout
 {
+	// Number of mip levels past the first one whose offset is precalculated,
+	// sized to fill up the remaining space in DkImage
+	static constexpr unsigned s_numCachedLevels = 10;
+
 	DkImageType m_type;
 	uint32_t m_flags;
 	DkImageFormat m_format;
@@ -27,7 +31,9 @@ struct ImageLayout
 	uint64_t m_layerSize;
 	uint32_t m_alignment;
 	uint32_t m_stride; // {for pitch-linear only}
+	uint32_t m_levelOffsets[s_numCachedLevels]; // {for block-linear only} in units of 512 bytes (one gob)
 
+	uint64_t calcLevelSize(unsigned level) const;
 	uint64_t calcLevelOffset(unsigned level) const;
 };
 
@@ -0,0 +1,140 @@
+#include "dk_pipeline.h"
+#include "dk_device.h"
+#include "dk_cmdbuf.h"
+#include "cmdbuf_writer.h"
+
+using namespace maxwell;
+using namespace dk::detail;
+
+Pipeline::Pipeline(DkDevice dev, uint32_t segmentMask, uint32_t const segmentOffsets[], CmdWord const* words) :
+	ObjBase{dev}, m_segmentMask{segmentMask}, m_segmentOffsets{}
+{
+	memcpy(m_segmentOffsets, segmentOffsets, sizeof(m_segmentOffsets));
+	memcpy(reinterpret_cast<CmdWord*>(this+1), words, getNumWords()*sizeof(CmdWord));
+}
+
+Pipeline* Pipeline::compile(DkPipelineMaker const& maker)
+{
+	// Compile the pipeline into temporary memory first, in order to find out its size
+	CmdWord* words = static_cast<CmdWord*>(maker.device->allocMem(s_maxWords*sizeof(CmdWord)));
+	if (!words)
+		return nullptr;
+
+	// Record the commands emitted by the regular bind functions, one segment at a time
+	DkCmdBufMaker cmdBufMaker;
+	dkCmdBufMakerDefaults(&cmdBufMaker, maker.device);
+	cmdBufMaker.flags = DkCmdBufFlags_OptimizeCaptures;
+	CmdBuf cmdbuf{cmdBufMaker};
+
+	uint32_t numWords = 0;
+	uint32_t segmentMask = 0;
+	uint32_t segmentOffsets[NumSegments+1];
+	segmentOffsets[0] = 0;
+	for (unsigned seg = 0; seg < NumSegments; seg ++)
+	{
+		cmdbuf.beginCapture(reinterpret_cast<uint32_t*>(words + numWords), s_maxWords - numWords, true);
+		switch (seg)
+		{
+			case Shaders:
+				if (maker.stageMask)
+					dkCmdBufBindShaders(&cmdbuf, maker.stageMask, maker.shaders, maker.numShaders);
+				break;
+			case RasterizerState:
+				if (maker.rasterizerState)
+					dkCmdBufBindRasterizerState(&cmdbuf, maker.rasterizerState);
+				break;
+			case ColorState:
+				if (maker.colorState)
+					dkCmdBufBindColorState(&cmdbuf, maker.colorState);
+				break;
+			case ColorWriteState:
+				if (maker.colorWriteState)
+					dkCmdBufBindColorWriteState(&cmdbuf, maker.colorWriteState);
+				break;
+			case BlendStates:
+				if (maker.blendStates)
+					dkCmdBufBindBlendStates(&cmdbuf, 0, maker.blendStates, maker.numBlendStates);
+				break;
+			case DepthStencilState:
+				if (maker.depthStencilState)
+					dkCmdBufBindDepthStencilState(&cmdbuf, maker.depthStencilState);
+				break;
+			case VtxAttribState:
+				if (maker.vtxAttribs)
+					dkCmdBufBindVtxAttribState(&cmdbuf, maker.vtxAttribs, maker.numVtxAttribs);
+				break;
+			case VtxBufferState:
+				if (maker.vtxBuffers)
+					dkCmdBufBindVtxBufferState(&cmdbuf, maker.vtxBuffers, maker.numVtxBuffers);
+				break;
+		}
+
+		uint32_t segWords = cmdbuf.endCapture();
+		if (cmdbuf.hasCaptureOverflowed())
+		{
+			maker.device->freeMem(words);
+			return nullptr;
+		}
+		if (segWords)
+			segmentMask |= 1U << seg;
+		numWords += segWords;
+		segmentOffsets[seg+1] = numWords;
+	}
+
+	Pipeline* obj = new(maker.device, numWords*sizeof(CmdWord)) Pipeline(maker.device, segmentMask, segmentOffsets, words);
+	maker.device->freeMem(words);
+	return obj;
+}
+
+bool Pipeline::isSegmentEqual(unsigned seg, Pipeline const& other) const
+{
+	uint32_t size = getSegmentSize(seg);
+	return other.hasSegment(seg) && other.getSegmentSize(seg) == size &&
+		memcmp(getSegment(seg), other.getSegment(seg), size*sizeof(CmdWord)) == 0;
+}
+
+void Pipeline::bind(DkCmdBuf cmdbuf, Pipeline const* prev) const
+{
+	if (prev == this)
+		return;
+
+	CmdBufWriter w{cmdbuf};
+	w.reserve(getNumWords());
+	for (unsigned seg = 0; seg < NumSegments; seg ++)
+	{
+		// State groups that are identical in the previously bound pipeline are skipped
+		if (!hasSegment(seg) || (prev && isSegmentEqual(seg, *prev)))
+			continue;
+		w.addRawData(getSegment(seg), getSegmentSize(seg)*sizeof(CmdWord));
+	}
+	w.flush();
+
+	// The replayed commands bypass redundant state filtering
+	cmdbuf->invalidateStateShadow();
+}
+
+DkPipeline dkPipelineCreate(DkPipelineMaker const* maker)
+{
+	DK_ENTRYPOINT(maker->device);
+	DK_DEBUG_BAD_FLAGS(maker->stageMask & DkStageFlag_Compute, "pipelines only hold graphics state");
+	DK_DEBUG_NON_NULL_ARRAY(maker->shaders, maker->numShaders);
+
+	DkPipeline obj = Pipeline::compile(*maker);
+
+	// Compiling switches the debug context over to a temporary command buffer
+	DK_ENTRYPOINT(maker->device);
+	return obj;
+}
+
+void dkPipelineDestroy(DkPipeline obj)
+{
+	DK_ENTRYPOINT(obj);
+	delete obj;
+}
+
+void dkCmdBufBindPipeline(DkCmdBuf obj, DkPipeline pipeline, DkPipeline prevPipeline)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL(pipeline);
+	pipeline->bind(obj, prevPipeline);
+}
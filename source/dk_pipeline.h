@@ -0,0 +1,55 @@
+#pragma once
+#include "dk_private.h"
+#include "maxwell/command.h"
+
+namespace dk::detail
+{
+
+// Graphics state compiled into ready-to-replay commands. The commands of each state group
+// are kept in a separate segment, so that switching between pipelines only emits the
+// segments that differ.
+class Pipeline : public ObjBase
+{
+public:
+	enum Segment
+	{
+		Shaders,
+		RasterizerState,
+		ColorState,
+		ColorWriteState,
+		BlendStates,
+		DepthStencilState,
+		VtxAttribState,
+		VtxBufferState,
+
+		NumSegments
+	};
+
+	// Maximum size of a compiled pipeline
+	static constexpr uint32_t s_maxWords = 1024;
+
+private:
+	uint32_t m_segmentMask;
+	uint32_t m_segmentOffsets[NumSegments+1];
+
+	maxwell::CmdWord const* getWords() const noexcept
+	{
+		return reinterpret_cast<maxwell::CmdWord const*>(this+1);
+	}
+
+	bool hasSegment(unsigned seg) const noexcept { return (m_segmentMask & (1U << seg)) != 0; }
+	uint32_t getSegmentSize(unsigned seg) const noexcept { return m_segmentOffsets[seg+1] - m_segmentOffsets[seg]; }
+	maxwell::CmdWord const* getSegment(unsigned seg) const noexcept { return getWords() + m_segmentOffsets[seg]; }
+	bool isSegmentEqual(unsigned seg, Pipeline const& other) const noexcept;
+
+public:
+	Pipeline(DkDevice dev, uint32_t segmentMask, uint32_t const segmentOffsets[], maxwell::CmdWord const* words) noexcept;
+
+	uint32_t getNumWords() const noexcept { return m_segmentOffsets[NumSegments]; }
+	void bind(DkCmdBuf cmdbuf, Pipeline const* prev) const noexcept;
+
+	// Returns nullptr if the commands don't fit in s_maxWords
+	static Pipeline* compile(DkPipelineMaker const& maker) noexcept;
+};
+
+}
@@ -0,0 +1,134 @@
+#include "dk_profiler.h"
+
+using namespace dk::detail;
+
+static_assert(DK_PROFILER_REGION_SIZE == 2*sizeof(NvLongSemaphore), "Invalid profiler region size");
+
+uint64_t Profiler::calcDurationNs(uint64_t beginTicks, uint64_t endTicks)
+{
+	// Regions that were never ended (or that ended before they began) report zero
+	if (!endTicks || endTicks < beginTicks)
+		return 0;
+
+	// The GPU timer runs at 614.4 MHz, i.e. 384 ticks every 625 ns
+	return (endTicks - beginTicks) * 625 / 384;
+}
+
+void Profiler::retireBatches(bool block)
+{
+	uint32_t id;
+	while (m_batchRing.getFirstInFlight(id))
+	{
+		if (m_batches[id].m_fence.wait(block ? -1 : 0) != DkResult_Success)
+			break;
+		m_numReady += m_batches[id].m_numRegions;
+		m_batchRing.consumeOne();
+		block = false;
+	}
+}
+
+uint32_t Profiler::beginRegion(DkCmdBuf cmdbuf, uint32_t tag)
+{
+	// Drop the region if there are no free report slots left
+	uint32_t region;
+	if (!m_regionRing.reserve(region, 1))
+		return DK_PROFILER_INVALID_REGION;
+	m_regionRing.updateProducer(region+1);
+	m_numUnsubmitted ++;
+
+	// The GPU finished using this slot long ago, so clear the end report
+	// in order to detect regions that are never ended
+	m_tags[region] = tag;
+	getReports(region)[1].timestamp = 0;
+
+	dkCmdBufWriteTimestamp(cmdbuf, getReportGpuAddr(region, false));
+	return region;
+}
+
+void Profiler::endRegion(DkCmdBuf cmdbuf, uint32_t region)
+{
+	if (region != DK_PROFILER_INVALID_REGION)
+		dkCmdBufWriteTimestamp(cmdbuf, getReportGpuAddr(region, true));
+}
+
+void Profiler::submitRegions(DkFence const& fence)
+{
+	if (!m_numUnsubmitted)
+		return;
+
+	uint32_t id;
+	while (!m_batchRing.reserve(id, 1))
+		retireBatches(true);
+
+	m_batches[id].m_fence = fence;
+	m_batches[id].m_numRegions = m_numUnsubmitted;
+	m_batchRing.updateProducer(id+1);
+	m_numUnsubmitted = 0;
+}
+
+uint32_t Profiler::resolve(DkProfilerRegion* regions, uint32_t maxRegions)
+{
+	retireBatches(false);
+
+	// Slots are consumed one by one: consuming a full ring in one go would look like a no-op
+	uint32_t count = m_numReady < maxRegions ? m_numReady : maxRegions;
+	for (uint32_t i = 0; i < count; i ++)
+	{
+		uint32_t pos = m_regionRing.getConsumer();
+		NvLongSemaphore volatile* reports = getReports(pos);
+		regions[i].tag = m_tags[pos];
+		regions[i].durationNs = calcDurationNs(reports[0].timestamp, reports[1].timestamp);
+		m_regionRing.consumeOne();
+	}
+
+	m_numReady -= count;
+	return count;
+}
+
+DkProfiler dkProfilerCreate(DkProfilerMaker const* maker)
+{
+	DK_ENTRYPOINT(maker->device);
+	DK_DEBUG_NON_NULL(maker->memBlock);
+	DK_DEBUG_NON_ZERO(maker->numRegions);
+	DK_DEBUG_DATA_ALIGN(maker->offset, DK_TIMESTAMP_ALIGNMENT);
+	DK_DEBUG_BAD_INPUT(maker->offset + maker->numRegions*DK_PROFILER_REGION_SIZE > maker->memBlock->getSize(), "profiler regions out of bounds");
+	DK_DEBUG_BAD_FLAGS(!maker->memBlock->isGpuUncached() || !maker->memBlock->isCpuUncached(), "DkMemBlock must be created with DkMemBlockFlags_CpuUncached and DkMemBlockFlags_GpuUncached");
+
+	DkProfiler obj = nullptr;
+	obj = new(maker->device, Profiler::calcExtraSize(*maker)) Profiler(*maker);
+	return obj;
+}
+
+void dkProfilerDestroy(DkProfiler obj)
+{
+	DK_ENTRYPOINT(obj);
+	delete obj;
+}
+
+uint32_t dkProfilerBeginRegion(DkProfiler obj, DkCmdBuf cmdbuf, uint32_t tag)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL(cmdbuf);
+	return obj->beginRegion(cmdbuf, tag);
+}
+
+void dkProfilerEndRegion(DkProfiler obj, DkCmdBuf cmdbuf, uint32_t region)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL(cmdbuf);
+	obj->endRegion(cmdbuf, region);
+}
+
+void dkProfilerSubmitRegions(DkProfiler obj, DkFence const* fence)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL(fence);
+	obj->submitRegions(*fence);
+}
+
+uint32_t dkProfilerResolve(DkProfiler obj, DkProfilerRegion regions[], uint32_t maxRegions)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL_ARRAY(regions, maxRegions);
+	return obj->resolve(regions, maxRegions);
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "dk_private.h"
+#include "dk_device.h"
+#include "dk_fence.h"
+#include "dk_memblock.h"
+#include "ringbuf.h"
+
+namespace dk::detail
+{
+
+// Measures the GPU time spent in regions of command lists. Each region uses a pair
+// of timestamp reports taken from a ring; regions are handed back to the user once
+// the fence guarding the commands that recorded them is signaled.
+class Profiler : public ObjBase
+{
+	static constexpr uint32_t s_numBatches = 16;
+
+	struct Batch
+	{
+		DkFence m_fence;
+		uint32_t m_numRegions;
+	};
+
+	DkMemBlock m_memBlock;
+	uint32_t m_offset;
+	RingBuf<uint32_t> m_regionRing;
+	RingBuf<uint32_t> m_batchRing;
+	uint32_t m_numUnsubmitted;
+	uint32_t m_numReady;
+	Batch m_batches[s_numBatches];
+	uint32_t* m_tags;
+
+	NvLongSemaphore volatile* getReports(uint32_t region) const noexcept
+	{
+		return (NvLongSemaphore volatile*)((char*)m_memBlock->getCpuAddr() + m_offset) + 2*region;
+	}
+
+	DkGpuAddr getReportGpuAddr(uint32_t region, bool end) const noexcept
+	{
+		return m_memBlock->getGpuAddrPitch() + m_offset + region*DK_PROFILER_REGION_SIZE + (end ? sizeof(NvLongSemaphore) : 0);
+	}
+
+	void retireBatches(bool block) noexcept;
+
+public:
+	Profiler(DkProfilerMaker const& m) noexcept : ObjBase{m.device},
+		m_memBlock{m.memBlock}, m_offset{m.offset}, m_regionRing{m.numRegions}, m_batchRing{s_numBatches},
+		m_numUnsubmitted{}, m_numReady{}, m_batches{}, m_tags{(uint32_t*)(void*)(this+1)} { }
+
+	uint32_t beginRegion(DkCmdBuf cmdbuf, uint32_t tag) noexcept;
+	void endRegion(DkCmdBuf cmdbuf, uint32_t region) noexcept;
+	void submitRegions(DkFence const& fence) noexcept;
+	uint32_t resolve(DkProfilerRegion* regions, uint32_t maxRegions) noexcept;
+
+	static uint64_t calcDurationNs(uint64_t beginTicks, uint64_t endTicks) noexcept;
+
+	static size_t calcExtraSize(DkProfilerMaker const& m) noexcept
+	{
+		return sizeof(uint32_t) * m.numRegions;
+	}
+};
+
+}
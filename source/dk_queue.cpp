@@ -1,6 +1,7 @@
 #include "dk_queue.h"
 #include "dk_device.h"
 #include "queue_compute.h"
+#include "queue_submitter.h"
 
 #include "cmdbuf_writer.h"
 
@@ -68,20 +69,44 @@ DkResult Queue::initialize()
 	postSubmitFlush();
 	flush();
 
+	// From now on, kickoffs are performed by the submission thread
+	if (hasAsyncSubmit())
+	{
+		NvFence fence;
+		nvGpuChannelGetFence(&m_gpuChannel, &fence);
+		void* storage = reinterpret_cast<char*>(this+1) + (hasCompute() ? sizeof(ComputeQueue) : 0);
+		m_submitter = new(storage) QueueSubmitter(this);
+		res = m_submitter->initialize(fence);
+		if (res != DkResult_Success)
+			return res;
+	}
+
 #ifdef DK_QUEUE_DEBUG
 	printf("cmdBufRing: sz=0x%x con=0x%x pro=0x%x fli=0x%x\n", m_cmdBufRing.getSize(), m_cmdBufRing.getConsumer(), m_cmdBufRing.getProducer(), m_cmdBufRing.getInFlight());
 #endif
 
-	m_state = Healthy;
+	// The queue may already have failed during initialization, don't overwrite that
+	auto state = Uninitialized;
+	__atomic_compare_exchange_n(&m_state, &state, Healthy, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
 	getDevice()->registerQueue(m_id, this);
 	return DkResult_Success;
 }
 
 Queue::~Queue()
 {
-	if (m_state == Healthy)
+	// The queue stays registered until all work is done, so that the error checks
+	// performed by the wait below can notice the queue failing while it waits
+	if (isHealthy())
 		waitIdle();
 
+	if (m_submitter)
+	{
+		m_submitter->finalize();
+		m_submitter->~QueueSubmitter();
+	}
+
+	getDevice()->unregisterQueue(m_id);
+
 	if (m_computeQueue)
 		m_computeQueue->~ComputeQueue();
 
@@ -89,7 +114,7 @@ Queue::~Queue()
 	getDevice()->returnQueueId(m_id);
 }
 
-void Queue::addCmdMemory(size_t minReqSize)
+bool Queue::addCmdMemory(size_t minReqSize, bool wait)
 {
 	uint32_t inFlightSize = getInFlightCmdSize();
 	uint32_t idealSize = minReqSize;
@@ -105,12 +130,32 @@ void Queue::addCmdMemory(size_t minReqSize)
 	bool peek = true;
 	while (!availableSize)
 	{
+		if (!peek && !wait)
+			return false;
 		waitFenceRing(peek);
 		peek = false;
 		availableSize = m_cmdBufRing.reserve(offset, minReqSize);
 	}
 
 	m_cmdBuf.addMemory(&m_cmdBufMemBlock, offset, availableSize < idealSize ? availableSize : idealSize);
+	return true;
+}
+
+void Queue::addFlushCmdMemory()
+{
+	if (!m_submitter)
+	{
+		addCmdMemory(m_cmdBufPerFenceSliceSize);
+		return;
+	}
+
+	// Flushing an asynchronous queue only waits for the GPU when there isn't even room for
+	// the post-submit commands, that is when it's a whole ring behind. Anything else can
+	// make do with the memory already available, until more is needed to record commands.
+	if (addCmdMemory(m_cmdBufPerFenceSliceSize, false) || addCmdMemory(s_minFlushCmdMemSize, false))
+		return;
+	__atomic_store_n(&m_numStalls, m_numStalls+1, __ATOMIC_RELAXED);
+	addCmdMemory(s_minFlushCmdMemSize);
 }
 
 bool Queue::waitFenceRing(bool peek)
@@ -124,6 +169,8 @@ bool Queue::waitFenceRing(bool peek)
 		if (res == DkResult_Timeout)
 			break;
 		m_cmdBufRing.updateConsumer(m_fenceCmdOffsets[id]);
+		if (m_computeQueue)
+			m_computeQueue->releaseJobs(m_fenceJobOffsets[id]);
 		m_fenceRing.consumeOne();
 		timeout = 0;
 		waited = true;
@@ -131,12 +178,14 @@ bool Queue::waitFenceRing(bool peek)
 	return waited;
 }
 
-void Queue::flushRing(bool fenceFlush)
+bool Queue::flushRing(bool fenceFlush, bool wait)
 {
 	uint32_t id;
 	bool peek = true;
 	do
 	{
+		if (!peek && !wait)
+			return false;
 		waitFenceRing(peek);
 		peek = false;
 	}
@@ -145,7 +194,10 @@ void Queue::flushRing(bool fenceFlush)
 	m_cmdBuf.unlockReservedWords();
 	signalFence(m_fences[id], fenceFlush);
 	m_fenceLastFlushOffset = m_fenceCmdOffsets[id] = getCmdOffset();
+	if (m_computeQueue)
+		m_fenceJobOffsets[id] = m_computeQueue->markJobsFenced();
 	m_fenceRing.updateProducer(id+1);
+	return true;
 }
 
 void Queue::onCmdBufAddMem(size_t minReqSize)
@@ -167,21 +219,80 @@ void Queue::onCmdBufAddMem(size_t minReqSize)
 
 void Queue::appendGpfifoEntries(CtrlCmdGpfifoEntry const* entries, uint32_t numEntries)
 {
+#ifdef DK_QUEUE_DEBUG
 	for (unsigned i = 0; i < numEntries; i ++)
+		printf("  [%u]: iova 0x%010lx numCmds %u flags %x\n", i, entries[i].iova, entries[i].numCmds, entries[i].flags);
+#endif
+
+	if (m_submitter)
+	{
+		for (unsigned i = 0; i < numEntries; i ++)
+			m_submitter->appendEntry(entries[i]);
+	}
+	else
+		appendToChannel(entries, numEntries);
+}
+
+bool Queue::appendToChannel(CtrlCmdGpfifoEntry const* entries, uint32_t numEntries)
+{
+	// AutoKick entries ask for the channel to be kicked off early when it's nearly full.
+	// Every entry of the batch is appended before anything is kicked off, so it's enough
+	// to honor this for the last such entry; the others only kick off a full channel.
+	uint32_t lastAutoKick = numEntries;
+	for (uint32_t i = numEntries; i --;)
+		if (entries[i].flags & CtrlCmdGpfifoEntry::AutoKick)
+		{
+			lastAutoKick = i;
+			break;
+		}
+
+	for (uint32_t i = 0; i < numEntries; i ++)
 	{
 		auto& ent = entries[i];
-#ifdef DK_QUEUE_DEBUG
-		printf("  [%u]: iova 0x%010lx numCmds %u flags %x\n", i, ent.iova, ent.numCmds, ent.flags);
-#endif
 		u32 flags = GPFIFO_ENTRY_NOT_MAIN | ((ent.flags & CtrlCmdGpfifoEntry::NoPrefetch) ? GPFIFO_ENTRY_NO_PREFETCH : 0);
-		u32 threshold = (ent.flags & CtrlCmdGpfifoEntry::AutoKick) ? 8 : 0;
+		u32 threshold = i == lastAutoKick ? s_gpfifoKickThreshold : 0;
 		if (R_FAILED(nvGpuChannelAppendEntry(&m_gpuChannel, ent.iova, ent.numCmds, flags, threshold)))
 		{
 			if (!checkError())
 				DK_ERROR(DkResult_Fail, "gpfifo entry append failed, but no error was reported");
-			return;
+			return false;
 		}
 	}
+	return true;
+}
+
+bool Queue::kickoffChannel()
+{
+	if (R_FAILED(nvGpuChannelKickoff(&m_gpuChannel)))
+	{
+		if (!checkError())
+			DK_ERROR(DkResult_Fail, "gpu channel kickoff failed, but no error was reported");
+		return false;
+	}
+	return true;
+}
+
+bool Queue::hasPendingEntries() const
+{
+	if (m_submitter)
+		return m_submitter->hasUnpublishedEntries();
+	return m_gpuChannel.num_entries != 0;
+}
+
+void Queue::incrFence()
+{
+	if (m_submitter)
+		m_submitter->incrFence();
+	else
+		nvGpuChannelIncrFence(&m_gpuChannel);
+}
+
+void Queue::getFence(NvFence* out)
+{
+	if (m_submitter)
+		m_submitter->getFence(out);
+	else
+		nvGpuChannelGetFence(&m_gpuChannel, out);
 }
 
 void Queue::waitFence(DkFence& fence)
@@ -252,10 +363,11 @@ void Queue::signalFence(DkFence& fence, bool flush)
 			action |= A::FlushCache{};
 			w << Cmd(3D, SyncptAction{}, action);
 			w << Cmd(3D, SyncptAction{}, action);
-			nvGpuChannelIncrFence(&m_gpuChannel);
+			incrFence();
 		}
-		nvGpuChannelIncrFence(&m_gpuChannel);
+		incrFence();
 		fence.m_internal.m_semaphoreValue = getDevice()->incrSemaphoreValue(m_id);
+		releaseSemaphoreIfFailed();
 
 		w << CmdInline(3D, UnknownFlush{}, 0);
 		w << Cmd(3D, SetReportSemaphoreOffset{},
@@ -269,64 +381,169 @@ void Queue::signalFence(DkFence& fence, bool flush)
 	else
 		fence.m_internal.m_semaphoreValue = getDevice()->getSemaphoreValue(m_id);
 
-	nvGpuChannelGetFence(&m_gpuChannel, &fence.m_internal.m_fence);
+	getFence(&fence.m_internal.m_fence);
+}
+
+void Queue::waitTimeline(Queue& srcQueue, uint64_t value)
+{
+	if (isInErrorState())
+		return;
+
+	using S = EngineGpfifo::Semaphore;
+	CmdBufWriterChecked w{&m_cmdBuf};
+	w << Cmd(Gpfifo, SemaphoreOffset{},
+		Iova(getDevice()->getSemaphoreGpuAddr(srcQueue.m_id)),
+		uint32_t(value),
+		S::Operation::AcqGeq | S::AcquireSwitch{}
+	);
+}
+
+uint64_t Queue::signalTimeline()
+{
+	if (isInErrorState())
+		return getDevice()->getSemaphoreValue(m_id);
+
+	// Unlike fences, timeline points don't involve the channel syncpoint:
+	// a plain semaphore release is enough since waits only look at the semaphore
+	using S = Engine3D::SetReportSemaphore;
+	uint64_t value = getDevice()->incrSemaphoreValue(m_id);
+	releaseSemaphoreIfFailed();
+	CmdBufWriter w{&m_cmdBuf};
+	w.reserve(7);
+
+	w << CmdInline(3D, UnknownFlush{}, 0);
+	w << Cmd(3D, SetReportSemaphoreOffset{},
+		Iova(getDevice()->getSemaphoreGpuAddr(m_id)),
+		uint32_t(value),
+		S::Operation::Release | S::FenceEnable{} | S::Unit::Crop | S::StructureSize::OneWord
+	);
+	w << CmdInline(3D, TiledCacheFlush{}, Engine3D::TiledCacheFlush::Flush);
+
+	return value;
+}
+
+uint64_t Queue::waitQueue(Queue& srcQueue)
+{
+	// The timeline point must be submitted, otherwise this queue would wait forever
+	uint64_t value = srcQueue.signalTimeline();
+	if (!srcQueue.isInErrorState())
+		srcQueue.flush();
+	waitTimeline(srcQueue, value);
+	return value;
+}
+
+uint64_t Queue::getTimelineValue()
+{
+	// Extend the 32-bit GPU value using the most recently signaled 64-bit value. The GPU
+	// value must be read first: it only ever holds values that were already handed out, so
+	// the signaled value read afterwards can't be behind it (which would be off by 2^32)
+	uint32_t cur = __atomic_load_n(&getDevice()->getSemaphoreCpuAddr(m_id)->sequence, __ATOMIC_ACQUIRE);
+	uint64_t signaled = getDevice()->getSemaphoreValue(m_id);
+	uint32_t behind = uint32_t(signaled) - cur;
+	if (int32_t(behind) < 0)
+		return signaled; // Never report more than what was signaled
+	return signaled - behind;
+}
+
+DkResult Queue::hostWaitTimeline(uint64_t value, int64_t timeout_ns)
+{
+	if (pollTimeline(value))
+		return DkResult_Success;
+	if (timeout_ns == 0)
+		return DkResult_Timeout;
+
+	// There is no syncpoint to block on, so back off exponentially between polls,
+	// checking for errors (which release the semaphore) every so often
+	u64 start = armGetSystemTick();
+	u64 lastCheck = start;
+	s64 sleep_ns = 10000; // 10 μs
+	for (;;)
+	{
+		svcSleepThread(sleep_ns);
+		if (sleep_ns < 1000000) // 1 ms
+			sleep_ns *= 2;
+
+		if (pollTimeline(value))
+			return DkResult_Success;
+
+		u64 now = armGetSystemTick();
+		if (timeout_ns >= 0 && armTicksToNs(now - start) >= u64(timeout_ns))
+			return DkResult_Timeout;
+
+		if (armTicksToNs(now - lastCheck) >= 100000000) // 10^8 ns = 100 ms
+		{
+			lastCheck = now;
+			if (checkError())
+				return DkResult_Fail;
+		}
+	}
 }
 
 void Queue::submitCommands(DkCmdList list)
 {
-	CtrlCmdHeader const *cur, *next;
-	for (cur = reinterpret_cast<CtrlCmdHeader*>(list); cur; cur = next)
+	WalkCtrlCmds(reinterpret_cast<CtrlCmdHeader const*>(list), [this](CtrlCmdHeader const* cur) -> CtrlCmdHeader const*
 	{
 		switch (cur->type)
 		{
 			default:
-			case CtrlCmdHeader::Return:
-				next = nullptr;
-				break;
-			case CtrlCmdHeader::Jump:
-			case CtrlCmdHeader::Call:
-			{
-				auto* cmd = static_cast<CtrlCmdJumpCall const*>(cur);
-				if (cur->type == CtrlCmdHeader::Jump)
-					next = cmd->ptr;
-				else
-				{
-					submitCommands(DkCmdList(cmd->ptr));
-					next = cmd+1;
-				}
-				break;
-			}
+				return nullptr;
 			case CtrlCmdHeader::WaitFence:
 			{
 				auto* cmd = static_cast<CtrlCmdFence const*>(cur);
 				waitFence(*cmd->fence);
-				next = cmd+1;
-				break;
+				return cmd+1;
 			}
 			case CtrlCmdHeader::SignalFence:
 			{
 				auto* cmd = static_cast<CtrlCmdFence const*>(cur);
 				signalFence(*cmd->fence, cur->arg != 0);
-				next = cmd+1;
-				break;
+				return cmd+1;
 			}
 			case CtrlCmdHeader::GpfifoList:
 			{
 				auto* entries = reinterpret_cast<CtrlCmdGpfifoEntry const*>(cur+1);
-				flushCmdBuf();
-				appendGpfifoEntries(entries, cur->arg);
-				next = reinterpret_cast<CtrlCmdHeader const*>(entries+cur->arg);
-				break;
+				submitGpfifoEntries(entries, cur->arg);
+				return reinterpret_cast<CtrlCmdHeader const*>(entries+cur->arg);
 			}
 			case CtrlCmdHeader::ComputeBindShader ... CtrlCmdHeader::ComputeDispatchIndirect:
-			{
-				next = m_computeQueue->processCtrlCmd(cur);
-				break;
-			}
+				return m_computeQueue->processCtrlCmd(cur);
 		}
+	});
+}
+
+void Queue::submitCommandsBatch(DkCmdListSubmission const* submissions, uint32_t numSubmissions)
+{
+	for (uint32_t i = 0; i < numSubmissions; i ++)
+	{
+		auto& sub = submissions[i];
+		if (sub.waitFence)
+			waitFence(*sub.waitFence);
+		if (sub.cmdList)
+			submitCommands(sub.cmdList);
+		if (sub.signalFence)
+			signalFence(*sub.signalFence, sub.signalFlush);
 	}
 }
 
+void Queue::submitGpfifoEntries(CtrlCmdGpfifoEntry const* entries, uint32_t numEntries)
+{
+	if (numEntries >= s_maxMergedGpfifoEntries)
+	{
+		// Large runs are sent straight to the channel
+		flushCmdBuf();
+		appendGpfifoEntries(entries, numEntries);
+		return;
+	}
+
+	// Small runs are merged into the pending gpfifo entries of the internal command buffer,
+	// together with the queue's own commands and the runs of any lists submitted after it
+	m_cmdBuf.signOffGpfifoEntry(
+		CtrlCmdGpfifoEntry::AutoKick |
+		CtrlCmdGpfifoEntry::NoPrefetch);
+	for (uint32_t i = 0; i < numEntries; i ++)
+		m_cmdBuf.appendRawGpfifoEntry(entries[i].iova, entries[i].numCmds, entries[i].flags);
+}
+
 void Queue::flush()
 {
 	if (isInErrorState())
@@ -335,22 +552,22 @@ void Queue::flush()
 		return;
 	}
 
-	if (m_gpuChannel.num_entries || hasPendingCommands())
+	if (hasPendingEntries() || hasPendingCommands())
 	{
-		if (getSizeSinceLastFenceFlush() >= m_cmdBufPerFenceSliceSize)
-			flushRing();
+		// Asynchronous queues don't wait for a fence to be freed up: if the ring is full,
+		// the commands are covered by the fence signaled by a later flush instead
+		if (getSizeSinceLastFenceFlush() >= m_cmdBufPerFenceSliceSize || (m_computeQueue && m_computeQueue->hasManyUnfencedJobs()))
+			flushRing(false, !m_submitter);
 		flushCmdBuf();
 		// TODO:
 		// - Do the ZBC shit
-		if (R_FAILED(nvGpuChannelKickoff(&m_gpuChannel)))
-		{
-			if (!checkError())
-				DK_ERROR(DkResult_Fail, "gpu channel kickoff failed, but no error was reported");
+		if (m_submitter)
+			m_submitter->publish();
+		else if (!kickoffChannel())
 			return;
-		}
 		// - Update device query data (is this really necessary?)
 		m_cmdBufRing.updateProducer(getCmdOffset());
-		addCmdMemory(m_cmdBufPerFenceSliceSize);
+		addFlushCmdMemory();
 		postSubmitFlush();
 		m_cmdBuf.flushGpfifoEntries();
 	}
@@ -379,6 +596,8 @@ DkQueue dkQueueCreate(DkQueueMaker const* maker)
 	size_t extraSize = 0;
 	if (maker->flags & DkQueueFlags_Compute)
 		extraSize += sizeof(ComputeQueue);
+	if (maker->flags & DkQueueFlags_AsyncSubmit)
+		extraSize += sizeof(QueueSubmitter);
 
 	int32_t id = maker->device->reserveQueueId();
 	if (id < 0)
@@ -406,6 +625,11 @@ bool dkQueueIsInErrorState(DkQueue obj)
 	return obj->isInErrorState();
 }
 
+uint32_t dkQueueGetNumStalls(DkQueue obj)
+{
+	return obj->getNumStalls();
+}
+
 void dkQueueWaitFence(DkQueue obj, DkFence* fence)
 {
 	DK_ENTRYPOINT(obj);
@@ -418,6 +642,45 @@ void dkQueueSignalFence(DkQueue obj, DkFence* fence, bool flush)
 	obj->signalFence(*fence, flush);
 }
 
+void dkQueueWaitTimeline(DkQueue obj, DkQueue srcQueue, uint64_t value)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL(srcQueue);
+	DK_DEBUG_BAD_INPUT(srcQueue->getDevice() != obj->getDevice(), "queues must belong to the same device");
+	obj->waitTimeline(*srcQueue, value);
+}
+
+uint64_t dkQueueSignalTimeline(DkQueue obj)
+{
+	DK_ENTRYPOINT(obj);
+	return obj->signalTimeline();
+}
+
+uint64_t dkQueueWaitQueue(DkQueue obj, DkQueue srcQueue)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL(srcQueue);
+	DK_DEBUG_BAD_INPUT(srcQueue == obj, "a queue cannot wait on itself");
+	DK_DEBUG_BAD_INPUT(srcQueue->getDevice() != obj->getDevice(), "queues must belong to the same device");
+	return obj->waitQueue(*srcQueue);
+}
+
+uint64_t dkQueueGetTimelineValue(DkQueue obj)
+{
+	return obj->getTimelineValue();
+}
+
+bool dkQueuePollTimeline(DkQueue obj, uint64_t value)
+{
+	return obj->pollTimeline(value);
+}
+
+DkResult dkQueueHostWaitTimeline(DkQueue obj, uint64_t value, int64_t timeout_ns)
+{
+	DK_ENTRYPOINT(obj);
+	return obj->hostWaitTimeline(value, timeout_ns);
+}
+
 void dkQueueSubmitCommands(DkQueue obj, DkCmdList cmds)
 {
 	DK_ENTRYPOINT(obj);
@@ -427,6 +690,16 @@ void dkQueueSubmitCommands(DkQueue obj, DkCmdList cmds)
 	obj->submitCommands(cmds);
 }
 
+void dkQueueSubmitCommandsBatch(DkQueue obj, DkCmdListSubmission const submissions[], uint32_t numSubmissions)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL_ARRAY(submissions, numSubmissions);
+	if (obj->isInErrorState())
+		DK_ERROR(DkResult_Fail, "attempt to submit commands to a queue in error state");
+
+	obj->submitCommandsBatch(submissions, numSubmissions);
+}
+
 void dkQueueFlush(DkQueue obj)
 {
 	DK_ENTRYPOINT(obj);
@@ -456,22 +729,5 @@ DK_WEAK void ComputeQueue::initialize()
 DK_WEAK CtrlCmdHeader const* ComputeQueue::processCtrlCmd(CtrlCmdHeader const* cmd)
 {
 	DK_WARNING("compute command called, but Dispatch never called");
-
-	switch (cmd->type)
-	{
-		default: return nullptr; // shouldn't happen
-
-		case CtrlCmdHeader::ComputeBindShader:
-			return reinterpret_cast<CtrlCmdComputeShader const*>(cmd)+1;
-
-		case CtrlCmdHeader::ComputeBindBuffer:
-		case CtrlCmdHeader::ComputeDispatchIndirect:
-			return reinterpret_cast<CtrlCmdComputeAddress const*>(cmd)+1;
-
-		case CtrlCmdHeader::ComputeBindHandle:
-			return cmd+1;
-
-		case CtrlCmdHeader::ComputeDispatch:
-			return reinterpret_cast<CtrlCmdComputeDispatch const*>(cmd)+1;
-	}
+	return reinterpret_cast<CtrlCmdHeader const*>(reinterpret_cast<char const*>(cmd) + GetCtrlCmdSize(cmd));
 }
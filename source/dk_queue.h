@@ -1,6 +1,7 @@
 #pragma once
 #include "dk_private.h"
 #include "dk_memblock.h"
+#include "dk_device.h"
 #include "dk_fence.h"
 #include "dk_cmdbuf.h"
 #include "ringbuf.h"
@@ -10,14 +11,19 @@ namespace dk::detail
 {
 
 class ComputeQueue;
+class QueueSubmitter;
 
 class Queue : public ObjBase
 {
 	friend class ComputeQueue;
+	friend class QueueSubmitter;
 
 	static constexpr uint32_t s_numReservedWords = 12;
 	static constexpr size_t s_maxQueuedGpfifoEntries = 64;
 	static constexpr uint32_t s_numFences = 16;
+	static constexpr uint32_t s_gpfifoKickThreshold = 8;
+	static constexpr uint32_t s_maxMergedGpfifoEntries = s_maxQueuedGpfifoEntries/4;
+	static constexpr uint32_t s_minFlushCmdMemSize = 0x100;
 
 	uint32_t m_id;
 	uint32_t m_flags;
@@ -42,11 +48,15 @@ class Queue : public ObjBase
 	RingBuf<uint32_t> m_fenceRing;
 	DkFence m_fences[s_numFences];
 	uint32_t m_fenceCmdOffsets[s_numFences];
+	uint32_t m_fenceJobOffsets[s_numFences];
 	uint32_t m_fenceLastFlushOffset;
 
 	QueueWorkBuf m_workBuf;
 
 	ComputeQueue* m_computeQueue;
+	QueueSubmitter* m_submitter;
+	u64 m_lastErrorCheck;
+	uint32_t m_numStalls;
 
 	uint32_t getCmdOffset() const noexcept { return m_cmdBufRing.getProducer() + m_cmdBuf.getCmdOffset(); }
 	uint32_t getInFlightCmdSize() const noexcept { return m_cmdBufRing.getInFlight() + m_cmdBuf.getCmdOffset(); }
@@ -59,12 +69,19 @@ class Queue : public ObjBase
 			return offset - m_fenceLastFlushOffset;
 	}
 
-	void addCmdMemory(size_t minReqSize) noexcept;
+	bool addCmdMemory(size_t minReqSize, bool wait = true) noexcept;
 	bool waitFenceRing(bool peek = false) noexcept;
-	void flushRing(bool fenceFlush = false) noexcept;
+	bool flushRing(bool fenceFlush = false, bool wait = true) noexcept;
+	void addFlushCmdMemory() noexcept;
 
 	void onCmdBufAddMem(size_t minReqSize) noexcept;
 	void appendGpfifoEntries(CtrlCmdGpfifoEntry const* entries, uint32_t numEntries) noexcept;
+	void submitGpfifoEntries(CtrlCmdGpfifoEntry const* entries, uint32_t numEntries) noexcept;
+	bool appendToChannel(CtrlCmdGpfifoEntry const* entries, uint32_t numEntries) noexcept;
+	bool kickoffChannel() noexcept;
+	bool hasPendingEntries() const noexcept;
+	void incrFence() noexcept;
+	void getFence(NvFence* out) noexcept;
 
 	bool hasPendingCommands() const noexcept
 	{
@@ -97,14 +114,23 @@ class Queue : public ObjBase
 	void setupTransfer();
 	void postSubmitFlush();
 
+	void releaseSemaphore() noexcept;
+	void releaseSemaphoreIfFailed() noexcept
+	{
+		// The queue may have entered the error state right before a new value was handed out
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (isInErrorState())
+			releaseSemaphore();
+	}
+
 public:
 	Queue(DkQueueMaker const& maker, uint32_t id) : ObjBase{maker.device},
 		m_id{id}, m_flags{maker.flags}, m_state{Uninitialized}, m_gpuChannel{},
-		m_cmdBufMemBlock{maker.device}, m_cmdBuf{{maker.device,this,_addMemFunc},s_numReservedWords},
+		m_cmdBufMemBlock{maker.device}, m_cmdBuf{{maker.device,this,_addMemFunc,nullptr,0},s_numReservedWords},
 		m_cmdBufCtrlHeader{}, m_gpfifoEntries{},
 		m_cmdBufRing{maker.commandMemorySize}, m_cmdBufFlushThreshold{maker.flushThreshold}, m_cmdBufPerFenceSliceSize{maker.commandMemorySize/s_numFences},
-		m_fenceRing{s_numFences}, m_fences{}, m_fenceCmdOffsets{}, m_fenceLastFlushOffset{},
-		m_workBuf{maker}, m_computeQueue{}
+		m_fenceRing{s_numFences}, m_fences{}, m_fenceCmdOffsets{}, m_fenceJobOffsets{}, m_fenceLastFlushOffset{},
+		m_workBuf{maker}, m_computeQueue{}, m_submitter{}, m_lastErrorCheck{}, m_numStalls{}
 	{
 		m_cmdBuf.useGpfifoFlushFunc(_gpfifoFlushFunc, this, &m_cmdBufCtrlHeader, s_maxQueuedGpfifoEntries);
 	}
@@ -112,18 +138,34 @@ public:
 	bool hasGraphics() const noexcept { return (m_flags & DkQueueFlags_Graphics) != 0; }
 	bool hasCompute() const noexcept { return (m_flags & DkQueueFlags_Compute) != 0; }
 	bool hasZcull() const noexcept { return (m_flags & DkQueueFlags_DisableZcull) == 0; }
-	bool isInErrorState() const noexcept { return m_state == Error; }
+	bool hasAsyncSubmit() const noexcept { return (m_flags & DkQueueFlags_AsyncSubmit) != 0; }
+	bool isHealthy() const noexcept { return __atomic_load_n(&m_state, __ATOMIC_ACQUIRE) == Healthy; }
+	bool isInErrorState() const noexcept { return __atomic_load_n(&m_state, __ATOMIC_ACQUIRE) == Error; }
+	uint32_t getNumStalls() const noexcept { return __atomic_load_n(&m_numStalls, __ATOMIC_RELAXED); }
 
 	~Queue();
 	DkResult initialize();
 	void waitFence(DkFence& fence);
 	void signalFence(DkFence& fence, bool flush);
+	void waitTimeline(Queue& srcQueue, uint64_t value);
+	uint64_t signalTimeline();
+	uint64_t waitQueue(Queue& srcQueue);
+	uint64_t getTimelineValue() noexcept;
+	DkResult hostWaitTimeline(uint64_t value, int64_t timeout_ns);
+
+	bool pollTimeline(uint64_t value) noexcept
+	{
+		uint32_t cur = getDevice()->getSemaphoreCpuAddr(m_id)->sequence;
+		return int32_t(cur - uint32_t(value)) >= 0;
+	}
 	void submitCommands(DkCmdList list);
+	void submitCommandsBatch(DkCmdListSubmission const* submissions, uint32_t numSubmissions);
 	void flush();
 	void waitIdle();
 
 	void decompressSurface(DkImage const* image);
 	bool checkError();
+	bool checkErrorRateLimited(u64 now, u64 interval) noexcept;
 };
 
 }
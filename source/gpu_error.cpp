@@ -5,20 +5,59 @@ using namespace dk::detail;
 
 void Device::checkQueueErrors() noexcept
 {
-	MutexHolder m{m_queueTableMutex};
-	for (unsigned i = 0; i < s_numQueues; i ++)
+	u64 now = armGetSystemTick();
+	u64 interval = armNsToTicks(u64(m_maker.errorCheckIntervalUs) * 1000);
+
+	for (unsigned i = 0; i < s_usedQueueBitmapSize; i ++)
 	{
-		DkQueue q = m_queueTable[i];
-		if (q) q->checkError();
+		uint32_t mask = __atomic_load_n(&m_liveQueues[i], __ATOMIC_SEQ_CST);
+		while (mask)
+		{
+			unsigned id = 32*i + __builtin_ctz(mask);
+			mask &= mask - 1;
+
+			// The reference must be taken before looking up the queue (see unregisterQueue)
+			__atomic_add_fetch(&m_queueRefs[id], 1, __ATOMIC_SEQ_CST);
+			DkQueue q = __atomic_load_n(&m_queueTable[id], __ATOMIC_SEQ_CST);
+			if (q) q->checkErrorRateLimited(now, interval);
+			__atomic_sub_fetch(&m_queueRefs[id], 1, __ATOMIC_RELEASE);
+		}
 	}
 }
 
+bool Queue::checkErrorRateLimited(u64 now, u64 interval) noexcept
+{
+	if (isInErrorState())
+		return true;
+
+	// Only one thread gets to check the queue per interval
+	u64 last = __atomic_load_n(&m_lastErrorCheck, __ATOMIC_RELAXED);
+	if (now - last < interval)
+		return false;
+	if (!__atomic_compare_exchange_n(&m_lastErrorCheck, &last, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		return false;
+
+	return checkError();
+}
+
 bool Queue::checkError()
 {
+	if (isInErrorState())
+		return true;
+
 	NvNotification notif;
 	if (R_FAILED(nvGpuChannelGetErrorNotification(&m_gpuChannel, &notif)) || !notif.status)
 		return false; // No error
 
+	// Error checks can race (e.g. submission thread vs. device error checks),
+	// only the thread that moves the queue into the error state reports it
+	auto state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+	do
+	{
+		if (state == Error)
+			return true;
+	} while (!__atomic_compare_exchange_n(&m_state, &state, Error, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
 	DK_WARNING("Queue (%u) entered error state", m_id);
 	DK_WARNING("  timestamp: %lu", notif.timestamp);
 	DK_WARNING("  info32: %u", notif.info32);
@@ -58,9 +97,22 @@ bool Queue::checkError()
 		}
 	}
 
-	// Enter error state - update the semaphore with the most recent value so that any users
-	// who are waiting for work in this failed queue to complete are allowed to end the wait
-	m_state = Error;
-	getDevice()->getSemaphoreCpuAddr(m_id)->sequence = getDevice()->getSemaphoreValue(m_id);
+	// Update the semaphore with the most recent value so that any users who are
+	// waiting for work in this failed queue to complete are allowed to end the wait
+	releaseSemaphore();
 	return true;
 }
+
+void Queue::releaseSemaphore() noexcept
+{
+	// Pairs with the fence in releaseSemaphoreIfFailed: either this sees the new value,
+	// or the thread that handed it out sees the error state and releases it itself.
+	// The semaphore is only ever moved forward, which makes repeated releases harmless.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	uint32_t target = getDevice()->getSemaphoreValue(m_id);
+	u32 volatile* sequence = &getDevice()->getSemaphoreCpuAddr(m_id)->sequence;
+	u32 cur = __atomic_load_n(sequence, __ATOMIC_RELAXED);
+	while (int32_t(target - cur) > 0)
+		if (__atomic_compare_exchange_n(sequence, &cur, target, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			break;
+}
@@ -101,6 +101,26 @@ constexpr uint32_t MakeCmdHeader(SubmissionMode mode, uint16_t arg, uint8_t subc
 	return ShiftField(method, 0, 13) | ShiftField(subchannel, 13, 3) | ShiftField(arg, 16, 13) | ShiftField(mode, 29, 3);
 }
 
+// Returns the offset of the first command in a prebaked list that has the same header
+// and first argument as the given one, or the size of the list if there is none.
+// This is used to locate the commands that need to be patched at runtime.
+template <uint32_t size, uint32_t cmdSize>
+constexpr uint32_t FindCmd(CmdList<size> const& list, CmdList<cmdSize> const& cmd)
+{
+	uint32_t header = cmd.raw[0].i;
+	for (uint32_t pos = 0; pos < size;)
+	{
+		uint32_t cur = list.raw[pos].i;
+		bool match = cur == header;
+		if constexpr (cmdSize > 1)
+			match = match && list.raw[pos+1].i == cmd.raw[1].i;
+		if (match)
+			return pos;
+		pos += 1 + ((cur >> 29) == Inline ? 0 : ((cur >> 16) & 0x1FFF));
+	}
+	return size;
+}
+
 template <typename... Targs>
 constexpr auto MakeCmd(uint32_t header, Targs&&... args)
 {
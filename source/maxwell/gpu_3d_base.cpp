@@ -54,186 +54,375 @@ namespace
 			info.m_horizontal, info.m_vertical,
 			info.m_format, info.m_tileMode, info.m_arrayMode, info.m_layerStride);
 	}
-}
 
-void Queue::setup3DEngine()
-{
-	CmdBufWriter w{&m_cmdBuf};
+	// Maximum number of draws submitted with a single MultiDraw/MultiDrawIndexed macro call
+	constexpr uint32_t s_maxDrawsPerMultiDraw = 256;
 
-	w << CmdInline(3D, MultisampleEnable{}, 0);
-	w << CmdInline(3D, CsaaEnable{}, 0);
-	w << CmdInline(3D, MultisampleMode{}, MsaaMode_1x1);
-	w << CmdInline(3D, MultisampleControl{}, 0);
-	w << CmdInline(3D, Unknown1d3{}, 0x3F);
-	w << MacroFillRegisterArray<E::WindowRectangle>(0);
-	w << CmdInline(3D, ClearBufferFlags{}, E::ClearBufferFlags::StencilMask{} | E::ClearBufferFlags::Scissor{});
-	w << MacroSetRegisterInArray<E::Scissor>(E::Scissor::Enable{}, 1);
-	w << Cmd(3D, Unknown5aa{}, 0x00030003);
-	w << Cmd(3D, Unknown5e5{}, 0x00020002);
-	w << CmdInline(3D, PrimitiveRestartWithDrawArrays{}, 0);
-	w << CmdInline(3D, PointRasterRules{}, 0);
-	w << CmdInline(3D, LinkedTsc{}, 0);
-	w << CmdInline(3D, ProvokingVertexLast{}, 1);
-	w << CmdInline(3D, SetShaderExceptions{}, 0);
-	w << CmdInline(3D, Unknown400{}, 0x10);
-	w << CmdInline(3D, Unknown086{}, 0x10);
-	w << CmdInline(3D, Unknown43f{}, 0x10);
-	w << CmdInline(3D, Unknown4a4{}, 0x10);
-	w << CmdInline(3D, Unknown4b6{}+0, 0x10);
-	w << CmdInline(3D, Unknown4b6{}+1, 0x10);
-	w << CmdInline(3D, SetApiVisibleCallLimit{}, E::SetApiVisibleCallLimit::Cta::_128);
-	w << CmdInline(3D, Unknown450{}, 0x10);
-	w << CmdInline(3D, Unknown584{}, 0x0E);
-	w << MacroFillArray<E::IsVertexArrayPerInstance>(0);
-	w << CmdInline(3D, VertexIdConfig{}, E::VertexIdConfig::DrawArraysAddStart{});
-	w << CmdInline(3D, ZcullStatCountersEnable{}, 1);
-	w << CmdInline(3D, LineWidthSeparate{}, 1);
-	w << CmdInline(3D, Unknown0c3{}, 0);
-	w << CmdInline(3D, Unknown0c0{}, 3);
-	w << CmdInline(3D, Unknown3f7{}, 1);
-	w << CmdInline(3D, Unknown670{}, 1);
-	w << CmdInline(3D, Unknown3e3{}, 0);
-	w << CmdInline(3D, StencilTwoSideEnable{}, 1);
-	w << CmdInline(3D, SetBindlessTexture{}, 0); // Using constbuf0 as the texture constbuf
-	w << CmdInline(3D, SetSpaVersion{},
-		E::SetSpaVersion::Major{5} | E::SetSpaVersion::Minor{3} // SM 5.3
-	);
-	w << Cmd(3D, SetShaderLocalMemoryWindow{}, 0x01000000);
-	w << Cmd(3D, SetShaderLocalMemory{}, Iova(m_workBuf.getScratchMem()), Iova(m_workBuf.getScratchMemSize()));
-	w << CmdInline(3D, Unknown44c{}, 0x13);
-	w << CmdInline(3D, Unknown0dd{}, 0x00);
-	w << Cmd(3D, SetRenderLayer{}, E::SetRenderLayer::UseIndexFromVTG{});
-	w << CmdInline(3D, Unknown488{}, 5);
-	w << Cmd(3D, Unknown514{}, 8 | (getDevice()->getGpuInfo().numWarpsPerSm << 16));
-	// here there would be 2D engine commands
-	w << Macro(WriteHardwareReg, 0x00418800, 0x00000001, 0x00000001);
-	w << Macro(WriteHardwareReg, 0x00419A08, 0x00000000, 0x00000010);
-	w << Macro(WriteHardwareReg, 0x00419F78, 0x00000000, 0x00000008);
-	w << Macro(WriteHardwareReg, 0x00404468, 0x07FFFFFF, 0x3FFFFFFF);
-	w << Macro(WriteHardwareReg, 0x00419A04, 0x00000001, 0x00000001);
-	w << Macro(WriteHardwareReg, 0x00419A04, 0x00000002, 0x00000002);
-	w << CmdInline(3D, ZcullUnknown65a{}, 0x11);
-	w << CmdInline(3D, ZcullTestMask{}, 0x00);
-	w << CmdInline(3D, ZcullRegion{}, hasZcull() ? 0 : 0x3f);
-	w << CmdInline(3D, MmeStencilCullCriteria{}, 0);
-	w << Macro(SetStencilCullCriteria,
-		E::ZcullStencilCriteria::Func{DkCompareOp_NotEqual-1} | E::ZcullStencilCriteria::FuncMask{0xFF}
-	);
-	w << Cmd(3D, SetInstrumentationMethodHeader{}, 0x49000000);
-	w << Cmd(3D, SetInstrumentationMethodData{}, 0x49000001);
-	w << Cmd(3D, MmeDriverConstbufIova{}, m_workBuf.getGraphicsCbuf() >> 8, m_workBuf.getGraphicsCbufSize());
-	w << Cmd(3D, VertexRunoutBufferIova{}, Iova(m_workBuf.getVtxRunoutBuf()));
-	w << Macro(SelectDriverConstbuf, 0);
-	w << MacroSetRegisterInArray<E::Bind>(E::Bind::Constbuf{},
-		E::Bind::Constbuf::Valid{} | E::Bind::Constbuf::Index{0}
-	);
+	template <typename T>
+	void MultiDraw(DkCmdBuf obj, uint16_t macro, DkPrimitive prim, T const draws[], uint32_t numDraws)
+	{
+		// Draw records are passed as-is to the macro, so they must only consist of whole words
+		constexpr uint32_t wordsPerDraw = sizeof(T) / sizeof(uint32_t);
+		static_assert(sizeof(T) == wordsPerDraw*sizeof(uint32_t));
+
+		CmdBufWriter w{obj};
+		w.reserve(1);
+		w << MacroInline(SelectDriverConstbuf, 0); // needed for updating gl_BaseVertex/gl_BaseInstance/gl_DrawID in the driver constbuf
+
+		for (uint32_t firstDraw = 0; firstDraw < numDraws; firstDraw += s_maxDrawsPerMultiDraw)
+		{
+			uint32_t batchSize = numDraws - firstDraw;
+			if (batchSize > s_maxDrawsPerMultiDraw)
+				batchSize = s_maxDrawsPerMultiDraw;
+
+			w.reserve(4 + batchSize*wordsPerDraw);
+			w << CmdList<4>{ MakeCmdHeader(IncreaseOnce, 3 + batchSize*wordsPerDraw, Subchannel3D, macro), prim, batchSize, firstDraw };
+			w.addRawData(&draws[firstDraw], batchSize*sizeof(T));
+		}
+	}
 
-	w << CmdInline(3D, AdvancedBlendEnable{}, 0);
-	w << CmdInline(3D, IndependentBlendEnable{}, 1);
-	w << CmdInline(3D, EdgeFlag{}, 1);
-	w << CmdInline(3D, ViewportTransformEnable{}, 1);
-	using VVCC = E::ViewVolumeClipControl;
-	w << Cmd(3D, ViewVolumeClipControl{},
-		VVCC::ForceDepthRangeZeroToOne{} | VVCC::Unknown1{2} |
-		VVCC::DepthClampNear{} | VVCC::DepthClampFar{} |
-		VVCC::Unknown11{} | VVCC::Unknown12{1}
-	);
+	template <typename T>
+	void MultiDrawIndirect(DkCmdBuf obj, uint16_t macro, DkPrimitive prim, DkGpuAddr indirect, uint32_t stride, uint32_t maxDrawCount, DkGpuAddr countAddr)
+	{
+		constexpr uint32_t wordsPerDraw = sizeof(T) / sizeof(uint32_t);
+		static_assert(sizeof(T) == wordsPerDraw*sizeof(uint32_t));
+
+		CmdBufWriter w{obj};
+		w.reserve(1);
+		w << MacroInline(SelectDriverConstbuf, 0); // needed for updating gl_BaseVertex/gl_BaseInstance/gl_DrawID in the driver constbuf
+
+		for (uint32_t firstDraw = 0; firstDraw < maxDrawCount; firstDraw += s_maxDrawsPerMultiDraw)
+		{
+			uint32_t batchSize = maxDrawCount - firstDraw;
+			if (batchSize > s_maxDrawsPerMultiDraw)
+				batchSize = s_maxDrawsPerMultiDraw;
+
+			w.reserve(5);
+			w << CmdList<4>{ MakeCmdHeader(IncreaseOnce, 4 + batchSize*wordsPerDraw, Subchannel3D, macro), prim, batchSize, firstDraw };
+
+			// The draw count and the draw records are fetched straight from GPU memory,
+			// after the commands preceding them have been processed.
+			if (countAddr != DK_GPU_ADDR_INVALID)
+			{
+				w.split(CtrlCmdGpfifoEntry::NoPrefetch);
+				w.addRaw(countAddr, 1, CtrlCmdGpfifoEntry::NoPrefetch);
+			}
+			else
+				w << CmdList<1>{ maxDrawCount };
+			w.split(CtrlCmdGpfifoEntry::NoPrefetch);
+
+			DkGpuAddr records = indirect + uint64_t(firstDraw)*stride;
+			if (stride == sizeof(T))
+				w.addRaw(records, batchSize*wordsPerDraw, CtrlCmdGpfifoEntry::AutoKick);
+			else for (uint32_t i = 0; i < batchSize; i ++)
+			{
+				bool isLast = i == batchSize-1;
+				w.addRaw(records + i*stride, wordsPerDraw, isLast ? CtrlCmdGpfifoEntry::AutoKick : CtrlCmdGpfifoEntry::NoPrefetch);
+			}
+		}
+	}
 
-	// For MinusOneToOne mode, we need to do this transform: newZ = 0.5*oldZ + 0.5
-	// For ZeroToOne mode, the incoming depth value is already in the correct range.
-	bool isDepthOpenGL = getDevice()->isDepthModeOpenGL();
-	w << CmdInline(3D, SetDepthMode{}, isDepthOpenGL ? E::SetDepthMode::MinusOneToOne : E::SetDepthMode::ZeroToOne); // this controls pre-transform clipping
-	w << MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::ScaleZ{}, isDepthOpenGL ? 0.5f : 1.0f);
-	w << MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::TranslateZ{}, isDepthOpenGL ? 0.5f : 0.0f);
-
-	// Configure viewport transform XY to convert [-1,1] into [0,1]: newXY = 0.5*oldXY + 0.5
-	// Additionally, for UpperLeft origin mode, the Y value needs to be reversed since the incoming Y coordinate points up,
-	// and that needs to be fixed to point down.
-	// Also, SetWindowOriginMode seems to affect how the hardware treats polygons as front-facing or back-facing,
-	// but it doesn't actually flip rendering.
-	bool isOriginOpenGL = getDevice()->isOriginModeOpenGL();
-	w << CmdInline(3D, SetWindowOriginMode{}, isOriginOpenGL ? E::SetWindowOriginMode::Mode::LowerLeft : E::SetWindowOriginMode::Mode::UpperLeft);
-	w << MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::ScaleX{}, +0.5f);
-	w << MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::ScaleY{}, isOriginOpenGL ? +0.5f : -0.5f);
-	w << MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::TranslateX{}, +0.5f);
-	w << MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::TranslateY{}, +0.5f);
-	w << MacroSetRegisterInArray<E::Viewport>(E::Viewport::Horizontal{}, 0U | (1U << 16)); // x=0 w=1
-	w << MacroSetRegisterInArray<E::Viewport>(E::Viewport::Vertical{},   0U | (1U << 16)); // y=0 h=1
-
-	w << SetShadowRamControl(SRC::MethodTrack);
-	w << MacroSetRegisterInArray<E::Scissor>(E::Scissor::Horizontal{}, 0xFFFF0000);
-	w << MacroSetRegisterInArray<E::Scissor>(E::Scissor::Vertical{},   0xFFFF0000);
-	w << SetShadowRamControl(SRC::MethodTrackWithFilter);
+	// Commands in the 3D engine initialization sequence that depend on runtime values.
+	// The prebaked sequence contains them with placeholder values, which get patched afterwards.
+	constexpr auto SetLocalMemoryCmd(DkGpuAddr iova, uint64_t size)
+	{
+		return Cmd(3D, SetShaderLocalMemory{}, Iova(iova), Iova(size));
+	}
 
-	w << MacroFillArray<E::MmeProgramIds>(0);
-	w << MacroFillArray<E::MmeProgramOffsets>(0);
-	w << Cmd(3D, MmeDepthRenderTargetIova{}, 0xFFFFFFFF);
-
-	w << MacroSetRegisterInArray<E::VertexArray>(E::VertexArray::Start{}+0, 0);
-	w << MacroSetRegisterInArray<E::VertexArray>(E::VertexArray::Start{}+1, 0x1000);
-	w << MacroFillRegisters(E::VertexArrayLimit{}+0, 2, 16, 0);
-	w << MacroFillRegisters(E::VertexArrayLimit{}+1, 2, 16, 0xFFF);
-
-	w << Cmd(3D, IndexArrayLimitIova{}, Iova(0xFFFFFFFFFFUL));
-	w << CmdInline(3D, SampleCounterEnable{}, 1);
-	w << CmdInline(3D, ClipDistanceEnable{}, 0xFF); // Enable all clip distances
-	w << MacroFillArray<E::MultisampleSampleMask>(0xFFFF);
-	w << CmdInline(3D, ColorReductionEnable{}, 0);
-	w << CmdInline(3D, PointSpriteEnable{}, 1);
-	w << CmdInline(3D, PointCoordReplace{}, E::PointCoordReplace::Enable{1});
-	w << CmdInline(3D, VertexProgramPointSize{}, E::VertexProgramPointSize::Enable{});
-	w << Cmd(3D, PointSpriteSize{}, 1.0f);
-	w << CmdInline(3D, PipeNop{}, 0);
-
-	w << CmdInline(3D, StencilFrontFuncMask{}, 0xFF);
-	w << CmdInline(3D, StencilFrontMask{}, 0xFF);
-	w << CmdInline(3D, StencilBackFuncMask{}, 0xFF);
-	w << CmdInline(3D, StencilBackMask{}, 0xFF);
-
-	w << CmdInline(3D, DepthTargetArrayMode{}, E::DepthTargetArrayMode::Layers{1});
-	w << CmdInline(3D, SetConservativeRasterEnable{}, 0);
-	w << Macro(WriteHardwareReg, 0x00418800, 0x00000000, 0x01800000);
-	w << CmdInline(3D, MmeConservativeRasterDilateEnabled{}, 0);
-	w << CmdInline(3D, Unknown0bb{}, 0);
+	constexpr auto SetNumWarpsCmd(uint32_t numWarpsPerSm)
+	{
+		return Cmd(3D, Unknown514{}, 8 | (numWarpsPerSm << 16));
+	}
 
-	w << CmdInline(3D, SetMultisampleRasterEnable{}, 0);
-	w << CmdInline(3D, SetCoverageModulationTableEnable{}, 0);
-	w << CmdInline(3D, Unknown44c{}, 0x13);
-	w << CmdInline(3D, MultisampleCoverageToColor{}, 0);
-
-	w << Cmd(3D, SetProgramRegion{}, Iova(getDevice()->getCodeSeg().getBase()));
-	w << CmdInline(3D, Unknown5ad{}, 0);
-
-	// The following pgraph register writes apparently initialize the tile cache hardware.
-	w << Macro(WriteHardwareReg, 0x00418E40, 0x00000007, 0x0000000F);
-	w << Macro(WriteHardwareReg, 0x00418E58, 0x00000842, 0x0000FFFF);
-	w << Macro(WriteHardwareReg, 0x00418E40, 0x00000070, 0x000000F0);
-	w << Macro(WriteHardwareReg, 0x00418E58, 0x04F10000, 0xFFFF0000);
-	w << Macro(WriteHardwareReg, 0x00418E40, 0x00000700, 0x00000F00);
-	w << Macro(WriteHardwareReg, 0x00418E5C, 0x00000053, 0x0000FFFF);
-	w << Macro(WriteHardwareReg, 0x00418E40, 0x00007000, 0x0000F000);
-	w << Macro(WriteHardwareReg, 0x00418E5C, 0x00E90000, 0xFFFF0000);
-	w << Macro(WriteHardwareReg, 0x00418E40, 0x00070000, 0x000F0000);
-	w << Macro(WriteHardwareReg, 0x00418E60, 0x000000EA, 0x0000FFFF);
-	w << Macro(WriteHardwareReg, 0x00418E40, 0x00700000, 0x00F00000);
-	w << Macro(WriteHardwareReg, 0x00418E60, 0x00EB0000, 0xFFFF0000);
-	w << Macro(WriteHardwareReg, 0x00418E40, 0x07000000, 0x0F000000);
-	w << Macro(WriteHardwareReg, 0x00418E64, 0x00000208, 0x0000FFFF);
-	w << Macro(WriteHardwareReg, 0x00418E40, 0x70000000, 0xF0000000);
-	w << Macro(WriteHardwareReg, 0x00418E64, 0x02090000, 0xFFFF0000);
-	w << Macro(WriteHardwareReg, 0x00418E44, 0x00000007, 0x0000000F);
-	w << Macro(WriteHardwareReg, 0x00418E68, 0x0000020A, 0x0000FFFF);
-	w << Macro(WriteHardwareReg, 0x00418E44, 0x00000070, 0x000000F0);
-	w << Macro(WriteHardwareReg, 0x00418E68, 0x020B0000, 0xFFFF0000);
-	w << Macro(WriteHardwareReg, 0x00418E44, 0x00000700, 0x00000F00);
-	w << Macro(WriteHardwareReg, 0x00418E6C, 0x00000644, 0x0000FFFF);
-
-	w << Cmd(3D, TiledCacheTileSize{}, 0x80 | (0x80 << 16));
-	w << Cmd(3D, TiledCacheUnknownConfig0{}, 0x00001109);
-	w << Cmd(3D, TiledCacheUnknownConfig1{}, 0x08080202);
-	w << Cmd(3D, TiledCacheUnknownConfig2{}, 0x0000001F);
-	w << Cmd(3D, TiledCacheUnknownConfig3{}, 0x00080001);
-	w << CmdInline(3D, TiledCacheUnkFeatureEnable{}, 0);
+	constexpr auto SetZcullRegionCmd(bool hasZcull)
+	{
+		return CmdInline(3D, ZcullRegion{}, hasZcull ? 0 : 0x3f);
+	}
+
+	constexpr auto SetDriverConstbufCmd(DkGpuAddr iova, uint32_t size)
+	{
+		return Cmd(3D, MmeDriverConstbufIova{}, iova >> 8, size);
+	}
+
+	constexpr auto SetVtxRunoutBufCmd(DkGpuAddr iova)
+	{
+		return Cmd(3D, VertexRunoutBufferIova{}, Iova(iova));
+	}
+
+	constexpr auto SetDepthModeCmd(bool isDepthOpenGL)
+	{
+		return CmdInline(3D, SetDepthMode{}, isDepthOpenGL ? E::SetDepthMode::MinusOneToOne : E::SetDepthMode::ZeroToOne);
+	}
+
+	constexpr auto SetViewportScaleZCmd(bool isDepthOpenGL)
+	{
+		return MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::ScaleZ{}, isDepthOpenGL ? 0.5f : 1.0f);
+	}
+
+	constexpr auto SetViewportTranslateZCmd(bool isDepthOpenGL)
+	{
+		return MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::TranslateZ{}, isDepthOpenGL ? 0.5f : 0.0f);
+	}
+
+	constexpr auto SetWindowOriginModeCmd(bool isOriginOpenGL)
+	{
+		return CmdInline(3D, SetWindowOriginMode{}, isOriginOpenGL ? E::SetWindowOriginMode::Mode::LowerLeft : E::SetWindowOriginMode::Mode::UpperLeft);
+	}
+
+	constexpr auto SetViewportScaleYCmd(bool isOriginOpenGL)
+	{
+		return MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::ScaleY{}, isOriginOpenGL ? +0.5f : -0.5f);
+	}
+
+	constexpr auto SetProgramRegionCmd(DkGpuAddr iova)
+	{
+		return Cmd(3D, SetProgramRegion{}, Iova(iova));
+	}
+
+	constexpr auto Setup3DCmds()
+	{
+		return Cmds(
+		CmdInline(3D, MultisampleEnable{}, 0),
+		CmdInline(3D, CsaaEnable{}, 0),
+		CmdInline(3D, MultisampleMode{}, MsaaMode_1x1),
+		CmdInline(3D, MultisampleControl{}, 0),
+		CmdInline(3D, Unknown1d3{}, 0x3F),
+		MacroFillRegisterArray<E::WindowRectangle>(0),
+		CmdInline(3D, ClearBufferFlags{}, E::ClearBufferFlags::StencilMask{} | E::ClearBufferFlags::Scissor{}),
+		MacroSetRegisterInArray<E::Scissor>(E::Scissor::Enable{}, 1),
+		Cmd(3D, Unknown5aa{}, 0x00030003),
+		Cmd(3D, Unknown5e5{}, 0x00020002),
+		CmdInline(3D, PrimitiveRestartWithDrawArrays{}, 0),
+		CmdInline(3D, PointRasterRules{}, 0),
+		CmdInline(3D, LinkedTsc{}, 0),
+		CmdInline(3D, ProvokingVertexLast{}, 1),
+		CmdInline(3D, SetShaderExceptions{}, 0),
+		CmdInline(3D, Unknown400{}, 0x10),
+		CmdInline(3D, Unknown086{}, 0x10),
+		CmdInline(3D, Unknown43f{}, 0x10),
+		CmdInline(3D, Unknown4a4{}, 0x10),
+		CmdInline(3D, Unknown4b6{}+0, 0x10),
+		CmdInline(3D, Unknown4b6{}+1, 0x10),
+		CmdInline(3D, SetApiVisibleCallLimit{}, E::SetApiVisibleCallLimit::Cta::_128),
+		CmdInline(3D, Unknown450{}, 0x10),
+		CmdInline(3D, Unknown584{}, 0x0E),
+		MacroFillArray<E::IsVertexArrayPerInstance>(0),
+		CmdInline(3D, VertexIdConfig{}, E::VertexIdConfig::DrawArraysAddStart{}),
+		CmdInline(3D, ZcullStatCountersEnable{}, 1),
+		CmdInline(3D, LineWidthSeparate{}, 1),
+		CmdInline(3D, Unknown0c3{}, 0),
+		CmdInline(3D, Unknown0c0{}, 3),
+		CmdInline(3D, Unknown3f7{}, 1),
+		CmdInline(3D, Unknown670{}, 1),
+		CmdInline(3D, Unknown3e3{}, 0),
+		CmdInline(3D, StencilTwoSideEnable{}, 1),
+		CmdInline(3D, SetBindlessTexture{}, 0), // Using constbuf0 as the texture constbuf
+		CmdInline(3D, SetSpaVersion{},
+			E::SetSpaVersion::Major{5} | E::SetSpaVersion::Minor{3} // SM 5.3
+		),
+		Cmd(3D, SetShaderLocalMemoryWindow{}, 0x01000000),
+		SetLocalMemoryCmd(0, 0),
+		CmdInline(3D, Unknown44c{}, 0x13),
+		CmdInline(3D, Unknown0dd{}, 0x00),
+		Cmd(3D, SetRenderLayer{}, E::SetRenderLayer::UseIndexFromVTG{}),
+		CmdInline(3D, Unknown488{}, 5),
+		SetNumWarpsCmd(0),
+		// here there would be 2D engine commands
+		Macro(WriteHardwareReg, 0x00418800, 0x00000001, 0x00000001),
+		Macro(WriteHardwareReg, 0x00419A08, 0x00000000, 0x00000010),
+		Macro(WriteHardwareReg, 0x00419F78, 0x00000000, 0x00000008),
+		Macro(WriteHardwareReg, 0x00404468, 0x07FFFFFF, 0x3FFFFFFF),
+		Macro(WriteHardwareReg, 0x00419A04, 0x00000001, 0x00000001),
+		Macro(WriteHardwareReg, 0x00419A04, 0x00000002, 0x00000002),
+		CmdInline(3D, ZcullUnknown65a{}, 0x11),
+		CmdInline(3D, ZcullTestMask{}, 0x00),
+		SetZcullRegionCmd(false),
+		CmdInline(3D, MmeStencilCullCriteria{}, 0),
+		Macro(SetStencilCullCriteria,
+			E::ZcullStencilCriteria::Func{DkCompareOp_NotEqual-1} | E::ZcullStencilCriteria::FuncMask{0xFF}
+		),
+		Cmd(3D, SetInstrumentationMethodHeader{}, 0x49000000),
+		Cmd(3D, SetInstrumentationMethodData{}, 0x49000001),
+		SetDriverConstbufCmd(0, 0),
+		SetVtxRunoutBufCmd(0),
+		Macro(SelectDriverConstbuf, 0),
+		MacroSetRegisterInArray<E::Bind>(E::Bind::Constbuf{},
+			E::Bind::Constbuf::Valid{} | E::Bind::Constbuf::Index{0}
+		),
+
+		CmdInline(3D, AdvancedBlendEnable{}, 0),
+		CmdInline(3D, IndependentBlendEnable{}, 1),
+		CmdInline(3D, EdgeFlag{}, 1),
+		CmdInline(3D, ViewportTransformEnable{}, 1),
+		Cmd(3D, ViewVolumeClipControl{},
+			E::ViewVolumeClipControl::ForceDepthRangeZeroToOne{} | E::ViewVolumeClipControl::Unknown1{2} |
+			E::ViewVolumeClipControl::DepthClampNear{} | E::ViewVolumeClipControl::DepthClampFar{} |
+			E::ViewVolumeClipControl::Unknown11{} | E::ViewVolumeClipControl::Unknown12{1}
+		),
+
+		// For MinusOneToOne mode, we need to do this transform: newZ = 0.5*oldZ + 0.5
+		// For ZeroToOne mode, the incoming depth value is already in the correct range.
+		SetDepthModeCmd(false), // this controls pre-transform clipping
+		SetViewportScaleZCmd(false),
+		SetViewportTranslateZCmd(false),
+
+		// Configure viewport transform XY to convert [-1,1] into [0,1]: newXY = 0.5*oldXY + 0.5
+		// Additionally, for UpperLeft origin mode, the Y value needs to be reversed since the incoming Y coordinate points up,
+		// and that needs to be fixed to point down.
+		// Also, SetWindowOriginMode seems to affect how the hardware treats polygons as front-facing or back-facing,
+		// but it doesn't actually flip rendering.
+		SetWindowOriginModeCmd(false),
+		MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::ScaleX{}, +0.5f),
+		SetViewportScaleYCmd(false),
+		MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::TranslateX{}, +0.5f),
+		MacroSetRegisterInArray<E::ViewportTransform>(E::ViewportTransform::TranslateY{}, +0.5f),
+		MacroSetRegisterInArray<E::Viewport>(E::Viewport::Horizontal{}, 0U | (1U << 16)), // x=0 w=1
+		MacroSetRegisterInArray<E::Viewport>(E::Viewport::Vertical{},   0U | (1U << 16)), // y=0 h=1
+
+		SetShadowRamControl(SRC::MethodTrack),
+		MacroSetRegisterInArray<E::Scissor>(E::Scissor::Horizontal{}, 0xFFFF0000),
+		MacroSetRegisterInArray<E::Scissor>(E::Scissor::Vertical{},   0xFFFF0000),
+		SetShadowRamControl(SRC::MethodTrackWithFilter),
+
+		MacroFillArray<E::MmeProgramIds>(0),
+		MacroFillArray<E::MmeProgramOffsets>(0),
+		Cmd(3D, MmeDepthRenderTargetIova{}, 0xFFFFFFFF),
+
+		MacroSetRegisterInArray<E::VertexArray>(E::VertexArray::Start{}+0, 0),
+		MacroSetRegisterInArray<E::VertexArray>(E::VertexArray::Start{}+1, 0x1000),
+		MacroFillRegisters(E::VertexArrayLimit{}+0, 2, 16, 0),
+		MacroFillRegisters(E::VertexArrayLimit{}+1, 2, 16, 0xFFF),
+
+		Cmd(3D, IndexArrayLimitIova{}, Iova(0xFFFFFFFFFFUL)),
+		CmdInline(3D, SampleCounterEnable{}, 1),
+		CmdInline(3D, ClipDistanceEnable{}, 0xFF), // Enable all clip distances
+		MacroFillArray<E::MultisampleSampleMask>(0xFFFF),
+		CmdInline(3D, ColorReductionEnable{}, 0),
+		CmdInline(3D, PointSpriteEnable{}, 1),
+		CmdInline(3D, PointCoordReplace{}, E::PointCoordReplace::Enable{1}),
+		CmdInline(3D, VertexProgramPointSize{}, E::VertexProgramPointSize::Enable{}),
+		Cmd(3D, PointSpriteSize{}, 1.0f),
+		CmdInline(3D, PipeNop{}, 0),
+
+		CmdInline(3D, StencilFrontFuncMask{}, 0xFF),
+		CmdInline(3D, StencilFrontMask{}, 0xFF),
+		CmdInline(3D, StencilBackFuncMask{}, 0xFF),
+		CmdInline(3D, StencilBackMask{}, 0xFF),
+
+		CmdInline(3D, DepthTargetArrayMode{}, E::DepthTargetArrayMode::Layers{1}),
+		CmdInline(3D, SetConservativeRasterEnable{}, 0),
+		Macro(WriteHardwareReg, 0x00418800, 0x00000000, 0x01800000),
+		CmdInline(3D, MmeConservativeRasterDilateEnabled{}, 0),
+		CmdInline(3D, Unknown0bb{}, 0),
+
+		CmdInline(3D, SetMultisampleRasterEnable{}, 0),
+		CmdInline(3D, SetCoverageModulationTableEnable{}, 0),
+		CmdInline(3D, Unknown44c{}, 0x13),
+		CmdInline(3D, MultisampleCoverageToColor{}, 0),
+
+		SetProgramRegionCmd(0),
+		CmdInline(3D, Unknown5ad{}, 0),
+
+		// The following pgraph register writes apparently initialize the tile cache hardware.
+		Macro(WriteHardwareReg, 0x00418E40, 0x00000007, 0x0000000F),
+		Macro(WriteHardwareReg, 0x00418E58, 0x00000842, 0x0000FFFF),
+		Macro(WriteHardwareReg, 0x00418E40, 0x00000070, 0x000000F0),
+		Macro(WriteHardwareReg, 0x00418E58, 0x04F10000, 0xFFFF0000),
+		Macro(WriteHardwareReg, 0x00418E40, 0x00000700, 0x00000F00),
+		Macro(WriteHardwareReg, 0x00418E5C, 0x00000053, 0x0000FFFF),
+		Macro(WriteHardwareReg, 0x00418E40, 0x00007000, 0x0000F000),
+		Macro(WriteHardwareReg, 0x00418E5C, 0x00E90000, 0xFFFF0000),
+		Macro(WriteHardwareReg, 0x00418E40, 0x00070000, 0x000F0000),
+		Macro(WriteHardwareReg, 0x00418E60, 0x000000EA, 0x0000FFFF),
+		Macro(WriteHardwareReg, 0x00418E40, 0x00700000, 0x00F00000),
+		Macro(WriteHardwareReg, 0x00418E60, 0x00EB0000, 0xFFFF0000),
+		Macro(WriteHardwareReg, 0x00418E40, 0x07000000, 0x0F000000),
+		Macro(WriteHardwareReg, 0x00418E64, 0x00000208, 0x0000FFFF),
+		Macro(WriteHardwareReg, 0x00418E40, 0x70000000, 0xF0000000),
+		Macro(WriteHardwareReg, 0x00418E64, 0x02090000, 0xFFFF0000),
+		Macro(WriteHardwareReg, 0x00418E44, 0x00000007, 0x0000000F),
+		Macro(WriteHardwareReg, 0x00418E68, 0x0000020A, 0x0000FFFF),
+		Macro(WriteHardwareReg, 0x00418E44, 0x00000070, 0x000000F0),
+		Macro(WriteHardwareReg, 0x00418E68, 0x020B0000, 0xFFFF0000),
+		Macro(WriteHardwareReg, 0x00418E44, 0x00000700, 0x00000F00),
+		Macro(WriteHardwareReg, 0x00418E6C, 0x00000644, 0x0000FFFF),
+
+		Cmd(3D, TiledCacheTileSize{}, 0x80 | (0x80 << 16)),
+		Cmd(3D, TiledCacheUnknownConfig0{}, 0x00001109),
+		Cmd(3D, TiledCacheUnknownConfig1{}, 0x08080202),
+		Cmd(3D, TiledCacheUnknownConfig2{}, 0x0000001F),
+		Cmd(3D, TiledCacheUnknownConfig3{}, 0x00080001),
+		CmdInline(3D, TiledCacheUnkFeatureEnable{}, 0)
+		);
+	}
+
+	constexpr auto s_setup3DCmds = Setup3DCmds();
+
+	// Offsets of the commands in s_setup3DCmds that get patched at runtime
+	struct Setup3DRelocs
+	{
+		uint32_t localMemory;
+		uint32_t numWarps;
+		uint32_t zcullRegion;
+		uint32_t driverConstbuf;
+		uint32_t vtxRunoutBuf;
+		uint32_t depthMode;
+		uint32_t viewportScaleZ;
+		uint32_t viewportTranslateZ;
+		uint32_t windowOriginMode;
+		uint32_t viewportScaleY;
+		uint32_t programRegion;
+
+		constexpr bool isValid(uint32_t size) const
+		{
+			return localMemory < size && numWarps < size && zcullRegion < size &&
+				driverConstbuf < size && vtxRunoutBuf < size && depthMode < size &&
+				viewportScaleZ < size && viewportTranslateZ < size && windowOriginMode < size &&
+				viewportScaleY < size && programRegion < size;
+		}
+	};
+
+	constexpr Setup3DRelocs s_setup3DRelocs =
+	{
+		FindCmd(s_setup3DCmds, SetLocalMemoryCmd(0, 0)),
+		FindCmd(s_setup3DCmds, SetNumWarpsCmd(0)),
+		FindCmd(s_setup3DCmds, SetZcullRegionCmd(false)),
+		FindCmd(s_setup3DCmds, SetDriverConstbufCmd(0, 0)),
+		FindCmd(s_setup3DCmds, SetVtxRunoutBufCmd(0)),
+		FindCmd(s_setup3DCmds, SetDepthModeCmd(false)),
+		FindCmd(s_setup3DCmds, SetViewportScaleZCmd(false)),
+		FindCmd(s_setup3DCmds, SetViewportTranslateZCmd(false)),
+		FindCmd(s_setup3DCmds, SetWindowOriginModeCmd(false)),
+		FindCmd(s_setup3DCmds, SetViewportScaleYCmd(false)),
+		FindCmd(s_setup3DCmds, SetProgramRegionCmd(0)),
+	};
+
+	static_assert(s_setup3DRelocs.isValid(s_setup3DCmds.getSize()), "missing command in the 3D engine setup sequence");
+}
+
+void Queue::setup3DEngine()
+{
+	DkDevice dev = getDevice();
+	bool isDepthOpenGL = dev->isDepthModeOpenGL();
+	bool isOriginOpenGL = dev->isOriginModeOpenGL();
+	auto const& r = s_setup3DRelocs;
+
+	CmdBufWriter w{&m_cmdBuf};
+	CmdWord* cmds = w.reserve(s_setup3DCmds.getSize());
+	w << s_setup3DCmds;
+
+	// Patch in the values that are only known at runtime
+	SetLocalMemoryCmd(m_workBuf.getScratchMem(), m_workBuf.getScratchMemSize()).moveTo(&cmds[r.localMemory]);
+	SetNumWarpsCmd(dev->getGpuInfo().numWarpsPerSm).moveTo(&cmds[r.numWarps]);
+	SetZcullRegionCmd(hasZcull()).moveTo(&cmds[r.zcullRegion]);
+	SetDriverConstbufCmd(m_workBuf.getGraphicsCbuf(), m_workBuf.getGraphicsCbufSize()).moveTo(&cmds[r.driverConstbuf]);
+	SetVtxRunoutBufCmd(m_workBuf.getVtxRunoutBuf()).moveTo(&cmds[r.vtxRunoutBuf]);
+	SetDepthModeCmd(isDepthOpenGL).moveTo(&cmds[r.depthMode]);
+	SetViewportScaleZCmd(isDepthOpenGL).moveTo(&cmds[r.viewportScaleZ]);
+	SetViewportTranslateZCmd(isDepthOpenGL).moveTo(&cmds[r.viewportTranslateZ]);
+	SetWindowOriginModeCmd(isOriginOpenGL).moveTo(&cmds[r.windowOriginMode]);
+	SetViewportScaleYCmd(isOriginOpenGL).moveTo(&cmds[r.viewportScaleY]);
+	SetProgramRegionCmd(dev->getCodeSeg().getBase()).moveTo(&cmds[r.programRegion]);
 }
 
 void dkCmdBufBindRenderTargets(DkCmdBuf obj, DkImageView const* const colorTargets[], uint32_t numColorTargets, DkImageView const* depthTarget)
@@ -354,14 +543,14 @@ void dkCmdBufSetViewports(DkCmdBuf obj, uint32_t firstId, DkViewport const viewp
 		float viewportNear = depthRange >= 0 ? v.near : v.far;
 		float viewportFar  = depthRange >= 0 ? v.far  : v.near;
 
-		w << Cmd(3D, ViewportTransform::ScaleX{id},
+		w.addState(Cmd(3D, ViewportTransform::ScaleX{id},
 			scaleX, scaleY, scaleZ,
-			offsetX, offsetY, offsetZ);
-		w << Cmd(3D, Viewport::Horizontal{id},
+			offsetX, offsetY, offsetZ));
+		w.addState(Cmd(3D, Viewport::Horizontal{id},
 			viewportX | (viewportW << 16),
 			viewportY | (viewportH << 16),
 			viewportNear,
-			viewportFar);
+			viewportFar));
 	}
 }
 
@@ -409,10 +598,10 @@ void dkCmdBufSetScissors(DkCmdBuf obj, uint32_t firstId, DkScissor const scissor
 		DkScissor const& s = scissors[i];
 		uint32_t id = firstId + i;
 
-		w << Cmd(3D, Scissor::Horizontal{id},
+		w.addState(Cmd(3D, Scissor::Horizontal{id},
 			s.x | ((s.x+s.width) <<16),
 			s.y | ((s.y+s.height)<<16)
-		);
+		));
 	}
 
 }
@@ -583,3 +772,53 @@ void dkCmdBufDrawIndexedIndirect(DkCmdBuf obj, DkPrimitive prim, DkGpuAddr indir
 	w.split(CtrlCmdGpfifoEntry::NoPrefetch);
 	w.addRaw(indirect, 5, CtrlCmdGpfifoEntry::AutoKick);
 }
+
+void dkCmdBufMultiDraw(DkCmdBuf obj, DkPrimitive prim, DkDrawIndirectData const draws[], uint32_t numDraws)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL_ARRAY(draws, numDraws);
+	if (!numDraws)
+		return;
+
+	MultiDraw(obj, MmeMacroMultiDraw, prim, draws, numDraws);
+}
+
+void dkCmdBufMultiDrawIndexed(DkCmdBuf obj, DkPrimitive prim, DkDrawIndexedIndirectData const draws[], uint32_t numDraws)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_NON_NULL_ARRAY(draws, numDraws);
+	if (!numDraws)
+		return;
+
+	MultiDraw(obj, MmeMacroMultiDrawIndexed, prim, draws, numDraws);
+}
+
+void dkCmdBufMultiDrawIndirect(DkCmdBuf obj, DkPrimitive prim, DkGpuAddr indirect, uint32_t stride, uint32_t maxDrawCount, DkGpuAddr countAddr)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_BAD_INPUT(indirect == DK_GPU_ADDR_INVALID);
+	DK_DEBUG_DATA_ALIGN(indirect, 4);
+	DK_DEBUG_SIZE_ALIGN(stride, 4);
+	DK_DEBUG_BAD_INPUT(stride < sizeof(DkDrawIndirectData));
+	if (countAddr != DK_GPU_ADDR_INVALID)
+		DK_DEBUG_DATA_ALIGN(countAddr, 4);
+	if (!maxDrawCount)
+		return;
+
+	MultiDrawIndirect<DkDrawIndirectData>(obj, MmeMacroMultiDrawIndirect, prim, indirect, stride, maxDrawCount, countAddr);
+}
+
+void dkCmdBufMultiDrawIndexedIndirect(DkCmdBuf obj, DkPrimitive prim, DkGpuAddr indirect, uint32_t stride, uint32_t maxDrawCount, DkGpuAddr countAddr)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_BAD_INPUT(indirect == DK_GPU_ADDR_INVALID);
+	DK_DEBUG_DATA_ALIGN(indirect, 4);
+	DK_DEBUG_SIZE_ALIGN(stride, 4);
+	DK_DEBUG_BAD_INPUT(stride < sizeof(DkDrawIndexedIndirectData));
+	if (countAddr != DK_GPU_ADDR_INVALID)
+		DK_DEBUG_DATA_ALIGN(countAddr, 4);
+	if (!maxDrawCount)
+		return;
+
+	MultiDrawIndirect<DkDrawIndexedIndirectData>(obj, MmeMacroMultiDrawIndexedIndirect, prim, indirect, stride, maxDrawCount, countAddr);
+}
@@ -119,14 +119,14 @@ void dkCmdBufBindBlendStates(DkCmdBuf obj, uint32_t firstId, DkBlendState const
 	for (uint32_t i = 0; i < numStates; i ++)
 	{
 		DkBlendState const& state = states[i];
-		w << Cmd(3D, IndependentBlend::EquationRgb{firstId+i},
+		w.addState(Cmd(3D, IndependentBlend::EquationRgb{firstId+i},
 			state.colorBlendOp,                               // EquationRgb
 			getBlendFactorSetting(state.srcColorBlendFactor), // FuncRgbSrc
 			getBlendFactorSetting(state.dstColorBlendFactor), // FuncRgbDst
 			state.alphaBlendOp,                               // EquationAlpha
 			getBlendFactorSetting(state.srcAlphaBlendFactor), // FuncAlphaSrc
 			getBlendFactorSetting(state.dstColorBlendFactor)  // FuncAlphaDst
-		);
+		));
 	}
 }
 
@@ -139,8 +139,8 @@ void dkCmdBufBindDepthStencilState(DkCmdBuf obj, DkDepthStencilState const* stat
 
 	static_assert(sizeof(DkDepthStencilState) == 8, "Bad definition for DkDepthStencilState");
 
-	w << CmdList<1>{ MakeCmdHeader(IncreaseOnce, 2, Subchannel3D, MmeMacroBindDepthStencilState) };
-	w.addRawData(state, 8);
+	uint32_t const* words = reinterpret_cast<uint32_t const*>(state);
+	w.addState(Macro(BindDepthStencilState, words[0], words[1]));
 }
 
 void dkCmdBufSetDepthBias(DkCmdBuf obj, float constantFactor, float clamp, float slopeFactor)
@@ -149,9 +149,9 @@ void dkCmdBufSetDepthBias(DkCmdBuf obj, float constantFactor, float clamp, float
 	CmdBufWriter w{obj};
 	w.reserve(6);
 
-	w << Cmd(3D, PolygonOffsetUnits{}, constantFactor*2.0f);
-	w << Cmd(3D, PolygonOffsetClamp{}, clamp);
-	w << Cmd(3D, PolygonOffsetFactor{}, slopeFactor);
+	w.addState(Cmd(3D, PolygonOffsetUnits{}, constantFactor*2.0f));
+	w.addState(Cmd(3D, PolygonOffsetClamp{}, clamp));
+	w.addState(Cmd(3D, PolygonOffsetFactor{}, slopeFactor));
 }
 
 void dkCmdBufSetPointSize(DkCmdBuf obj, float size)
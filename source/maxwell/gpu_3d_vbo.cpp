@@ -13,13 +13,21 @@ void dkCmdBufBindVtxAttribState(DkCmdBuf obj, DkVtxAttribState const attribs[],
 	DK_ENTRYPOINT(obj);
 	DK_DEBUG_BAD_INPUT(numAttribs > DK_MAX_VERTEX_ATTRIBS);
 	DK_DEBUG_NON_NULL_ARRAY(attribs, numAttribs);
+
+	// Slots past the ones used by the previous bind already hold the unused attribute state
+	uint32_t numWords = obj->swapNumVtxAttribs(numAttribs);
+	if (numWords < numAttribs)
+		numWords = numAttribs;
+	if (!numWords)
+		return;
+
 	CmdBufWriter w{obj};
-	w.reserve(1+DK_MAX_VERTEX_ATTRIBS);
+	w.reserve(1+numWords);
 
-	w << CmdList<1> { MakeCmdHeader(Increasing, DK_MAX_VERTEX_ATTRIBS, Subchannel3D, E::VertexAttribState{}) };
+	w << CmdList<1> { MakeCmdHeader(Increasing, numWords, Subchannel3D, E::VertexAttribState{}) };
 	w.addRawData(attribs, numAttribs*sizeof(DkVtxAttribState));
 
-	for (uint32_t i = numAttribs; i < DK_MAX_VERTEX_ATTRIBS; i ++)
+	for (uint32_t i = numAttribs; i < numWords; i ++)
 	{
 		using VS = E::VertexAttribState;
 		w << CmdList<1> { VS::IsFixed{} | VS::Size{DkVtxAttribSize_1x32} | VS::Type{DkVtxAttribType_Float} };
@@ -31,8 +39,14 @@ void dkCmdBufBindVtxBufferState(DkCmdBuf obj, DkVtxBufferState const buffers[],
 	DK_ENTRYPOINT(obj);
 	DK_DEBUG_BAD_INPUT(numBuffers > DK_MAX_VERTEX_BUFFERS);
 	DK_DEBUG_NON_NULL_ARRAY(buffers, numBuffers);
+
+	// Slots past the ones used by the previous bind are already disabled
+	uint32_t numSlots = obj->swapNumVtxBuffers(numBuffers);
+	if (numSlots < numBuffers)
+		numSlots = numBuffers;
+
 	CmdBufWriter w{obj};
-	w.reserve(4*numBuffers + 1*(DK_MAX_VERTEX_BUFFERS-numBuffers));
+	w.reserve(4*numBuffers + 1*(numSlots-numBuffers));
 
 	for (uint32_t i = 0; i < numBuffers; i ++)
 	{
@@ -44,7 +58,7 @@ void dkCmdBufBindVtxBufferState(DkCmdBuf obj, DkVtxBufferState const buffers[],
 			w << Cmd(3D, VertexArray::Divisor{i}, state.divisor);
 	}
 
-	for (uint32_t i = numBuffers; i < DK_MAX_VERTEX_BUFFERS; i ++)
+	for (uint32_t i = numBuffers; i < numSlots; i ++)
 		w << CmdInline(3D, VertexArray::Config{i}, 0);
 }
 
@@ -67,7 +81,7 @@ void dkCmdBufBindVtxBuffers(DkCmdBuf obj, uint32_t firstId, DkBufExtents const b
 			bufLimit = buf.addr + buf.size - 1;
 		}
 
-		w << Cmd(3D, VertexArray::Start{firstId+i}, Iova(bufStart));
-		w << Cmd(3D, VertexArrayLimit{}+2*(firstId+i), Iova(bufLimit));
+		w.addState(Cmd(3D, VertexArray::Start{firstId+i}, Iova(bufStart)));
+		w.addState(Cmd(3D, VertexArrayLimit{}+2*(firstId+i), Iova(bufLimit)));
 	}
 }
@@ -12,10 +12,9 @@
 using namespace maxwell;
 using namespace dk::detail;
 
-void Queue::setupEngines()
+namespace
 {
-	CmdBufWriter w{&m_cmdBuf};
-	w.reserveAdd(
+	constexpr auto s_setupEnginesCmds = Cmds(
 		BindEngine(3D),
 		BindEngine(Compute),
 		BindEngine(Copy),
@@ -25,6 +24,12 @@ void Queue::setupEngines()
 	);
 }
 
+void Queue::setupEngines()
+{
+	CmdBufWriter w{&m_cmdBuf};
+	w.reserveAdd(s_setupEnginesCmds);
+}
+
 void Queue::postSubmitFlush()
 {
 	// Invalidate image cache, image/sampler descriptor cache, shader caches, and L2 cache
@@ -116,6 +121,23 @@ void dkCmdBufBarrier(DkCmdBuf obj, DkBarrier mode, uint32_t invalidateFlags)
 		w.split(CtrlCmdGpfifoEntry::AutoKick | CtrlCmdGpfifoEntry::NoPrefetch);
 }
 
+void dkCmdBufWriteTimestamp(DkCmdBuf obj, DkGpuAddr addr)
+{
+	DK_ENTRYPOINT(obj);
+	DK_DEBUG_DATA_ALIGN(addr, DK_TIMESTAMP_ALIGNMENT);
+
+	// A four-word semaphore release writes the payload followed by the 64-bit GPU timestamp,
+	// once all previous work is done (FenceEnable)
+	using S = Engine3D::SetReportSemaphore;
+	CmdBufWriter w{obj};
+	w.reserve(5);
+	w << Cmd(3D, SetReportSemaphoreOffset{},
+		Iova(addr),
+		0,
+		S::Operation::Release | S::FenceEnable{} | S::Unit::Crop | S::StructureSize::FourWords
+	);
+}
+
 void dkCmdBufBindImageDescriptorSet(DkCmdBuf obj, DkGpuAddr setAddr, uint32_t numDescriptors)
 {
 	DK_ENTRYPOINT(obj);
@@ -3,6 +3,8 @@
 #include "../queue_compute.h"
 #include "../cmdbuf_writer.h"
 
+#include "mme_macros.h"
+#include "engine_3d.h"
 #include "engine_compute.h"
 
 using namespace maxwell;
@@ -26,6 +28,64 @@ namespace
 		);
 		w << CmdList<1>{ MakeCmdHeader(NonIncreasing, (sizeBytes + 3) / 4, SubchannelCompute, C::LoadInlineData{}) };
 	}
+
+	// Commands in the compute engine initialization sequence that depend on runtime values
+	constexpr auto SetProgramRegionCmd(DkGpuAddr iova)
+	{
+		return Cmd(Compute, SetProgramRegion{}, Iova(iova));
+	}
+
+	constexpr auto SetLocalMemoryCmd(DkGpuAddr iova)
+	{
+		return Cmd(Compute, SetShaderLocalMemory{}, Iova(iova));
+	}
+
+	constexpr auto SetLocalMemoryThrottlingCmd(uint32_t scratchMemPerSm)
+	{
+		return Cmd(Compute, SetShaderLocalMemoryNonThrottledA{},
+			0, scratchMemPerSm, 0x100, // NonThrottled
+			0, scratchMemPerSm, 0x100  // Throttled
+		);
+	}
+
+	constexpr auto s_computeInitCmds = Cmds(
+		CmdInline(Compute, SetShaderExceptions{}, 0),
+		CmdInline(Compute, SetBindlessTexture{}, 0), // Using constbuf0 as the texture constbuf
+		Cmd(Compute, SetShaderLocalMemoryWindow{}, 0x01000000),
+		Cmd(Compute, SetShaderSharedMemoryWindow{}, 0x03000000),
+		SetProgramRegionCmd(0),
+		CmdInline(Compute, SetSpaVersion{},
+			C::SetSpaVersion::Major{5} | C::SetSpaVersion::Minor{3} // SM 5.3
+		),
+		SetLocalMemoryCmd(0),
+		SetLocalMemoryThrottlingCmd(0)
+	);
+
+	// Offsets of the commands in s_computeInitCmds that get patched at runtime
+	struct ComputeInitRelocs
+	{
+		uint32_t programRegion;
+		uint32_t localMemory;
+		uint32_t localMemoryThrottling;
+	};
+
+	constexpr ComputeInitRelocs s_computeInitRelocs =
+	{
+		FindCmd(s_computeInitCmds, SetProgramRegionCmd(0)),
+		FindCmd(s_computeInitCmds, SetLocalMemoryCmd(0)),
+		FindCmd(s_computeInitCmds, SetLocalMemoryThrottlingCmd(0)),
+	};
+
+	// Offsets hardcoded in the PatchComputeJobGridSize macro
+	static_assert(offsetof(ComputeQmd, cta_raster_width) == 0x30 &&
+		sizeof(ComputeQmd) + offsetof(ComputeDriverCbuf, gridSize) == 0x10C &&
+		sizeof(ComputeQmd) + offsetof(ComputeDriverCbuf, gridSize) + 12 <= 0x200,
+		"mismatched compute job layout in PatchComputeJobGridSize");
+
+	static_assert(s_computeInitRelocs.programRegion < s_computeInitCmds.getSize() &&
+		s_computeInitRelocs.localMemory < s_computeInitCmds.getSize() &&
+		s_computeInitRelocs.localMemoryThrottling < s_computeInitCmds.getSize(),
+		"missing command in the compute engine setup sequence");
 }
 
 void ComputeQueue::initQmd()
@@ -40,26 +100,20 @@ void ComputeQueue::initQmd()
 void ComputeQueue::initComputeEngine()
 {
 	DkDevice dev = m_parent.getDevice();
-	CmdBufWriter w{&m_parent.m_cmdBuf};
-	w.reserve(20);
+	auto const& r = s_computeInitRelocs;
 
 	DkGpuAddr scratchMemIova = m_parent.m_workBuf.getScratchMem();
 	uint32_t scratchMemPerSm = m_parent.m_workBuf.getScratchMemSize() / dev->getGpuInfo().numSms;
 	scratchMemPerSm &= ~0x7FFF;
 
-	w << CmdInline(Compute, SetShaderExceptions{}, 0);
-	w << CmdInline(Compute, SetBindlessTexture{}, 0); // Using constbuf0 as the texture constbuf
-	w << Cmd(Compute, SetShaderLocalMemoryWindow{}, 0x01000000);
-	w << Cmd(Compute, SetShaderSharedMemoryWindow{}, 0x03000000);
-	w << Cmd(Compute, SetProgramRegion{}, Iova(dev->getCodeSeg().getBase()));
-	w << CmdInline(Compute, SetSpaVersion{},
-		C::SetSpaVersion::Major{5} | C::SetSpaVersion::Minor{3} // SM 5.3
-	);
-	w << Cmd(Compute, SetShaderLocalMemory{}, Iova(scratchMemIova));
-	w << Cmd(Compute, SetShaderLocalMemoryNonThrottledA{},
-		0, scratchMemPerSm, 0x100, // NonThrottled
-		0, scratchMemPerSm, 0x100  // Throttled
-	);
+	CmdBufWriter w{&m_parent.m_cmdBuf};
+	CmdWord* cmds = w.reserve(s_computeInitCmds.getSize());
+	w << s_computeInitCmds;
+
+	// Patch in the values that are only known at runtime
+	SetProgramRegionCmd(dev->getCodeSeg().getBase()).moveTo(&cmds[r.programRegion]);
+	SetLocalMemoryCmd(scratchMemIova).moveTo(&cmds[r.localMemory]);
+	SetLocalMemoryThrottlingCmd(scratchMemPerSm).moveTo(&cmds[r.localMemoryThrottling]);
 }
 
 void ComputeQueue::bindConstbuf(uint32_t id, DkGpuAddr addr, uint32_t size)
@@ -122,27 +176,48 @@ void ComputeQueue::bindShader(CtrlCmdComputeShader const* cmd)
 	job.qmd.shader_local_memory_crs_size = cmd->crsSize;
 	bindConstbuf(1, dev->getCodeSeg().getBase() + cmd->dataOffset, (cmd->dataSize + 0xFF) &~ 0xFF);
 
-	job.cbuf.ctaSize[0] = cmd->blockDims[0];
-	job.cbuf.ctaSize[1] = cmd->blockDims[1];
-	job.cbuf.ctaSize[2] = cmd->blockDims[2];
+	updateCbuf(job.cbuf.ctaSize[0], cmd->blockDims[0]);
+	updateCbuf(job.cbuf.ctaSize[1], cmd->blockDims[1]);
+	updateCbuf(job.cbuf.ctaSize[2], cmd->blockDims[2]);
+}
+
+uint32_t ComputeQueue::reserveJob()
+{
+	while (m_numJobsLaunched - m_numJobsReleased >= m_numJobSlots)
+	{
+		// All job slots are in use: wait for the oldest fence in the ring to be signaled.
+		// If no fence covers the jobs yet, signal one and submit it first. Note that the
+		// fence is released by the 3D engine, which only runs after preceding compute
+		// work in the channel has completed.
+		if (!m_parent.waitFenceRing())
+		{
+			m_parent.flushRing();
+			if (!m_parent.isInErrorState())
+				m_parent.flush();
+		}
+	}
+	return m_numJobsLaunched % m_numJobSlots;
 }
 
 void ComputeQueue::dispatch(uint32_t numGroupsX, uint32_t numGroupsY, uint32_t numGroupsZ, DkGpuAddr indirect)
 {
+	// This may need to flush the queue, so it must happen before reserving command space
+	uint32_t jobId = reserveJob();
+
 	CmdBufWriter w{&m_parent.m_cmdBuf};
-	w.reserve(7 + s_jobSizeWords + 7*3 + 3);
+	w.reserve(1 + 7 + s_jobSizeWords + 2 + 2 + 3);
+
+	// Only claim the slot now: reserving command space may have signaled a ring fence,
+	// which must not account for this job since it's launched after the fence
+	m_numJobsLaunched ++;
 
-	uint32_t jobId = m_curJob;
-	if (jobId >= m_parent.m_workBuf.getComputeJobsCount())
+	if (m_invalidateConstants)
 	{
-		// We ran out of slots in the job queue, so now we need to wait for
-		// all previous jobs to finish and start over from the beginning
+		// Job slots are being reused, so make sure no stale cbuf data is left in the constant cache
 		using ISC = C::InvalidateShaderCaches;
-		w << CmdInline(Compute, WaitForIdle{}, 0);
-		w << CmdInline(Compute, InvalidateShaderCaches{}, ISC::Constant{}); // we're overwriting old cbufs so invalidate this too
-		jobId = 0;
+		w << CmdInline(Compute, InvalidateShaderCaches{}, ISC::Constant{});
+		m_invalidateConstants = false;
 	}
-	m_curJob = jobId + 1; // advance the job counter
 
 	// Calculate the address to the job within the queue
 	DkGpuAddr jobAddr = m_parent.m_workBuf.getComputeJobs();
@@ -152,37 +227,41 @@ void ComputeQueue::dispatch(uint32_t numGroupsX, uint32_t numGroupsY, uint32_t n
 	job.qmd.cta_raster_width  = numGroupsX;
 	job.qmd.cta_raster_height = numGroupsY;
 	job.qmd.cta_raster_depth  = numGroupsZ;
-	bindConstbuf(0, jobAddr + sizeof(ComputeQmd), ComputeDriverCbufSize);
 
 	// Update grid dimension parameters in the driver constbuf
-	job.cbuf.gridSize[0] = numGroupsX;
-	job.cbuf.gridSize[1] = numGroupsY;
-	job.cbuf.gridSize[2] = numGroupsZ;
+	updateCbuf(job.cbuf.gridSize[0], numGroupsX);
+	updateCbuf(job.cbuf.gridSize[1], numGroupsY);
+	updateCbuf(job.cbuf.gridSize[2], numGroupsZ);
+
+	// Indirect dispatches patch the grid size in the job's own cbuf, so they can neither
+	// reuse a previous cbuf nor let later jobs reuse theirs
+	bool uploadCbuf = m_cbufDirty || indirect != DK_GPU_ADDR_INVALID;
+	m_cbufDirty = indirect != DK_GPU_ADDR_INVALID;
+	if (uploadCbuf)
+		m_cbufAddr = jobAddr + sizeof(ComputeQmd);
+	bindConstbuf(0, m_cbufAddr, ComputeDriverCbufSize);
 
 	// Time to copy the job to the job queue!
-	PrepareInlineCopy(w, s_jobSizeBytes, jobAddr);
-	w.addRawData(&job, s_jobSizeBytes);
+	uint32_t uploadSize = uploadCbuf ? s_jobSizeBytes : sizeof(ComputeQmd);
+	PrepareInlineCopy(w, uploadSize, jobAddr);
+	w.addRawData(&job, uploadSize);
 
 	if (indirect != DK_GPU_ADDR_INVALID)
 	{
-		// Calculate the offsets we need
-		u64 cbufGridSizeOffset = sizeof(ComputeQmd) + offsetof(ComputeDriverCbuf, gridSize[0]);
-		u64 qmdCtaRasterOffset = offsetof(ComputeQmd, cta_raster_width);
-
-		// Update grid dimension parameters in the driver constbuf
-		PrepareInlineCopy(w, 12, jobAddr + cbufGridSizeOffset);
+		// Patch the grid size into both the QMD and the driver constbuf with a single macro call,
+		// which takes the dimensions straight from the indirect buffer
+		w << CmdList<2>{ MakeCmdHeader(IncreaseOnce, 4, Subchannel3D, MmeMacroPatchComputeJobGridSize), uint32_t(jobAddr>>8) };
 		w.split(CtrlCmdGpfifoEntry::NoPrefetch);
-		w.addRaw(indirect + 0x00, 3, CtrlCmdGpfifoEntry::AutoKick);
+		w.addRaw(indirect, 3, CtrlCmdGpfifoEntry::AutoKick);
 
-		// Update cta_raster_width (32-bit) and cta_raster_height (16-bit) in the QMD
-		PrepareInlineCopy(w, 6, jobAddr + qmdCtaRasterOffset + 0x00);
-		w.split(CtrlCmdGpfifoEntry::NoPrefetch);
-		w.addRaw(indirect + 0x00, 2, CtrlCmdGpfifoEntry::AutoKick);
-
-		// Update cta_raster_depth (16-bit) in the QMD
-		PrepareInlineCopy(w, 2, jobAddr + qmdCtaRasterOffset + 0x06);
-		w.split(CtrlCmdGpfifoEntry::NoPrefetch);
-		w.addRaw(indirect + 0x08, 1, CtrlCmdGpfifoEntry::AutoKick);
+		// The patch is written by the 3D engine while the job is fetched by the compute engine,
+		// so nothing orders the two on its own. Wait for the 3D engine to idle so that the
+		// constbuf updates have landed in memory, then drop any driver cbuf data the compute
+		// engine may have cached. The QMD itself is refetched since the launch below uses
+		// SendSignalingPcasB::Invalidate.
+		using ISC = C::InvalidateShaderCaches;
+		w << CmdInline(3D, WaitForIdle{}, 0);
+		w << CmdInline(Compute, InvalidateShaderCaches{}, ISC::Constant{});
 	}
 
 	// Launch the job
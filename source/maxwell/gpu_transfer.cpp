@@ -16,13 +16,19 @@ using E2D  = Engine2D;
 using Copy = EngineCopy;
 using Inl  = EngineInline;
 
+namespace
+{
+	constexpr auto s_setupTransferCmds = Cmds(
+		Cmd(2D, BlendAlphaFactor{}, E2D::BlendAlphaFactor::Value{0xFF}),
+		CmdInline(2D, ClipEnable{}, 0),
+		CmdInline(2D, Unknown221{}, 0x3f)
+	);
+}
+
 void Queue::setupTransfer()
 {
 	CmdBufWriter w{&m_cmdBuf};
-
-	w << Cmd(2D, BlendAlphaFactor{}, E2D::BlendAlphaFactor::Value{0xFF});
-	w << CmdInline(2D, ClipEnable{}, 0);
-	w << CmdInline(2D, Unknown221{}, 0x3f);
+	w.reserveAdd(s_setupTransferCmds);
 }
 
 void dk::detail::BlitCopyEngine(DkCmdBuf obj, ImageInfo const& src, ImageInfo const& dst, BlitParams const& params, uint32_t srcZ, uint32_t dstZ)
@@ -6,25 +6,25 @@ using namespace dk::detail;
 
 inline void ComputeQueue::bindUniformBuffer(uint32_t id, DkGpuAddr addr, uint32_t size)
 {
-	job.cbuf.uniformBufs[id] = addr;
+	updateCbuf(job.cbuf.uniformBufs[id], addr);
 	if (id < 6)
 		bindConstbuf(id+2, addr, size);
 }
 
 inline void ComputeQueue::bindStorageBuffer(uint32_t id, DkGpuAddr addr, uint32_t size)
 {
-	job.cbuf.data.storageBufs[id].address = addr;
-	job.cbuf.data.storageBufs[id].size = size;
+	updateCbuf(job.cbuf.data.storageBufs[id].address, addr);
+	updateCbuf(job.cbuf.data.storageBufs[id].size, size);
 }
 
 inline void ComputeQueue::bindTexture(uint32_t id, DkResHandle handle)
 {
-	job.cbuf.data.textures[id] = handle;
+	updateCbuf(job.cbuf.data.textures[id], handle);
 }
 
 inline void ComputeQueue::bindImage(uint32_t id, DkResHandle handle)
 {
-	job.cbuf.data.images[id] = handle;
+	updateCbuf(job.cbuf.data.images[id], handle);
 }
 
 void ComputeQueue::initialize()
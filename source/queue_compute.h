@@ -10,9 +10,24 @@ namespace dk::detail
 	class ComputeQueue //: public ObjBase
 	{
 		Queue& m_parent;
-		uint32_t m_curJob;
 		uint32_t m_curSmThrottling;
 
+		// Jobs are tracked with free-running counters (wrapping around is harmless), so that
+		// a full set of slots can't be mistaken for an empty one. A job goes into the slot
+		// given by its index modulo the number of slots.
+		uint32_t m_numJobSlots;
+		uint32_t m_numJobsLaunched;
+		uint32_t m_numJobsReleased;
+		uint32_t m_lastFencedJob;
+
+		// Set when slots are released, since their cbuf data may still be in the constant cache
+		bool m_invalidateConstants;
+
+		// The driver cbuf is only uploaded when its contents change: otherwise jobs
+		// keep referencing the copy uploaded alongside a previous job
+		bool m_cbufDirty;
+		DkGpuAddr m_cbufAddr;
+
 		struct
 		{
 			maxwell::ComputeQmd qmd;
@@ -31,14 +46,52 @@ namespace dk::detail
 		void bindStorageBuffer(uint32_t id, DkGpuAddr addr, uint32_t size);
 		void bindTexture(uint32_t id, DkResHandle handle);
 		void bindImage(uint32_t id, DkResHandle handle);
+		template <typename T>
+		void updateCbuf(T& field, T value) noexcept
+		{
+			if (field != value)
+			{
+				field = value;
+				m_cbufDirty = true;
+			}
+		}
+
+		uint32_t reserveJob();
 		void dispatch(uint32_t numGroupsX, uint32_t numGroupsY, uint32_t numGroupsZ, DkGpuAddr indirect);
 
 	public:
 		ComputeQueue(DkQueue parent) :
-			m_parent{*parent}, m_curJob{}, m_curSmThrottling{0x100}, job{}
+			m_parent{*parent}, m_curSmThrottling{0x100},
+			m_numJobSlots{parent->m_workBuf.getComputeJobsCount()}, m_numJobsLaunched{}, m_numJobsReleased{}, m_lastFencedJob{},
+			m_invalidateConstants{true}, m_cbufDirty{true}, m_cbufAddr{}, job{}
 		{ }
 
 		void initialize();
+
+		// Job slots are recycled along with the queue's fence ring: each fence records
+		// the number of jobs launched at the time it was signaled, and once it is reached
+		// all jobs launched before it are known to have been consumed by the GPU.
+		uint32_t markJobsFenced() noexcept
+		{
+			// Jobs after the fence must not reference cbufs from slots it releases
+			m_cbufDirty = true;
+			return m_lastFencedJob = m_numJobsLaunched;
+		}
+		void releaseJobs(uint32_t numJobs) noexcept
+		{
+			if (numJobs != m_numJobsReleased)
+			{
+				m_numJobsReleased = numJobs;
+				m_invalidateConstants = true;
+			}
+		}
+
+		// Used to signal fences before the job slots run out, so that slots can be
+		// recycled without waiting for every job to complete
+		bool hasManyUnfencedJobs() const noexcept
+		{
+			return 2*(m_numJobsLaunched - m_lastFencedJob) >= m_numJobSlots;
+		}
 		CtrlCmdHeader const* processCtrlCmd(CtrlCmdHeader const* cmd);
 
 		void* operator new(size_t size, void* p) noexcept { return p; }
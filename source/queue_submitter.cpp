@@ -0,0 +1,111 @@
+#include "queue_submitter.h"
+#include "dk_queue.h"
+
+using namespace dk::detail;
+
+DkResult QueueSubmitter::initialize(NvFence const& fence)
+{
+	m_fence = fence;
+	semaphoreInit(&m_pendingSem, 0);
+
+	// Run the submission thread at the same priority as the thread creating the queue
+	s32 prio = 0x2C;
+	svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+	if (R_FAILED(threadCreate(&m_thread, _threadFunc, this, nullptr, s_threadStackSize, prio, -2)))
+		return DkResult_Fail;
+
+	if (R_FAILED(threadStart(&m_thread)))
+	{
+		threadClose(&m_thread);
+		m_thread.handle = INVALID_HANDLE;
+		return DkResult_Fail;
+	}
+
+	return DkResult_Success;
+}
+
+void QueueSubmitter::finalize()
+{
+	if (m_thread.handle == INVALID_HANDLE)
+		return;
+
+	if (hasUnpublishedEntries())
+		publish();
+
+	__atomic_store_n(&m_exit, true, __ATOMIC_RELEASE);
+	semaphoreSignal(&m_pendingSem);
+	threadWaitForExit(&m_thread);
+	threadClose(&m_thread);
+	m_thread.handle = INVALID_HANDLE;
+}
+
+void QueueSubmitter::publish()
+{
+	// The kickoff marker carries the fence increments of the batch
+	push(0, m_fenceIncr, s_kickoffFlag);
+	m_fenceIncr = 0;
+
+	__atomic_store_n(&m_publishPos, m_writePos, __ATOMIC_RELEASE);
+	semaphoreSignal(&m_pendingSem);
+}
+
+void QueueSubmitter::waitForSlots(uint32_t numSlots)
+{
+	// The ring is full of entries that were never published: submit them
+	// early so that the submission thread has something to consume.
+	if (hasUnpublishedEntries())
+		publish();
+
+	while ((s_ringSize - getUsedSlots()) < numSlots)
+		svcSleepThread(0);
+}
+
+uint32_t QueueSubmitter::processBatch(uint32_t pos)
+{
+	// Locate the kickoff marker terminating this batch
+	uint32_t marker = pos;
+	while (!(m_items[marker & (s_ringSize-1)].flags & s_kickoffFlag))
+		marker ++;
+
+	if (!m_parent.isInErrorState())
+	{
+		// Account for the fence increments before any entry can be kicked off
+		for (uint32_t i = m_items[marker & (s_ringSize-1)].numCmds; i; i --)
+			nvGpuChannelIncrFence(&m_parent.m_gpuChannel);
+
+		// The batch may wrap around the end of the ring
+		uint32_t start = pos & (s_ringSize-1);
+		uint32_t count = marker - pos;
+		uint32_t firstCount = s_ringSize - start;
+		if (firstCount > count)
+			firstCount = count;
+
+		if (m_parent.appendToChannel(&m_items[start], firstCount) &&
+			m_parent.appendToChannel(&m_items[0], count - firstCount))
+			m_parent.kickoffChannel();
+	}
+
+	return marker+1;
+}
+
+void QueueSubmitter::threadFunc()
+{
+	// Errors and warnings raised on this thread are reported through the queue's device
+	DK_ENTRYPOINT(&m_parent);
+
+	for (;;)
+	{
+		semaphoreWait(&m_pendingSem);
+
+		uint32_t end = __atomic_load_n(&m_publishPos, __ATOMIC_ACQUIRE);
+		uint32_t pos = m_readPos;
+		while (pos != end)
+		{
+			pos = processBatch(pos);
+			__atomic_store_n(&m_readPos, pos, __ATOMIC_RELEASE);
+		}
+
+		if (__atomic_load_n(&m_exit, __ATOMIC_ACQUIRE) && pos == __atomic_load_n(&m_publishPos, __ATOMIC_ACQUIRE))
+			break;
+	}
+}
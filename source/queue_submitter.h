@@ -0,0 +1,85 @@
+#pragma once
+#include "dk_private.h"
+#include "dk_ctrlcmd.h"
+
+namespace dk::detail
+{
+	class Queue;
+
+	// Hands off gpfifo entries prepared by the queue to a dedicated submission thread,
+	// which performs the channel kickoffs (and the associated error checking) on its behalf.
+	// Entries travel through a single-producer single-consumer ring: the queue's owning
+	// thread is the only producer, and the submission thread the only consumer.
+	class QueueSubmitter
+	{
+		static constexpr uint32_t s_ringSize = 256; // must be a power of two
+		static constexpr uint32_t s_kickoffFlag = BIT(31);
+		static constexpr size_t s_threadStackSize = 0x4000;
+
+		Queue& m_parent;
+		Thread m_thread;
+		Semaphore m_pendingSem;
+		NvFence m_fence;
+		uint32_t m_fenceIncr;
+		uint32_t m_writePos;   // Producer only
+		uint32_t m_publishPos; // Written by producer, read by consumer
+		uint32_t m_readPos;    // Written by consumer, read by producer
+		bool m_exit;
+		CtrlCmdGpfifoEntry m_items[s_ringSize];
+
+		uint32_t getUsedSlots() const noexcept
+		{
+			return m_writePos - __atomic_load_n(&m_readPos, __ATOMIC_ACQUIRE);
+		}
+
+		void push(DkGpuAddr iova, uint32_t numCmds, uint32_t flags) noexcept
+		{
+			m_items[m_writePos & (s_ringSize-1)] = { iova, numCmds, flags };
+			m_writePos ++;
+		}
+
+		void waitForSlots(uint32_t numSlots) noexcept;
+		uint32_t processBatch(uint32_t pos) noexcept;
+		void threadFunc() noexcept;
+
+		static void _threadFunc(void* arg) noexcept
+		{
+			static_cast<QueueSubmitter*>(arg)->threadFunc();
+		}
+
+	public:
+		QueueSubmitter(Queue* parent) noexcept :
+			m_parent{*parent}, m_thread{}, m_pendingSem{}, m_fence{}, m_fenceIncr{},
+			m_writePos{}, m_publishPos{}, m_readPos{}, m_exit{}, m_items{}
+		{ }
+
+		DkResult initialize(NvFence const& fence) noexcept;
+		void finalize() noexcept;
+
+		bool hasUnpublishedEntries() const noexcept { return m_writePos != m_publishPos; }
+
+		void appendEntry(CtrlCmdGpfifoEntry const& entry) noexcept
+		{
+			// Always leave room for the kickoff marker
+			if (getUsedSlots() >= s_ringSize-1)
+				waitForSlots(2);
+			push(entry.iova, entry.numCmds, entry.flags);
+		}
+
+		void incrFence() noexcept
+		{
+			m_fenceIncr ++;
+			m_fence.value ++;
+		}
+
+		void getFence(NvFence* out) const noexcept
+		{
+			*out = m_fence;
+		}
+
+		void publish() noexcept;
+
+		void* operator new(size_t size, void* p) noexcept { return p; }
+		void operator delete(void* ptr, void* p) noexcept { }
+	};
+}
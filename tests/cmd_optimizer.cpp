@@ -0,0 +1,165 @@
+// Replays command streams through the register state simulator with and without the
+// capture optimizer, and checks that the engines see exactly the same method writes.
+#include "common.h"
+#include "cmd_sim.h"
+#include <string.h>
+
+namespace
+{
+	constexpr uint32_t s_maxWords = 0x10000;
+
+	uint32_t g_original[s_maxWords];
+	uint32_t g_optimized[s_maxWords];
+
+	// Checks that both streams decode to the same writes and final register state
+	void Compare(uint32_t const* a, uint32_t numA, uint32_t const* b, uint32_t numB)
+	{
+		test::RegSim simA, simB;
+		CHECK(simA.process(a, numA));
+		CHECK(simB.process(b, numB));
+		CHECK(numB <= numA);
+		CHECK(simA.getWrites() == simB.getWrites());
+		CHECK(simA.getRegs() == simB.getRegs());
+	}
+
+	void RecordScene(DkCmdBuf cmdbuf)
+	{
+		DkViewport viewports[2] = { { 0, 0, 1280, 720, 0, 1 }, { 0, 0, 640, 360, 0, 1 } };
+		DkScissor scissors[2] = { { 0, 0, 1280, 720 }, { 0, 0, 640, 360 } };
+		// Zero-initialized, since the packed states are captured as is (padding included)
+		DkRasterizerState rasterizer = {};
+		DkColorState color = {};
+		DkColorWriteState colorWrite = {};
+		DkBlendState blend[2] = {};
+		DkDepthStencilState depthStencil = {};
+		DkVtxAttribState attribs[2] = {
+			{ 0, 0, 0, DkVtxAttribSize_3x32, DkVtxAttribType_Float, 0 },
+			{ 0, 0, 12, DkVtxAttribSize_4x8, DkVtxAttribType_Unorm, 0 },
+		};
+		DkVtxBufferState bufState = { 16, 0 };
+		DkBufExtents vtxBuf = { 0x100000, 0x4000 };
+		DkBufExtents ubo = { 0x200000, 0x100 };
+		uint32_t constants[16] = { 1, 2, 3, 4, 0x3f800000, 0x40000000, 0x12345678 };
+
+		dkRasterizerStateDefaults(&rasterizer);
+		dkColorStateDefaults(&color);
+		dkColorWriteStateDefaults(&colorWrite);
+		dkBlendStateDefaults(&blend[0]);
+		dkBlendStateDefaults(&blend[1]);
+		dkDepthStencilStateDefaults(&depthStencil);
+
+		for (unsigned i = 0; i < 4; i ++)
+		{
+			dkCmdBufSetViewports(cmdbuf, 0, viewports, 2);
+			dkCmdBufSetScissors(cmdbuf, 0, scissors, 2);
+			dkCmdBufBindRasterizerState(cmdbuf, &rasterizer);
+			dkCmdBufBindColorState(cmdbuf, &color);
+			dkCmdBufBindColorWriteState(cmdbuf, &colorWrite);
+			dkCmdBufBindBlendStates(cmdbuf, 0, blend, 2);
+			dkCmdBufBindDepthStencilState(cmdbuf, &depthStencil);
+			dkCmdBufBindVtxAttribState(cmdbuf, attribs, 2);
+			dkCmdBufBindVtxBufferState(cmdbuf, &bufState, 1);
+			dkCmdBufBindVtxBuffers(cmdbuf, 0, &vtxBuf, 1);
+			dkCmdBufBindUniformBuffers(cmdbuf, DkStage_Vertex, 0, &ubo, 1);
+			dkCmdBufPushConstants(cmdbuf, ubo.addr, ubo.size, 4*i, sizeof(constants), constants);
+			dkCmdBufSetDepthBias(cmdbuf, 1.0f, 0.0f, float(i));
+			dkCmdBufSetStencil(cmdbuf, DkFace_FrontAndBack, 0xFF, i, 0xFF);
+			dkCmdBufSetBlendConst(cmdbuf, 0.0f, 0.5f, 1.0f, 1.0f);
+			dkCmdBufSetPrimitiveRestart(cmdbuf, i & 1, 0xFFFF);
+			dkCmdBufSetPointSize(cmdbuf, 2.0f);
+			dkCmdBufSetLineWidth(cmdbuf, 1.0f);
+			dkCmdBufBindIdxBuffer(cmdbuf, DkIdxFormat_Uint16, 0x300000);
+			dkCmdBufDraw(cmdbuf, DkPrimitive_Triangles, 3*i+3, 1, 0, 0);
+			dkCmdBufDrawIndexed(cmdbuf, DkPrimitive_TriangleStrip, 4, 2, i, 0, 0);
+			dkCmdBufBarrier(cmdbuf, DkBarrier_Primitives, DkInvalidateFlags_Image);
+			dkCmdBufPushData(cmdbuf, 0x400000, constants, sizeof(constants));
+		}
+	}
+
+	// Simple deterministic generator, so that failures are reproducible
+	uint32_t g_seed = 0x12345678;
+	uint32_t Random(uint32_t range)
+	{
+		g_seed = g_seed * 1103515245 + 12345;
+		return (g_seed >> 8) % range;
+	}
+
+	// Builds a stream out of random commands that tend to continue each other, mixing in
+	// everything the optimizer must leave alone: FIFO and macro methods, IncreaseOnce
+	// and empty commands, and runs longer than a single merged header can hold
+	uint32_t MakeRandomStream(uint32_t* words, uint32_t maxWords)
+	{
+		uint32_t pos = 0, method = 0x100, subchannel = 0;
+		while (pos + 0x200 < maxWords)
+		{
+			static const uint32_t modes[] = { 1, 1, 1, 3, 4, 4, 4, 5 };
+			uint32_t mode = modes[Random(8)];
+
+			switch (Random(16))
+			{
+				case 0:  subchannel = Random(5); method = 0x40 + Random(0x200); break;
+				case 1:  method = Random(0x40); break;                 // FIFO methods
+				case 2:  method = 0xE00 + 2*Random(0x40); break;       // 3D macros
+				case 3:  break;                                        // same method
+				default: method ++; break;                             // next method
+			}
+
+			uint32_t count = Random(8) ? 1 + Random(3) : Random(300);
+			if (mode == 4)
+			{
+				words[pos++] = (mode << 29) | (Random(0x2000) << 16) | (subchannel << 13) | method;
+				continue;
+			}
+
+			words[pos++] = (mode << 29) | (count << 16) | (subchannel << 13) | method;
+			for (uint32_t i = 0; i < count; i ++)
+				words[pos++] = Random(2) ? Random(0x2000) : g_seed;
+			if (mode == 1)
+				method += count ? count - 1 : 0;
+		}
+		return pos;
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+
+	// Commands recorded through the API, optimized in place after the fact...
+	DkCmdBuf cmdbuf = test::CreateCmdBuf(device, nullptr);
+	dkCmdBufBeginCaptureCmds(cmdbuf, g_original, s_maxWords);
+	RecordScene(cmdbuf);
+	uint32_t numOriginal = dkCmdBufEndCaptureCmds(cmdbuf);
+	memcpy(g_optimized, g_original, numOriginal*4);
+	uint32_t numOptimized = dkCmdBufOptimizeCapturedCmds(cmdbuf, g_optimized, numOriginal);
+	Compare(g_original, numOriginal, g_optimized, numOptimized);
+	printf("  scene: %u -> %u words\n", numOriginal, numOptimized);
+	CHECK(numOptimized < numOriginal);
+	dkCmdBufDestroy(cmdbuf);
+
+	// ...and while capturing
+	cmdbuf = test::CreateCmdBuf(device, nullptr, DkCmdBufFlags_OptimizeCaptures);
+	dkCmdBufBeginCaptureCmds(cmdbuf, g_optimized, s_maxWords);
+	RecordScene(cmdbuf);
+	uint32_t numCaptured = dkCmdBufEndCaptureCmds(cmdbuf);
+	Compare(g_original, numOriginal, g_optimized, numCaptured);
+	CHECK(numCaptured == numOptimized);
+
+	// Random streams
+	unsigned numStreams = 200;
+	uint64_t totalOriginal = 0, totalOptimized = 0;
+	for (unsigned i = 0; i < numStreams; i ++)
+	{
+		uint32_t numWords = MakeRandomStream(g_original, 0x2000 + Random(0x2000));
+		memcpy(g_optimized, g_original, numWords*4);
+		uint32_t numOut = dkCmdBufOptimizeCapturedCmds(cmdbuf, g_optimized, numWords);
+		Compare(g_original, numWords, g_optimized, numOut);
+		totalOriginal += numWords;
+		totalOptimized += numOut;
+	}
+	printf("  %u random streams: %lu -> %lu words\n", numStreams, (unsigned long)totalOriginal, (unsigned long)totalOptimized);
+
+	dkCmdBufDestroy(cmdbuf);
+	dkDeviceDestroy(device);
+	return test::Finish("cmd_optimizer");
+}
@@ -0,0 +1,79 @@
+// Host model of the method writes performed by a command stream. Streams are decoded
+// the way the GPU's PBDMA does it, and every write is both logged and applied to a
+// per-subchannel register file, so that two streams can be checked for equivalence.
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+namespace test
+{
+	class RegSim
+	{
+	public:
+		static constexpr unsigned s_numSubchannels = 8;
+		static constexpr unsigned s_numMethods = 0x2000;
+
+		struct Write
+		{
+			uint32_t subchannel;
+			uint32_t method;
+			uint32_t value;
+
+			bool operator==(Write const& rhs) const
+			{
+				return subchannel == rhs.subchannel && method == rhs.method && value == rhs.value;
+			}
+		};
+
+	private:
+		std::vector<uint32_t> m_regs;
+		std::vector<Write> m_writes;
+
+		void write(uint32_t subchannel, uint32_t method, uint32_t value)
+		{
+			method &= s_numMethods - 1;
+			m_regs[subchannel*s_numMethods + method] = value;
+			m_writes.push_back({ subchannel, method, value });
+		}
+
+	public:
+		RegSim() : m_regs(s_numSubchannels*s_numMethods) { }
+
+		std::vector<uint32_t> const& getRegs() const { return m_regs; }
+		std::vector<Write> const& getWrites() const { return m_writes; }
+
+		// Returns false if the stream is malformed (unknown mode or truncated command)
+		bool process(uint32_t const* words, uint32_t numWords)
+		{
+			for (uint32_t pos = 0; pos < numWords;)
+			{
+				uint32_t header = words[pos++];
+				uint32_t method = header & 0x1FFF;
+				uint32_t subchannel = (header >> 13) & 7;
+				uint32_t arg = (header >> 16) & 0x1FFF;
+				uint32_t mode = header >> 29;
+
+				switch (mode)
+				{
+					case 1: // Increasing
+					case 3: // NonIncreasing
+					case 5: // IncreaseOnce
+						if (pos + arg > numWords)
+							return false;
+						for (uint32_t i = 0; i < arg; i ++)
+						{
+							uint32_t offset = mode == 1 ? i : mode == 5 ? (i ? 1 : 0) : 0;
+							write(subchannel, method + offset, words[pos++]);
+						}
+						break;
+					case 4: // Inline
+						write(subchannel, method, arg);
+						break;
+					default:
+						return false;
+				}
+			}
+			return true;
+		}
+	};
+}
@@ -0,0 +1,96 @@
+// Stress test for command arenas: several threads keep acquiring chunks and retiring
+// them behind fences, while a fake GPU thread signals the fences in order. The arena
+// has exactly one chunk per thread, so every acquire must eventually succeed.
+#include "common.h"
+#include "host/gpu_host.h"
+#include "dk_cmdarena.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace dk::detail;
+
+namespace
+{
+	constexpr unsigned s_numThreads = 8;
+	constexpr unsigned s_numIterations = 20000;
+	constexpr uint32_t s_chunkSize = 0x1000;
+
+	std::atomic<unsigned> g_chunkOwners[s_numThreads];
+	std::atomic<unsigned> g_numFailedAcquires;
+	std::atomic<unsigned> g_numDoubleAcquires;
+	std::atomic<bool> g_stop;
+
+	void Worker(CmdArena* arena, uint32_t syncpt, unsigned threadId)
+	{
+		for (unsigned i = 0; i < s_numIterations; i ++)
+		{
+			uint32_t id = arena->acquireChunk();
+			if (id == CmdArena::s_invalidChunk)
+			{
+				g_numFailedAcquires ++;
+				continue;
+			}
+			if (id >= s_numThreads || g_chunkOwners[id].exchange(threadId+1) != 0)
+			{
+				g_numDoubleAcquires ++;
+				continue;
+			}
+
+			// Retire most chunks behind a fence a few increments ahead of the current value
+			DkFence fence = {};
+			DkFence* pFence = nullptr;
+			if (i % 4)
+			{
+				fence.m_type = DkFence::External;
+				fence.m_external.m_fence.num_fences = 1;
+				fence.m_external.m_fence.fences[0].id = syncpt;
+				fence.m_external.m_fence.fences[0].value = hostgpu::readSyncpt(syncpt) + 1 + i % 3;
+				pFence = &fence;
+			}
+
+			arena->setNextChunk(id, CmdArena::s_invalidChunk);
+			g_chunkOwners[id] = 0;
+			arena->releaseChunks(id, pFence);
+		}
+	}
+
+	void FakeGpu(uint32_t syncpt)
+	{
+		while (!g_stop)
+		{
+			hostgpu::incrSyncpt(syncpt);
+			svcSleepThread(20000);
+		}
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+	DkMemBlock mem = test::CreateMemBlock(device, s_numThreads*s_chunkSize);
+
+	DkCmdArenaMaker maker;
+	dkCmdArenaMakerDefaults(&maker, device, mem, 0, s_numThreads*s_chunkSize);
+	maker.chunkSize = s_chunkSize;
+	DkCmdArena arena = dkCmdArenaCreate(&maker);
+
+	uint32_t syncpt = hostgpu::allocSyncpt();
+	std::thread gpu{FakeGpu, syncpt};
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < s_numThreads; i ++)
+		workers.emplace_back(Worker, arena, syncpt, i);
+	for (auto& t : workers)
+		t.join();
+	g_stop = true;
+	gpu.join();
+
+	CHECK(g_numFailedAcquires == 0);
+	CHECK(g_numDoubleAcquires == 0);
+
+	dkCmdArenaDestroy(arena);
+	dkMemBlockDestroy(mem);
+	dkDeviceDestroy(device);
+	return test::Finish("cmdarena_stress");
+}
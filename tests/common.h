@@ -0,0 +1,52 @@
+// Helpers shared by the host tests
+#pragma once
+#include <deko3d.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK(_cond) \
+	do { if (!(_cond)) ::test::Fail(__FILE__, __LINE__, #_cond); } while (0)
+
+namespace test
+{
+	inline unsigned g_numFailures;
+
+	inline void Fail(const char* file, int line, const char* expr)
+	{
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+		g_numFailures ++;
+	}
+
+	inline int Finish(const char* name)
+	{
+		printf("%s: %s\n", name, g_numFailures ? "FAIL" : "ok");
+		return g_numFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	inline DkDevice CreateDevice()
+	{
+		DkDeviceMaker maker;
+		dkDeviceMakerDefaults(&maker);
+		maker.errorCheckIntervalUs = 1000;
+		return dkDeviceCreate(&maker);
+	}
+
+	inline DkMemBlock CreateMemBlock(DkDevice device, uint32_t size, uint32_t flags = DkMemBlockFlags_CpuUncached | DkMemBlockFlags_GpuCached)
+	{
+		DkMemBlockMaker maker;
+		dkMemBlockMakerDefaults(&maker, device, (size + DK_MEMBLOCK_ALIGNMENT - 1) &~ (DK_MEMBLOCK_ALIGNMENT - 1));
+		maker.flags = flags;
+		return dkMemBlockCreate(&maker);
+	}
+
+	inline DkCmdBuf CreateCmdBuf(DkDevice device, DkMemBlock mem, uint32_t flags = 0)
+	{
+		DkCmdBufMaker maker;
+		dkCmdBufMakerDefaults(&maker, device);
+		maker.flags = flags;
+		DkCmdBuf cmdbuf = dkCmdBufCreate(&maker);
+		if (mem)
+			dkCmdBufAddMemory(cmdbuf, mem, 0, dkMemBlockGetSize(mem));
+		return cmdbuf;
+	}
+}
@@ -0,0 +1,179 @@
+// Records a command list that calls sublists nested as deep as allowed, and enough of them
+// for its control commands to span several chunks, then compiles it and checks that the
+// compiled list is flat, that it holds fewer gpfifo entries than the original, and that
+// submitting it runs exactly the same methods as submitting the original list.
+#include "common.h"
+#include "host/gpu_host.h"
+#include "engine_3d.h"
+#include "dk_fence.h"
+#include "dk_ctrlcmd.h"
+#include <vector>
+
+using namespace dk::detail;
+
+namespace
+{
+	constexpr uint32_t s_numCalls = 600;
+	constexpr uint32_t s_waitInterval = 100;
+	constexpr uint32_t s_cmdMemSize = 0x40000;
+
+	uint32_t g_nextMarker = 1;
+
+	void RecordMarker(DkCmdBuf cmdbuf)
+	{
+		dkCmdBufSetPointSize(cmdbuf, float(g_nextMarker++));
+	}
+
+	struct ListStats
+	{
+		uint32_t numGpfifoEntries;
+		uint32_t numCalls;
+		uint32_t numJumps;
+	};
+
+	// Counts the commands of a list itself, without following jumps or calls
+	ListStats GetFlatStats(DkCmdList list)
+	{
+		ListStats stats = {};
+		auto* cur = reinterpret_cast<CtrlCmdHeader const*>(list);
+		while (cur->type != CtrlCmdHeader::Return)
+		{
+			switch (cur->type)
+			{
+				case CtrlCmdHeader::Jump:
+				case CtrlCmdHeader::Call:
+					stats.numJumps += cur->type == CtrlCmdHeader::Jump;
+					stats.numCalls += cur->type == CtrlCmdHeader::Call;
+					if (cur->type == CtrlCmdHeader::Jump)
+						cur = static_cast<CtrlCmdJumpCall const*>(cur)->ptr;
+					else
+						cur = static_cast<CtrlCmdJumpCall const*>(cur) + 1;
+					break;
+				case CtrlCmdHeader::GpfifoList:
+					stats.numGpfifoEntries += cur->arg;
+					cur = reinterpret_cast<CtrlCmdHeader const*>(reinterpret_cast<CtrlCmdGpfifoEntry const*>(cur+1) + cur->arg);
+					break;
+				default:
+					cur = reinterpret_cast<CtrlCmdHeader const*>(reinterpret_cast<char const*>(cur) + GetCtrlCmdSize(cur));
+					break;
+			}
+		}
+		return stats;
+	}
+
+	// Counts the gpfifo entries submitted by a list, following jumps and calls
+	uint32_t CountSubmittedEntries(DkCmdList list)
+	{
+		uint32_t count = 0;
+		WalkCtrlCmds(reinterpret_cast<CtrlCmdHeader const*>(list), [&](CtrlCmdHeader const* cur) -> CtrlCmdHeader const*
+		{
+			if (cur->type != CtrlCmdHeader::GpfifoList)
+				return reinterpret_cast<CtrlCmdHeader const*>(reinterpret_cast<char const*>(cur) + GetCtrlCmdSize(cur));
+			count += cur->arg;
+			return reinterpret_cast<CtrlCmdHeader const*>(reinterpret_cast<CtrlCmdGpfifoEntry const*>(cur+1) + cur->arg);
+		});
+		return count;
+	}
+
+	std::vector<hostgpu::Method> Submit(DkQueue queue, uint32_t channel, DkCmdList list)
+	{
+		hostgpu::enableTrace(channel, true);
+		dkQueueSubmitCommands(queue, list);
+		dkQueueFlush(queue);
+		hostgpu::waitChannelIdle(channel);
+		hostgpu::enableTrace(channel, false);
+		return hostgpu::takeTrace(channel);
+	}
+
+	bool IsSameTrace(std::vector<hostgpu::Method> const& a, std::vector<hostgpu::Method> const& b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (size_t i = 0; i < a.size(); i ++)
+			if (a[i].subchannel != b[i].subchannel || a[i].method != b[i].method || a[i].value != b[i].value)
+				return false;
+		return true;
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+	DkQueueMaker maker;
+	dkQueueMakerDefaults(&maker, device);
+	DkQueue queue = dkQueueCreate(&maker);
+	uint32_t channel = hostgpu::lastChannel();
+
+	DkFence fence;
+	dkQueueSignalFence(queue, &fence, false);
+	dkQueueWaitIdle(queue);
+
+	DkMemBlock mem = test::CreateMemBlock(device, s_cmdMemSize);
+	DkCmdBuf cmdbuf = test::CreateCmdBuf(device, mem);
+
+	// A chain of lists, each calling the previous one, nested as deep as allowed once called
+	RecordMarker(cmdbuf);
+	DkCmdList chain = dkCmdBufFinishList(cmdbuf);
+	for (unsigned i = 0; i < s_maxCtrlCallDepth-1; i ++)
+	{
+		RecordMarker(cmdbuf);
+		dkCmdBufCallList(cmdbuf, chain);
+		RecordMarker(cmdbuf);
+		chain = dkCmdBufFinishList(cmdbuf);
+	}
+
+	RecordMarker(cmdbuf);
+	RecordMarker(cmdbuf);
+	DkCmdList leaf = dkCmdBufFinishList(cmdbuf);
+
+	// Many calls in a single list, with fence waits in between. The first call runs the commands
+	// recorded right before those following it, so the compiled list can merge their entries.
+	for (uint32_t i = 0; i < s_numCalls; i ++)
+	{
+		dkCmdBufCallList(cmdbuf, leaf);
+		if (i == 0)
+			RecordMarker(cmdbuf);
+		if (i % s_waitInterval == 0)
+		{
+			RecordMarker(cmdbuf);
+			dkCmdBufWaitFence(cmdbuf, &fence);
+		}
+	}
+	dkCmdBufCallList(cmdbuf, chain);
+	RecordMarker(cmdbuf);
+	DkCmdList list = dkCmdBufFinishList(cmdbuf);
+
+	ListStats stats = GetFlatStats(list);
+	CHECK(stats.numCalls == s_numCalls+1);
+	CHECK(stats.numJumps > 0);
+
+	size_t compiledSize = dkCmdBufGetCompiledListSize(cmdbuf, list);
+	std::vector<uint64_t> storage((compiledSize + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+	DkCmdList compiled = dkCmdBufCompileList(cmdbuf, list, storage.data(), compiledSize);
+	CHECK(compiled == reinterpret_cast<DkCmdList>(storage.data()));
+
+	// The compiled list is flat, and merges what the original list submits
+	ListStats compiledStats = GetFlatStats(compiled);
+	uint32_t numEntries = CountSubmittedEntries(list);
+	printf("  %u gpfifo entries, %u once compiled (%zu bytes)\n", numEntries, compiledStats.numGpfifoEntries, compiledSize);
+	CHECK(compiledStats.numCalls == 0 && compiledStats.numJumps == 0);
+	CHECK(CountSubmittedEntries(compiled) == compiledStats.numGpfifoEntries);
+	CHECK(compiledStats.numGpfifoEntries < numEntries);
+
+	// Both run the same methods, including every marker of every nesting level
+	auto original = Submit(queue, channel, list);
+	auto flat = Submit(queue, channel, compiled);
+	uint32_t numMarkers = 0;
+	for (auto& m : original)
+		if (m.subchannel == 0 && m.method == maxwell::Engine3D::PointSpriteSize{})
+			numMarkers ++;
+	CHECK(numMarkers == (1 + 2*(s_maxCtrlCallDepth-1)) + 2*s_numCalls + (2 + s_numCalls/s_waitInterval));
+	CHECK(IsSameTrace(original, flat));
+
+	dkQueueWaitIdle(queue);
+	dkCmdBufDestroy(cmdbuf);
+	dkMemBlockDestroy(mem);
+	dkQueueDestroy(queue);
+	dkDeviceDestroy(device);
+	return test::Finish("compile_list");
+}
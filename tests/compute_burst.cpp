@@ -0,0 +1,107 @@
+// Benchmark for bursts of compute dispatches with few fences in between, run with
+// several job slot counts. Besides timing, it checks that every job is launched and
+// that the constant cache is invalidated before any job slot gets reused.
+#include "common.h"
+#include "host/gpu_host.h"
+#include "compute_shader.h"
+#include "dk_fence.h"
+
+#include <chrono>
+#include <map>
+
+namespace
+{
+	constexpr uint32_t s_numDispatchesPerFence = 1000;
+	constexpr uint32_t s_numBursts = 4;
+	constexpr uint32_t s_cmdMemSize = 0x100000;
+
+	// Compute engine methods
+	constexpr uint32_t s_subchannelCompute = 1;
+	constexpr uint32_t s_invalidateShaderCaches = 0x087;
+	constexpr uint32_t s_invalidateConstant = 1U << 12;
+	constexpr uint32_t s_sendPcasA = 0x0AD;
+
+	// Checks that each job slot is only relaunched after a constant cache invalidation
+	uint32_t CheckTrace(std::vector<hostgpu::Method> const& trace)
+	{
+		std::map<uint32_t, uint32_t> lastLaunch; // QMD address -> invalidation count at launch
+		uint32_t numInvalidations = 0, numLaunches = 0;
+		for (auto& m : trace)
+		{
+			if (m.subchannel != s_subchannelCompute)
+				continue;
+			if (m.method == s_invalidateShaderCaches && (m.value & s_invalidateConstant))
+				numInvalidations ++;
+			else if (m.method == s_sendPcasA)
+			{
+				auto it = lastLaunch.find(m.value);
+				if (it != lastLaunch.end())
+					CHECK(it->second != numInvalidations);
+				lastLaunch[m.value] = numInvalidations;
+				numLaunches ++;
+			}
+		}
+		return numLaunches;
+	}
+
+	void Run(DkDevice device, DkMemBlock cmdMem, DkShader const& shader, uint32_t maxJobs)
+	{
+		DkQueueMaker maker;
+		dkQueueMakerDefaults(&maker, device);
+		maker.flags = DkQueueFlags_Compute;
+		maker.maxConcurrentComputeJobs = maxJobs;
+		DkQueue queue = dkQueueCreate(&maker);
+		uint32_t channel = hostgpu::lastChannel();
+		hostgpu::enableTrace(channel, true);
+
+		DkCmdBuf cmdbuf = test::CreateCmdBuf(device, cmdMem);
+		DkShader const* shaders[] = { &shader };
+		dkCmdBufBindShaders(cmdbuf, DkStageFlag_Compute, shaders, 1);
+		for (uint32_t i = 0; i < s_numDispatchesPerFence; i ++)
+			dkCmdBufDispatchCompute(cmdbuf, 1 + (i & 7), 1, 1);
+		DkCmdList list = dkCmdBufFinishList(cmdbuf);
+
+		uint32_t launchesBefore = hostgpu::getNumComputeLaunches();
+		auto start = std::chrono::steady_clock::now();
+		DkFence fence;
+		for (uint32_t i = 0; i < s_numBursts; i ++)
+		{
+			dkQueueSubmitCommands(queue, list);
+			dkQueueSignalFence(queue, &fence, false);
+			dkQueueFlush(queue);
+		}
+		CHECK(dkFenceWait(&fence, -1) == DkResult_Success);
+		auto elapsed = std::chrono::steady_clock::now() - start;
+
+		uint32_t numJobs = s_numBursts*s_numDispatchesPerFence;
+		double us = std::chrono::duration<double, std::micro>(elapsed).count();
+		printf("  %3u job slots: %u dispatches in %.1f ms (%.2f us/dispatch)\n", maxJobs, numJobs, us/1000, us/numJobs);
+
+		CHECK(hostgpu::getNumComputeLaunches() - launchesBefore == numJobs);
+		CHECK(CheckTrace(hostgpu::takeTrace(channel)) == numJobs);
+		CHECK(!dkQueueIsInErrorState(queue));
+
+		dkCmdBufDestroy(cmdbuf);
+		dkQueueDestroy(queue);
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+	DkMemBlock codeMem = test::CreateCodeMemBlock(device);
+	DkMemBlock cmdMem = test::CreateMemBlock(device, s_cmdMemSize);
+
+	test::Dksh dksh;
+	DkShader shader;
+	test::InitComputeShader(shader, codeMem, dksh);
+
+	static const uint32_t jobCounts[] = { 1, 2, 3, 16, DK_DEFAULT_MAX_COMPUTE_CONCURRENT_JOBS };
+	for (uint32_t maxJobs : jobCounts)
+		Run(device, cmdMem, shader, maxJobs);
+
+	dkMemBlockDestroy(cmdMem);
+	dkMemBlockDestroy(codeMem);
+	dkDeviceDestroy(device);
+	return test::Finish("compute_burst");
+}
@@ -0,0 +1,172 @@
+// Checks that compute jobs only upload the driver cbuf when its contents change. The same
+// dispatches are run on a queue where every job uploads its own cbuf, since each one is
+// fenced before the next: jobs must read back the same cbuf contents either way. Also checks
+// that fencing jobs forces the next one to upload its cbuf, even if nothing else changed.
+#include "common.h"
+#include "host/gpu_host.h"
+#include "compute_shader.h"
+#include "driver_constbuf.h"
+#include "maxwell/compute_qmd.h"
+#include <string.h>
+#include <vector>
+
+using namespace dk::detail;
+
+namespace
+{
+	constexpr uint32_t s_numSteps = 8;
+	constexpr uint32_t s_numFullUploads = 4; // steps whose cbuf differs from the previous one
+	constexpr uint32_t s_numFullUploadsAgain = 3; // same, when repeated after a fence
+	constexpr DkGpuAddr s_uniformAddr = UINT64_C(0x87654300);
+	constexpr uint32_t s_cmdMemSize = 0x10000;
+
+	// Compute engine methods
+	constexpr uint32_t s_subchannelCompute = 1;
+	constexpr uint32_t s_lineLengthIn = 0x060;
+	constexpr uint32_t s_sendPcasA = 0x0AD;
+
+	struct JobData
+	{
+		maxwell::ComputeQmd qmd;
+		ComputeDriverCbuf cbuf;
+		DkGpuAddr jobAddr;
+		DkGpuAddr cbufAddr;
+	};
+
+	struct RunResult
+	{
+		std::vector<JobData> jobs;
+		uint32_t numFullUploads;
+	};
+
+	// Some steps change the cbuf, others dispatch again with the same contents
+	void RecordStep(DkCmdBuf cmdbuf, DkShader const& shader, uint32_t step)
+	{
+		static const uint32_t dims[s_numSteps][3] =
+		{
+			{ 4, 1, 1 }, { 4, 1, 1 }, { 4, 2, 1 }, { 4, 2, 1 },
+			{ 4, 2, 1 }, { 4, 2, 1 }, { 4, 1, 1 }, { 4, 1, 1 },
+		};
+
+		if (step == 0)
+		{
+			DkShader const* shaders[] = { &shader };
+			dkCmdBufBindShaders(cmdbuf, DkStageFlag_Compute, shaders, 1);
+		}
+		if (step == 3 || step == 4)
+			dkCmdBufBindUniformBuffer(cmdbuf, DkStage_Compute, 0, s_uniformAddr, DK_UNIFORM_BUF_ALIGNMENT);
+		dkCmdBufDispatchCompute(cmdbuf, dims[step][0], dims[step][1], dims[step][2]);
+	}
+
+	DkQueue CreateQueue(DkDevice device, uint32_t maxJobs)
+	{
+		DkQueueMaker maker;
+		dkQueueMakerDefaults(&maker, device);
+		maker.flags = DkQueueFlags_Compute;
+		maker.maxConcurrentComputeJobs = maxJobs;
+		return dkQueueCreate(&maker);
+	}
+
+	// Submits a list and reads back what the GPU sees for each job it launches
+	RunResult Run(DkQueue queue, uint32_t channel, DkCmdList list)
+	{
+		RunResult res = {};
+		hostgpu::enableTrace(channel, true);
+		dkQueueSubmitCommands(queue, list);
+		dkQueueFlush(queue);
+		dkQueueWaitIdle(queue);
+		hostgpu::enableTrace(channel, false);
+
+		for (auto& m : hostgpu::takeTrace(channel))
+		{
+			if (m.subchannel != s_subchannelCompute)
+				continue;
+			if (m.method == s_lineLengthIn && m.value > sizeof(maxwell::ComputeQmd))
+				res.numFullUploads ++;
+			else if (m.method == s_sendPcasA)
+			{
+				JobData job;
+				job.jobAddr = DkGpuAddr(m.value) << 8;
+				memcpy(&job.qmd, hostgpu::translate(job.jobAddr), sizeof(job.qmd));
+				auto& cb = job.qmd.constant_buffer[0];
+				job.cbufAddr = (DkGpuAddr(cb.addr_upper) << 32) | cb.addr_lower;
+				memcpy(&job.cbuf, hostgpu::translate(job.cbufAddr), sizeof(job.cbuf));
+				res.jobs.push_back(job);
+			}
+		}
+		return res;
+	}
+
+	// Jobs must match apart from where their cbuf lives
+	bool IsSameJob(JobData a, JobData b)
+	{
+		a.qmd.constant_buffer[0].addr_lower = b.qmd.constant_buffer[0].addr_lower = 0;
+		a.qmd.constant_buffer[0].addr_upper = b.qmd.constant_buffer[0].addr_upper = 0;
+		return memcmp(&a.qmd, &b.qmd, sizeof(a.qmd)) == 0 && memcmp(&a.cbuf, &b.cbuf, sizeof(a.cbuf)) == 0;
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+	DkMemBlock codeMem = test::CreateCodeMemBlock(device);
+	DkMemBlock cmdMem = test::CreateMemBlock(device, s_cmdMemSize);
+
+	test::Dksh dksh;
+	DkShader shader;
+	test::InitComputeShader(shader, codeMem, dksh);
+
+	DkCmdBuf cmdbuf = test::CreateCmdBuf(device, cmdMem);
+	DkCmdList steps[s_numSteps];
+	for (uint32_t i = 0; i < s_numSteps; i ++)
+	{
+		RecordStep(cmdbuf, shader, i);
+		steps[i] = dkCmdBufFinishList(cmdbuf);
+	}
+	for (uint32_t i = 0; i < s_numSteps; i ++)
+		RecordStep(cmdbuf, shader, i);
+	DkCmdList list = dkCmdBufFinishList(cmdbuf);
+
+	// With two job slots, flushing after a job fences it, so every job uploads its own cbuf
+	DkQueue refQueue = CreateQueue(device, 2);
+	uint32_t refChannel = hostgpu::lastChannel();
+	std::vector<JobData> refJobs;
+	for (uint32_t i = 0; i < 2*s_numSteps; i ++)
+	{
+		RunResult step = Run(refQueue, refChannel, steps[i % s_numSteps]);
+		CHECK(step.jobs.size() == 1 && step.numFullUploads == 1);
+		refJobs.insert(refJobs.end(), step.jobs.begin(), step.jobs.end());
+	}
+
+	// Running the steps in a single list only uploads the cbuf when it changes. Flushing
+	// fences the jobs once half the slots are in use, so the second run reuses no cbuf.
+	DkQueue queue = CreateQueue(device, 2*s_numSteps);
+	uint32_t channel = hostgpu::lastChannel();
+	RunResult first = Run(queue, channel, list);
+	RunResult second = Run(queue, channel, list);
+	printf("  %u dispatches: %u + %u cbuf uploads\n", 2*s_numSteps, first.numFullUploads, second.numFullUploads);
+	CHECK(first.numFullUploads == s_numFullUploads);
+	CHECK(second.numFullUploads == s_numFullUploadsAgain);
+	CHECK(first.jobs.size() == s_numSteps && second.jobs.size() == s_numSteps);
+	if (first.jobs.size() != s_numSteps || second.jobs.size() != s_numSteps || refJobs.size() != 2*s_numSteps)
+		return test::Finish("compute_cbuf");
+
+	for (auto& job : refJobs)
+		CHECK(job.cbufAddr == job.jobAddr + sizeof(maxwell::ComputeQmd));
+	for (uint32_t i = 0; i < s_numSteps; i ++)
+	{
+		CHECK(IsSameJob(first.jobs[i], refJobs[i]));
+		CHECK(IsSameJob(second.jobs[i], refJobs[s_numSteps+i]));
+		CHECK(second.jobs[i].cbufAddr > second.jobs[0].jobAddr);
+	}
+	CHECK(second.jobs[0].cbufAddr == second.jobs[0].jobAddr + sizeof(maxwell::ComputeQmd));
+	CHECK(first.jobs[1].cbufAddr == first.jobs[0].cbufAddr);
+
+	dkQueueDestroy(queue);
+	dkQueueDestroy(refQueue);
+	dkCmdBufDestroy(cmdbuf);
+	dkMemBlockDestroy(cmdMem);
+	dkMemBlockDestroy(codeMem);
+	dkDeviceDestroy(device);
+	return test::Finish("compute_cbuf");
+}
@@ -0,0 +1,157 @@
+// Checks the grid size patch performed by indirect compute dispatches: the macro that
+// writes the dimensions into the job (QMD and driver cbuf) is run through the MME model,
+// and the queue's stream is checked to order the patch before the job is launched.
+#include "common.h"
+#include "host/gpu_host.h"
+#include "compute_shader.h"
+#include "mme_sim.h"
+#include "driver_constbuf.h"
+#include "maxwell/compute_qmd.h"
+
+using namespace dk::detail;
+
+namespace
+{
+	constexpr uint32_t s_dims[3] = { 0x12345, 0xABCD, 0x7 };
+	constexpr uint64_t s_jobAddr = UINT64_C(0x123456700);
+	constexpr uint32_t s_cmdMemSize = 0x10000;
+
+	// Engine methods
+	constexpr uint32_t s_subchannel3D = 0;
+	constexpr uint32_t s_subchannelCompute = 1;
+	constexpr uint32_t s_waitForIdle = 0x044;
+	constexpr uint32_t s_invalidateShaderCaches = 0x087;
+	constexpr uint32_t s_invalidateConstant = 1U << 12;
+	constexpr uint32_t s_sendPcasA = 0x0AD;
+
+	constexpr uint32_t s_qmdRasterOffset = offsetof(maxwell::ComputeQmd, cta_raster_width);
+	constexpr uint32_t s_cbufGridSizeOffset = sizeof(maxwell::ComputeQmd) + offsetof(ComputeDriverCbuf, gridSize);
+
+	// Words of a QMD whose grid size was set on the CPU, at the offset the patch writes to
+	void GetExpectedRaster(uint32_t out[2])
+	{
+		maxwell::ComputeQmd qmd = {};
+		qmd.cta_raster_width = s_dims[0];
+		qmd.cta_raster_height = s_dims[1];
+		qmd.cta_raster_depth = s_dims[2];
+		memcpy(out, (char*)&qmd + s_qmdRasterOffset, 2*sizeof(uint32_t));
+	}
+
+	test::MmeSim CreateSim()
+	{
+		test::MmeSim sim;
+		test::AddDrawSymbols(sim);
+		CHECK(sim.load("compute.mme"));
+		return sim;
+	}
+
+	// Runs the macro on its own, and checks every word it writes
+	void CheckMacro()
+	{
+		test::MmeSim sim = CreateSim();
+		CHECK(sim.run("PatchComputeJobGridSize", { uint32_t(s_jobAddr >> 8), s_dims[0], s_dims[1], s_dims[2] }));
+
+		uint32_t raster[2];
+		GetExpectedRaster(raster);
+		CHECK(sim.getNumMemoryWords() == 5);
+		CHECK(sim.readMemory(s_jobAddr + s_qmdRasterOffset + 0) == raster[0]);
+		CHECK(sim.readMemory(s_jobAddr + s_qmdRasterOffset + 4) == raster[1]);
+		for (unsigned i = 0; i < 3; i ++)
+			CHECK(sim.readMemory(s_jobAddr + s_cbufGridSizeOffset + 4*i) == s_dims[i]);
+
+		// The selector is left pointing at the job
+		CHECK(sim.reg(test::MmeSim::s_constbufSelectorAddr) == uint32_t(s_jobAddr >> 32));
+		CHECK(sim.reg(test::MmeSim::s_constbufSelectorAddr+1) == uint32_t(s_jobAddr));
+	}
+
+	size_t Find(std::vector<hostgpu::Method> const& trace, size_t start, uint32_t subchannel, uint32_t method)
+	{
+		for (size_t i = start; i < trace.size(); i ++)
+			if (trace[i].subchannel == subchannel && trace[i].method == method)
+				return i;
+		return trace.size();
+	}
+
+	// Dispatches an indirect job on a real queue, and checks the stream it produces
+	void CheckDispatch()
+	{
+		DkDevice device = test::CreateDevice();
+		DkMemBlock codeMem = test::CreateCodeMemBlock(device);
+		DkMemBlock cmdMem = test::CreateMemBlock(device, s_cmdMemSize);
+		DkMemBlock indirectMem = test::CreateMemBlock(device, DK_MEMBLOCK_ALIGNMENT);
+		memcpy(dkMemBlockGetCpuAddr(indirectMem), s_dims, sizeof(s_dims));
+
+		test::Dksh dksh;
+		DkShader shader;
+		test::InitComputeShader(shader, codeMem, dksh);
+
+		DkQueueMaker maker;
+		dkQueueMakerDefaults(&maker, device);
+		maker.flags = DkQueueFlags_Compute;
+		DkQueue queue = dkQueueCreate(&maker);
+		uint32_t channel = hostgpu::lastChannel();
+		hostgpu::enableTrace(channel, true);
+
+		DkCmdBuf cmdbuf = test::CreateCmdBuf(device, cmdMem);
+		DkShader const* shaders[] = { &shader };
+		dkCmdBufBindShaders(cmdbuf, DkStageFlag_Compute, shaders, 1);
+		dkCmdBufDispatchComputeIndirect(cmdbuf, dkMemBlockGetGpuAddr(indirectMem));
+		dkQueueSubmitCommands(queue, dkCmdBufFinishList(cmdbuf));
+		dkQueueWaitIdle(queue);
+		auto trace = hostgpu::takeTrace(channel);
+
+		// Macro call with the job address, followed by the dimensions from the indirect buffer
+		size_t call = Find(trace, 0, s_subchannel3D, MmeMacroPatchComputeJobGridSize);
+		CHECK(call + 4 <= trace.size());
+		if (call + 4 > trace.size())
+			return;
+		uint64_t jobAddr = uint64_t(trace[call].value) << 8;
+		for (unsigned i = 0; i < 3; i ++)
+			CHECK(trace[call+1+i].method == MmeMacroPatchComputeJobGridSize+1u && trace[call+1+i].value == s_dims[i]);
+
+		// The 3D engine must idle, and the compute constant cache be invalidated, before the launch
+		size_t wfi = Find(trace, call, s_subchannel3D, s_waitForIdle);
+		size_t invalidate = call;
+		do
+			invalidate = Find(trace, invalidate+1, s_subchannelCompute, s_invalidateShaderCaches);
+		while (invalidate < trace.size() && !(trace[invalidate].value & s_invalidateConstant));
+		size_t launch = Find(trace, call, s_subchannelCompute, s_sendPcasA);
+		CHECK(launch < trace.size() && trace[launch].value == uint32_t(jobAddr >> 8));
+		CHECK(wfi < invalidate && invalidate < launch);
+
+		// Apply the 3D writes of the stream on top of the job uploaded by the compute engine
+		test::MmeSim sim = CreateSim();
+		std::vector<test::MmeSim::Write> writes;
+		for (auto& m : trace)
+			if (m.subchannel == s_subchannel3D)
+				writes.push_back({ m.subchannel, m.method, m.value });
+		CHECK(sim.process(writes));
+
+		uint32_t const* job = (uint32_t const*)hostgpu::translate(jobAddr);
+		CHECK(job != nullptr);
+		if (job)
+		{
+			auto read = [&](uint32_t offset) { return sim.readMemory(jobAddr + offset, job[offset/4]); };
+			uint32_t raster[2];
+			GetExpectedRaster(raster);
+			CHECK(read(s_qmdRasterOffset + 0) == raster[0]);
+			CHECK(read(s_qmdRasterOffset + 4) == raster[1]);
+			for (unsigned i = 0; i < 3; i ++)
+				CHECK(read(s_cbufGridSizeOffset + 4*i) == s_dims[i]);
+		}
+
+		dkCmdBufDestroy(cmdbuf);
+		dkQueueDestroy(queue);
+		dkMemBlockDestroy(indirectMem);
+		dkMemBlockDestroy(cmdMem);
+		dkMemBlockDestroy(codeMem);
+		dkDeviceDestroy(device);
+	}
+}
+
+int main()
+{
+	CheckMacro();
+	CheckDispatch();
+	return test::Finish("compute_indirect");
+}
@@ -0,0 +1,44 @@
+// A compute program with no actual code, for tests that dispatch compute jobs:
+// the GPU model does not run shaders
+#pragma once
+#include <deko3d.h>
+#include "dk_shader.h"
+#include <string.h>
+
+namespace test
+{
+	struct alignas(DK_SHADER_CODE_ALIGNMENT) Dksh
+	{
+		DkshHeader hdr;
+		DkshProgramHeader prog;
+	};
+
+	inline void InitComputeShader(DkShader& shader, DkMemBlock codeMem, Dksh& dksh)
+	{
+		memset(&dksh, 0, sizeof(dksh));
+		dksh.hdr.magic = DKSH_MAGIC;
+		dksh.hdr.header_sz = sizeof(DkshHeader);
+		dksh.hdr.control_sz = sizeof(Dksh);
+		dksh.hdr.code_sz = DK_SHADER_CODE_ALIGNMENT;
+		dksh.hdr.programs_off = offsetof(Dksh, prog);
+		dksh.hdr.num_programs = 1;
+		dksh.prog.type = DkshProgramType_Compute;
+		dksh.prog.num_gprs = 8;
+		dksh.prog.comp.block_dims[0] = 64;
+		dksh.prog.comp.block_dims[1] = 1;
+		dksh.prog.comp.block_dims[2] = 1;
+
+		DkShaderMaker maker;
+		dkShaderMakerDefaults(&maker, codeMem, 0);
+		maker.control = &dksh;
+		dkShaderInitialize(&shader, &maker);
+	}
+
+	inline DkMemBlock CreateCodeMemBlock(DkDevice device)
+	{
+		DkMemBlockMaker maker;
+		dkMemBlockMakerDefaults(&maker, device, DK_MEMBLOCK_ALIGNMENT);
+		maker.flags = DkMemBlockFlags_CpuUncached | DkMemBlockFlags_GpuCached | DkMemBlockFlags_Code;
+		return dkMemBlockCreate(&maker);
+	}
+}
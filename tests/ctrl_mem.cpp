@@ -0,0 +1,120 @@
+// Counts the allocator calls made for control command memory while recording dispatches,
+// both with a long-lived command buffer that is cleared every frame and with short-lived
+// command buffers, and checks that commands too big for any size class still get memory.
+#include "common.h"
+#include "dk_cmdbuf.h"
+
+namespace
+{
+	constexpr uint32_t s_numDispatches = 10000;
+	constexpr uint32_t s_dispatchesPerList = 100;
+	constexpr size_t s_oversizedCmdSize = 0x40000; // 256 KiB, above the largest size class
+
+	struct AllocStats
+	{
+		uint32_t numAllocs;
+		uint32_t numFrees;
+	};
+
+	DkResult CountingAlloc(void* userData, size_t alignment, size_t size, void** out)
+	{
+		static_cast<AllocStats*>(userData)->numAllocs ++;
+		*out = aligned_alloc(alignment, (size + alignment - 1) &~ (alignment - 1));
+		return *out ? DkResult_Success : DkResult_OutOfMemory;
+	}
+
+	void CountingFree(void* userData, void* mem)
+	{
+		static_cast<AllocStats*>(userData)->numFrees ++;
+		free(mem);
+	}
+
+	// Allocator calls made while recording a list, leaving out those for the command buffer itself
+	uint32_t RecordList(DkCmdBuf cmdbuf, AllocStats const& stats)
+	{
+		uint32_t before = stats.numAllocs;
+		for (uint32_t i = 0; i < s_dispatchesPerList; i ++)
+			dkCmdBufDispatchCompute(cmdbuf, 1 + i, 1, 1);
+		CHECK(dkCmdBufFinishList(cmdbuf) != 0);
+		return stats.numAllocs - before;
+	}
+
+	// One command buffer, cleared after each list
+	uint32_t CountReused(DkDevice device, AllocStats const& stats)
+	{
+		uint32_t numAllocs = 0;
+		DkCmdBuf cmdbuf = test::CreateCmdBuf(device, nullptr);
+		for (uint32_t i = 0; i < s_numDispatches; i += s_dispatchesPerList)
+		{
+			numAllocs += RecordList(cmdbuf, stats);
+			dkCmdBufClear(cmdbuf);
+		}
+		dkCmdBufDestroy(cmdbuf);
+		return numAllocs;
+	}
+
+	// A new command buffer for each list
+	uint32_t CountShortLived(DkDevice device, AllocStats const& stats, uint32_t flags)
+	{
+		uint32_t numAllocs = 0;
+		for (uint32_t i = 0; i < s_numDispatches; i += s_dispatchesPerList)
+		{
+			DkCmdBuf cmdbuf = test::CreateCmdBuf(device, nullptr, flags);
+			numAllocs += RecordList(cmdbuf, stats);
+			dkCmdBufDestroy(cmdbuf);
+		}
+		return numAllocs;
+	}
+
+	void TestOversized(DkDevice device, AllocStats& stats)
+	{
+		DkCmdBuf cmdbuf = test::CreateCmdBuf(device, nullptr);
+		dkCmdBufDispatchCompute(cmdbuf, 1, 1, 1);
+
+		uint32_t allocsBefore = stats.numAllocs, freesBefore = stats.numFrees;
+		auto* cmd = cmdbuf->appendCtrlCmd(s_oversizedCmdSize);
+		CHECK(cmd != nullptr);
+		CHECK(stats.numAllocs == allocsBefore + 1);
+		if (cmd)
+			memset(cmd, 0, s_oversizedCmdSize);
+
+		// The chunk is released on clear, instead of being kept in a free list
+		dkCmdBufClear(cmdbuf);
+		CHECK(stats.numFrees == freesBefore + 1);
+
+		// Regular commands keep reusing the chunks of their size class
+		allocsBefore = stats.numAllocs;
+		dkCmdBufDispatchCompute(cmdbuf, 1, 1, 1);
+		CHECK(dkCmdBufFinishList(cmdbuf) != 0);
+		CHECK(stats.numAllocs == allocsBefore);
+		dkCmdBufDestroy(cmdbuf);
+	}
+}
+
+int main()
+{
+	AllocStats stats = {};
+	DkDeviceMaker maker;
+	dkDeviceMakerDefaults(&maker);
+	maker.userData = &stats;
+	maker.cbAlloc = CountingAlloc;
+	maker.cbFree = CountingFree;
+	DkDevice device = dkDeviceCreate(&maker);
+
+	uint32_t reused = CountReused(device, stats);
+	uint32_t shortLived = CountShortLived(device, stats, 0);
+	uint32_t shared = CountShortLived(device, stats, DkCmdBufFlags_SharedCtrlMemPool);
+	printf("  allocator calls per %u dispatches: %u reused, %u short-lived, %u short-lived with shared pool\n",
+		s_numDispatches, reused, shortLived, shared);
+
+	// Only the first list should need new memory, after that chunks are reused
+	uint32_t numLists = s_numDispatches / s_dispatchesPerList;
+	CHECK(reused > 0 && reused == shared);
+	CHECK(shortLived == numLists*reused);
+
+	TestOversized(device, stats);
+
+	dkDeviceDestroy(device);
+	CHECK(stats.numAllocs == stats.numFrees);
+	return test::Finish("ctrl_mem");
+}
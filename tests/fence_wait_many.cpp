@@ -0,0 +1,82 @@
+// Waits on fences from queues of two different devices, and checks that a queue
+// entering error state ends the wait no matter which device it belongs to.
+#include "common.h"
+#include "host/gpu_host.h"
+#include "dk_fence.h"
+
+namespace
+{
+	constexpr int64_t s_timeoutNs = 2000000000; // 2 s
+
+	// The faults are expected, so keep their warnings quiet
+	void DebugFunc(void* userData, const char* context, DkResult result, const char* message)
+	{
+		if (result != DkResult_Success)
+		{
+			fprintf(stderr, "[%s] error %d: %s\n", context, result, message);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	struct Context
+	{
+		DkDevice device;
+		DkQueue queue;
+		uint32_t channel;
+		DkFence fence;
+	};
+
+	// Leaves a fence pending on a paused channel
+	void Setup(Context& ctx)
+	{
+		DkDeviceMaker deviceMaker;
+		dkDeviceMakerDefaults(&deviceMaker);
+		deviceMaker.cbDebug = DebugFunc;
+		deviceMaker.errorCheckIntervalUs = 1000;
+		ctx.device = dkDeviceCreate(&deviceMaker);
+
+		DkQueueMaker queueMaker;
+		dkQueueMakerDefaults(&queueMaker, ctx.device);
+		ctx.queue = dkQueueCreate(&queueMaker);
+		ctx.channel = hostgpu::lastChannel();
+
+		hostgpu::pauseChannel(ctx.channel, true);
+		dkQueueSignalFence(ctx.queue, &ctx.fence, true);
+		dkQueueFlush(ctx.queue);
+	}
+
+	void Cleanup(Context& ctx)
+	{
+		hostgpu::pauseChannel(ctx.channel, false);
+		dkQueueDestroy(ctx.queue);
+		dkDeviceDestroy(ctx.device);
+	}
+
+	void Run(bool waitAll)
+	{
+		Context a, b;
+		Setup(a);
+		Setup(b);
+
+		DkFence* fences[] = { &a.fence, &b.fence };
+		CHECK(dkFenceWaitMany(fences, 2, waitAll, 0) == DkResult_Timeout);
+
+		// The faulted queue is not on the device of the last fence in the array
+		hostgpu::injectFault(a.channel);
+		if (waitAll)
+			hostgpu::pauseChannel(b.channel, false);
+		CHECK(dkFenceWaitMany(fences, 2, waitAll, s_timeoutNs) == DkResult_Success);
+		CHECK(dkQueueIsInErrorState(a.queue));
+		CHECK(!dkQueueIsInErrorState(b.queue));
+
+		Cleanup(b);
+		Cleanup(a);
+	}
+}
+
+int main()
+{
+	Run(false);
+	Run(true);
+	return test::Finish("fence_wait_many");
+}
@@ -0,0 +1,182 @@
+// Binds framebuffers created from several render target configurations, and compares the
+// commands against binding the same image views with dkCmdBufBindRenderTargets: the words
+// must be those of an optimized capture of the regular bind, and leave every register in
+// the same state as the regular bind, whichever configuration was bound before.
+#include "common.h"
+#include "cmd_sim.h"
+#include "dk_image.h"
+#include <vector>
+
+namespace
+{
+	constexpr uint32_t s_maxWords = 0x400;
+	constexpr uint32_t s_maxImages = 16;
+	constexpr uint32_t s_memSize = 0x4000000;
+
+	struct ImageDesc
+	{
+		DkImageFormat format;
+		uint32_t width, height;
+		DkMsMode msMode;
+	};
+
+	struct Config
+	{
+		uint32_t numColorTargets;
+		ImageDesc color[DK_MAX_RENDER_TARGETS];
+		ImageDesc depth; // format is DkImageFormat_None when there is no depth target
+	};
+
+	const Config s_configs[] =
+	{
+		{ 2, { { DkImageFormat_RGBA8_Unorm, 1280, 720 }, { DkImageFormat_RGB10A2_Unorm, 1280, 720 } }, { DkImageFormat_Z24S8, 1280, 720 } },
+		{ 1, { { DkImageFormat_RGBA16_Float, 640, 480 } }, { DkImageFormat_None } },
+		{ 0, { }, { DkImageFormat_Z24S8, 1024, 1024, DkMsMode_4x } },
+		{ 1, { { DkImageFormat_RGBA8_Unorm, 1920, 1080, DkMsMode_4x } }, { DkImageFormat_Z24S8, 1920, 1080, DkMsMode_4x } },
+		{ DK_MAX_RENDER_TARGETS, {
+			{ DkImageFormat_RGBA8_Unorm, 800, 600 }, { DkImageFormat_RGBA8_Unorm, 800, 600 },
+			{ DkImageFormat_RGBA8_Unorm, 800, 600 }, { DkImageFormat_RGBA8_Unorm, 800, 600 },
+			{ DkImageFormat_RGBA8_Unorm, 800, 600 }, { DkImageFormat_RGBA8_Unorm, 800, 600 },
+			{ DkImageFormat_RGBA8_Unorm, 800, 600 }, { DkImageFormat_RGBA8_Unorm, 400, 300 } },
+			{ DkImageFormat_None } },
+	};
+	constexpr uint32_t s_numConfigs = sizeof(s_configs)/sizeof(s_configs[0]);
+
+	class ImageAllocator
+	{
+		DkDevice m_device;
+		DkMemBlock m_mem;
+		uint32_t m_offset;
+		uint32_t m_numImages;
+		DkImage m_images[s_maxImages];
+
+	public:
+		ImageAllocator(DkDevice device) :
+			m_device{device}, m_mem{test::CreateMemBlock(device, s_memSize, DkMemBlockFlags_GpuCached | DkMemBlockFlags_Image)}, m_offset{}, m_numImages{} { }
+		~ImageAllocator() { dkMemBlockDestroy(m_mem); }
+
+		void createView(DkImageView& view, ImageDesc const& desc)
+		{
+			DkImageLayoutMaker maker;
+			dkImageLayoutMakerDefaults(&maker, m_device);
+			maker.flags = DkImageFlags_UsageRender | DkImageFlags_HwCompression;
+			maker.format = desc.format;
+			maker.msMode = desc.msMode;
+			maker.dimensions[0] = desc.width;
+			maker.dimensions[1] = desc.height;
+
+			DkImageLayout layout;
+			dkImageLayoutInitialize(&layout, &maker);
+			uint32_t align = dkImageLayoutGetAlignment(&layout);
+			m_offset = (m_offset + align - 1) &~ (align - 1);
+
+			DkImage* image = &m_images[m_numImages++];
+			dkImageInitialize(image, &layout, m_mem, m_offset);
+			m_offset += dkImageLayoutGetSize(&layout);
+			CHECK(m_numImages <= s_maxImages && m_offset <= s_memSize);
+			dkImageViewDefaults(&view, image);
+		}
+	};
+
+	struct Targets
+	{
+		DkImageView colorViews[DK_MAX_RENDER_TARGETS];
+		DkImageView depthView;
+		DkImageView const* colorTargets[DK_MAX_RENDER_TARGETS];
+		DkImageView const* depthTarget;
+		uint32_t numColorTargets;
+
+		void create(ImageAllocator& alloc, Config const& config)
+		{
+			numColorTargets = config.numColorTargets;
+			for (uint32_t i = 0; i < numColorTargets; i ++)
+			{
+				alloc.createView(colorViews[i], config.color[i]);
+				colorTargets[i] = &colorViews[i];
+			}
+			depthTarget = nullptr;
+			if (config.depth.format != DkImageFormat_None)
+			{
+				alloc.createView(depthView, config.depth);
+				depthTarget = &depthView;
+			}
+		}
+
+		void bind(DkCmdBuf cmdbuf) const
+		{
+			dkCmdBufBindRenderTargets(cmdbuf, colorTargets, numColorTargets, depthTarget);
+		}
+
+		DkFramebuffer createFramebuffer(DkDevice device) const
+		{
+			DkFramebufferMaker maker;
+			dkFramebufferMakerDefaults(&maker, device, colorTargets, numColorTargets, depthTarget);
+			return dkFramebufferCreate(&maker);
+		}
+	};
+
+	template <typename Func>
+	std::vector<uint32_t> Capture(DkCmdBuf cmdbuf, Func&& func)
+	{
+		std::vector<uint32_t> words(s_maxWords);
+		dkCmdBufBeginCaptureCmds(cmdbuf, words.data(), s_maxWords);
+		func();
+		words.resize(dkCmdBufEndCaptureCmds(cmdbuf));
+		return words;
+	}
+
+	// Registers after executing each stream in turn
+	std::vector<uint32_t> GetRegs(std::initializer_list<std::vector<uint32_t> const*> streams)
+	{
+		test::RegSim sim;
+		for (auto* s : streams)
+			CHECK(sim.process(s->data(), s->size()));
+		return sim.getRegs();
+	}
+
+	void TestFramebuffers(DkDevice device)
+	{
+		DkCmdBuf cmdbuf = test::CreateCmdBuf(device, nullptr);
+		DkCmdBuf optCmdbuf = test::CreateCmdBuf(device, nullptr, DkCmdBufFlags_OptimizeCaptures);
+		ImageAllocator alloc{device};
+
+		Targets targets[s_numConfigs];
+		DkFramebuffer framebuffers[s_numConfigs];
+		std::vector<uint32_t> fbWords[s_numConfigs], refWords[s_numConfigs];
+		for (uint32_t i = 0; i < s_numConfigs; i ++)
+		{
+			targets[i].create(alloc, s_configs[i]);
+			framebuffers[i] = targets[i].createFramebuffer(device);
+			CHECK(framebuffers[i]);
+			if (!framebuffers[i])
+				return;
+
+			fbWords[i] = Capture(cmdbuf, [&] { dkCmdBufBindFramebuffer(cmdbuf, framebuffers[i]); });
+			refWords[i] = Capture(cmdbuf, [&] { targets[i].bind(cmdbuf); });
+			auto optWords = Capture(optCmdbuf, [&] { targets[i].bind(optCmdbuf); });
+			CHECK(!fbWords[i].empty());
+			CHECK(fbWords[i] == optWords);
+			CHECK(fbWords[i].size() <= refWords[i].size());
+		}
+
+		// Binding a framebuffer overwrites everything the previous configuration set
+		for (uint32_t prev = 0; prev < s_numConfigs; prev ++)
+			for (uint32_t i = 0; i < s_numConfigs; i ++)
+				CHECK(GetRegs({ &refWords[prev], &fbWords[i] }) == GetRegs({ &refWords[prev], &refWords[i] }));
+
+		for (uint32_t i = 0; i < s_numConfigs; i ++)
+			dkFramebufferDestroy(framebuffers[i]);
+		dkCmdBufDestroy(optCmdbuf);
+		dkCmdBufDestroy(cmdbuf);
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+
+	TestFramebuffers(device);
+
+	dkDeviceDestroy(device);
+	return test::Finish("framebuffer_bind");
+}
@@ -0,0 +1,102 @@
+// Measures the cost of submitting command lists made of many gpfifo entries, which the
+// queue appends to its channel in bulk, and checks that every entry reaches the GPU in
+// order without the channel being kicked off more often than it fills up.
+#include "common.h"
+#include "host/gpu_host.h"
+#include <chrono>
+
+namespace
+{
+	constexpr uint32_t s_maxEntries = 4096;
+	constexpr uint32_t s_entriesPerRun = 0x10000;
+	constexpr uint32_t s_maxSubmissionsPerRun = 4096;
+	constexpr uint32_t s_cmdMemSize = 0x10000;
+
+	// Inline write of the entry's index to an otherwise unused 3D method
+	constexpr uint32_t s_markerMethod = 0x7FF;
+	constexpr uint32_t MakeMarker(uint32_t index) { return (4U << 29) | (index << 16) | s_markerMethod; }
+
+	DkCmdList RecordEntries(DkCmdBuf cmdbuf, DkMemBlock markers, uint32_t numEntries)
+	{
+		// Markers are spaced out so that consecutive entries can't be coalesced into one
+		for (uint32_t i = 0; i < numEntries; i ++)
+			dkCmdBufReplayCmdsFromMemBlock(cmdbuf, markers, 8*i, 1);
+		return dkCmdBufFinishList(cmdbuf);
+	}
+
+	void CheckOrder(uint32_t channel, uint32_t numEntries, uint32_t numSubmissions)
+	{
+		uint32_t expected = 0, numSeen = 0;
+		for (auto& m : hostgpu::takeTrace(channel))
+		{
+			if (m.subchannel != 0 || m.method != s_markerMethod)
+				continue;
+			CHECK(m.value == expected);
+			expected = (m.value + 1) % numEntries;
+			numSeen ++;
+		}
+		CHECK(numSeen == numEntries*numSubmissions);
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+	DkMemBlock cmdMem = test::CreateMemBlock(device, s_cmdMemSize);
+	DkMemBlock markers = test::CreateMemBlock(device, 8*s_maxEntries);
+	uint32_t* markerWords = (uint32_t*)dkMemBlockGetCpuAddr(markers);
+	for (uint32_t i = 0; i < s_maxEntries; i ++)
+		markerWords[2*i] = MakeMarker(i);
+
+	DkQueueMaker maker;
+	dkQueueMakerDefaults(&maker, device);
+	DkQueue queue = dkQueueCreate(&maker);
+	uint32_t channel = hostgpu::lastChannel();
+	DkCmdBuf cmdbuf = test::CreateCmdBuf(device, cmdMem);
+
+	for (uint32_t numEntries : { 1U, 64U, s_maxEntries })
+	{
+		DkCmdList list = RecordEntries(cmdbuf, markers, numEntries);
+		uint32_t numSubmissions = s_entriesPerRun / numEntries;
+		if (numSubmissions > s_maxSubmissionsPerRun)
+			numSubmissions = s_maxSubmissionsPerRun;
+
+		// Correctness first: every entry must reach the GPU, in order
+		hostgpu::enableTrace(channel, true);
+		for (uint32_t i = 0; i < 4; i ++)
+		{
+			dkQueueSubmitCommands(queue, list);
+			dkQueueFlush(queue);
+		}
+		dkQueueWaitIdle(queue);
+		hostgpu::enableTrace(channel, false);
+		CheckOrder(channel, numEntries, 4);
+
+		uint32_t kickoffsBefore = hostgpu::getNumKickoffs(channel);
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < numSubmissions; i ++)
+		{
+			dkQueueSubmitCommands(queue, list);
+			dkQueueFlush(queue);
+		}
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		dkQueueWaitIdle(queue);
+		uint32_t numKickoffs = hostgpu::getNumKickoffs(channel) - kickoffsBefore;
+
+		// One kickoff per flush, plus one each time the channel fills up
+		uint32_t maxKickoffs = numSubmissions * (1 + (numEntries + GPFIFO_QUEUE_SIZE - 1) / GPFIFO_QUEUE_SIZE) + 1;
+		CHECK(numKickoffs <= maxKickoffs);
+
+		double us = std::chrono::duration<double, std::micro>(elapsed).count();
+		printf("  %4u entries: %u submissions in %.1f ms (%.1f ns/entry, %.2f kickoffs/submission)\n",
+			numEntries, numSubmissions, us/1000, 1000*us/(numSubmissions*numEntries), double(numKickoffs)/numSubmissions);
+		dkCmdBufClear(cmdbuf);
+	}
+
+	dkCmdBufDestroy(cmdbuf);
+	dkQueueDestroy(queue);
+	dkMemBlockDestroy(markers);
+	dkMemBlockDestroy(cmdMem);
+	dkDeviceDestroy(device);
+	return test::Finish("gpfifo_append");
+}
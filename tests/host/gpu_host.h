@@ -0,0 +1,57 @@
+// Control interface of the host GPU model implemented in nx_host.cpp.
+//
+// Each channel created through nvGpuChannelCreate gets a worker thread that executes the
+// gpfifo entries kicked off to it. The model only understands the handful of methods that
+// have observable side effects for the driver: semaphore and syncpoint operations, report
+// semaphores, inline memory uploads and compute job launches. Everything else is accepted
+// and ignored, but can be recorded in a per-channel trace.
+#pragma once
+#include "switch.h"
+#include <vector>
+
+namespace hostgpu
+{
+	struct Method
+	{
+		uint32_t subchannel;
+		uint32_t method;
+		uint32_t value;
+	};
+
+	// Channels are numbered in creation order, starting from 1
+	uint32_t lastChannel();
+
+	// Stops (or resumes) executing entries kicked off to a channel
+	void pauseChannel(uint32_t channel, bool pause);
+
+	// Makes kickoffs to a channel block until released, so that tests can control when
+	// a kickoff (e.g. one performed by a queue's submission thread) reaches the GPU
+	void holdKickoffs(uint32_t channel, bool hold);
+	void waitKickoffHeld(uint32_t channel);
+
+	// Makes a channel raise an error: pending work is dropped, further kickoffs fail and
+	// its syncpoint is released to the maximum value, as the kernel does on a real fault
+	void injectFault(uint32_t channel);
+
+	// Number of successful nvGpuChannelKickoff calls made on a channel
+	uint32_t getNumKickoffs(uint32_t channel);
+
+	// Number of gpfifo entries kicked off to a channel
+	uint32_t getNumEntries(uint32_t channel);
+
+	// Blocks until the channel has executed every entry kicked off to it
+	void waitChannelIdle(uint32_t channel);
+
+	// Recording of the methods executed by a channel
+	void enableTrace(uint32_t channel, bool enable);
+	std::vector<Method> takeTrace(uint32_t channel);
+
+	uint32_t getNumComputeLaunches();
+
+	// Syncpoints not owned by any channel, for tests that need fences without a queue
+	uint32_t allocSyncpt();
+	uint32_t readSyncpt(uint32_t id);
+	void incrSyncpt(uint32_t id);
+
+	void* translate(uint64_t iova);
+}
@@ -0,0 +1,474 @@
+// hostgen - generates the headers normally produced by dekodef/dekomme, for host builds
+//
+// Only the parts of the generated headers that the library sources rely on are produced:
+// method ids, array/structure strides, bitfields and enum values for engine definitions,
+// and macro ids plus a placeholder setup sequence for MME macros (the macros themselves
+// are not assembled, the host GPU model does not execute them).
+//
+// Usage: hostgen -h <out.h> <in.def>
+//        hostgen -m <out.h> <in.mme...>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct Token
+	{
+		std::string m_text;
+		unsigned m_line;
+	};
+
+	bool ReadFile(const char* path, std::string& out)
+	{
+		FILE* f = fopen(path, "rb");
+		if (!f)
+		{
+			fprintf(stderr, "cannot open %s\n", path);
+			return false;
+		}
+
+		char buf[4096];
+		size_t len;
+		while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+			out.append(buf, len);
+		fclose(f);
+		return true;
+	}
+
+	//-------------------------------------------------------------------------
+	// Engine definitions
+	//-------------------------------------------------------------------------
+
+	class DefGenerator
+	{
+		std::vector<Token> m_tokens;
+		size_t m_pos;
+		const char* m_fileName;
+		bool m_failed;
+		std::string m_out;
+		unsigned m_indent;
+
+		void tokenize(const char* text)
+		{
+			unsigned line = 1;
+			for (const char* p = text; *p; )
+			{
+				if (*p == '\n')
+				{
+					line ++;
+					p ++;
+				}
+				else if (isspace((unsigned char)*p))
+					p ++;
+				else if (p[0] == '/' && p[1] == '/')
+				{
+					while (*p && *p != '\n')
+						p ++;
+				}
+				else if (p[0] == '.' && p[1] == '.')
+				{
+					m_tokens.push_back({ "..", line });
+					p += 2;
+				}
+				else if (isalnum((unsigned char)*p) || *p == '_')
+				{
+					const char* start = p;
+					while (isalnum((unsigned char)*p) || *p == '_')
+						p ++;
+					m_tokens.push_back({ std::string{start, p}, line });
+				}
+				else
+				{
+					m_tokens.push_back({ std::string(1, *p), line });
+					p ++;
+				}
+			}
+		}
+
+		bool atEnd() const { return m_pos >= m_tokens.size(); }
+		std::string const& peek(size_t ahead = 0) const
+		{
+			static const std::string s_empty;
+			return m_pos + ahead >= m_tokens.size() ? s_empty : m_tokens[m_pos + ahead].m_text;
+		}
+
+		void error(const char* msg)
+		{
+			if (!m_failed)
+				fprintf(stderr, "%s:%u: error: %s\n", m_fileName, atEnd() ? 0 : m_tokens[m_pos].m_line, msg);
+			m_failed = true;
+			m_pos = m_tokens.size();
+		}
+
+		std::string next()
+		{
+			if (atEnd())
+			{
+				error("unexpected end of file");
+				return {};
+			}
+			return m_tokens[m_pos++].m_text;
+		}
+
+		bool accept(const char* text)
+		{
+			if (peek() == text)
+			{
+				m_pos ++;
+				return true;
+			}
+			return false;
+		}
+
+		void expect(const char* text)
+		{
+			if (!accept(text))
+				error((std::string{"expected '"} + text + "'").c_str());
+		}
+
+		uint32_t number()
+		{
+			std::string tok = next();
+			char* end;
+			uint32_t value = strtoul(tok.c_str(), &end, 0);
+			if (tok.empty() || *end)
+				error("expected number");
+			return value;
+		}
+
+		void line(std::string const& text)
+		{
+			if (!text.empty())
+				m_out.append(m_indent, '\t');
+			m_out += text;
+			m_out += '\n';
+		}
+
+		void open(std::string const& text)
+		{
+			line(text);
+			line("{");
+			m_indent ++;
+		}
+
+		void close()
+		{
+			m_indent --;
+			line("};");
+		}
+
+		static std::string hex(uint32_t value)
+		{
+			char buf[16];
+			snprintf(buf, sizeof(buf), "0x%x", value);
+			return buf;
+		}
+
+		// Emits the value constants of an enum, shifted into place
+		void parseEnum(unsigned shift)
+		{
+			expect("(");
+			while (!m_failed && !accept(")"))
+			{
+				uint32_t value = number();
+				std::string name = next();
+				expect(";");
+				line("static constexpr uint32_t " + name + " = " + hex(value << shift) + ";");
+			}
+		}
+
+		void parseBits()
+		{
+			expect("(");
+			while (!m_failed && !accept(")"))
+			{
+				unsigned lo = number(), hi = lo;
+				if (accept(".."))
+					hi = number();
+				std::string name = next();
+				unsigned width = hi - lo + 1;
+				uint32_t mask = width >= 32 ? UINT32_MAX : ((1U << width) - 1);
+
+				open("struct " + name);
+				line("static constexpr unsigned Shift = " + std::to_string(lo) + ";");
+				line("static constexpr uint32_t Mask = " + hex(mask) + ";");
+				line("uint32_t m_value;");
+				if (width == 1)
+					line("constexpr " + name + "() : m_value{1U << Shift} { }");
+				line("template <typename T>");
+				line("constexpr " + name + "(T value) : m_value{(uint32_t(value) & Mask) << Shift} { }");
+				line("constexpr operator uint32_t() const { return m_value; }");
+				accept("bool");
+				if (accept("enum"))
+					parseEnum(lo);
+				close();
+				expect(";");
+			}
+		}
+
+		// Emits the type-specific contents of a method structure, returns the number of words it takes
+		unsigned parseType()
+		{
+			if (accept("iova"))
+				return 2;
+			if (accept("float") || accept("bool") || accept("pipe"))
+				return 1;
+			if (accept("enum"))
+				parseEnum(0);
+			else if (accept("bits"))
+				parseBits();
+			return 1;
+		}
+
+		void parseMethod()
+		{
+			uint32_t offset = number();
+			std::string name = next();
+
+			unsigned arraySize = 0;
+			if (accept("array"))
+			{
+				expect("[");
+				arraySize = number();
+				expect("]");
+			}
+
+			if (arraySize && peek() == "(")
+			{
+				// Array of structures: the stride is only known after parsing the members,
+				// so the members are generated into a separate buffer first
+				std::string saved = std::move(m_out);
+				m_out.clear();
+				m_indent ++;
+
+				uint32_t stride = 0;
+				expect("(");
+				while (!m_failed && !accept(")"))
+				{
+					uint32_t memberOffset = number();
+					std::string memberName = next();
+					if (memberName == "next")
+					{
+						stride = memberOffset;
+						expect(";");
+						continue;
+					}
+
+					// Default-constructed members yield their offset within the structure,
+					// as expected by the register array fill macros
+					open("struct " + memberName);
+					line("uint32_t m_method;");
+					line("constexpr " + memberName + "() : m_method{" + hex(memberOffset) + "} { }");
+					line("template <typename T>");
+					line("constexpr " + memberName + "(T index) : m_method{@BASE@ + uint32_t(index)*@STRIDE@ + " + hex(memberOffset) + "} { }");
+					line("constexpr operator uint32_t() const { return m_method; }");
+					unsigned size = parseType();
+					close();
+					expect(";");
+					if (stride < memberOffset + size)
+						stride = memberOffset + size;
+				}
+				m_indent --;
+
+				std::string body = std::move(m_out);
+				m_out = std::move(saved);
+
+				unsigned shift = 0;
+				while ((1U << shift) < stride)
+					shift ++;
+				if ((1U << shift) != stride)
+					error("structure stride is not a power of two");
+
+				for (auto* tok : { "@BASE@", "@STRIDE@" })
+				{
+					std::string value = tok[1] == 'B' ? hex(offset) : hex(stride);
+					for (size_t pos; (pos = body.find(tok)) != std::string::npos; )
+						body.replace(pos, strlen(tok), value);
+				}
+
+				open("struct " + name);
+				line("static constexpr uint32_t Count = " + std::to_string(arraySize) + ";");
+				line("static constexpr unsigned Shift = " + std::to_string(shift) + ";");
+				line("uint32_t m_method;");
+				line("constexpr " + name + "() : m_method{" + hex(offset) + "} { }");
+				line("template <typename T>");
+				line("constexpr " + name + "(T index) : m_method{" + hex(offset) + " + uint32_t(index)*" + hex(stride) + "} { }");
+				line("constexpr operator uint32_t() const { return m_method; }");
+				m_out += body;
+				close();
+			}
+			else
+			{
+				open("struct " + name);
+				size_t headerPos = m_out.size();
+				unsigned size = parseType();
+				if (!arraySize)
+					line("constexpr operator uint32_t() const { return " + hex(offset) + "; }");
+				else
+				{
+					// Bitfields may themselves be called Size, in which case the constant is omitted
+					std::string decl;
+					if (m_out.find("struct Size\n", headerPos) == std::string::npos)
+						decl += std::string(m_indent, '\t') + "static constexpr uint32_t Size = " + std::to_string(arraySize) + ";\n";
+					decl += std::string(m_indent, '\t') + "uint32_t m_method;\n";
+					decl += std::string(m_indent, '\t') + "constexpr " + name + "() : m_method{" + hex(offset) + "} { }\n";
+					decl += std::string(m_indent, '\t') + "template <typename T>\n";
+					decl += std::string(m_indent, '\t') + "constexpr " + name + "(T index) : m_method{" + hex(offset) + " + uint32_t(index)*" + std::to_string(size) + "} { }\n";
+					decl += std::string(m_indent, '\t') + "constexpr operator uint32_t() const { return m_method; }\n";
+					m_out.insert(headerPos, decl);
+				}
+				close();
+			}
+
+			expect(";");
+		}
+
+	public:
+		DefGenerator(const char* fileName, const char* text) : m_pos{}, m_fileName{fileName}, m_failed{}, m_indent{}
+		{
+			tokenize(text);
+		}
+
+		bool generate(std::string& out)
+		{
+			line("// Generated by hostgen from " + std::string{m_fileName} + ", do not edit");
+			line("#pragma once");
+			line("#include <stdint.h>");
+			line("");
+			line("namespace maxwell");
+			line("{");
+			line("");
+			line("#ifndef MAXWELL_CLASS_ID_DEFINED");
+			line("#define MAXWELL_CLASS_ID_DEFINED");
+			line("template <typename Engine>");
+			line("constexpr uint32_t ClassId = Engine::s_classId;");
+			line("#endif");
+			line("");
+
+			bool inEngine = false;
+			while (!m_failed && !atEnd())
+			{
+				if (accept("engine"))
+				{
+					std::string name = next();
+					if (name[0] == '_')
+						name.erase(0, 1);
+					uint32_t classId = number();
+					expect(";");
+					open("struct Engine" + name);
+					line("static constexpr uint32_t s_classId = " + hex(classId) + ";");
+					inEngine = true;
+				}
+				else if (!inEngine)
+					error("expected engine declaration");
+				else
+					parseMethod();
+			}
+
+			if (inEngine)
+				close();
+			line("");
+			line("}");
+			out = std::move(m_out);
+			return !m_failed;
+		}
+	};
+
+	//-------------------------------------------------------------------------
+	// MME macros
+	//-------------------------------------------------------------------------
+
+	bool GenerateMacros(std::vector<const char*> const& inputs, std::string& out)
+	{
+		constexpr uint32_t s_firstMacroMethod = 0xE00;
+
+		out += "// Generated by hostgen, do not edit\n";
+		out += "#pragma once\n";
+		out += "#include <stdint.h>\n\n";
+
+		// Exported macros are labels followed by a double colon, and are numbered
+		// in the order they appear in (which is also the order dekomme uses)
+		unsigned numMacros = 0;
+		for (auto* path : inputs)
+		{
+			std::string text;
+			if (!ReadFile(path, text))
+				return false;
+
+			for (size_t pos = 0; pos < text.size(); )
+			{
+				size_t end = text.find('\n', pos);
+				if (end == std::string::npos)
+					end = text.size();
+				std::string ln = text.substr(pos, end - pos);
+				pos = end + 1;
+
+				size_t len = 0;
+				while (len < ln.size() && (isalnum((unsigned char)ln[len]) || ln[len] == '_'))
+					len ++;
+				if (!len || ln.compare(len, 2, "::") != 0)
+					continue;
+
+				char buf[128];
+				snprintf(buf, sizeof(buf), "constexpr uint16_t MmeMacro%s = 0x%x;\n",
+					ln.substr(0, len).c_str(), s_firstMacroMethod + 2*numMacros++);
+				out += buf;
+			}
+		}
+
+		// The macro code is not uploaded, only the start address table is loaded (with zeros)
+		char buf[128];
+		snprintf(buf, sizeof(buf),
+			"\nconstexpr uint32_t MmeMacro_SetupCmds[] =\n{\n\t0x%08x,\n\t0x%08x,\n",
+			0x80000000U | (0x0047U) | (0U << 13), // inline MmeStartAddressRamPointer = 0
+			0x60000000U | (0x0048U) | (numMacros << 16)); // non-increasing MmeStartAddressRamLoad
+		out += buf;
+		for (unsigned i = 0; i < numMacros; i ++)
+			out += "\t0,\n";
+		out += "};\n";
+		return true;
+	}
+
+	bool WriteFile(const char* path, std::string const& text)
+	{
+		FILE* f = fopen(path, "wb");
+		if (!f)
+		{
+			fprintf(stderr, "cannot create %s\n", path);
+			return false;
+		}
+		fwrite(text.data(), 1, text.size(), f);
+		fclose(f);
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 4 || (strcmp(argv[1], "-h") != 0 && strcmp(argv[1], "-m") != 0))
+	{
+		fprintf(stderr,
+			"Usage: %s -h <out.h> <in.def>\n"
+			"       %s -m <out.h> <in.mme...>\n",
+			argv[0], argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::string out;
+	if (argv[1][1] == 'h')
+	{
+		std::string text;
+		if (!ReadFile(argv[3], text) || !DefGenerator{argv[3], text.c_str()}.generate(out))
+			return EXIT_FAILURE;
+	}
+	else if (!GenerateMacros({ argv + 3, argv + argc }, out))
+		return EXIT_FAILURE;
+
+	return WriteFile(argv[2], out) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
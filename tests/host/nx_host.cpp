@@ -0,0 +1,883 @@
+// Host implementation of the libnx subset declared in switch.h, backed by a small
+// software model of the GPU (see gpu_host.h for the interface exposed to tests).
+#include "switch.h"
+#include "gpu_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+extern "C" u32 __nx_applet_exit_mode;
+u32 __nx_applet_exit_mode;
+
+namespace
+{
+	// Methods understood by the model (see the engine .def files)
+	namespace m
+	{
+		constexpr uint32_t GpfifoSemaphoreOffset  = 0x004;
+		constexpr uint32_t GpfifoSemaphorePayload = 0x006;
+		constexpr uint32_t GpfifoSemaphore        = 0x007;
+		constexpr uint32_t GpfifoFenceValue       = 0x01C;
+		constexpr uint32_t GpfifoFenceAction      = 0x01D;
+		constexpr uint32_t NumChannelMethods      = 0x040;
+
+		constexpr uint32_t LineLengthIn           = 0x060;
+		constexpr uint32_t OffsetOut              = 0x062;
+		constexpr uint32_t LaunchDma              = 0x06C;
+		constexpr uint32_t LoadInlineData         = 0x06D;
+		constexpr uint32_t SendPcasA              = 0x0AD;
+		constexpr uint32_t SyncptAction           = 0x0B2;
+		constexpr uint32_t ReportSemaphoreOffset  = 0x6C0;
+		constexpr uint32_t ReportSemaphorePayload = 0x6C2;
+		constexpr uint32_t ReportSemaphore        = 0x6C3;
+		constexpr uint32_t NumMethods             = 0x2000;
+
+		constexpr uint32_t Subchannel3D           = 0;
+		constexpr uint32_t SubchannelCompute      = 1;
+		constexpr uint32_t SubchannelInline       = 2;
+	}
+
+	constexpr uint32_t s_numSyncpts = 192;
+	constexpr uint64_t s_iovaBase = UINT64_C(1) << 32;
+	constexpr uint64_t s_iovaMask = (UINT64_C(1) << 40) - 1;
+	constexpr uint64_t s_segmentAlign = UINT64_C(1) << 32;
+	constexpr Result s_timeoutResult = MAKERESULT(Module_LibnxNvidia, LibnxNvidiaError_Timeout);
+
+	struct Mapping
+	{
+		uint64_t size;
+		uint8_t* cpuAddr; // null for reserved address space
+	};
+
+	struct Channel
+	{
+		uint32_t index;
+		uint32_t syncpt;
+		std::deque<uint64_t> entries;
+		std::thread worker;
+		bool paused, faulted, closing, busy;
+		bool holdKickoffs, kickoffHeld;
+		uint32_t numKickoffs, numEntries;
+		NvNotification notif;
+		NvError error;
+
+		// Method decoder state, which persists across entries
+		uint32_t mode, method, subchannel, remaining;
+		bool first;
+
+		// Engine state
+		uint64_t semaphoreAddr;
+		uint32_t semaphorePayload;
+		uint32_t fenceValue;
+		uint64_t dmaAddr[8];
+		uint32_t dmaPos[8], dmaSize[8];
+		std::unique_ptr<uint32_t[]> regs;
+
+		bool tracing;
+		std::vector<hostgpu::Method> trace;
+	};
+
+	struct Gpu
+	{
+		std::mutex lock;
+		std::condition_variable cond;
+		std::map<uint64_t, Mapping> mappings; // by iova
+		std::map<uint32_t, NvMap*> maps;      // by handle
+		uint64_t nextIova = s_iovaBase;
+		uint32_t nextHandle = 1;
+		uint32_t syncpts[s_numSyncpts];
+		uint32_t syncptMax[s_numSyncpts];
+		uint32_t nextSyncpt = 1;
+		uint32_t nextChannel = 1;
+		std::map<uint32_t, std::unique_ptr<Channel>> channels;
+		uint32_t numComputeLaunches;
+	};
+
+	Gpu g_gpu;
+
+	const nvioctl_gpu_characteristics s_gpuChars =
+	{
+		.arch = 0x120, .impl = 0xb, .rev = 0xa1, .num_gpc = 1,
+		.L2_cache_size = 0x40000, .on_board_video_memory_size = 0,
+		.num_tpc_per_gpc = 2, .bus_type = 0x20, .big_page_size = 0x20000,
+		.compression_page_size = 0x20000, .pde_coverage_bit_count = 27,
+		.available_big_page_sizes = 0x30000, .gpc_mask = 1,
+		.sm_arch_sm_version = 0x503, .sm_arch_spa_version = 0x503, .sm_arch_warp_count = 128,
+	};
+
+	const nvioctl_zcull_info s_zcullInfo =
+	{
+		.width_align_pixels = 0x20, .height_align_pixels = 0x20,
+		.pixel_squares_by_aliquots = 0x400, .aliquot_total = 0x800,
+		.region_byte_multiplier = 0x20, .region_header_size = 0x20,
+		.subregion_header_size = 0xc0, .subregion_width_align_pixels = 0x20,
+		.subregion_height_align_pixels = 0x40, .subregion_count = 0x10,
+	};
+
+	uint64_t NowNs()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+	}
+
+	// Must be called with the lock held
+	uint8_t* Translate(uint64_t iova, uint64_t size)
+	{
+		auto it = g_gpu.mappings.upper_bound(iova);
+		if (it == g_gpu.mappings.begin())
+			return nullptr;
+		--it;
+		uint64_t offset = iova - it->first;
+		if (!it->second.cpuAddr || offset + size > it->second.size)
+			return nullptr;
+		return it->second.cpuAddr + offset;
+	}
+
+	uint64_t AllocIova(uint64_t size, uint64_t align)
+	{
+		uint64_t iova = (g_gpu.nextIova + align - 1) &~ (align - 1);
+		g_gpu.nextIova = iova + ((size + 0xFFFF) &~ UINT64_C(0xFFFF));
+		return iova;
+	}
+
+	Channel* FindChannel(uint32_t index)
+	{
+		auto it = g_gpu.channels.find(index);
+		return it != g_gpu.channels.end() ? it->second.get() : nullptr;
+	}
+
+	bool SyncptReached(uint32_t id, uint32_t value)
+	{
+		return (int32_t)(g_gpu.syncpts[id] - value) >= 0;
+	}
+
+	void RaiseFault(Channel& ch, uint32_t type, uint64_t addr)
+	{
+		if (ch.faulted)
+			return;
+		ch.faulted = true;
+		ch.entries.clear();
+		ch.notif.timestamp = NowNs();
+		ch.notif.status = 0xFFFF;
+		ch.error.type = type;
+		ch.error.info[1] = uint32_t(addr >> 32);
+		ch.error.info[2] = uint32_t(addr);
+		g_gpu.syncpts[ch.syncpt] = g_gpu.syncptMax[ch.syncpt];
+		g_gpu.cond.notify_all();
+	}
+
+	// Blocks the channel until the condition holds; fails if the channel faulted or is closing.
+	// Memory written by the CPU is not tracked, so the condition is also polled periodically.
+	template <typename Func>
+	bool Wait(Channel& ch, std::unique_lock<std::mutex>& lk, Func&& cond)
+	{
+		while (!cond())
+		{
+			if (ch.faulted || ch.closing)
+				return false;
+			g_gpu.cond.wait_for(lk, std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	bool Write32(Channel& ch, uint64_t iova, uint32_t value)
+	{
+		uint32_t* p = (uint32_t*)Translate(iova, 4);
+		if (!p)
+		{
+			RaiseFault(ch, 1, iova);
+			return false;
+		}
+		__atomic_store_n(p, value, __ATOMIC_RELEASE);
+		g_gpu.cond.notify_all();
+		return true;
+	}
+
+	bool AcquireSemaphore(Channel& ch, std::unique_lock<std::mutex>& lk, uint64_t iova, uint32_t payload, bool geq)
+	{
+		uint32_t* p = (uint32_t*)Translate(iova, 4);
+		if (!p)
+		{
+			RaiseFault(ch, 1, iova);
+			return false;
+		}
+		return Wait(ch, lk, [=]
+		{
+			uint32_t cur = __atomic_load_n(p, __ATOMIC_ACQUIRE);
+			return geq ? (int32_t)(cur - payload) >= 0 : cur == payload;
+		});
+	}
+
+	bool ReportSemaphore(Channel& ch, uint32_t const* regs, uint32_t value)
+	{
+		uint64_t iova = (uint64_t(regs[m::ReportSemaphoreOffset]) << 32) | regs[m::ReportSemaphoreOffset+1];
+		uint32_t payload = regs[m::ReportSemaphorePayload];
+		if ((value & 3) != 0) // only releases are supported
+			return true;
+
+		if (value & (1U << 28)) // OneWord
+			return Write32(ch, iova, payload);
+
+		// FourWords: sequence, padding and a timestamp in GPU ticks (614.4 MHz)
+		uint64_t timestamp = NowNs() * 384 / 625;
+		return Write32(ch, iova+8, uint32_t(timestamp)) && Write32(ch, iova+12, uint32_t(timestamp >> 32)) &&
+			Write32(ch, iova+4, 0) && Write32(ch, iova, payload);
+	}
+
+	bool ExecuteMethod(Channel& ch, std::unique_lock<std::mutex>& lk, uint32_t subchannel, uint32_t method, uint32_t value)
+	{
+		if (ch.tracing)
+			ch.trace.push_back({ subchannel, method, value });
+
+		if (method < m::NumChannelMethods)
+		{
+			switch (method)
+			{
+				case m::GpfifoSemaphoreOffset:
+					ch.semaphoreAddr = (ch.semaphoreAddr & 0xFFFFFFFF) | (uint64_t(value) << 32);
+					break;
+				case m::GpfifoSemaphoreOffset+1:
+					ch.semaphoreAddr = (ch.semaphoreAddr &~ UINT64_C(0xFFFFFFFF)) | value;
+					break;
+				case m::GpfifoSemaphorePayload:
+					ch.semaphorePayload = value;
+					break;
+				case m::GpfifoSemaphore:
+					switch (value & 0x1F)
+					{
+						case 1: return AcquireSemaphore(ch, lk, ch.semaphoreAddr, ch.semaphorePayload, false);
+						case 2: return Write32(ch, ch.semaphoreAddr, ch.semaphorePayload);
+						case 4: return AcquireSemaphore(ch, lk, ch.semaphoreAddr, ch.semaphorePayload, true);
+					}
+					break;
+				case m::GpfifoFenceValue:
+					ch.fenceValue = value;
+					break;
+				case m::GpfifoFenceAction:
+					if (((value >> 4) & 0xF) == 1)
+					{
+						uint32_t id = (value >> 8) & 0xFF, fenceValue = ch.fenceValue;
+						if (id >= s_numSyncpts)
+						{
+							RaiseFault(ch, 2, 0);
+							return false;
+						}
+						return Wait(ch, lk, [=] { return SyncptReached(id, fenceValue); });
+					}
+					break;
+			}
+			return true;
+		}
+
+		uint32_t* regs = &ch.regs[subchannel*m::NumMethods];
+		regs[method] = value;
+
+		if (subchannel == m::Subchannel3D && method == m::SyncptAction)
+		{
+			if (value & (1U << 20))
+			{
+				uint32_t id = value & 0xFFF;
+				if (id >= s_numSyncpts)
+				{
+					RaiseFault(ch, 2, 0);
+					return false;
+				}
+				g_gpu.syncpts[id]++;
+				g_gpu.cond.notify_all();
+			}
+			return true;
+		}
+
+		if ((subchannel == m::Subchannel3D || subchannel == m::SubchannelCompute) && method == m::ReportSemaphore)
+			return ReportSemaphore(ch, regs, value);
+
+		if (subchannel == m::SubchannelCompute || subchannel == m::SubchannelInline)
+		{
+			switch (method)
+			{
+				case m::LaunchDma:
+					ch.dmaAddr[subchannel] = (uint64_t(regs[m::OffsetOut]) << 32) | regs[m::OffsetOut+1];
+					ch.dmaSize[subchannel] = regs[m::LineLengthIn];
+					ch.dmaPos[subchannel] = 0;
+					break;
+				case m::LoadInlineData:
+				{
+					uint32_t pos = ch.dmaPos[subchannel];
+					ch.dmaPos[subchannel] += 4;
+					if (pos >= ch.dmaSize[subchannel])
+						break;
+					uint64_t iova = ch.dmaAddr[subchannel] + pos;
+					uint32_t size = ch.dmaSize[subchannel] - pos;
+					if (size >= 4)
+						return Write32(ch, iova, value);
+					uint8_t* p = Translate(iova, size);
+					if (!p)
+					{
+						RaiseFault(ch, 1, iova);
+						return false;
+					}
+					memcpy(p, &value, size);
+					break;
+				}
+				case m::SendPcasA:
+					if (subchannel == m::SubchannelCompute)
+						g_gpu.numComputeLaunches++;
+					break;
+			}
+		}
+
+		return true;
+	}
+
+	bool ExecuteEntry(Channel& ch, std::unique_lock<std::mutex>& lk, uint64_t desc)
+	{
+		uint64_t iova = desc & s_iovaMask;
+		uint32_t numCmds = (desc >> 42) & 0x1FFFFF;
+		uint32_t const* cmds = (uint32_t const*)Translate(iova, numCmds*4);
+		if (!cmds)
+		{
+			RaiseFault(ch, 1, iova);
+			return false;
+		}
+
+		for (uint32_t pos = 0; pos < numCmds; pos ++)
+		{
+			uint32_t word = cmds[pos];
+			if (ch.remaining)
+			{
+				ch.remaining--;
+				uint32_t method = ch.method;
+				if (ch.mode == 1 || (ch.mode == 5 && ch.first))
+					ch.method++;
+				ch.first = false;
+				if (!ExecuteMethod(ch, lk, ch.subchannel, method, word))
+					return false;
+				continue;
+			}
+
+			uint32_t mode = word >> 29;
+			uint32_t arg = (word >> 16) & 0x1FFF;
+			ch.method = word & 0x1FFF;
+			ch.subchannel = (word >> 13) & 7;
+			switch (mode)
+			{
+				case 1: case 3: case 5:
+					ch.mode = mode;
+					ch.remaining = arg;
+					ch.first = true;
+					break;
+				case 4:
+					if (!ExecuteMethod(ch, lk, ch.subchannel, ch.method, arg))
+						return false;
+					break;
+				case 0:
+					// Old style increasing command with a zero count: the driver uses it as a nop
+					if (word == 0)
+						break;
+					[[fallthrough]];
+				default:
+					RaiseFault(ch, 3, iova + pos*4);
+					return false;
+			}
+		}
+		return true;
+	}
+
+	void ChannelThread(Channel* ch)
+	{
+		std::unique_lock<std::mutex> lk{g_gpu.lock};
+		for (;;)
+		{
+			g_gpu.cond.wait(lk, [=] { return ch->closing || (!ch->paused && !ch->faulted && !ch->entries.empty()); });
+			if (ch->closing)
+				break;
+
+			uint64_t desc = ch->entries.front();
+			ch->busy = true;
+			if (ExecuteEntry(*ch, lk, desc) && !ch->entries.empty())
+				ch->entries.pop_front();
+			ch->busy = false;
+			g_gpu.cond.notify_all();
+		}
+	}
+
+	Result WaitSyncpts(NvFence const* fences, u32 numFences, s32 timeout_us)
+	{
+		auto reached = [=]
+		{
+			for (u32 i = 0; i < numFences; i ++)
+				if ((s32)fences[i].id >= 0 && fences[i].id < s_numSyncpts && !SyncptReached(fences[i].id, fences[i].value))
+					return false;
+			return true;
+		};
+
+		std::unique_lock<std::mutex> lk{g_gpu.lock};
+		if (timeout_us < 0)
+			g_gpu.cond.wait(lk, reached);
+		else if (!g_gpu.cond.wait_for(lk, std::chrono::microseconds(timeout_us), reached))
+			return s_timeoutResult;
+		return 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Kernel, threads and synchronization
+//-----------------------------------------------------------------------------
+
+void svcSleepThread(s64 nano)
+{
+	if (nano <= 0)
+		sched_yield();
+	else
+		std::this_thread::sleep_for(std::chrono::nanoseconds(nano));
+}
+
+Result svcGetThreadPriority(s32* priority, Handle handle)
+{
+	*priority = 0x2C;
+	return 0;
+}
+
+namespace
+{
+	void* ThreadEntry(void* arg)
+	{
+		Thread* t = (Thread*)arg;
+		t->entry(t->arg);
+		return nullptr;
+	}
+}
+
+Result threadCreate(Thread* t, ThreadFunc entry, void* arg, void* stack_mem, size_t stack_sz, int prio, int cpuid)
+{
+	t->handle = 1;
+	t->entry = entry;
+	t->arg = arg;
+	return 0;
+}
+
+Result threadStart(Thread* t)
+{
+	return pthread_create(&t->pthread, nullptr, ThreadEntry, t) == 0 ? 0 : MAKERESULT(Module_Libnx, 1);
+}
+
+Result threadWaitForExit(Thread* t)
+{
+	return pthread_join(t->pthread, nullptr) == 0 ? 0 : MAKERESULT(Module_Libnx, 1);
+}
+
+Result threadClose(Thread* t)
+{
+	t->handle = INVALID_HANDLE;
+	return 0;
+}
+
+void mutexLock(Mutex* m)
+{
+	while (__atomic_exchange_n(m, 1, __ATOMIC_ACQUIRE))
+		sched_yield();
+}
+
+void mutexUnlock(Mutex* m)
+{
+	__atomic_store_n(m, 0, __ATOMIC_RELEASE);
+}
+
+void semaphoreInit(Semaphore* s, u64 initial_count)
+{
+	sem_init(&s->sem, 0, initial_count);
+}
+
+void semaphoreSignal(Semaphore* s)
+{
+	sem_post(&s->sem);
+}
+
+void semaphoreWait(Semaphore* s)
+{
+	while (sem_wait(&s->sem) != 0);
+}
+
+// The system tick runs at 19.2 MHz
+u64 armGetSystemTick(void)
+{
+	return NowNs() * 12 / 625;
+}
+
+u64 armTicksToNs(u64 tick)
+{
+	return tick * 625 / 12;
+}
+
+u64 armNsToTicks(u64 ns)
+{
+	return ns * 12 / 625;
+}
+
+void armDCacheFlush(void* addr, size_t size)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void fatalThrow(Result err)
+{
+	fprintf(stderr, "fatalThrow(0x%x)\n", err);
+	abort();
+}
+
+void errorApplicationCreate(ErrorApplicationConfig* c, const char* dialog_message, const char* fullscreen_message)
+{
+	memset(c, 0, sizeof(*c));
+}
+
+void errorApplicationSetNumber(ErrorApplicationConfig* c, u32 errorNumber)
+{
+	c->number = errorNumber;
+}
+
+Result errorApplicationShow(ErrorApplicationConfig* c)
+{
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// nvidia services
+//-----------------------------------------------------------------------------
+
+Result nvInitialize(void) { return 0; }
+void nvExit(void) { }
+Result nvGpuInit(void) { return 0; }
+void nvGpuExit(void) { }
+Result nvFenceInit(void) { return 0; }
+void nvFenceExit(void) { }
+Result nvMapInit(void) { return 0; }
+void nvMapExit(void) { }
+
+const nvioctl_gpu_characteristics* nvGpuGetCharacteristics(void)
+{
+	return &s_gpuChars;
+}
+
+u32 nvGpuGetZcullCtxSize(void)
+{
+	return 0x4600;
+}
+
+const nvioctl_zcull_info* nvGpuGetZcullInfo(void)
+{
+	return &s_zcullInfo;
+}
+
+Result nvFenceWait(NvFence* f, s32 timeout_us)
+{
+	return WaitSyncpts(f, 1, timeout_us);
+}
+
+Result nvMultiFenceWait(NvMultiFence* mf, s32 timeout_us)
+{
+	return WaitSyncpts(mf->fences, mf->num_fences, timeout_us);
+}
+
+Result nvMapCreate(NvMap* m, void* cpu_addr, u32 size, u32 align, NvKind kind, bool is_cpu_cacheable)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	m->handle = g_gpu.nextHandle++;
+	m->id = m->handle;
+	m->size = size;
+	m->cpu_addr = cpu_addr;
+	m->kind = kind;
+	m->is_cpu_cacheable = is_cpu_cacheable;
+	m->has_init = true;
+	g_gpu.maps[m->handle] = m;
+	return 0;
+}
+
+void nvMapClose(NvMap* m)
+{
+	if (!m->has_init)
+		return;
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	g_gpu.maps.erase(m->handle);
+	m->has_init = false;
+}
+
+Result nvAddressSpaceCreate(NvAddressSpace* a, u32 page_size)
+{
+	a->page_size = page_size;
+	a->has_init = true;
+	return 0;
+}
+
+void nvAddressSpaceClose(NvAddressSpace* a)
+{
+	a->has_init = false;
+}
+
+Result nvAddressSpaceAlloc(NvAddressSpace* a, bool sparse, u64 size, u64* iova_out)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	*iova_out = AllocIova(size, size >= s_segmentAlign ? s_segmentAlign : a->page_size);
+	return 0;
+}
+
+Result nvAddressSpaceAllocFixed(NvAddressSpace* a, bool sparse, u64 size, u64 iova)
+{
+	return 0;
+}
+
+Result nvAddressSpaceFree(NvAddressSpace* a, u64 iova, u64 size)
+{
+	return 0;
+}
+
+Result nvAddressSpaceMapFixed(NvAddressSpace* a, u32 nvmap_handle, bool is_gpu_cacheable, NvKind kind, u64 iova)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	auto it = g_gpu.maps.find(nvmap_handle);
+	if (it == g_gpu.maps.end())
+		return MAKERESULT(Module_LibnxNvidia, LibnxNvidiaError_BadParameter);
+	g_gpu.mappings[iova] = Mapping{ it->second->size, (uint8_t*)it->second->cpu_addr };
+	return 0;
+}
+
+Result nvAddressSpaceMap(NvAddressSpace* a, u32 nvmap_handle, bool is_gpu_cacheable, NvKind kind, u64* iova_out)
+{
+	uint64_t iova;
+	{
+		std::lock_guard<std::mutex> lk{g_gpu.lock};
+		auto it = g_gpu.maps.find(nvmap_handle);
+		if (it == g_gpu.maps.end())
+			return MAKERESULT(Module_LibnxNvidia, LibnxNvidiaError_BadParameter);
+		iova = AllocIova(it->second->size, a->page_size);
+	}
+	*iova_out = iova;
+	return nvAddressSpaceMapFixed(a, nvmap_handle, is_gpu_cacheable, kind, iova);
+}
+
+Result nvAddressSpaceModify(NvAddressSpace* a, u64 iova, u64 offset, u64 size, NvKind kind)
+{
+	return 0;
+}
+
+Result nvAddressSpaceUnmap(NvAddressSpace* a, u64 iova)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	g_gpu.mappings.erase(iova);
+	return 0;
+}
+
+Result nvGpuChannelCreate(NvGpuChannel* c, NvAddressSpace* as, NvChannelPriority prio)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	if (g_gpu.nextSyncpt >= s_numSyncpts)
+		return MAKERESULT(Module_LibnxNvidia, LibnxNvidiaError_InsufficientMemory);
+
+	auto ch = std::make_unique<Channel>();
+	ch->index = g_gpu.nextChannel++;
+	ch->syncpt = g_gpu.nextSyncpt++;
+	ch->regs = std::make_unique<uint32_t[]>(8*m::NumMethods);
+	Channel* p = ch.get();
+	g_gpu.channels[p->index] = std::move(ch);
+	p->worker = std::thread{ChannelThread, p};
+
+	c->index = p->index;
+	c->fence.id = p->syncpt;
+	c->fence.value = g_gpu.syncpts[p->syncpt];
+	c->fence_incr = 0;
+	c->num_entries = 0;
+	return 0;
+}
+
+void nvGpuChannelClose(NvGpuChannel* c)
+{
+	if (!c->index)
+		return;
+
+	std::unique_ptr<Channel> ch;
+	{
+		std::lock_guard<std::mutex> lk{g_gpu.lock};
+		auto it = g_gpu.channels.find(c->index);
+		ch = std::move(it->second);
+		g_gpu.channels.erase(it);
+		ch->closing = true;
+		g_gpu.cond.notify_all();
+	}
+	ch->worker.join();
+	c->index = 0;
+}
+
+Result nvGpuChannelZcullBind(NvGpuChannel* c, u64 iova)
+{
+	return 0;
+}
+
+Result nvGpuChannelAppendEntry(NvGpuChannel* c, iova_t start, size_t num_cmds, u32 flags, u32 flush_threshold)
+{
+	// Same behavior as libnx: kick off first if fewer than flush_threshold slots are left
+	if (flush_threshold >= GPFIFO_QUEUE_SIZE)
+		return MAKERESULT(Module_Libnx, LibnxError_BadInput);
+	if (c->num_entries >= GPFIFO_QUEUE_SIZE - flush_threshold)
+	{
+		Result res = nvGpuChannelKickoff(c);
+		if (R_FAILED(res))
+			return res;
+	}
+
+	nvioctl_gpfifo_entry* entry = &c->entries[c->num_entries++];
+	entry->desc = start;
+	entry->desc32[1] |= flags | (num_cmds << 10);
+	return 0;
+}
+
+Result nvGpuChannelKickoff(NvGpuChannel* c)
+{
+	std::unique_lock<std::mutex> lk{g_gpu.lock};
+	Channel* ch = FindChannel(c->index);
+	if (ch->holdKickoffs)
+	{
+		ch->kickoffHeld = true;
+		g_gpu.cond.notify_all();
+		g_gpu.cond.wait(lk, [=] { return !ch->holdKickoffs; });
+		ch->kickoffHeld = false;
+	}
+
+	if (ch->faulted)
+		return MAKERESULT(Module_LibnxNvidia, LibnxNvidiaError_InvalidState);
+
+	ch->numKickoffs++;
+	ch->numEntries += c->num_entries;
+	for (u32 i = 0; i < c->num_entries; i ++)
+		ch->entries.push_back(c->entries[i].desc);
+	g_gpu.syncptMax[ch->syncpt] += c->fence_incr;
+	c->fence.value += c->fence_incr;
+	c->fence_incr = 0;
+	c->num_entries = 0;
+	g_gpu.cond.notify_all();
+	return 0;
+}
+
+Result nvGpuChannelGetErrorNotification(NvGpuChannel* c, NvNotification* notif)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	*notif = FindChannel(c->index)->notif;
+	return 0;
+}
+
+Result nvGpuChannelGetErrorInfo(NvGpuChannel* c, NvError* error)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	*error = FindChannel(c->index)->error;
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Test control interface
+//-----------------------------------------------------------------------------
+
+uint32_t hostgpu::lastChannel()
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	return g_gpu.nextChannel - 1;
+}
+
+void hostgpu::pauseChannel(uint32_t channel, bool pause)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	FindChannel(channel)->paused = pause;
+	g_gpu.cond.notify_all();
+}
+
+void hostgpu::holdKickoffs(uint32_t channel, bool hold)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	FindChannel(channel)->holdKickoffs = hold;
+	g_gpu.cond.notify_all();
+}
+
+void hostgpu::waitKickoffHeld(uint32_t channel)
+{
+	std::unique_lock<std::mutex> lk{g_gpu.lock};
+	Channel* ch = FindChannel(channel);
+	g_gpu.cond.wait(lk, [=] { return ch->kickoffHeld; });
+}
+
+void hostgpu::injectFault(uint32_t channel)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	RaiseFault(*FindChannel(channel), 4, 0);
+}
+
+void hostgpu::waitChannelIdle(uint32_t channel)
+{
+	std::unique_lock<std::mutex> lk{g_gpu.lock};
+	Channel* ch = FindChannel(channel);
+	g_gpu.cond.wait(lk, [=] { return ch->faulted || (ch->entries.empty() && !ch->busy); });
+}
+
+void hostgpu::enableTrace(uint32_t channel, bool enable)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	FindChannel(channel)->tracing = enable;
+}
+
+std::vector<hostgpu::Method> hostgpu::takeTrace(uint32_t channel)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	return std::move(FindChannel(channel)->trace);
+}
+
+uint32_t hostgpu::getNumKickoffs(uint32_t channel)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	return FindChannel(channel)->numKickoffs;
+}
+
+uint32_t hostgpu::getNumEntries(uint32_t channel)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	return FindChannel(channel)->numEntries;
+}
+
+uint32_t hostgpu::getNumComputeLaunches()
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	return g_gpu.numComputeLaunches;
+}
+
+uint32_t hostgpu::allocSyncpt()
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	return g_gpu.nextSyncpt++;
+}
+
+uint32_t hostgpu::readSyncpt(uint32_t id)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	return g_gpu.syncpts[id];
+}
+
+void hostgpu::incrSyncpt(uint32_t id)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	g_gpu.syncpts[id]++;
+	g_gpu.syncptMax[id]++;
+	g_gpu.cond.notify_all();
+}
+
+void* hostgpu::translate(uint64_t iova)
+{
+	std::lock_guard<std::mutex> lk{g_gpu.lock};
+	return Translate(iova, 1);
+}
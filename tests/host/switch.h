@@ -0,0 +1,346 @@
+// Host stand-in for the subset of libnx used by deko3d.
+//
+// The types mirror the libnx ones closely enough for the library sources to build unchanged,
+// and the functions are implemented by nx_host.cpp on top of a small software model of the
+// GPU (see gpu_host.h), which executes the command streams kicked off through the channels.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef int64_t  s64;
+
+typedef u64 iova_t;
+typedef u32 Result;
+typedef u32 Handle;
+
+#define BIT(n) (1U<<(n))
+#define NX_INLINE __attribute__((always_inline)) static inline
+#ifdef __cplusplus
+#define NX_CONSTEXPR static constexpr
+#else
+#define NX_CONSTEXPR NX_INLINE
+#endif
+
+#define INVALID_HANDLE    ((Handle)0)
+#define CUR_THREAD_HANDLE ((Handle)0xFFFF8000)
+
+#define R_SUCCEEDED(res) ((res)==0)
+#define R_FAILED(res)    ((res)!=0)
+#define MAKERESULT(module,description) \
+	((((module)&0x1FF)) | ((description)&0x1FFF)<<9)
+
+enum
+{
+	Module_Libnx = 345,
+	Module_LibnxNvidia = 348,
+};
+
+enum
+{
+	LibnxError_BadInput = 34,
+};
+
+enum
+{
+	LibnxNvidiaError_Unknown = 1,
+	LibnxNvidiaError_NotImplemented,
+	LibnxNvidiaError_NotSupported,
+	LibnxNvidiaError_NotInitialized,
+	LibnxNvidiaError_BadParameter,
+	LibnxNvidiaError_Timeout,
+	LibnxNvidiaError_InsufficientMemory,
+	LibnxNvidiaError_ReadOnlyAttribute,
+	LibnxNvidiaError_InvalidState,
+	LibnxNvidiaError_InvalidAddress,
+	LibnxNvidiaError_InvalidSize,
+	LibnxNvidiaError_BadValue,
+	LibnxNvidiaError_AlreadyAllocated,
+	LibnxNvidiaError_Busy,
+	LibnxNvidiaError_ResourceError,
+	LibnxNvidiaError_CountMismatch,
+	LibnxNvidiaError_SharedMemoryTooSmall,
+	LibnxNvidiaError_FileOperationFailed,
+	LibnxNvidiaError_IoctlFailed,
+};
+
+//-----------------------------------------------------------------------------
+// Kernel, threads and synchronization
+//-----------------------------------------------------------------------------
+
+typedef void (*ThreadFunc)(void*);
+
+typedef struct
+{
+	Handle handle;
+	pthread_t pthread;
+	ThreadFunc entry;
+	void* arg;
+} Thread;
+
+typedef u32 Mutex;
+
+typedef struct
+{
+	sem_t sem;
+} Semaphore;
+
+void svcSleepThread(s64 nano);
+Result svcGetThreadPriority(s32* priority, Handle handle);
+
+Result threadCreate(Thread* t, ThreadFunc entry, void* arg, void* stack_mem, size_t stack_sz, int prio, int cpuid);
+Result threadStart(Thread* t);
+Result threadWaitForExit(Thread* t);
+Result threadClose(Thread* t);
+
+void mutexLock(Mutex* m);
+void mutexUnlock(Mutex* m);
+
+void semaphoreInit(Semaphore* s, u64 initial_count);
+void semaphoreSignal(Semaphore* s);
+void semaphoreWait(Semaphore* s);
+
+u64 armGetSystemTick(void);
+u64 armTicksToNs(u64 tick);
+u64 armNsToTicks(u64 ns);
+void armDCacheFlush(void* addr, size_t size);
+
+void fatalThrow(Result err) __attribute__((noreturn));
+
+typedef struct
+{
+	char context[256];
+	char message[1024];
+	u32 number;
+} ErrorApplicationConfig;
+
+void errorApplicationCreate(ErrorApplicationConfig* c, const char* dialog_message, const char* fullscreen_message);
+void errorApplicationSetNumber(ErrorApplicationConfig* c, u32 errorNumber);
+Result errorApplicationShow(ErrorApplicationConfig* c);
+
+//-----------------------------------------------------------------------------
+// nvidia services
+//-----------------------------------------------------------------------------
+
+typedef enum
+{
+	NvKind_Pitch = 0x0,
+	NvKind_Z16 = 0x1,
+	NvKind_Z16_2C = 0x2,
+	NvKind_Z16_MS2_2C = 0x3,
+	NvKind_Z16_MS4_2C = 0x4,
+	NvKind_Z16_MS8_2C = 0x5,
+	NvKind_Z16_2Z = 0x7,
+	NvKind_Z16_MS2_2Z = 0x8,
+	NvKind_Z16_MS4_2Z = 0x9,
+	NvKind_Z16_MS8_2Z = 0xa,
+	NvKind_S8 = 0x2a,
+	NvKind_S8_2S = 0x2b,
+	NvKind_Z24S8 = 0x6c,
+	NvKind_Z24S8_2CZ = 0x6d,
+	NvKind_Z24S8_MS2_2CZ = 0x6e,
+	NvKind_Z24S8_MS4_2CZ = 0x6f,
+	NvKind_Z24S8_MS8_2CZ = 0x70,
+	NvKind_S8Z24 = 0x14,
+	NvKind_S8Z24_2CZ = 0x15,
+	NvKind_S8Z24_MS2_2CZ = 0x16,
+	NvKind_S8Z24_MS4_2CZ = 0x17,
+	NvKind_S8Z24_MS8_2CZ = 0x18,
+	NvKind_ZF32 = 0x7b,
+	NvKind_ZF32_2CZ = 0x7e,
+	NvKind_ZF32_MS2_2CZ = 0x7f,
+	NvKind_ZF32_MS4_2CZ = 0x80,
+	NvKind_ZF32_MS8_2CZ = 0x81,
+	NvKind_ZF32_X24S8 = 0xce,
+	NvKind_ZF32_X24S8_2CSZV = 0xcf,
+	NvKind_ZF32_X24S8_MS2_2CSZV = 0xd0,
+	NvKind_ZF32_X24S8_MS4_2CSZV = 0xd1,
+	NvKind_ZF32_X24S8_MS8_2CSZV = 0xd2,
+	NvKind_C32_2CRA = 0xdb,
+	NvKind_C32_MS2_2CRA = 0xdd,
+	NvKind_C32_MS4_2CBR = 0xe0,
+	NvKind_C32_MS8_MS16_2CRA = 0xe3,
+	NvKind_C64_2CRA = 0xe8,
+	NvKind_C64_MS2_2CRA = 0xea,
+	NvKind_C64_MS4_2CBR = 0xed,
+	NvKind_C64_MS8_MS16_2CRA = 0xf0,
+	NvKind_C128_2CR = 0xf4,
+	NvKind_C128_MS2_2CR = 0xf5,
+	NvKind_C128_MS4_2CR = 0xf6,
+	NvKind_C128_MS8_MS16_2CR = 0xf7,
+	NvKind_Generic_16BX2 = 0xfe,
+	NvKind_Invalid = 0xff,
+} NvKind;
+
+typedef enum
+{
+	NvChannelPriority_Low    = 50,
+	NvChannelPriority_Medium = 100,
+	NvChannelPriority_High   = 150,
+} NvChannelPriority;
+
+typedef struct
+{
+	u32 id;
+	u32 value;
+} NvFence;
+
+typedef struct
+{
+	u32 num_fences;
+	NvFence fences[4];
+} NvMultiFence;
+
+typedef struct
+{
+	u64 timestamp;
+	u32 info32;
+	u16 info16;
+	u16 status;
+} NvNotification;
+
+typedef struct
+{
+	u32 type;
+	u32 info[31];
+} NvError;
+
+typedef struct
+{
+	u32 arch;
+	u32 impl;
+	u32 rev;
+	u32 num_gpc;
+	u64 L2_cache_size;
+	u64 on_board_video_memory_size;
+	u32 num_tpc_per_gpc;
+	u32 bus_type;
+	u32 big_page_size;
+	u32 compression_page_size;
+	u32 pde_coverage_bit_count;
+	u32 available_big_page_sizes;
+	u32 gpc_mask;
+	u32 sm_arch_sm_version;
+	u32 sm_arch_spa_version;
+	u32 sm_arch_warp_count;
+} nvioctl_gpu_characteristics;
+
+typedef struct
+{
+	u32 width_align_pixels;
+	u32 height_align_pixels;
+	u32 pixel_squares_by_aliquots;
+	u32 aliquot_total;
+	u32 region_byte_multiplier;
+	u32 region_header_size;
+	u32 subregion_header_size;
+	u32 subregion_width_align_pixels;
+	u32 subregion_height_align_pixels;
+	u32 subregion_count;
+} nvioctl_zcull_info;
+
+typedef struct
+{
+	union
+	{
+		u64 desc;
+		u32 desc32[2];
+	};
+} nvioctl_gpfifo_entry;
+
+#define GPFIFO_QUEUE_SIZE 0x800
+#define GPFIFO_ENTRY_NOT_MAIN BIT(9)
+#define GPFIFO_ENTRY_NO_PREFETCH BIT(31)
+
+typedef struct
+{
+	u32 page_size;
+	bool has_init;
+} NvAddressSpace;
+
+typedef struct
+{
+	u32 handle;
+	u32 id;
+	u32 size;
+	void* cpu_addr;
+	NvKind kind;
+	bool has_init;
+	bool is_cpu_cacheable;
+} NvMap;
+
+typedef struct
+{
+	u32 index; // Index of the channel in the host GPU model, zero when not created
+	NvFence fence;
+	u32 fence_incr;
+	nvioctl_gpfifo_entry entries[GPFIFO_QUEUE_SIZE];
+	u32 num_entries;
+} NvGpuChannel;
+
+Result nvInitialize(void);
+void nvExit(void);
+
+Result nvGpuInit(void);
+void nvGpuExit(void);
+const nvioctl_gpu_characteristics* nvGpuGetCharacteristics(void);
+u32 nvGpuGetZcullCtxSize(void);
+const nvioctl_zcull_info* nvGpuGetZcullInfo(void);
+
+Result nvFenceInit(void);
+void nvFenceExit(void);
+Result nvFenceWait(NvFence* f, s32 timeout_us);
+Result nvMultiFenceWait(NvMultiFence* mf, s32 timeout_us);
+
+Result nvMapInit(void);
+void nvMapExit(void);
+Result nvMapCreate(NvMap* m, void* cpu_addr, u32 size, u32 align, NvKind kind, bool is_cpu_cacheable);
+void nvMapClose(NvMap* m);
+
+NX_CONSTEXPR u32 nvMapGetHandle(NvMap* m) { return m->handle; }
+NX_CONSTEXPR u32 nvMapGetId(NvMap* m) { return m->id; }
+NX_CONSTEXPR u32 nvMapGetSize(NvMap* m) { return m->size; }
+NX_CONSTEXPR void* nvMapGetCpuAddr(NvMap* m) { return m->cpu_addr; }
+
+Result nvAddressSpaceCreate(NvAddressSpace* a, u32 page_size);
+void nvAddressSpaceClose(NvAddressSpace* a);
+Result nvAddressSpaceAlloc(NvAddressSpace* a, bool sparse, u64 size, u64* iova_out);
+Result nvAddressSpaceAllocFixed(NvAddressSpace* a, bool sparse, u64 size, u64 iova);
+Result nvAddressSpaceFree(NvAddressSpace* a, u64 iova, u64 size);
+Result nvAddressSpaceMap(NvAddressSpace* a, u32 nvmap_handle, bool is_gpu_cacheable, NvKind kind, u64* iova_out);
+Result nvAddressSpaceMapFixed(NvAddressSpace* a, u32 nvmap_handle, bool is_gpu_cacheable, NvKind kind, u64 iova);
+Result nvAddressSpaceModify(NvAddressSpace* a, u64 iova, u64 offset, u64 size, NvKind kind);
+Result nvAddressSpaceUnmap(NvAddressSpace* a, u64 iova);
+
+Result nvGpuChannelCreate(NvGpuChannel* c, NvAddressSpace* as, NvChannelPriority prio);
+void nvGpuChannelClose(NvGpuChannel* c);
+Result nvGpuChannelZcullBind(NvGpuChannel* c, u64 iova);
+Result nvGpuChannelAppendEntry(NvGpuChannel* c, iova_t start, size_t num_cmds, u32 flags, u32 flush_threshold);
+Result nvGpuChannelKickoff(NvGpuChannel* c);
+Result nvGpuChannelGetErrorNotification(NvGpuChannel* c, NvNotification* notif);
+Result nvGpuChannelGetErrorInfo(NvGpuChannel* c, NvError* error);
+
+NX_CONSTEXPR void nvGpuChannelIncrFence(NvGpuChannel* c) { c->fence_incr++; }
+NX_CONSTEXPR void nvGpuChannelGetFence(NvGpuChannel* c, NvFence* fence_out)
+{
+	fence_out->id = c->fence.id;
+	fence_out->value = c->fence.value + c->fence_incr;
+}
+NX_CONSTEXPR u32 nvGpuChannelGetSyncpointId(NvGpuChannel* c) { return c->fence.id; }
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,81 @@
+// Checks the mip level offsets cached in image layouts against the offsets obtained by
+// walking the size of every preceding level, for every format and mip level count
+// (including levels past the cached ones).
+#include "common.h"
+#include "dk_image.h"
+
+using namespace dk::detail;
+
+namespace
+{
+	constexpr unsigned s_maxMipLevels = 15;
+
+	struct Shape
+	{
+		DkImageType type;
+		uint32_t flags;
+		uint32_t dimensions[3];
+		DkTileSize tileSize;
+	};
+
+	const Shape s_shapes[] =
+	{
+		{ DkImageType_2D,      0, { 16384, 16384, 1 } },
+		{ DkImageType_2D,      0, { 16383, 9999,  1 } },
+		{ DkImageType_3D,      0, { 300,   200,   100 } },
+		{ DkImageType_2DArray, 0, { 4000,  3000,  6 } },
+		{ DkImageType_1D,      0, { 16384, 1,     1 } },
+		{ DkImageType_Cubemap, 0, { 2048,  2048,  1 } },
+		{ DkImageType_2D,      DkImageFlags_CustomTileSize, { 12345, 678, 1 }, DkTileSize_OneGob },
+	};
+
+	unsigned g_numLayouts;
+
+	void CheckLayout(DkDevice device, Shape const& shape, DkImageFormat format, unsigned mipLevels)
+	{
+		DkImageLayoutMaker maker;
+		dkImageLayoutMakerDefaults(&maker, device);
+		maker.type = shape.type;
+		maker.flags = shape.flags;
+		maker.format = format;
+		maker.dimensions[0] = shape.dimensions[0];
+		maker.dimensions[1] = shape.dimensions[1];
+		maker.dimensions[2] = shape.dimensions[2];
+		maker.mipLevels = mipLevels;
+		maker.tileSize = shape.tileSize;
+
+		DkImageLayout layout;
+		dkImageLayoutInitialize(&layout, &maker);
+		g_numLayouts ++;
+
+		uint64_t walked = 0;
+		for (unsigned level = 0; level <= mipLevels; level ++)
+		{
+			if (layout.calcLevelOffset(level) != walked)
+			{
+				fprintf(stderr, "type %d format %d levels %u: level %u at 0x%llx, expected 0x%llx\n",
+					shape.type, format, mipLevels, level, (unsigned long long)layout.calcLevelOffset(level), (unsigned long long)walked);
+				CHECK(layout.calcLevelOffset(level) == walked);
+				return;
+			}
+			if (level < mipLevels)
+				walked += layout.calcLevelSize(level);
+		}
+		CHECK(layout.m_layerSize == walked);
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+
+	static_assert(s_maxMipLevels > ImageLayout::s_numCachedLevels + 1, "levels past the cached ones must be tested");
+	for (auto& shape : s_shapes)
+		for (int format = DkImageFormat_None+1; format < DkImageFormat_Count; format ++)
+			for (unsigned mipLevels = 1; mipLevels <= s_maxMipLevels; mipLevels ++)
+				CheckLayout(device, shape, DkImageFormat(format), mipLevels);
+	printf("  %u layouts checked\n", g_numLayouts);
+
+	dkDeviceDestroy(device);
+	return test::Finish("image_levels");
+}
@@ -0,0 +1,704 @@
+// Host model of the 3D engine's macro unit (MME). The macro sources in source/maxwell are
+// interpreted directly instead of being assembled, using the conventions of dekomme:
+// - '*' marks the last instruction before exiting; the exit takes effect after the
+//   following instruction (its delay slot),
+// - branches execute their delay slot unless annulled (bza/bnza),
+// - a taken branch cancels a pending exit.
+// Method and bitfield names used by the macros are resolved through a symbol table
+// supplied by the test, only when the instruction naming them is executed.
+//
+// Method writes performed by the macros are applied to a 3D register file, which also
+// backs ldi/ldr, and constbuf updates (LoadConstbufData) are applied to a sparse model
+// of GPU memory, so that tests can check what a macro call ends up writing where.
+#pragma once
+#include "cmd_sim.h"
+#include "engine_3d.h"
+#include "mme_macros.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+
+namespace test
+{
+	class MmeSim
+	{
+	public:
+		static constexpr uint32_t s_macroBase = 0xE00;
+		static constexpr uint32_t s_constbufSelectorSize = 0x8E0;
+		static constexpr uint32_t s_constbufSelectorAddr = 0x8E1;
+		static constexpr uint32_t s_loadConstbufOffset = 0x8E3;
+		static constexpr uint32_t s_loadConstbufData = 0x8E4;
+		static constexpr uint32_t s_numLoadConstbufData = 16;
+		static constexpr uint32_t s_maxSteps = 1000000;
+
+		using Write = RegSim::Write;
+
+	private:
+		enum class Dest
+		{
+			None,
+			Reg,
+			Addr,
+			Mem,
+			RegMem,
+			AddrMemHigh, // to addr'mem: sets the method address and sends bits 12..17 of it
+		};
+
+		struct Instr
+		{
+			std::string macro; // for error messages and local labels
+			std::string op;    // ALU operation or branch mnemonic, empty for plain values
+			std::string args[3];
+			unsigned numArgs;
+			Dest dest;
+			unsigned destReg;
+			bool fetch;        // "; fetch rN" or "; fetch mem"
+			bool fetchToMem;
+			unsigned fetchReg;
+			bool exit;
+		};
+
+		std::map<std::string, uint32_t> m_symbols;
+		std::vector<Instr> m_code;
+		std::map<std::string, uint32_t> m_labels; // macro entry points, global labels and "macro.label"
+		std::map<uint32_t, std::string> m_macroIds;
+
+		std::vector<uint32_t> m_regs3D;
+		std::map<uint64_t, uint32_t> m_memory;
+		std::vector<Write> m_writes;
+
+		// Current macro invocation
+		uint32_t m_r[8];
+		uint32_t m_methodAddr;
+		std::vector<uint32_t> const* m_params;
+		size_t m_paramPos;
+		bool m_failed;
+
+		static std::string trim(std::string const& s)
+		{
+			size_t b = 0, e = s.size();
+			while (b < e && isspace((unsigned char)s[b])) b++;
+			while (e > b && isspace((unsigned char)s[e-1])) e--;
+			return s.substr(b, e-b);
+		}
+
+		static std::vector<std::string> split(std::string const& s)
+		{
+			std::vector<std::string> out;
+			size_t pos = 0;
+			while (pos < s.size())
+			{
+				while (pos < s.size() && isspace((unsigned char)s[pos])) pos++;
+				if (pos == s.size())
+					break;
+				size_t start = pos;
+				while (pos < s.size() && !isspace((unsigned char)s[pos])) pos++;
+				out.push_back(s.substr(start, pos-start));
+			}
+			return out;
+		}
+
+		void fail(const char* what, std::string const& detail)
+		{
+			fprintf(stderr, "mme: %s: %s\n", what, detail.c_str());
+			m_failed = true;
+		}
+
+		static bool parseReg(std::string const& s, unsigned& reg)
+		{
+			if (s == "rz")
+			{
+				reg = 0;
+				return true;
+			}
+			if (s.size() == 2 && s[0] == 'r' && s[1] >= '0' && s[1] <= '7')
+			{
+				reg = s[1] - '0';
+				return true;
+			}
+			return false;
+		}
+
+		// Immediate expressions: numbers, symbols (optionally followed by [index] and 'increment),
+		// parentheses and the |, <<, + and - operators
+		class ExprParser
+		{
+			MmeSim& m_sim;
+			std::string const& m_text;
+			size_t m_pos;
+
+			void skip() { while (m_pos < m_text.size() && isspace((unsigned char)m_text[m_pos])) m_pos++; }
+			bool accept(const char* tok)
+			{
+				skip();
+				size_t len = strlen(tok);
+				if (m_text.compare(m_pos, len, tok) != 0)
+					return false;
+				m_pos += len;
+				return true;
+			}
+
+			uint32_t number()
+			{
+				skip();
+				const char* start = m_text.c_str() + m_pos;
+				char* end;
+				uint32_t value = strtoul(start, &end, 0);
+				m_pos += end - start;
+				return value;
+			}
+
+			uint32_t atom()
+			{
+				skip();
+				if (accept("("))
+				{
+					uint32_t value = orExpr();
+					if (!accept(")"))
+						m_sim.fail("missing )", m_text);
+					return value;
+				}
+				if (accept("-"))
+					return -atom();
+				if (m_pos < m_text.size() && isdigit((unsigned char)m_text[m_pos]))
+					return number();
+
+				size_t start = m_pos;
+				while (m_pos < m_text.size() && (isalnum((unsigned char)m_text[m_pos]) || m_text[m_pos] == '_'))
+					m_pos++;
+				std::string name = m_text.substr(start, m_pos-start);
+				auto it = m_sim.m_symbols.find(name);
+				if (name.empty() || it == m_sim.m_symbols.end())
+				{
+					m_sim.fail("unknown symbol", name.empty() ? m_text : name);
+					return 0;
+				}
+				uint32_t value = it->second;
+				if (accept("["))
+				{
+					value += orExpr();
+					if (!accept("]"))
+						m_sim.fail("missing ]", m_text);
+				}
+				if (accept("'"))
+					value |= number() << 12;
+				return value;
+			}
+
+			uint32_t addExpr()
+			{
+				uint32_t value = atom();
+				for (;;)
+				{
+					if (accept("+"))
+						value += atom();
+					else if (accept("-"))
+						value -= atom();
+					else
+						return value;
+				}
+			}
+
+			uint32_t shiftExpr()
+			{
+				uint32_t value = addExpr();
+				while (accept("<<"))
+					value <<= addExpr();
+				return value;
+			}
+
+			uint32_t orExpr()
+			{
+				uint32_t value = shiftExpr();
+				while (accept("|"))
+					value |= shiftExpr();
+				return value;
+			}
+
+		public:
+			ExprParser(MmeSim& sim, std::string const& text) : m_sim{sim}, m_text{text}, m_pos{} { }
+
+			uint32_t parse()
+			{
+				uint32_t value = orExpr();
+				skip();
+				if (m_pos != m_text.size())
+					m_sim.fail("trailing characters in expression", m_text);
+				return value;
+			}
+		};
+
+		uint32_t eval(std::string const& text)
+		{
+			unsigned reg;
+			if (parseReg(text, reg))
+				return m_r[reg];
+			return ExprParser{*this, text}.parse();
+		}
+
+		// Bitfield operand of the form "position:register"
+		uint32_t evalField(std::string const& text, uint32_t& pos)
+		{
+			size_t colon = text.find(':');
+			if (colon == std::string::npos)
+			{
+				fail("expected position:register", text);
+				return 0;
+			}
+			pos = eval(text.substr(0, colon));
+			return eval(text.substr(colon+1));
+		}
+
+		static uint32_t mask(uint32_t size) { return size >= 32 ? ~0U : (1U << size) - 1; }
+
+		uint32_t fetchParam()
+		{
+			if (m_paramPos >= m_params->size())
+			{
+				fail("fetched past the last parameter", "");
+				return 0;
+			}
+			return (*m_params)[m_paramPos++];
+		}
+
+		bool parseLine(std::string const& macro, std::string line, Instr& instr)
+		{
+			instr = Instr{};
+			instr.macro = macro;
+			if (line[0] == '*')
+			{
+				instr.exit = true;
+				line = trim(line.substr(1));
+			}
+
+			size_t semi = line.find(';');
+			if (semi != std::string::npos)
+			{
+				auto fetch = split(line.substr(semi+1));
+				line = trim(line.substr(0, semi));
+				if (fetch.size() != 2 || fetch[0] != "fetch")
+					return false;
+				instr.fetch = true;
+				instr.fetchToMem = fetch[1] == "mem";
+				if (!instr.fetchToMem && !parseReg(fetch[1], instr.fetchReg))
+					return false;
+			}
+
+			auto tokens = split(line);
+			if (tokens.empty())
+				return false;
+
+			if (tokens[0] == "nop")
+			{
+				instr.op = "nop";
+				return tokens.size() == 1;
+			}
+			if (tokens[0] == "fetch")
+			{
+				// Plain parameter fetch
+				if (tokens.size() != 2 || instr.fetch)
+					return false;
+				instr.fetch = true;
+				instr.fetchToMem = tokens[1] == "mem";
+				return instr.fetchToMem || parseReg(tokens[1], instr.fetchReg);
+			}
+			if (tokens[0] == "bz" || tokens[0] == "bnz" || tokens[0] == "bza" || tokens[0] == "bnza")
+			{
+				if (tokens.size() != 3)
+					return false;
+				instr.op = tokens[0];
+				instr.args[0] = tokens[1];
+				instr.args[1] = tokens[2][0] == '.' ? macro + tokens[2] : tokens[2];
+				instr.numArgs = 2;
+				return true;
+			}
+
+			// "<value> to <dest>"
+			size_t to = line.rfind(" to ");
+			if (to == std::string::npos)
+				return false;
+			auto dest = split(line.substr(to+4));
+			std::string value = trim(line.substr(0, to));
+			if (dest.size() == 2 && dest[1] == "mem" && parseReg(dest[0], instr.destReg))
+				instr.dest = Dest::RegMem;
+			else if (dest.size() != 1)
+				return false;
+			else if (dest[0] == "addr")
+				instr.dest = Dest::Addr;
+			else if (dest[0] == "mem")
+				instr.dest = Dest::Mem;
+			else if (dest[0] == "addr'mem")
+				instr.dest = Dest::AddrMemHigh;
+			else if (parseReg(dest[0], instr.destReg))
+				instr.dest = Dest::Reg;
+			else
+				return false;
+
+			static const char* const s_aluOps[] = { "lsr", "lsl", "bit", "bfl", "ei", "addi", "dec", "sub", "add", "orr", "and", "xor", "ldi", "ldr" };
+			auto valueTokens = split(value);
+			for (const char* op : s_aluOps)
+				if (valueTokens[0] == op)
+				{
+					instr.op = op;
+					// The last operand may be an expression containing spaces
+					size_t numFixed = instr.op == "ei" ? 2 : 1;
+					if (instr.op == "ldi" || instr.op == "dec")
+						numFixed = 0;
+					if (valueTokens.size() < numFixed + (instr.op == "dec" ? 1 : 2))
+						return false;
+					size_t pos = value.find(valueTokens[0]) + valueTokens[0].size();
+					for (size_t i = 0; i < numFixed; i ++)
+					{
+						pos = value.find(valueTokens[1+i], pos);
+						instr.args[i] = valueTokens[1+i];
+						pos += valueTokens[1+i].size();
+					}
+					instr.args[numFixed] = trim(value.substr(pos));
+					instr.numArgs = numFixed + 1;
+					return true;
+				}
+
+			instr.args[0] = value;
+			instr.numArgs = 1;
+			return true;
+		}
+
+		uint32_t execAlu(Instr const& instr)
+		{
+			std::string const& op = instr.op;
+			if (op.empty())
+				return eval(instr.args[0]);
+			if (op == "lsr")
+				return eval(instr.args[0]) >> eval(instr.args[1]);
+			if (op == "lsl")
+				return eval(instr.args[0]) << eval(instr.args[1]);
+			if (op == "bit")
+				return (eval(instr.args[0]) >> eval(instr.args[1])) & 1;
+			if (op == "bfl")
+			{
+				uint32_t pos, value = evalField(instr.args[0], pos);
+				return (value >> pos) & mask(eval(instr.args[1]));
+			}
+			if (op == "ei")
+			{
+				uint32_t dstPos, srcPos;
+				uint32_t dst = evalField(instr.args[0], dstPos);
+				uint32_t src = evalField(instr.args[1], srcPos);
+				uint32_t m = mask(eval(instr.args[2]));
+				return (dst &~ (m << dstPos)) | (((src >> srcPos) & m) << dstPos);
+			}
+			if (op == "addi" || op == "add")
+				return eval(instr.args[0]) + eval(instr.args[1]);
+			if (op == "dec")
+				return eval(instr.args[0]) - 1;
+			if (op == "sub")
+				return eval(instr.args[0]) - eval(instr.args[1]);
+			if (op == "orr")
+				return eval(instr.args[0]) | eval(instr.args[1]);
+			if (op == "and")
+				return eval(instr.args[0]) & eval(instr.args[1]);
+			if (op == "xor")
+				return eval(instr.args[0]) ^ eval(instr.args[1]);
+			if (op == "ldi")
+				return readReg(eval(instr.args[0]));
+			if (op == "ldr")
+				return readReg(eval(instr.args[0]) + eval(instr.args[1]));
+			fail("unsupported operation", op);
+			return 0;
+		}
+
+		uint32_t readReg(uint32_t method) const
+		{
+			return m_regs3D[method & (RegSim::s_numMethods-1)];
+		}
+
+		void send(uint32_t value)
+		{
+			write(m_methodAddr & 0xFFF, value);
+			m_methodAddr = (m_methodAddr & ~0xFFFU) | ((m_methodAddr + ((m_methodAddr >> 12) & 0x3F)) & 0xFFF);
+		}
+
+		// Executes a non-branch instruction
+		void exec(Instr const& instr)
+		{
+			if (instr.op == "nop")
+				return;
+
+			uint32_t result = 0;
+			if (instr.dest != Dest::None)
+				result = execAlu(instr);
+			switch (instr.dest)
+			{
+				case Dest::None:
+					break;
+				case Dest::Reg:
+					if (instr.destReg)
+						m_r[instr.destReg] = result;
+					break;
+				case Dest::RegMem:
+					if (instr.destReg)
+						m_r[instr.destReg] = result;
+					send(result);
+					break;
+				case Dest::Addr:
+					m_methodAddr = result;
+					break;
+				case Dest::Mem:
+					send(result);
+					break;
+				case Dest::AddrMemHigh:
+					m_methodAddr = result;
+					send((result >> 12) & 0x3F);
+					break;
+			}
+
+			if (instr.fetch)
+			{
+				uint32_t param = fetchParam();
+				if (instr.fetchToMem)
+					send(param);
+				else if (instr.fetchReg)
+					m_r[instr.fetchReg] = param;
+			}
+		}
+
+		bool isBranch(Instr const& instr) const
+		{
+			return instr.op == "bz" || instr.op == "bnz" || instr.op == "bza" || instr.op == "bnza";
+		}
+
+		void applyConstbufWrite(uint32_t method, uint32_t value)
+		{
+			if (method < s_loadConstbufData || method >= s_loadConstbufData + s_numLoadConstbufData)
+				return;
+			uint64_t addr = (uint64_t(m_regs3D[s_constbufSelectorAddr]) << 32) | m_regs3D[s_constbufSelectorAddr+1];
+			uint32_t& offset = m_regs3D[s_loadConstbufOffset];
+			if (offset + 4 > m_regs3D[s_constbufSelectorSize])
+				fail("constbuf update out of bounds", std::to_string(offset));
+			m_memory[addr + offset] = value;
+			offset += 4;
+		}
+
+	public:
+		MmeSim() : m_regs3D(RegSim::s_numMethods), m_failed{} { }
+
+		void setSymbol(std::string const& name, uint32_t value) { m_symbols[name] = value; }
+		void setMacroId(uint32_t method, std::string const& name) { m_macroIds[method] = name; }
+
+		uint32_t& reg(uint32_t method) { return m_regs3D[method & (RegSim::s_numMethods-1)]; }
+		std::vector<Write> const& getWrites() const { return m_writes; }
+		void clearWrites() { m_writes.clear(); }
+		bool hasFailed() const { return m_failed; }
+
+		// Reads back a word written through LoadConstbufData, or the given default if it never was
+		uint32_t readMemory(uint64_t addr, uint32_t def = 0) const
+		{
+			auto it = m_memory.find(addr);
+			return it != m_memory.end() ? it->second : def;
+		}
+		size_t getNumMemoryWords() const { return m_memory.size(); }
+
+		// Applies a method write to the 3D engine, as if it came from the command stream
+		void write(uint32_t method, uint32_t value)
+		{
+			m_regs3D[method & (RegSim::s_numMethods-1)] = value;
+			m_writes.push_back({ 0, method, value });
+			applyConstbufWrite(method, value);
+		}
+
+		// Loads the macros from a .mme file, in the directory named by $DKDEFDIR
+		bool load(const char* fileName)
+		{
+			const char* dir = getenv("DKDEFDIR");
+			std::string path = std::string{dir ? dir : "."} + "/" + fileName;
+			FILE* f = fopen(path.c_str(), "r");
+			if (!f)
+			{
+				fail("cannot open", path);
+				return false;
+			}
+
+			std::string macro;
+			char buf[512];
+			bool ok = true;
+			while (fgets(buf, sizeof(buf), f))
+			{
+				std::string line{buf};
+				size_t comment = line.find('#');
+				if (comment != std::string::npos)
+					line.resize(comment);
+				line = trim(line);
+				if (line.empty())
+					continue;
+
+				if (line.size() > 2 && line.compare(line.size()-2, 2, "::") == 0)
+				{
+					macro = line.substr(0, line.size()-2);
+					m_labels[macro] = m_code.size();
+				}
+				else if (line[0] == '.')
+					m_labels[macro + line] = m_code.size();
+				else if (line.back() == ':' && line.find(' ') == std::string::npos)
+					m_labels[line.substr(0, line.size()-1)] = m_code.size();
+				else
+				{
+					Instr instr;
+					if (!parseLine(macro, line, instr))
+					{
+						fail("cannot parse", line);
+						ok = false;
+					}
+					m_code.push_back(instr);
+				}
+			}
+			fclose(f);
+			return ok;
+		}
+
+		// Runs a macro with the given parameters
+		bool run(std::string const& name, std::vector<uint32_t> const& params)
+		{
+			auto it = m_labels.find(name);
+			if (it == m_labels.end() || params.empty())
+			{
+				fail("cannot run macro", name);
+				return false;
+			}
+
+			memset(m_r, 0, sizeof(m_r));
+			m_r[1] = params[0];
+			m_methodAddr = 0;
+			m_params = &params;
+			m_paramPos = 1;
+
+			bool pendingExit = false;
+			uint32_t pc = it->second;
+			for (uint32_t steps = 0; !m_failed; steps ++)
+			{
+				if (pc >= m_code.size() || steps >= s_maxSteps)
+				{
+					fail("macro ran away", name);
+					break;
+				}
+
+				Instr const& instr = m_code[pc];
+				if (isBranch(instr))
+				{
+					bool isZero = eval(instr.args[0]) == 0;
+					bool taken = (instr.op[1] == 'z') == isZero;
+					bool annul = instr.op.back() == 'a';
+					if (taken)
+					{
+						auto target = m_labels.find(instr.args[1]);
+						if (target == m_labels.end())
+						{
+							fail("unknown label", instr.args[1]);
+							break;
+						}
+						if (!annul)
+						{
+							if (pc+1 >= m_code.size() || isBranch(m_code[pc+1]))
+							{
+								fail("invalid delay slot", instr.macro);
+								break;
+							}
+							exec(m_code[pc+1]);
+						}
+						pc = target->second;
+						pendingExit = false;
+						continue;
+					}
+				}
+				else
+					exec(instr);
+
+				if (pendingExit)
+					break;
+				pendingExit = instr.exit;
+				pc ++;
+			}
+
+			if (!m_failed && m_paramPos != params.size())
+				fail("not every parameter was fetched", name);
+			return !m_failed;
+		}
+
+		// Replays the 3D writes of a command stream (as decoded by RegSim), running the
+		// macros that are called along the way
+		bool process(std::vector<Write> const& writes)
+		{
+			std::string macro;
+			std::vector<uint32_t> params;
+			auto flushCall = [&]
+			{
+				if (!macro.empty())
+					run(macro, params);
+				macro.clear();
+				params.clear();
+			};
+
+			for (auto& w : writes)
+			{
+				if (w.subchannel != 0)
+					continue;
+				if (w.method >= s_macroBase)
+				{
+					if (!(w.method & 1))
+					{
+						flushCall();
+						auto it = m_macroIds.find(w.method);
+						if (it == m_macroIds.end())
+						{
+							fail("unknown macro id", std::to_string(w.method));
+							continue;
+						}
+						macro = it->second;
+					}
+					else if (macro.empty() || m_macroIds.find(w.method-1) == m_macroIds.end() || m_macroIds[w.method-1] != macro)
+					{
+						fail("macro parameter without a call", std::to_string(w.method));
+						continue;
+					}
+					params.push_back(w.value);
+					continue;
+				}
+				flushCall();
+				write(w.method, w.value);
+			}
+			flushCall();
+			return !m_failed;
+		}
+	};
+
+	// Symbols and macro ids used by the draw, compute and driver constbuf macros
+	inline void AddDrawSymbols(MmeSim& sim)
+	{
+		using E = maxwell::Engine3D;
+		sim.setSymbol("ConstbufSelectorSize", E::ConstbufSelectorSize{});
+		sim.setSymbol("LoadConstbufOffset", E::LoadConstbufOffset{});
+		sim.setSymbol("MmeDriverConstbufIova", E::MmeDriverConstbufIova{});
+		sim.setSymbol("MmeDriverConstbufSize", E::MmeDriverConstbufSize{});
+		sim.setSymbol("DrawArraysFirst", E::DrawArraysFirst{});
+		sim.setSymbol("DrawArraysCount", E::DrawArraysCount{});
+		sim.setSymbol("DrawElementsFirst", E::DrawElementsFirst{});
+		sim.setSymbol("DrawElementsCount", E::DrawElementsCount{});
+		sim.setSymbol("DrawBaseVertex", E::DrawBaseVertex{});
+		sim.setSymbol("DrawBaseInstance", E::DrawBaseInstance{});
+		sim.setSymbol("VertexIdBase", E::VertexIdBase{});
+		sim.setSymbol("VertexBeginGl", E::VertexBeginGl{});
+		sim.setSymbol("VertexEndGl", E::VertexEndGl{});
+		sim.setSymbol("VertexBeginGlInstanceNext_Shift", E::VertexBeginGl::InstanceNext::Shift);
+
+		sim.setMacroId(MmeMacroSelectDriverConstbuf, "SelectDriverConstbuf");
+		sim.setMacroId(MmeMacroDraw, "Draw");
+		sim.setMacroId(MmeMacroDrawIndexed, "DrawIndexed");
+		sim.setMacroId(MmeMacroMultiDraw, "MultiDraw");
+		sim.setMacroId(MmeMacroMultiDrawIndexed, "MultiDrawIndexed");
+		sim.setMacroId(MmeMacroMultiDrawIndirect, "MultiDrawIndirect");
+		sim.setMacroId(MmeMacroMultiDrawIndexedIndirect, "MultiDrawIndexedIndirect");
+		sim.setMacroId(MmeMacroPatchComputeJobGridSize, "PatchComputeJobGridSize");
+	}
+}
@@ -0,0 +1,200 @@
+// Records multi-draws and checks the words they emit, then runs them through the MME model
+// to check the draws they perform and the gl_BaseVertex/gl_BaseInstance/gl_DrawID updates
+// they make to the driver constbuf, against the same draws recorded one by one.
+#include "common.h"
+#include "mme_sim.h"
+#include "driver_constbuf.h"
+#include <string.h>
+
+using namespace dk::detail;
+
+namespace
+{
+	constexpr uint32_t s_maxWords = 0x10000;
+	constexpr uint32_t s_maxDrawsPerMacro = 256;
+	constexpr uint32_t s_numDraws = 300; // more than what fits in a single macro call
+	constexpr uint64_t s_driverCbufAddr = UINT64_C(0x123456700);
+
+	constexpr uint32_t s_baseVertexOffset = offsetof(GraphicsDriverCbuf, baseVertex);
+	constexpr uint32_t s_baseInstanceOffset = offsetof(GraphicsDriverCbuf, baseInstance);
+	constexpr uint32_t s_drawIdOffset = offsetof(GraphicsDriverCbuf, drawId);
+
+	uint32_t g_words[s_maxWords];
+
+	constexpr uint32_t IncreaseOnce(uint32_t count, uint32_t method) { return (5U << 29) | (count << 16) | method; }
+	constexpr uint32_t Inline(uint32_t arg, uint32_t method) { return (4U << 29) | (arg << 16) | method; }
+
+	// State of the 3D engine and driver constbuf when a draw is kicked off
+	struct DrawState
+	{
+		uint32_t begin, count, first;
+		uint32_t baseVertex, baseInstance, vertexIdBase;
+		uint32_t cbuf[3]; // baseVertex, baseInstance, drawId
+
+		bool operator==(DrawState const& rhs) const { return memcmp(this, &rhs, sizeof(*this)) == 0; }
+	};
+
+	template <typename Func>
+	uint32_t Capture(DkCmdBuf cmdbuf, Func&& func)
+	{
+		dkCmdBufBeginCaptureCmds(cmdbuf, g_words, s_maxWords);
+		func();
+		return dkCmdBufEndCaptureCmds(cmdbuf);
+	}
+
+	// Runs captured words through the MME model, and collects the state seen by each draw
+	std::vector<DrawState> Simulate(uint32_t numWords, bool indexed, uint32_t finalCbuf[3])
+	{
+		using E = maxwell::Engine3D;
+
+		test::RegSim regs;
+		CHECK(regs.process(g_words, numWords));
+
+		test::MmeSim sim;
+		test::AddDrawSymbols(sim);
+		CHECK(sim.load("program.mme"));
+		CHECK(sim.load("draw.mme"));
+		sim.write(E::MmeDriverConstbufIova{}, uint32_t(s_driverCbufAddr >> 8));
+		sim.write(E::MmeDriverConstbufSize{}, GraphicsDriverCbufSize);
+		sim.clearWrites();
+		CHECK(sim.process(regs.getWrites()));
+
+		// Replay the writes done by the macros, looking at the state as each draw ends
+		test::MmeSim replay;
+		std::vector<DrawState> draws;
+		auto readCbuf = [&](uint32_t* out)
+		{
+			out[0] = replay.readMemory(s_driverCbufAddr + s_baseVertexOffset);
+			out[1] = replay.readMemory(s_driverCbufAddr + s_baseInstanceOffset);
+			out[2] = replay.readMemory(s_driverCbufAddr + s_drawIdOffset);
+		};
+		for (auto& w : sim.getWrites())
+		{
+			replay.write(w.method, w.value);
+			if (w.method != E::VertexEndGl{})
+				continue;
+
+			DrawState d = {};
+			d.begin = replay.reg(E::VertexBeginGl{});
+			d.count = replay.reg(indexed ? uint32_t(E::DrawElementsCount{}) : uint32_t(E::DrawArraysCount{}));
+			d.first = replay.reg(indexed ? uint32_t(E::DrawElementsFirst{}) : uint32_t(E::DrawArraysFirst{}));
+			d.baseVertex = replay.reg(E::DrawBaseVertex{});
+			d.baseInstance = replay.reg(E::DrawBaseInstance{});
+			d.vertexIdBase = replay.reg(E::VertexIdBase{});
+			readCbuf(d.cbuf);
+			draws.push_back(d);
+		}
+		readCbuf(finalCbuf);
+		return draws;
+	}
+
+	// Checks the macro calls emitted for a multi-draw: one per batch of draws, with the records passed as-is
+	template <typename T>
+	void CheckLayout(uint32_t numWords, uint32_t macro, DkPrimitive prim, T const draws[], uint32_t numDraws)
+	{
+		constexpr uint32_t wordsPerDraw = sizeof(T) / sizeof(uint32_t);
+		uint32_t pos = 0;
+		CHECK(g_words[pos++] == Inline(0, MmeMacroSelectDriverConstbuf));
+		for (uint32_t firstDraw = 0; firstDraw < numDraws; firstDraw += s_maxDrawsPerMacro)
+		{
+			uint32_t batchSize = numDraws - firstDraw < s_maxDrawsPerMacro ? numDraws - firstDraw : s_maxDrawsPerMacro;
+			CHECK(pos + 4 + batchSize*wordsPerDraw <= numWords);
+			if (pos + 4 + batchSize*wordsPerDraw > numWords)
+				return;
+			CHECK(g_words[pos++] == IncreaseOnce(3 + batchSize*wordsPerDraw, macro));
+			CHECK(g_words[pos++] == uint32_t(prim));
+			CHECK(g_words[pos++] == batchSize);
+			CHECK(g_words[pos++] == firstDraw);
+			CHECK(memcmp(&g_words[pos], &draws[firstDraw], batchSize*sizeof(T)) == 0);
+			pos += batchSize*wordsPerDraw;
+		}
+		CHECK(pos == numWords);
+	}
+
+	// Each draw must see the same state as when drawn on its own, plus its draw id
+	void CheckDraws(std::vector<DrawState> multi, std::vector<DrawState> const& single, std::vector<uint32_t> const& drawIds)
+	{
+		CHECK(!multi.empty() && multi.size() == single.size() && multi.size() == drawIds.size());
+		if (multi.size() != single.size() || multi.size() != drawIds.size())
+			return;
+		for (size_t i = 0; i < multi.size(); i ++)
+		{
+			CHECK(multi[i].cbuf[2] == drawIds[i]);
+			multi[i].cbuf[2] = 0;
+			CHECK(multi[i] == single[i]);
+		}
+	}
+
+	void TestMultiDraw(DkCmdBuf cmdbuf)
+	{
+		std::vector<DkDrawIndirectData> draws(s_numDraws);
+		std::vector<uint32_t> drawIds;
+		for (uint32_t i = 0; i < s_numDraws; i ++)
+		{
+			draws[i] = { 3 + i, i % 3, 7*i, i & 4 ? i : 0 };
+			drawIds.insert(drawIds.end(), draws[i].instanceCount, i);
+		}
+
+		uint32_t numWords = Capture(cmdbuf, [&]
+		{
+			dkCmdBufMultiDraw(cmdbuf, DkPrimitive_Triangles, draws.data(), s_numDraws);
+		});
+		CheckLayout(numWords, MmeMacroMultiDraw, DkPrimitive_Triangles, draws.data(), s_numDraws);
+		uint32_t multiCbuf[3];
+		auto multi = Simulate(numWords, false, multiCbuf);
+
+		numWords = Capture(cmdbuf, [&]
+		{
+			for (auto& d : draws)
+				dkCmdBufDraw(cmdbuf, DkPrimitive_Triangles, d.vertexCount, d.instanceCount, d.firstVertex, d.firstInstance);
+		});
+		uint32_t singleCbuf[3];
+		auto single = Simulate(numWords, false, singleCbuf);
+
+		CheckDraws(multi, single, drawIds);
+		CHECK(multiCbuf[0] == 0 && multiCbuf[1] == 0 && multiCbuf[2] == 0);
+	}
+
+	void TestMultiDrawIndexed(DkCmdBuf cmdbuf)
+	{
+		std::vector<DkDrawIndexedIndirectData> draws(s_numDraws);
+		std::vector<uint32_t> drawIds;
+		for (uint32_t i = 0; i < s_numDraws; i ++)
+		{
+			draws[i] = { 6 + i, (i + 1) % 3, 5*i, i & 2 ? -int32_t(i) : 0, i & 4 ? i : 0 };
+			drawIds.insert(drawIds.end(), draws[i].instanceCount, i);
+		}
+
+		uint32_t numWords = Capture(cmdbuf, [&]
+		{
+			dkCmdBufMultiDrawIndexed(cmdbuf, DkPrimitive_TriangleStrip, draws.data(), s_numDraws);
+		});
+		CheckLayout(numWords, MmeMacroMultiDrawIndexed, DkPrimitive_TriangleStrip, draws.data(), s_numDraws);
+		uint32_t multiCbuf[3];
+		auto multi = Simulate(numWords, true, multiCbuf);
+
+		numWords = Capture(cmdbuf, [&]
+		{
+			for (auto& d : draws)
+				dkCmdBufDrawIndexed(cmdbuf, DkPrimitive_TriangleStrip, d.indexCount, d.instanceCount, d.firstIndex, d.vertexOffset, d.firstInstance);
+		});
+		uint32_t singleCbuf[3];
+		auto single = Simulate(numWords, true, singleCbuf);
+
+		CheckDraws(multi, single, drawIds);
+		CHECK(multiCbuf[0] == 0 && multiCbuf[1] == 0 && multiCbuf[2] == 0);
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+	DkCmdBuf cmdbuf = test::CreateCmdBuf(device, nullptr);
+
+	TestMultiDraw(cmdbuf);
+	TestMultiDrawIndexed(cmdbuf);
+
+	dkCmdBufDestroy(cmdbuf);
+	dkDeviceDestroy(device);
+	return test::Finish("multi_draw");
+}
@@ -0,0 +1,160 @@
+// Binds pipelines that only differ in some state groups, and checks that passing the
+// previously bound pipeline skips the identical groups while still emitting the others,
+// with the same end result as binding the new pipeline from scratch. Also checks that the
+// captures used to compile pipelines survive running out of storage.
+#include "common.h"
+#include "cmd_sim.h"
+#include "dk_cmdbuf.h"
+#include "dk_pipeline.h"
+#include <string.h>
+#include <vector>
+
+namespace
+{
+	constexpr uint32_t s_maxWords = 0x1000;
+	constexpr uint32_t s_numBlendStates = 4;
+	constexpr uint32_t s_numVtxAttribs = 8;
+	constexpr uint32_t s_numVtxBuffers = 4;
+
+	struct States
+	{
+		DkRasterizerState rasterizer;
+		DkColorState color;
+		DkColorWriteState colorWrite;
+		DkBlendState blend[s_numBlendStates];
+		DkDepthStencilState depthStencil;
+		DkVtxAttribState vtxAttribs[s_numVtxAttribs];
+		DkVtxBufferState vtxBuffers[s_numVtxBuffers];
+
+		States()
+		{
+			// Some states are passed to macros as raw words, padding bits included
+			memset(this, 0, sizeof(*this));
+			dkRasterizerStateDefaults(&rasterizer);
+			dkColorStateDefaults(&color);
+			dkColorWriteStateDefaults(&colorWrite);
+			for (auto& b : blend)
+				dkBlendStateDefaults(&b);
+			dkDepthStencilStateDefaults(&depthStencil);
+			for (uint32_t i = 0; i < s_numVtxAttribs; i ++)
+				vtxAttribs[i] = { i % s_numVtxBuffers, 0, 4*i, DkVtxAttribSize_4x32, DkVtxAttribType_Float, 0 };
+			for (uint32_t i = 0; i < s_numVtxBuffers; i ++)
+				vtxBuffers[i] = { 16*(i+1), 0 };
+		}
+
+		DkPipeline createPipeline(DkDevice device) const
+		{
+			DkPipelineMaker maker;
+			dkPipelineMakerDefaults(&maker, device);
+			maker.rasterizerState = &rasterizer;
+			maker.colorState = &color;
+			maker.colorWriteState = &colorWrite;
+			maker.blendStates = blend;
+			maker.numBlendStates = s_numBlendStates;
+			maker.depthStencilState = &depthStencil;
+			maker.vtxAttribs = vtxAttribs;
+			maker.numVtxAttribs = s_numVtxAttribs;
+			maker.vtxBuffers = vtxBuffers;
+			maker.numVtxBuffers = s_numVtxBuffers;
+			return dkPipelineCreate(&maker);
+		}
+	};
+
+	template <typename Func>
+	std::vector<uint32_t> Capture(DkCmdBuf cmdbuf, Func&& func)
+	{
+		std::vector<uint32_t> words(s_maxWords);
+		dkCmdBufBeginCaptureCmds(cmdbuf, words.data(), s_maxWords);
+		func();
+		words.resize(dkCmdBufEndCaptureCmds(cmdbuf));
+		return words;
+	}
+
+	// Registers after executing each stream in turn
+	std::vector<uint32_t> GetRegs(std::initializer_list<std::vector<uint32_t> const*> streams)
+	{
+		test::RegSim sim;
+		for (auto* s : streams)
+			CHECK(sim.process(s->data(), s->size()));
+		return sim.getRegs();
+	}
+
+	void TestPrevPipeline(DkDevice device)
+	{
+		// Pipelines compile each state group the same way as captures with DkCmdBufFlags_OptimizeCaptures.
+		// Bound pipelines are captured as-is, so that the groups they emit are seen unmerged.
+		DkCmdBuf cmdbuf = test::CreateCmdBuf(device, nullptr);
+		DkCmdBuf refCmdbuf = test::CreateCmdBuf(device, nullptr, DkCmdBufFlags_OptimizeCaptures);
+
+		States a, b;
+		b.rasterizer.cullMode = DkFace_Front;
+		dkBlendStateSetOps(&b.blend[1], DkBlendOp_Sub, DkBlendOp_Max);
+		DkPipeline pipeA = a.createPipeline(device);
+		DkPipeline pipeB = b.createPipeline(device);
+		DkPipeline pipeB2 = b.createPipeline(device);
+		CHECK(pipeA && pipeB && pipeB2);
+		if (!pipeA || !pipeB || !pipeB2)
+			return;
+
+		auto bindA = Capture(cmdbuf, [&] { dkCmdBufBindPipeline(cmdbuf, pipeA, nullptr); });
+		auto bindB = Capture(cmdbuf, [&] { dkCmdBufBindPipeline(cmdbuf, pipeB, nullptr); });
+		auto switchAB = Capture(cmdbuf, [&] { dkCmdBufBindPipeline(cmdbuf, pipeB, pipeA); });
+		CHECK(bindB.size() == pipeB->getNumWords());
+		CHECK(switchAB.size() < bindB.size());
+
+		// Only the differing groups are emitted, in segment order, as the regular bind functions emit them
+		auto rasterizer = Capture(refCmdbuf, [&] { dkCmdBufBindRasterizerState(refCmdbuf, &b.rasterizer); });
+		auto blend = Capture(refCmdbuf, [&] { dkCmdBufBindBlendStates(refCmdbuf, 0, b.blend, s_numBlendStates); });
+		std::vector<uint32_t> expected = rasterizer;
+		expected.insert(expected.end(), blend.begin(), blend.end());
+		CHECK(!rasterizer.empty() && !blend.empty());
+		CHECK(switchAB == expected);
+
+		// Switching ends up in the same state as binding the new pipeline from scratch
+		CHECK(GetRegs({ &bindA, &switchAB }) == GetRegs({ &bindA, &bindB }));
+		CHECK(GetRegs({ &bindA, &switchAB }) != GetRegs({ &bindA }));
+
+		// Identical pipelines emit nothing, whether or not they are the same object
+		CHECK(Capture(cmdbuf, [&] { dkCmdBufBindPipeline(cmdbuf, pipeB, pipeB); }).empty());
+		CHECK(Capture(cmdbuf, [&] { dkCmdBufBindPipeline(cmdbuf, pipeB2, pipeB); }).empty());
+
+		dkPipelineDestroy(pipeB2);
+		dkPipelineDestroy(pipeB);
+		dkPipelineDestroy(pipeA);
+		dkCmdBufDestroy(refCmdbuf);
+		dkCmdBufDestroy(cmdbuf);
+	}
+
+	// Pipeline compilation relies on captures that discard what doesn't fit instead of failing
+	void TestCaptureOverflow(DkDevice device)
+	{
+		States s;
+		DkCmdBuf cmdbuf = test::CreateCmdBuf(device, nullptr);
+		uint32_t words[s_maxWords];
+
+		cmdbuf->beginCapture(words, 4, true);
+		dkCmdBufBindVtxAttribState(cmdbuf, s.vtxAttribs, s_numVtxAttribs);
+		dkCmdBufBindVtxBufferState(cmdbuf, s.vtxBuffers, s_numVtxBuffers);
+		CHECK(cmdbuf->endCapture() == 0);
+		CHECK(cmdbuf->hasCaptureOverflowed());
+
+		// The next capture starts afresh
+		cmdbuf->beginCapture(words, s_maxWords, true);
+		dkCmdBufBindVtxAttribState(cmdbuf, s.vtxAttribs, s_numVtxAttribs);
+		CHECK(cmdbuf->endCapture() > 4);
+		CHECK(!cmdbuf->hasCaptureOverflowed());
+
+		dkCmdBufDestroy(cmdbuf);
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+
+	TestPrevPipeline(device);
+	TestCaptureOverflow(device);
+
+	dkDeviceDestroy(device);
+	return test::Finish("pipeline_bind");
+}
@@ -0,0 +1,124 @@
+// Resolves profiler regions whose timestamp reports are written directly into memory,
+// instead of by the GPU, and checks the returned tags and durations.
+#include "common.h"
+#include "host/gpu_host.h"
+#include "dk_profiler.h"
+
+using namespace dk::detail;
+
+namespace
+{
+	constexpr uint32_t s_numRegions = 8;
+	constexpr uint32_t s_offset = 0x100;
+
+	// The GPU timer runs at 614.4 MHz: 384 ticks are 625 ns
+	constexpr uint64_t s_ticksPer625Ns = 384;
+
+	NvLongSemaphore* GetReports(DkMemBlock mem, uint32_t region)
+	{
+		return (NvLongSemaphore*)((char*)dkMemBlockGetCpuAddr(mem) + s_offset) + 2*region;
+	}
+
+	DkFence MakeFence(uint32_t syncpt, uint32_t value)
+	{
+		DkFence fence = {};
+		fence.m_type = DkFence::External;
+		fence.m_external.m_fence.num_fences = 1;
+		fence.m_external.m_fence.fences[0].id = syncpt;
+		fence.m_external.m_fence.fences[0].value = value;
+		return fence;
+	}
+}
+
+int main()
+{
+	// Raw tick conversion
+	CHECK(Profiler::calcDurationNs(1000, 1000 + s_ticksPer625Ns) == 625);
+	CHECK(Profiler::calcDurationNs(0, 3*s_ticksPer625Ns) == 3*625);
+	CHECK(Profiler::calcDurationNs(5000, 5000) == 0);
+	CHECK(Profiler::calcDurationNs(5000, 0) == 0);    // never ended
+	CHECK(Profiler::calcDurationNs(5000, 4999) == 0); // ended before it began
+	CHECK(Profiler::calcDurationNs(1ULL << 40, (1ULL << 40) + 1000*s_ticksPer625Ns) == 1000*625);
+
+	DkDevice device = test::CreateDevice();
+	DkMemBlock mem = test::CreateMemBlock(device, s_offset + s_numRegions*DK_PROFILER_REGION_SIZE,
+		DkMemBlockFlags_CpuUncached | DkMemBlockFlags_GpuUncached);
+	DkMemBlock cmdMem = test::CreateMemBlock(device, 0x10000);
+	DkCmdBuf cmdbuf = test::CreateCmdBuf(device, cmdMem);
+
+	DkProfilerMaker maker;
+	dkProfilerMakerDefaults(&maker, device, mem, s_offset, s_numRegions);
+	DkProfiler profiler = dkProfilerCreate(&maker);
+	uint32_t syncpt = hostgpu::allocSyncpt();
+
+	// First batch: three regions, one of which is never ended
+	uint32_t regions[s_numRegions];
+	for (uint32_t i = 0; i < 3; i ++)
+	{
+		regions[i] = dkProfilerBeginRegion(profiler, cmdbuf, 100+i);
+		CHECK(regions[i] != DK_PROFILER_INVALID_REGION);
+		if (i != 1)
+			dkProfilerEndRegion(profiler, cmdbuf, regions[i]);
+	}
+	DkFence fence = MakeFence(syncpt, 1);
+	dkProfilerSubmitRegions(profiler, &fence);
+
+	for (uint32_t i = 0; i < 3; i ++)
+	{
+		NvLongSemaphore* reports = GetReports(mem, regions[i]);
+		reports[0].timestamp = 0x100000000ULL + i*s_ticksPer625Ns;
+		if (i != 1)
+			reports[1].timestamp = reports[0].timestamp + (i+1)*10*s_ticksPer625Ns;
+	}
+
+	// Nothing is handed back before the fence is signaled
+	DkProfilerRegion out[s_numRegions];
+	CHECK(dkProfilerResolve(profiler, out, s_numRegions) == 0);
+	hostgpu::incrSyncpt(syncpt);
+
+	// Partial resolves continue where the previous one stopped
+	CHECK(dkProfilerResolve(profiler, out, 2) == 2);
+	CHECK(out[0].tag == 100 && out[0].durationNs == 10*625);
+	CHECK(out[1].tag == 101 && out[1].durationNs == 0);
+	CHECK(dkProfilerResolve(profiler, out, s_numRegions) == 1);
+	CHECK(out[0].tag == 102 && out[0].durationNs == 30*625);
+
+	// Second batch wraps around the end of the ring, and overflows it
+	uint32_t numRecorded = 0;
+	for (uint32_t i = 0; i < s_numRegions + 2; i ++)
+	{
+		uint32_t region = dkProfilerBeginRegion(profiler, cmdbuf, 200+i);
+		if (region == DK_PROFILER_INVALID_REGION)
+			continue;
+		dkProfilerEndRegion(profiler, cmdbuf, region);
+		regions[numRecorded++] = region;
+	}
+	CHECK(numRecorded == s_numRegions);
+	CHECK(regions[0] == 3 && regions[s_numRegions-1] == 2);
+	fence = MakeFence(syncpt, 2);
+	dkProfilerSubmitRegions(profiler, &fence);
+
+	for (uint32_t i = 0; i < numRecorded; i ++)
+	{
+		NvLongSemaphore* reports = GetReports(mem, regions[i]);
+		reports[0].timestamp = 0xFFFFFFFF00ULL;
+		reports[1].timestamp = reports[0].timestamp + (i+1)*s_ticksPer625Ns;
+	}
+
+	hostgpu::incrSyncpt(syncpt);
+	CHECK(dkProfilerResolve(profiler, out, s_numRegions) == s_numRegions);
+	for (uint32_t i = 0; i < s_numRegions; i ++)
+		CHECK(out[i].tag == 200+i && out[i].durationNs == (i+1)*625);
+	CHECK(dkProfilerResolve(profiler, out, s_numRegions) == 0);
+
+	// Resolving a full ring frees every slot
+	for (uint32_t i = 0; i < s_numRegions; i ++)
+		CHECK(dkProfilerBeginRegion(profiler, cmdbuf, 300+i) != DK_PROFILER_INVALID_REGION);
+
+	dkProfilerDestroy(profiler);
+	dkCmdBufDestroy(cmdbuf);
+	dkMemBlockDestroy(cmdMem);
+	dkMemBlockDestroy(mem);
+	dkDeviceDestroy(device);
+	return test::Finish("profiler_resolve");
+}
@@ -0,0 +1,177 @@
+// Exercises the handoff between the user thread and the submission thread of a queue
+// created with DkQueueFlags_AsyncSubmit, checks that flushing only waits for the GPU once
+// the internal command memory runs out, then makes the channel fault while several
+// threads are waiting on fences and polling the queue state.
+#include "common.h"
+#include "host/gpu_host.h"
+#include "dk_fence.h"
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	constexpr unsigned s_numHandoffIterations = 2000;
+	constexpr unsigned s_numWaiters = 4;
+	constexpr unsigned s_numPollers = 4;
+	constexpr uint32_t s_cmdMemSize = 0x40000;
+	constexpr unsigned s_maxBytesPerFlush = 0x100; // upper bound for a fence signal and the post-submit commands
+	constexpr unsigned s_maxFlushes = 100000;
+
+	std::atomic<unsigned> g_numErrorReports;
+	std::atomic<bool> g_stop;
+
+	void DebugFunc(void* userData, const char* context, DkResult result, const char* message)
+	{
+		if (result != DkResult_Success)
+		{
+			fprintf(stderr, "[%s] error %d: %s\n", context, result, message);
+			exit(EXIT_FAILURE);
+		}
+		if (strstr(message, "entered error state"))
+			g_numErrorReports ++;
+	}
+
+	DkCmdList RecordWork(DkCmdBuf cmdbuf, unsigned i)
+	{
+		dkCmdBufSetPointSize(cmdbuf, float(i & 0xFF));
+		dkCmdBufSetLineWidth(cmdbuf, 1.0f);
+		dkCmdBufBarrier(cmdbuf, DkBarrier_None, DkInvalidateFlags_Image);
+		return dkCmdBufFinishList(cmdbuf);
+	}
+
+	// Waits for work that is stuck in the channel when it faults
+	void Waiter(DkFence fence, std::atomic<unsigned>* numWaitsEnded)
+	{
+		if (dkFenceWait(&fence, -1) == DkResult_Success)
+			(*numWaitsEnded) ++;
+	}
+
+	// Signals fences and flushes on a held channel, until the internal command memory runs out
+	void Flusher(DkQueue queue, std::atomic<unsigned>* numFlushes)
+	{
+		DkFence fence;
+		while (!dkQueueGetNumStalls(queue) && *numFlushes < s_maxFlushes)
+		{
+			dkQueueSignalFence(queue, &fence, false);
+			dkQueueFlush(queue);
+			(*numFlushes) ++;
+		}
+	}
+
+	void Poller(DkQueue queue, std::atomic<unsigned>* numErrorsSeen)
+	{
+		while (!g_stop)
+			if (dkQueueIsInErrorState(queue))
+				(*numErrorsSeen) ++;
+	}
+}
+
+int main()
+{
+	DkDeviceMaker deviceMaker;
+	dkDeviceMakerDefaults(&deviceMaker);
+	deviceMaker.cbDebug = DebugFunc;
+	deviceMaker.errorCheckIntervalUs = 1000;
+	DkDevice device = dkDeviceCreate(&deviceMaker);
+
+	DkQueueMaker queueMaker;
+	dkQueueMakerDefaults(&queueMaker, device);
+	queueMaker.flags |= DkQueueFlags_AsyncSubmit;
+	DkQueue queue = dkQueueCreate(&queueMaker);
+	uint32_t channel = hostgpu::lastChannel();
+
+	DkMemBlock mem = test::CreateMemBlock(device, s_cmdMemSize);
+	DkCmdBuf cmdbuf = test::CreateCmdBuf(device, mem);
+
+	// Every fence handed out by the user thread must be signaled by the submission thread
+	DkFence fences[4];
+	for (unsigned i = 0; i < s_numHandoffIterations; i ++)
+	{
+		DkFence& fence = fences[i % 4];
+		if (i >= 4)
+			CHECK(dkFenceWait(&fence, -1) == DkResult_Success);
+		dkQueueSubmitCommands(queue, RecordWork(cmdbuf, i));
+		dkQueueSignalFence(queue, &fence, i & 1);
+		if (i % 3 == 0)
+			dkQueueFlush(queue);
+	}
+	dkQueueWaitIdle(queue);
+	for (auto& fence : fences)
+		CHECK(dkFenceWait(&fence, 0) == DkResult_Success);
+	CHECK(!dkQueueIsInErrorState(queue));
+	CHECK(g_numErrorReports == 0);
+	CHECK(dkQueueGetNumStalls(queue) == 0);
+	dkCmdBufClear(cmdbuf);
+
+	// Flushes must not wait on fences while there is internal command memory left
+	hostgpu::pauseChannel(channel, true);
+	std::atomic<unsigned> numFlushes{};
+	std::thread flusher{Flusher, queue, &numFlushes};
+	for (unsigned i = 0; i < 5000 && !dkQueueGetNumStalls(queue); i ++)
+		svcSleepThread(1000000);
+	unsigned numFlushesBeforeStall = numFlushes;
+	CHECK(dkQueueGetNumStalls(queue) == 1);
+	CHECK(numFlushesBeforeStall >= (queueMaker.commandMemorySize - queueMaker.commandMemorySize/16) / s_maxBytesPerFlush);
+
+	// The stalled flush resumes once the GPU catches up
+	svcSleepThread(5000000);
+	CHECK(numFlushes == numFlushesBeforeStall);
+	hostgpu::pauseChannel(channel, false);
+	flusher.join();
+	CHECK(numFlushes == numFlushesBeforeStall+1);
+	dkQueueWaitIdle(queue);
+	CHECK(!dkQueueIsInErrorState(queue));
+
+	// Hold the channel so that there is work pending when it faults
+	hostgpu::pauseChannel(channel, true);
+	DkFence fence;
+	dkQueueSubmitCommands(queue, RecordWork(cmdbuf, 0));
+	dkQueueSignalFence(queue, &fence, false);
+	dkQueueFlush(queue);
+
+	// The kickoff of this fence is held on the submission thread until the channel faults
+	DkFence lastFence;
+	hostgpu::holdKickoffs(channel, true);
+	dkQueueSignalFence(queue, &lastFence, true);
+	dkQueueFlush(queue);
+	hostgpu::waitKickoffHeld(channel);
+
+	std::atomic<unsigned> numWaitsEnded{}, numErrorsSeen{};
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < s_numWaiters; i ++)
+		threads.emplace_back(Waiter, fence, &numWaitsEnded);
+	for (unsigned i = 0; i < s_numPollers; i ++)
+		threads.emplace_back(Poller, queue, &numErrorsSeen);
+	svcSleepThread(5000000);
+	CHECK(numWaitsEnded == 0);
+
+	// The failed kickoff races with the waiters' error checks: the error must be
+	// reported once, and every wait must end, including the one on the last fence
+	hostgpu::injectFault(channel);
+	hostgpu::holdKickoffs(channel, false);
+
+	CHECK(dkFenceWait(&lastFence, -1) == DkResult_Success);
+	while (numWaitsEnded != s_numWaiters)
+		svcSleepThread(100000);
+	g_stop = true;
+	for (auto& t : threads)
+		t.join();
+
+	CHECK(dkQueueIsInErrorState(queue));
+	CHECK(numErrorsSeen != 0);
+	CHECK(g_numErrorReports == 1);
+
+	// Fences signaled after the error must not block anyone either
+	dkQueueSignalFence(queue, &fence, true);
+	CHECK(dkFenceWait(&fence, 1000000000) == DkResult_Success);
+	dkQueueWaitIdle(queue);
+
+	dkQueueDestroy(queue);
+	dkCmdBufDestroy(cmdbuf);
+	dkMemBlockDestroy(mem);
+	dkDeviceDestroy(device);
+	return test::Finish("queue_async");
+}
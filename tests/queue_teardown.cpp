@@ -0,0 +1,97 @@
+// Destroys queues whose channel faults while the destructor waits for their work to
+// complete, with other threads checking the device for queue errors all along.
+#include "common.h"
+#include "host/gpu_host.h"
+#include "dk_fence.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	constexpr unsigned s_numCheckers = 4;
+	constexpr unsigned s_numRounds = 20;
+
+	std::atomic<bool> g_stop;
+
+	// The faults are expected, so keep their warnings quiet
+	void DebugFunc(void* userData, const char* context, DkResult result, const char* message)
+	{
+		if (result != DkResult_Success)
+		{
+			fprintf(stderr, "[%s] error %d: %s\n", context, result, message);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Keeps running the device's error checks, through short waits on a fence that never signals
+	void Checker(DkFence fence)
+	{
+		while (!g_stop)
+			dkFenceWait(&fence, 200000);
+	}
+
+	void FaultLater(uint32_t channel)
+	{
+		svcSleepThread(5000000);
+		hostgpu::injectFault(channel);
+	}
+}
+
+int main()
+{
+	DkDeviceMaker deviceMaker;
+	dkDeviceMakerDefaults(&deviceMaker);
+	deviceMaker.cbDebug = DebugFunc;
+	deviceMaker.errorCheckIntervalUs = 1000;
+	DkDevice device = dkDeviceCreate(&deviceMaker);
+
+	// A queue that stays busy for the whole test
+	DkQueueMaker queueMaker;
+	dkQueueMakerDefaults(&queueMaker, device);
+	DkQueue busyQueue = dkQueueCreate(&queueMaker);
+	uint32_t busyChannel = hostgpu::lastChannel();
+	hostgpu::pauseChannel(busyChannel, true);
+	DkFence busyFence;
+	dkQueueSignalFence(busyQueue, &busyFence, true);
+	dkQueueFlush(busyQueue);
+
+	std::vector<std::thread> checkers;
+	for (unsigned i = 0; i < s_numCheckers; i ++)
+		checkers.emplace_back(Checker, busyFence);
+
+	for (unsigned i = 0; i < s_numRounds; i ++)
+	{
+		dkQueueMakerDefaults(&queueMaker, device);
+		if (i & 1)
+			queueMaker.flags |= DkQueueFlags_AsyncSubmit;
+		DkQueue queue = dkQueueCreate(&queueMaker);
+		uint32_t channel = hostgpu::lastChannel();
+
+		// The destructor blocks on the paused channel until the fault happens
+		hostgpu::pauseChannel(channel, true);
+		std::thread fault{FaultLater, channel};
+		dkQueueDestroy(queue);
+		fault.join();
+	}
+
+	// Healthy queues are torn down while the checks go on as well
+	for (unsigned i = 0; i < s_numRounds; i ++)
+	{
+		dkQueueMakerDefaults(&queueMaker, device);
+		if (i & 1)
+			queueMaker.flags |= DkQueueFlags_AsyncSubmit;
+		dkQueueDestroy(dkQueueCreate(&queueMaker));
+	}
+
+	g_stop = true;
+	for (auto& t : checkers)
+		t.join();
+	CHECK(!dkQueueIsInErrorState(busyQueue));
+
+	hostgpu::pauseChannel(busyChannel, false);
+	dkQueueDestroy(busyQueue);
+	dkDeviceDestroy(device);
+	return test::Finish("queue_teardown");
+}
@@ -0,0 +1,173 @@
+// Makes a compute-only queue wait on a graphics queue with dkQueueWaitQueue, and checks
+// the semaphore release and acquire methods emitted on each channel as well as the
+// ordering they enforce between the two queues.
+#include "common.h"
+#include "host/gpu_host.h"
+#include "dk_fence.h"
+
+namespace
+{
+	constexpr int64_t s_shortWaitNs = 5000000; // 5 ms
+
+	// Channel and engine methods
+	constexpr uint32_t s_subchannelGpfifo = 6;
+	constexpr uint32_t s_subchannel3D = 0;
+	constexpr uint32_t s_gpfifoSemaphoreOffset = 0x004;
+	constexpr uint32_t s_gpfifoSemaphorePayload = 0x006;
+	constexpr uint32_t s_gpfifoSemaphore = 0x007;
+	constexpr uint32_t s_acqGeq = 4;
+	constexpr uint32_t s_acquireSwitch = 1U << 12;
+	constexpr uint32_t s_reportSemaphoreOffset = 0x6C0;
+	constexpr uint32_t s_reportSemaphorePayload = 0x6C2;
+	constexpr uint32_t s_reportSemaphore = 0x6C3;
+	constexpr uint32_t s_reportOneWord = 1U << 28;
+
+	// The faults are expected, so keep their warnings quiet
+	void DebugFunc(void* userData, const char* context, DkResult result, const char* message)
+	{
+		if (result != DkResult_Success)
+		{
+			fprintf(stderr, "[%s] error %d: %s\n", context, result, message);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	struct SemaphoreOp
+	{
+		size_t index;     // position of the triggering method in the trace
+		uint64_t addr;
+		uint32_t payload;
+		uint32_t action;
+	};
+
+	// Collects the semaphore operations triggered through the given method group
+	std::vector<SemaphoreOp> FindSemaphoreOps(std::vector<hostgpu::Method> const& trace,
+		uint32_t subchannel, uint32_t offsetMethod, uint32_t payloadMethod, uint32_t triggerMethod)
+	{
+		std::vector<SemaphoreOp> ops;
+		uint64_t addr = 0;
+		uint32_t payload = 0;
+		for (size_t i = 0; i < trace.size(); i ++)
+		{
+			auto& m = trace[i];
+			if (m.subchannel != subchannel)
+				continue;
+			if (m.method == offsetMethod)
+				addr = (addr & 0xFFFFFFFF) | (uint64_t(m.value) << 32);
+			else if (m.method == offsetMethod+1)
+				addr = (addr &~ UINT64_C(0xFFFFFFFF)) | m.value;
+			else if (m.method == payloadMethod)
+				payload = m.value;
+			else if (m.method == triggerMethod)
+				ops.push_back({ i, addr, payload, m.value });
+		}
+		return ops;
+	}
+
+	std::vector<SemaphoreOp> FindReleases(std::vector<hostgpu::Method> const& trace)
+	{
+		auto ops = FindSemaphoreOps(trace, s_subchannel3D, s_reportSemaphoreOffset, s_reportSemaphorePayload, s_reportSemaphore);
+		for (auto& op : ops)
+			CHECK((op.action & 3) == 0 && (op.action & s_reportOneWord));
+		return ops;
+	}
+
+	std::vector<SemaphoreOp> FindAcquires(std::vector<hostgpu::Method> const& trace)
+	{
+		auto ops = FindSemaphoreOps(trace, s_subchannelGpfifo, s_gpfifoSemaphoreOffset, s_gpfifoSemaphorePayload, s_gpfifoSemaphore);
+		for (auto& op : ops)
+			CHECK((op.action & 0x1F) == s_acqGeq && (op.action & s_acquireSwitch));
+		return ops;
+	}
+
+	SemaphoreOp const* FindPayload(std::vector<SemaphoreOp> const& ops, uint32_t payload)
+	{
+		SemaphoreOp const* found = nullptr;
+		for (auto& op : ops)
+			if (op.payload == payload)
+			{
+				CHECK(!found);
+				found = &op;
+			}
+		return found;
+	}
+}
+
+int main()
+{
+	DkDeviceMaker deviceMaker;
+	dkDeviceMakerDefaults(&deviceMaker);
+	deviceMaker.cbDebug = DebugFunc;
+	deviceMaker.errorCheckIntervalUs = 1000;
+	DkDevice device = dkDeviceCreate(&deviceMaker);
+
+	DkQueueMaker queueMaker;
+	dkQueueMakerDefaults(&queueMaker, device);
+	DkQueue gfxQueue = dkQueueCreate(&queueMaker);
+	uint32_t gfxChannel = hostgpu::lastChannel();
+	queueMaker.flags = DkQueueFlags_Compute;
+	DkQueue computeQueue = dkQueueCreate(&queueMaker);
+	uint32_t computeChannel = hostgpu::lastChannel();
+	hostgpu::enableTrace(gfxChannel, true);
+	hostgpu::enableTrace(computeChannel, true);
+
+	// The compute queue must not get past the dependency while the graphics queue is held
+	hostgpu::pauseChannel(gfxChannel, true);
+	uint64_t value = dkQueueWaitQueue(computeQueue, gfxQueue);
+	DkFence fence;
+	dkQueueSignalFence(computeQueue, &fence, false);
+	dkQueueFlush(computeQueue);
+
+	CHECK(dkFenceWait(&fence, s_shortWaitNs) == DkResult_Timeout);
+	CHECK(!dkQueuePollTimeline(gfxQueue, value));
+	CHECK(dkQueueGetTimelineValue(gfxQueue) < value);
+
+	hostgpu::pauseChannel(gfxChannel, false);
+	CHECK(dkFenceWait(&fence, -1) == DkResult_Success);
+	CHECK(dkQueuePollTimeline(gfxQueue, value));
+	CHECK(dkQueueGetTimelineValue(gfxQueue) >= value);
+
+	// Each dependency gets its own timeline point
+	uint64_t nextValue = dkQueueWaitQueue(computeQueue, gfxQueue);
+	CHECK(nextValue == value + 1);
+	dkQueueWaitIdle(computeQueue);
+
+	// The graphics queue releases each point on its own semaphore...
+	auto gfxReleases = FindReleases(hostgpu::takeTrace(gfxChannel));
+	SemaphoreOp const* release = FindPayload(gfxReleases, uint32_t(value));
+	SemaphoreOp const* nextRelease = FindPayload(gfxReleases, uint32_t(nextValue));
+	CHECK(release && nextRelease);
+
+	// ...and the compute queue acquires it, before releasing its own fence
+	auto computeTrace = hostgpu::takeTrace(computeChannel);
+	auto computeAcquires = FindAcquires(computeTrace);
+	auto computeReleases = FindReleases(computeTrace);
+	CHECK(computeAcquires.size() == 2);
+	SemaphoreOp const* acquire = FindPayload(computeAcquires, uint32_t(value));
+	SemaphoreOp const* nextAcquire = FindPayload(computeAcquires, uint32_t(nextValue));
+	SemaphoreOp const* fenceRelease = FindPayload(computeReleases, uint32_t(fence.m_internal.m_semaphoreValue));
+	if (release && nextRelease && acquire && nextAcquire && fenceRelease)
+	{
+		CHECK(acquire->addr == release->addr && nextAcquire->addr == release->addr);
+		CHECK(nextRelease->addr == release->addr);
+		CHECK(fenceRelease->addr != release->addr);
+		CHECK(acquire->index < fenceRelease->index && fenceRelease->index < nextAcquire->index);
+	}
+
+	// A dependency on a queue that faults must not leave the waiting queue stuck
+	hostgpu::pauseChannel(gfxChannel, true);
+	hostgpu::injectFault(gfxChannel);
+	value = dkQueueWaitQueue(computeQueue, gfxQueue);
+	CHECK(dkQueueIsInErrorState(gfxQueue));
+	dkQueueSignalFence(computeQueue, &fence, false);
+	dkQueueFlush(computeQueue);
+	CHECK(dkFenceWait(&fence, -1) == DkResult_Success);
+	CHECK(dkQueuePollTimeline(gfxQueue, value));
+	CHECK(!dkQueueIsInErrorState(computeQueue));
+
+	dkQueueDestroy(computeQueue);
+	hostgpu::pauseChannel(gfxChannel, false);
+	dkQueueDestroy(gfxQueue);
+	dkDeviceDestroy(device);
+	return test::Finish("queue_wait_queue");
+}
@@ -0,0 +1,120 @@
+// Compares the size of command streams recorded with and without
+// DkCmdBufFlags_FilterRedundantState, as counted by dkcmddis.
+#include "common.h"
+#include <string.h>
+#include <unistd.h>
+
+namespace
+{
+	constexpr unsigned s_numDraws = 32;
+	constexpr uint32_t s_maxWords = 0x10000;
+
+	uint32_t g_words[s_maxWords];
+
+	void RecordState(DkCmdBuf cmdbuf)
+	{
+		DkViewport viewport = { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f };
+		DkScissor scissor = { 0, 0, 1280, 720 };
+		DkBlendState blend;
+		DkDepthStencilState depthStencil;
+		DkBufExtents vtxBuf = { 0x100000, 0x1000 };
+		dkBlendStateDefaults(&blend);
+		dkDepthStencilStateDefaults(&depthStencil);
+
+		dkCmdBufSetViewports(cmdbuf, 0, &viewport, 1);
+		dkCmdBufSetScissors(cmdbuf, 0, &scissor, 1);
+		dkCmdBufSetDepthBias(cmdbuf, 1.0f, 0.0f, 2.0f);
+		dkCmdBufBindBlendStates(cmdbuf, 0, &blend, 1);
+		dkCmdBufBindDepthStencilState(cmdbuf, &depthStencil);
+		dkCmdBufBindVtxBuffers(cmdbuf, 0, &vtxBuf, 1);
+	}
+
+	void RecordDraw(DkCmdBuf cmdbuf)
+	{
+		dkCmdBufDraw(cmdbuf, DkPrimitive_Triangles, 3, 1, 0, 0);
+	}
+
+	template <typename Func>
+	uint32_t Capture(DkCmdBuf cmdbuf, Func&& func)
+	{
+		dkCmdBufBeginCaptureCmds(cmdbuf, g_words, s_maxWords);
+		func();
+		return dkCmdBufEndCaptureCmds(cmdbuf);
+	}
+
+	// Runs the captured words through dkcmddis and returns the total word count it reports
+	uint32_t CountWords(uint32_t numWords)
+	{
+		const char* dkcmddis = getenv("DKCMDDIS");
+		const char* defDir = getenv("DKDEFDIR");
+		if (!dkcmddis || !defDir)
+		{
+			fprintf(stderr, "DKCMDDIS and DKDEFDIR must be set\n");
+			exit(EXIT_FAILURE);
+		}
+
+		char path[] = "/tmp/dkcmdsXXXXXX";
+		int fd = mkstemp(path);
+		if (fd < 0 || write(fd, g_words, numWords*4) != ssize_t(numWords*4))
+			return 0;
+		close(fd);
+
+		char cmd[1024];
+		snprintf(cmd, sizeof(cmd), "%s -d %s -S %s", dkcmddis, defDir, path);
+		FILE* f = popen(cmd, "r");
+		uint32_t total = 0;
+		char line[256];
+		while (f && fgets(line, sizeof(line), f))
+			sscanf(line, " total %u words", &total);
+		if (f)
+			pclose(f);
+		unlink(path);
+		return total;
+	}
+
+	uint32_t CountStream(DkDevice device, uint32_t flags, uint32_t& numWords)
+	{
+		DkCmdBuf cmdbuf = test::CreateCmdBuf(device, nullptr, flags);
+		numWords = Capture(cmdbuf, [=]
+		{
+			for (unsigned i = 0; i < s_numDraws; i ++)
+			{
+				RecordState(cmdbuf);
+				RecordDraw(cmdbuf);
+			}
+		});
+		uint32_t total = CountWords(numWords);
+		dkCmdBufDestroy(cmdbuf);
+		return total;
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+
+	// Sizes of a single state update and a single draw
+	DkCmdBuf cmdbuf = test::CreateCmdBuf(device, nullptr);
+	uint32_t stateWords = Capture(cmdbuf, [=] { RecordState(cmdbuf); });
+	uint32_t drawWords = Capture(cmdbuf, [=] { RecordDraw(cmdbuf); });
+	dkCmdBufDestroy(cmdbuf);
+	CHECK(stateWords != 0 && drawWords != 0);
+	printf("  state update: %u words, draw: %u words\n", stateWords, drawWords);
+
+	uint32_t numWordsOff, numWordsOn;
+	uint32_t totalOff = CountStream(device, 0, numWordsOff);
+	uint32_t totalOn = CountStream(device, DkCmdBufFlags_FilterRedundantState, numWordsOn);
+	printf("  filter off: %u words\n", totalOff);
+	printf("  filter on:  %u words\n", totalOn);
+
+	// The disassembler must agree with the recorded sizes, i.e. both streams decode cleanly
+	CHECK(totalOff == numWordsOff);
+	CHECK(totalOn == numWordsOn);
+
+	// Without filtering every state update is recorded, with filtering only the first one is
+	CHECK(totalOff == s_numDraws*(stateWords + drawWords));
+	CHECK(totalOn == stateWords + s_numDraws*drawWords);
+
+	dkDeviceDestroy(device);
+	return test::Finish("state_filter");
+}
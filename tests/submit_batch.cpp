@@ -0,0 +1,139 @@
+// Submits command lists as a batch with fences in between, and compares what reaches the
+// GPU against submitting the same work one call at a time, with every list in its own
+// memory: the same methods must run in the same order, while the runs of lists recorded
+// back to back are merged into fewer gpfifo entries.
+#include "common.h"
+#include "host/gpu_host.h"
+#include "engine_3d.h"
+#include "dk_fence.h"
+#include <vector>
+
+namespace
+{
+	constexpr uint32_t s_numLists = 8;
+	constexpr uint32_t s_waitBefore = 3;  // list preceded by a fence wait
+	constexpr uint32_t s_signalAfter = 5; // list followed by a fence signal
+	constexpr uint32_t s_numListGroups = 3; // runs of lists not separated by fence commands
+	constexpr uint32_t s_cmdMemSize = 0x1000;
+
+	constexpr uint32_t s_markerMethod = maxwell::Engine3D::PointSpriteSize{};
+
+	DkCmdList RecordList(DkCmdBuf cmdbuf, uint32_t i)
+	{
+		dkCmdBufSetPointSize(cmdbuf, float(i+1));
+		return dkCmdBufFinishList(cmdbuf);
+	}
+
+	struct RunResult
+	{
+		std::vector<hostgpu::Method> trace;
+		uint32_t numEntries;
+	};
+
+	template <typename Func>
+	RunResult Run(DkQueue queue, uint32_t channel, Func&& submit)
+	{
+		RunResult res;
+		uint32_t entriesBefore = hostgpu::getNumEntries(channel);
+		hostgpu::enableTrace(channel, true);
+		submit();
+		dkQueueWaitIdle(queue);
+		hostgpu::enableTrace(channel, false);
+		res.trace = hostgpu::takeTrace(channel);
+		res.numEntries = hostgpu::getNumEntries(channel) - entriesBefore;
+		return res;
+	}
+
+	// Semaphore payloads depend on how many fences were signaled before, so only marker values are compared
+	bool IsSameWork(std::vector<hostgpu::Method> const& a, std::vector<hostgpu::Method> const& b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (size_t i = 0; i < a.size(); i ++)
+		{
+			if (a[i].subchannel != b[i].subchannel || a[i].method != b[i].method)
+				return false;
+			if (a[i].subchannel == 0 && a[i].method == s_markerMethod && a[i].value != b[i].value)
+				return false;
+		}
+		return true;
+	}
+
+	uint32_t CountMarkers(std::vector<hostgpu::Method> const& trace)
+	{
+		uint32_t count = 0;
+		for (auto& m : trace)
+			if (m.subchannel == 0 && m.method == s_markerMethod)
+				count ++;
+		return count;
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+	DkQueueMaker maker;
+	dkQueueMakerDefaults(&maker, device);
+	DkQueue queue = dkQueueCreate(&maker);
+	uint32_t channel = hostgpu::lastChannel();
+
+	DkFence waitFence, signalFence;
+	dkQueueSignalFence(queue, &waitFence, false);
+	dkQueueWaitIdle(queue);
+
+	// Batched, with every list recorded into the same memory
+	DkMemBlock sharedMem = test::CreateMemBlock(device, s_cmdMemSize);
+	DkCmdBuf sharedCmdBuf = test::CreateCmdBuf(device, sharedMem);
+	DkCmdListSubmission submissions[s_numLists] = {};
+	for (uint32_t i = 0; i < s_numLists; i ++)
+		submissions[i].cmdList = RecordList(sharedCmdBuf, i);
+	submissions[s_waitBefore].waitFence = &waitFence;
+	submissions[s_signalAfter].signalFence = &signalFence;
+
+	RunResult batched = Run(queue, channel, [&]
+	{
+		dkQueueSubmitCommandsBatch(queue, submissions, s_numLists);
+		dkQueueFlush(queue);
+	});
+	CHECK(dkFenceWait(&signalFence, 0) == DkResult_Success);
+
+	// One call at a time, with every list in its own memory
+	DkMemBlock mems[s_numLists];
+	DkCmdBuf cmdbufs[s_numLists];
+	DkCmdList lists[s_numLists];
+	for (uint32_t i = 0; i < s_numLists; i ++)
+	{
+		mems[i] = test::CreateMemBlock(device, s_cmdMemSize);
+		cmdbufs[i] = test::CreateCmdBuf(device, mems[i]);
+		lists[i] = RecordList(cmdbufs[i], i);
+	}
+
+	RunResult separate = Run(queue, channel, [&]
+	{
+		for (uint32_t i = 0; i < s_numLists; i ++)
+		{
+			if (i == s_waitBefore)
+				dkQueueWaitFence(queue, &waitFence);
+			dkQueueSubmitCommands(queue, lists[i]);
+			if (i == s_signalAfter)
+				dkQueueSignalFence(queue, &signalFence, false);
+		}
+		dkQueueFlush(queue);
+	});
+
+	printf("  %u gpfifo entries batched, %u submitted one by one\n", batched.numEntries, separate.numEntries);
+	CHECK(CountMarkers(batched.trace) == s_numLists);
+	CHECK(IsSameWork(batched.trace, separate.trace));
+	CHECK(batched.numEntries + s_numLists - s_numListGroups == separate.numEntries);
+
+	for (uint32_t i = 0; i < s_numLists; i ++)
+	{
+		dkCmdBufDestroy(cmdbufs[i]);
+		dkMemBlockDestroy(mems[i]);
+	}
+	dkCmdBufDestroy(sharedCmdBuf);
+	dkMemBlockDestroy(sharedMem);
+	dkQueueDestroy(queue);
+	dkDeviceDestroy(device);
+	return test::Finish("submit_batch");
+}
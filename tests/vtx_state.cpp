@@ -0,0 +1,78 @@
+// Binds vertex attribute and buffer states with varying slot counts, and compares the
+// commands against a command buffer created with DkCmdBufFlags_FullVtxStateRebind: only
+// resetting the slots enabled by the previous bind must leave every register in the same
+// state, and all slots must be reset again once the previous bind is forgotten.
+#include "common.h"
+#include "cmd_sim.h"
+#include <vector>
+
+namespace
+{
+	constexpr uint32_t s_maxWords = 0x1000;
+	constexpr uint32_t s_counts[] = { 8, 3, 3, 0, 5, DK_MAX_VERTEX_ATTRIBS, 2, 0, 0, 7 };
+
+	DkVtxAttribState g_attribs[DK_MAX_VERTEX_ATTRIBS];
+	DkVtxBufferState g_buffers[DK_MAX_VERTEX_BUFFERS];
+
+	void InitStates()
+	{
+		for (uint32_t i = 0; i < DK_MAX_VERTEX_ATTRIBS; i ++)
+			g_attribs[i] = { i % DK_MAX_VERTEX_BUFFERS, 0, 4*i, DkVtxAttribSize_2x32, DkVtxAttribType_Float, 0 };
+		for (uint32_t i = 0; i < DK_MAX_VERTEX_BUFFERS; i ++)
+			g_buffers[i] = { 8*(i+1), i & 1 };
+	}
+
+	void BindStates(DkCmdBuf cmdbuf, uint32_t count)
+	{
+		uint32_t numBuffers = count < DK_MAX_VERTEX_BUFFERS ? count : DK_MAX_VERTEX_BUFFERS;
+		dkCmdBufBindVtxAttribState(cmdbuf, g_attribs, count);
+		dkCmdBufBindVtxBufferState(cmdbuf, g_buffers, numBuffers);
+	}
+
+	// Captures the binds of the first numSteps counts in a single stream
+	std::vector<uint32_t> Capture(DkCmdBuf cmdbuf, uint32_t const counts[], uint32_t numSteps)
+	{
+		std::vector<uint32_t> words(s_maxWords);
+		dkCmdBufBeginCaptureCmds(cmdbuf, words.data(), s_maxWords);
+		for (uint32_t i = 0; i < numSteps; i ++)
+			BindStates(cmdbuf, counts[i]);
+		words.resize(dkCmdBufEndCaptureCmds(cmdbuf));
+		return words;
+	}
+
+	std::vector<uint32_t> GetRegs(std::vector<uint32_t> const& words)
+	{
+		test::RegSim sim;
+		CHECK(sim.process(words.data(), words.size()));
+		return sim.getRegs();
+	}
+}
+
+int main()
+{
+	DkDevice device = test::CreateDevice();
+	DkCmdBuf cmdbuf = test::CreateCmdBuf(device, nullptr);
+	DkCmdBuf fullCmdbuf = test::CreateCmdBuf(device, nullptr, DkCmdBufFlags_FullVtxStateRebind);
+	InitStates();
+
+	// Every prefix of the binds ends up in the same state
+	constexpr uint32_t numSteps = sizeof(s_counts)/sizeof(s_counts[0]);
+	std::vector<uint32_t> words, fullWords;
+	for (uint32_t i = 1; i <= numSteps; i ++)
+	{
+		words = Capture(cmdbuf, s_counts, i);
+		fullWords = Capture(fullCmdbuf, s_counts, i);
+		CHECK(GetRegs(words) == GetRegs(fullWords));
+		CHECK(words.size() <= fullWords.size());
+	}
+	printf("  %zu words, %zu with full rebinds\n", words.size(), fullWords.size());
+	CHECK(words.size() < fullWords.size());
+
+	// The previous bind is forgotten once a capture ends, since it may be replayed anywhere
+	CHECK(Capture(cmdbuf, &s_counts[numSteps-1], 1) == Capture(fullCmdbuf, &s_counts[numSteps-1], 1));
+
+	dkCmdBufDestroy(fullCmdbuf);
+	dkCmdBufDestroy(cmdbuf);
+	dkDeviceDestroy(device);
+	return test::Finish("vtx_state");
+}
@@ -0,0 +1,749 @@
+// dkcmddis - offline disassembler for deko3d command streams
+//
+// Decodes raw command words (such as those captured with dkCmdBufBeginCaptureCmds,
+// or dumped from a gpfifo range) into method names and bitfields, using the
+// engine definition files found in source/maxwell. It can also print word
+// histograms per subchannel and per method, and flag writes that rewrite
+// the last value seen for a method.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+namespace
+{
+	enum SubmissionMode : uint32_t
+	{
+		Increasing       = 1,
+		NonIncreasing    = 3,
+		Inline           = 4,
+		IncreaseOnce     = 5,
+	};
+
+	constexpr unsigned s_numSubchannels = 8;
+	constexpr unsigned s_subchannelGpfifo = 6;
+	constexpr uint32_t s_firstEngineMethod = 0x040;
+	constexpr uint32_t s_firstMacroMethod = 0xE00;
+
+	const char* const s_subchannelNames[s_numSubchannels] =
+	{
+		"3D", "Compute", "Inline", "2D", "Copy", "Sub5", "Gpfifo", "Sub7",
+	};
+
+	//-------------------------------------------------------------------------
+	// Engine definitions
+	//-------------------------------------------------------------------------
+
+	struct EnumDef
+	{
+		std::map<uint32_t, std::string> m_values;
+	};
+
+	struct FieldDef
+	{
+		std::string m_name;
+		unsigned m_lo, m_hi;
+		bool m_isBool;
+		EnumDef m_enum;
+	};
+
+	enum class TypeKind
+	{
+		Plain,
+		Iova,
+		Float,
+		Bool,
+		Pipe,
+		Enum,
+		Bits,
+	};
+
+	struct TypeDef
+	{
+		TypeKind m_kind = TypeKind::Plain;
+		EnumDef m_enum;
+		std::vector<FieldDef> m_fields;
+	};
+
+	struct MethodDef
+	{
+		std::string m_name;
+		TypeDef const* m_type;
+		int m_iovaPart; // -1 = not an iova, 0 = high word, 1 = low word
+	};
+
+	struct EngineDef
+	{
+		std::string m_name;
+		uint32_t m_classId;
+		std::map<uint32_t, MethodDef> m_methods;
+		std::vector<TypeDef*> m_types;
+
+		~EngineDef()
+		{
+			for (auto* t : m_types)
+				delete t;
+		}
+
+		MethodDef const* find(uint32_t method) const
+		{
+			auto it = m_methods.find(method);
+			return it != m_methods.end() ? &it->second : nullptr;
+		}
+	};
+
+	class DefParser
+	{
+		struct Token
+		{
+			std::string m_text;
+			unsigned m_line;
+		};
+
+		std::vector<Token> m_tokens;
+		size_t m_pos;
+		const char* m_fileName;
+		bool m_failed;
+
+		void tokenize(const char* text)
+		{
+			unsigned line = 1;
+			for (const char* p = text; *p; )
+			{
+				if (*p == '\n')
+				{
+					line ++;
+					p ++;
+				}
+				else if (isspace((unsigned char)*p))
+					p ++;
+				else if (p[0] == '/' && p[1] == '/')
+				{
+					while (*p && *p != '\n')
+						p ++;
+				}
+				else if (p[0] == '.' && p[1] == '.')
+				{
+					m_tokens.push_back({ "..", line });
+					p += 2;
+				}
+				else if (isalnum((unsigned char)*p) || *p == '_')
+				{
+					const char* start = p;
+					while (isalnum((unsigned char)*p) || *p == '_')
+						p ++;
+					m_tokens.push_back({ std::string{start, p}, line });
+				}
+				else
+				{
+					m_tokens.push_back({ std::string(1, *p), line });
+					p ++;
+				}
+			}
+		}
+
+		bool atEnd() const { return m_pos >= m_tokens.size(); }
+		std::string const& peek() const
+		{
+			static const std::string s_empty;
+			return atEnd() ? s_empty : m_tokens[m_pos].m_text;
+		}
+
+		void error(const char* msg)
+		{
+			if (!m_failed)
+				fprintf(stderr, "%s:%u: error: %s\n", m_fileName, atEnd() ? 0 : m_tokens[m_pos].m_line, msg);
+			m_failed = true;
+			m_pos = m_tokens.size();
+		}
+
+		std::string next()
+		{
+			if (atEnd())
+			{
+				error("unexpected end of file");
+				return {};
+			}
+			return m_tokens[m_pos++].m_text;
+		}
+
+		bool accept(const char* text)
+		{
+			if (peek() == text)
+			{
+				m_pos ++;
+				return true;
+			}
+			return false;
+		}
+
+		void expect(const char* text)
+		{
+			if (!accept(text))
+				error((std::string{"expected '"} + text + "'").c_str());
+		}
+
+		uint32_t number()
+		{
+			std::string tok = next();
+			char* end;
+			uint32_t value = strtoul(tok.c_str(), &end, 0);
+			if (tok.empty() || *end)
+				error("expected number");
+			return value;
+		}
+
+		void parseEnum(EnumDef& out)
+		{
+			expect("(");
+			while (!m_failed && !accept(")"))
+			{
+				uint32_t value = number();
+				std::string name = next();
+				expect(";");
+				if (!out.m_values.count(value))
+					out.m_values[value] = name;
+			}
+		}
+
+		void parseBits(std::vector<FieldDef>& out)
+		{
+			expect("(");
+			while (!m_failed && !accept(")"))
+			{
+				FieldDef field{};
+				field.m_lo = field.m_hi = number();
+				if (accept(".."))
+					field.m_hi = number();
+				field.m_name = next();
+				if (accept("bool"))
+					field.m_isBool = true;
+				else if (accept("enum"))
+					parseEnum(field.m_enum);
+				expect(";");
+				out.push_back(std::move(field));
+			}
+		}
+
+		// Parses the type of a method, returns the number of words it takes
+		unsigned parseType(EngineDef& engine, TypeDef*& out)
+		{
+			out = new TypeDef;
+			engine.m_types.push_back(out);
+			unsigned size = 1;
+
+			if (accept("iova"))
+			{
+				out->m_kind = TypeKind::Iova;
+				size = 2;
+			}
+			else if (accept("float"))
+				out->m_kind = TypeKind::Float;
+			else if (accept("bool"))
+				out->m_kind = TypeKind::Bool;
+			else if (accept("pipe"))
+				out->m_kind = TypeKind::Pipe;
+			else if (accept("enum"))
+			{
+				out->m_kind = TypeKind::Enum;
+				parseEnum(out->m_enum);
+			}
+			else if (accept("bits"))
+			{
+				out->m_kind = TypeKind::Bits;
+				parseBits(out->m_fields);
+			}
+
+			return size;
+		}
+
+		void addMethod(EngineDef& engine, uint32_t method, std::string const& name, TypeDef const* type)
+		{
+			if (type->m_kind == TypeKind::Iova)
+			{
+				engine.m_methods[method+0] = { name, type, 0 };
+				engine.m_methods[method+1] = { name, type, 1 };
+			}
+			else
+				engine.m_methods[method] = { name, type, -1 };
+		}
+
+		void parseMethod(EngineDef& engine, uint32_t base, std::string const& prefix)
+		{
+			uint32_t offset = number();
+			std::string name = next();
+
+			unsigned arraySize = 0;
+			if (accept("array"))
+			{
+				expect("[");
+				arraySize = number();
+				expect("]");
+			}
+
+			if (arraySize && peek() == "(")
+			{
+				// Array of structures: parse the members, then replicate them
+				struct Member { uint32_t offset; std::string name; TypeDef* type; };
+				std::vector<Member> members;
+				uint32_t stride = 0;
+
+				expect("(");
+				while (!m_failed && !accept(")"))
+				{
+					uint32_t memberOffset = number();
+					std::string memberName = next();
+					if (memberName == "next")
+						stride = memberOffset;
+					else
+					{
+						TypeDef* type;
+						unsigned size = parseType(engine, type);
+						members.push_back({ memberOffset, memberName, type });
+						if (stride < memberOffset + size)
+							stride = memberOffset + size;
+					}
+					expect(";");
+				}
+
+				for (unsigned i = 0; i < arraySize; i ++)
+					for (auto& m : members)
+						addMethod(engine, base + offset + i*stride + m.offset,
+							prefix + name + "[" + std::to_string(i) + "]." + m.name, m.type);
+			}
+			else
+			{
+				TypeDef* type;
+				unsigned size = parseType(engine, type);
+				if (!arraySize)
+					addMethod(engine, base + offset, prefix + name, type);
+				else for (unsigned i = 0; i < arraySize; i ++)
+					addMethod(engine, base + offset + i*size, prefix + name + "[" + std::to_string(i) + "]", type);
+			}
+
+			expect(";");
+		}
+
+	public:
+		DefParser(const char* fileName, const char* text) : m_pos{}, m_fileName{fileName}, m_failed{}
+		{
+			tokenize(text);
+		}
+
+		bool parse(EngineDef& engine)
+		{
+			while (!m_failed && !atEnd())
+			{
+				if (accept("engine"))
+				{
+					engine.m_name = next();
+					engine.m_classId = number();
+					expect(";");
+				}
+				else
+					parseMethod(engine, 0, "");
+			}
+
+			return !m_failed;
+		}
+	};
+
+	bool LoadEngine(EngineDef& engine, std::string const& path)
+	{
+		FILE* f = fopen(path.c_str(), "rb");
+		if (!f)
+		{
+			fprintf(stderr, "cannot open %s\n", path.c_str());
+			return false;
+		}
+
+		std::string text;
+		char buf[4096];
+		size_t len;
+		while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+			text.append(buf, len);
+		fclose(f);
+
+		return DefParser{path.c_str(), text.c_str()}.parse(engine);
+	}
+
+	//-------------------------------------------------------------------------
+	// Disassembler
+	//-------------------------------------------------------------------------
+
+	struct Engines
+	{
+		EngineDef m_3d, m_compute, m_inline, m_2d, m_copy, m_gpfifo;
+
+		bool load(std::string const& dir)
+		{
+			return LoadEngine(m_3d,      dir + "/engine_3d.def")
+				&& LoadEngine(m_compute, dir + "/engine_compute.def")
+				&& LoadEngine(m_inline,  dir + "/engine_inline.def")
+				&& LoadEngine(m_2d,      dir + "/engine_2d.def")
+				&& LoadEngine(m_copy,    dir + "/engine_copy.def")
+				&& LoadEngine(m_gpfifo,  dir + "/engine_gpfifo.def");
+		}
+
+		MethodDef const* find(unsigned subchannel, uint32_t method) const
+		{
+			if (method < s_firstEngineMethod || subchannel == s_subchannelGpfifo)
+				return m_gpfifo.find(method);
+
+			switch (subchannel)
+			{
+				case 0:
+				{
+					// The 3D class also contains the inline-to-memory methods
+					auto* def = m_3d.find(method);
+					return def ? def : m_inline.find(method);
+				}
+				case 1: return m_compute.find(method);
+				case 2: return m_inline.find(method);
+				case 3: return m_2d.find(method);
+				case 4: return m_copy.find(method);
+				default: return nullptr;
+			}
+		}
+	};
+
+	struct MethodStats
+	{
+		uint32_t m_writes;
+		uint32_t m_sameValueWrites;
+	};
+
+	struct Options
+	{
+		bool m_listing = true;
+		bool m_stats = false;
+		bool m_textInput = false;
+		unsigned m_topMethods = 32;
+	};
+
+	class Disassembler
+	{
+		Engines const& m_engines;
+		Options const& m_opts;
+
+		uint32_t m_subchannelWords[s_numSubchannels] = {};
+		uint32_t m_subchannelHeaders[s_numSubchannels] = {};
+		std::map<uint32_t, MethodStats> m_methodStats; // key: subchannel<<16 | method
+		std::map<uint32_t, uint32_t> m_lastValues;
+		uint32_t m_totalSameValueWrites = 0;
+
+		std::string methodName(unsigned subchannel, uint32_t method, MethodDef const* def) const
+		{
+			char buf[64];
+			if (def)
+			{
+				std::string name = def->m_name;
+				if (def->m_iovaPart >= 0)
+					name += def->m_iovaPart ? ".Low" : ".High";
+				return name;
+			}
+			if (subchannel == 0 && method >= s_firstMacroMethod)
+			{
+				uint32_t id = (method - s_firstMacroMethod) / 2;
+				snprintf(buf, sizeof(buf), "MmeMacro[%u].%s", id, (method & 1) ? "Param" : "Call");
+				return buf;
+			}
+			snprintf(buf, sizeof(buf), "Method%03X", method);
+			return buf;
+		}
+
+		static std::string decodeEnum(EnumDef const& e, uint32_t value)
+		{
+			auto it = e.m_values.find(value);
+			if (it != e.m_values.end())
+				return it->second;
+			char buf[16];
+			snprintf(buf, sizeof(buf), "0x%x", value);
+			return buf;
+		}
+
+		static std::string decodeValue(MethodDef const* def, uint32_t value)
+		{
+			char buf[32];
+			if (!def)
+				return {};
+
+			switch (def->m_type->m_kind)
+			{
+				default:
+					return {};
+				case TypeKind::Float:
+				{
+					float f;
+					memcpy(&f, &value, sizeof(f));
+					snprintf(buf, sizeof(buf), "%g", f);
+					return buf;
+				}
+				case TypeKind::Bool:
+					return value ? "true" : "false";
+				case TypeKind::Enum:
+					return decodeEnum(def->m_type->m_enum, value);
+				case TypeKind::Bits:
+				{
+					std::string out = "{";
+					uint32_t known = 0;
+					for (auto& field : def->m_type->m_fields)
+					{
+						unsigned width = field.m_hi - field.m_lo + 1;
+						uint32_t mask = width >= 32 ? UINT32_MAX : ((1U << width) - 1);
+						uint32_t fieldValue = (value >> field.m_lo) & mask;
+						known |= mask << field.m_lo;
+
+						// Omit zero-valued fields, unless they have an enum name for zero
+						if (!fieldValue && !field.m_enum.m_values.count(0))
+							continue;
+
+						out += " " + field.m_name;
+						if (field.m_isBool && fieldValue == 1)
+							continue;
+
+						out += "=";
+						if (!field.m_enum.m_values.empty())
+							out += decodeEnum(field.m_enum, fieldValue);
+						else
+						{
+							snprintf(buf, sizeof(buf), "0x%x", fieldValue);
+							out += buf;
+						}
+					}
+					if (value &~ known)
+					{
+						snprintf(buf, sizeof(buf), " ?=0x%x", value &~ known);
+						out += buf;
+					}
+					return out + " }";
+				}
+			}
+		}
+
+		void write(uint32_t pos, unsigned subchannel, uint32_t method, uint32_t value, bool isStream)
+		{
+			MethodDef const* def = m_engines.find(subchannel, method);
+			uint32_t key = (subchannel << 16) | method;
+			auto& stats = m_methodStats[key];
+			stats.m_writes ++;
+
+			// Data ports (pipe methods, macro parameters, non-increasing streams) legitimately
+			// receive the same value many times, so they are excluded from this check.
+			bool sameValue = false;
+			bool isDataPort = isStream || (def && def->m_type->m_kind == TypeKind::Pipe) ||
+				(subchannel == 0 && method >= s_firstMacroMethod && !def);
+			if (!isDataPort)
+			{
+				auto it = m_lastValues.find(key);
+				sameValue = it != m_lastValues.end() && it->second == value;
+				m_lastValues[key] = value;
+				if (sameValue)
+				{
+					stats.m_sameValueWrites ++;
+					m_totalSameValueWrites ++;
+				}
+			}
+
+			if (m_opts.m_listing)
+			{
+				std::string decoded = decodeValue(def, value);
+				printf("%06x:          %-8s %-40s 0x%08x%s%s%s\n", pos,
+					s_subchannelNames[subchannel],
+					methodName(subchannel, method, def).c_str(), value,
+					decoded.empty() ? "" : "  ", decoded.c_str(),
+					sameValue ? "  (same as last)" : "");
+			}
+		}
+
+	public:
+		Disassembler(Engines const& engines, Options const& opts) : m_engines{engines}, m_opts{opts} { }
+
+		void process(std::vector<uint32_t> const& words)
+		{
+			static const char* const s_modeNames[8] = { "Mode0", "Incr", "Mode2", "NonIncr", "Inline", "IncrOnce", "Mode6", "Mode7" };
+
+			for (uint32_t i = 0; i < words.size();)
+			{
+				uint32_t pos = i;
+				uint32_t header = words[i++];
+				uint32_t method = header & 0x1FFF;
+				unsigned subchannel = (header >> 13) & 7;
+				uint32_t arg = (header >> 16) & 0x1FFF;
+				uint32_t mode = header >> 29;
+
+				m_subchannelHeaders[subchannel] ++;
+				m_subchannelWords[subchannel] ++;
+
+				if (m_opts.m_listing)
+					printf("%06x: %08x %-8s %s count=%u\n", pos, header, s_subchannelNames[subchannel], s_modeNames[mode], mode == Inline ? 1 : arg);
+
+				switch (mode)
+				{
+					case Inline:
+						write(pos, subchannel, method, arg, false);
+						break;
+					case Increasing:
+					case NonIncreasing:
+					case IncreaseOnce:
+					{
+						if (i + arg > words.size())
+						{
+							printf("%06x: truncated command (%u words missing)\n", pos, uint32_t(i + arg - words.size()));
+							return;
+						}
+						for (uint32_t j = 0; j < arg; j ++)
+						{
+							uint32_t curMethod = method;
+							if (mode == Increasing)
+								curMethod += j;
+							else if (mode == IncreaseOnce && j)
+								curMethod += 1;
+							m_subchannelWords[subchannel] ++;
+							write(i, subchannel, curMethod, words[i], mode != Increasing && (mode != IncreaseOnce || j));
+							i ++;
+						}
+						break;
+					}
+					default:
+						if (m_opts.m_listing)
+							printf("%06x: unknown submission mode %u, stopping\n", pos, mode);
+						return;
+				}
+			}
+		}
+
+		void printStats() const
+		{
+			uint32_t totalWords = 0, totalHeaders = 0;
+			for (unsigned i = 0; i < s_numSubchannels; i ++)
+			{
+				totalWords += m_subchannelWords[i];
+				totalHeaders += m_subchannelHeaders[i];
+			}
+
+			printf("\nWords per subchannel:\n");
+			for (unsigned i = 0; i < s_numSubchannels; i ++)
+				if (m_subchannelWords[i])
+					printf("  %-8s %8u words %8u headers %6.2f%%\n", s_subchannelNames[i],
+						m_subchannelWords[i], m_subchannelHeaders[i], 100.0 * m_subchannelWords[i] / totalWords);
+			printf("  %-8s %8u words %8u headers\n", "total", totalWords, totalHeaders);
+
+			std::vector<std::pair<uint32_t, MethodStats>> sorted{m_methodStats.begin(), m_methodStats.end()};
+			std::stable_sort(sorted.begin(), sorted.end(), [](auto const& a, auto const& b) { return a.second.m_writes > b.second.m_writes; });
+			if (sorted.size() > m_opts.m_topMethods)
+				sorted.resize(m_opts.m_topMethods);
+
+			printf("\nMost written methods:\n");
+			for (auto& [key, stats] : sorted)
+			{
+				unsigned subchannel = key >> 16;
+				uint32_t method = key & 0xFFFF;
+				std::string name = methodName(subchannel, method, m_engines.find(subchannel, method));
+				printf("  %-8s %-40s %8u writes %8u same as last\n", s_subchannelNames[subchannel], name.c_str(), stats.m_writes, stats.m_sameValueWrites);
+			}
+
+			printf("\nWrites repeating the last value: %u\n", m_totalSameValueWrites);
+		}
+	};
+
+	bool ReadInput(const char* path, bool textInput, std::vector<uint32_t>& out)
+	{
+		FILE* f = strcmp(path, "-") == 0 ? stdin : fopen(path, textInput ? "r" : "rb");
+		if (!f)
+		{
+			fprintf(stderr, "cannot open %s\n", path);
+			return false;
+		}
+
+		if (textInput)
+		{
+			// Whitespace or comma separated hex words, with or without the 0x prefix
+			char tok[32];
+			while (fscanf(f, " %31[0-9a-fA-FxX]%*[ ,\t\r\n]", tok) == 1)
+				out.push_back(strtoul(tok, nullptr, 16));
+		}
+		else
+		{
+			uint8_t buf[4];
+			while (fread(buf, 1, 4, f) == 4)
+				out.push_back(buf[0] | (buf[1] << 8) | (buf[2] << 16) | (uint32_t(buf[3]) << 24));
+		}
+
+		if (f != stdin)
+			fclose(f);
+		return true;
+	}
+
+	void PrintUsage(const char* argv0)
+	{
+		fprintf(stderr,
+			"Usage: %s [options] <input|->\n"
+			"Options:\n"
+			"  -d <dir>  directory containing the engine .def files (default: source/maxwell)\n"
+			"  -t        input is text (hex words) instead of raw little-endian binary\n"
+			"  -s        print statistics after the listing\n"
+			"  -S        print statistics only\n"
+			"  -n <num>  number of methods to list in the statistics (default: 32)\n",
+			argv0);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options opts;
+	std::string defDir = "source/maxwell";
+	const char* input = nullptr;
+
+	for (int i = 1; i < argc; i ++)
+	{
+		const char* arg = argv[i];
+		if (strcmp(arg, "-d") == 0 && i+1 < argc)
+			defDir = argv[++i];
+		else if (strcmp(arg, "-n") == 0 && i+1 < argc)
+			opts.m_topMethods = strtoul(argv[++i], nullptr, 0);
+		else if (strcmp(arg, "-t") == 0)
+			opts.m_textInput = true;
+		else if (strcmp(arg, "-s") == 0)
+			opts.m_stats = true;
+		else if (strcmp(arg, "-S") == 0)
+		{
+			opts.m_stats = true;
+			opts.m_listing = false;
+		}
+		else if (arg[0] != '-' || arg[1] == 0)
+			input = arg;
+		else
+		{
+			PrintUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!input)
+	{
+		PrintUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	Engines engines;
+	if (!engines.load(defDir))
+		return EXIT_FAILURE;
+
+	std::vector<uint32_t> words;
+	if (!ReadInput(input, opts.m_textInput, words))
+		return EXIT_FAILURE;
+
+	Disassembler dis{engines, opts};
+	dis.process(words);
+	if (opts.m_stats)
+		dis.printStats();
+
+	return EXIT_SUCCESS;
+}